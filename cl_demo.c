@@ -45,6 +45,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #ifndef _WIN32
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
 #endif
 
 /* FIXME Move these to a proper header file and included that */
@@ -78,6 +79,9 @@ double bufferingtime; // if we stream from QTV, this is non zero when we trying
 vfsfile_t* playbackfile = NULL;           // The demo file used for playback.
 float demo_time_length = 0;               // The length of the demo.
 
+static qbool demo_file_on_disk = false;  // Was the last demo opened by CL_Open_Demo_File() found outside of the quake filesystem?
+static char demo_index_path[MAX_OSPATH]; // Sidecar index for the demo being played, empty if it can't have one.
+
 unsigned char stream_buffer[1024 * 256];  // Playback buffer (qtv only).
 int     stream_buffer_cnt = 0;            // How many bytes we've have in playback buffer.
 qbool   stream_buffer_eof = false;        // Have we reached the end of the playback buffer?
@@ -122,6 +126,10 @@ cvar_t cl_startupdemo = {"cl_startupdemo", ""};
 cvar_t demo_jump_rewind = { "demo_jump_rewind", "-10" };
 cvar_t cl_demo_qwd_delta = { "cl_demo_qwd_delta", "1" };
 cvar_t demo_jump_skip_messages = { "demo_jump_skip_messages", "1" };
+cvar_t demo_keyframes = { "demo_keyframes", "30" };
+cvar_t demo_keyframes_max = { "demo_keyframes_max", "16" };
+cvar_t demo_keyframes_memory = { "demo_keyframes_memory", "64" };
+cvar_t demo_index = { "demo_index", "1" };
 
 // Used to save track status when rewinding.
 static vec3_t rewind_angle;
@@ -135,6 +143,13 @@ void CL_ProcessUserInfo(int slot, player_info_t *player, char *key);
 
 char *CL_DemoDirectory(void);
 void CL_Demo_Jump_Status_Check (void);
+static void CL_Demo_Keyframe_Capture(void);
+static unsigned long CL_Demo_Keyframe_FileOffset(void);
+static void CL_DemoIndex_Capture(void);
+static void CL_DemoIndex_Seek(void);
+static void CL_DemoIndex_Init(void);
+static void CL_DemoIndex_Reset(void);
+static void CL_Demo_Stats_Finished(void);
 
 //=============================================================================
 //								DEMO WRITING
@@ -928,12 +943,255 @@ static void CL_WriteRecordMVDStatsMessage (sizebuf_t *msg, int client)
 	CL_MVD_DemoWrite (msg->data, msg->cursize);
 }
 
-// TODO: Split this up?
+// client is who dem_stats messages are for, -1 for dem_all
+typedef void (*mvd_write_func_t)(sizebuf_t *msg, int client);
+
+static void CL_WriteRecordMVD (sizebuf_t *msg, int client)
+{
+	if (client < 0)
+		CL_WriteRecordMVDMessage (msg);
+	else
+		CL_WriteRecordMVDStatsMessage (msg, client);
+}
+
+//
+// Sends all current light styles.
+//
+static void CL_WriteMVDLightstyles (sizebuf_t *buf, mvd_write_func_t write)
+{
+	int i;
+
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	{
+		// Don't send empty lightstyle strings.
+		if (!cl_lightstyle[i].length)
+			continue;
+
+		MSG_WriteByte (buf, svc_lightstyle);
+		MSG_WriteByte (buf, (char)i);
+		MSG_WriteString (buf, cl_lightstyle[i].map);
+
+		// Flush to demo file if buffer is half full.
+		if (buf->cursize > MAX_MSGLEN / 2)
+		{
+			write (buf, -1);
+			SZ_Clear (buf);
+		}
+	}
+
+	if (buf->cursize)
+	{
+		write (buf, -1);
+		SZ_Clear (buf);
+	}
+}
+
+//
+// Sends the status, state and stats of every player and the current packet entities,
+// everything needed to carry on from the next frame of the game.
+//
+static void CL_WriteMVDPlayers (sizebuf_t *buf, mvd_write_func_t write)
+{
+	player_info_t *player;
+	int i;
+
+	//
+	// Send current status of all other players: frags, ping, pl, enter time, userinfo, player id.
+	//
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		player = cl.players + i;
+
+		// Do NOT ignore spectators here, since we need at least userinfo.
+
+		// Frags.
+		MSG_WriteByte (buf, svc_updatefrags);
+		MSG_WriteByte (buf, i);
+		MSG_WriteShort (buf, player->frags);
+
+		// Ping.
+		MSG_WriteByte (buf, svc_updateping);
+		MSG_WriteByte (buf, i);
+		MSG_WriteShort (buf, player->ping);
+
+		// Packet loss.
+		MSG_WriteByte (buf, svc_updatepl);
+		MSG_WriteByte (buf, i);
+		MSG_WriteByte (buf, player->pl);
+
+		// Entertime.
+		MSG_WriteByte (buf, svc_updateentertime);
+		MSG_WriteByte (buf, i);
+		MSG_WriteFloat (buf, (cls.demoplayback ? cls.demotime : cls.realtime) - player->entertime);
+
+		// User ID and user info.
+		MSG_WriteByte (buf, svc_updateuserinfo);
+		MSG_WriteByte (buf, i);
+		MSG_WriteLong (buf, player->userid);
+		MSG_WriteString (buf, player->userinfo);
+
+		// Flush buffer to demo file.
+		if (buf->cursize > MAX_MSGLEN / 2)
+		{
+			write (buf, -1);
+			SZ_Clear (buf);
+		}
+	}
+
+	if (buf->cursize)
+	{
+		write (buf, -1);
+		SZ_Clear (buf);
+	}
+
+	//
+	// This set proper model, origin, angles etc for players.
+	//
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		vec3_t origin, angles;
+		int j, flags;
+		player_state_t *state;
+
+		player = cl.players + i;
+
+		state = cl.frames[cl.validsequence & UPDATE_MASK].playerstate + i;
+
+		if (!player->name[0])
+			continue;
+
+		if (player->spectator)
+			continue; // Ignore spectators.
+
+		flags =   (DF_ORIGIN << 0) | (DF_ORIGIN << 1) | (DF_ORIGIN << 2)
+				| (DF_ANGLES << 0) | (DF_ANGLES << 1) | (DF_ANGLES << 2)
+				| DF_EFFECTS | DF_SKINNUM 
+				| ((state->flags & PF_DEAD) ? DF_DEAD : 0)
+				| ((state->flags & PF_GIB)  ? DF_GIB  : 0)
+				| DF_WEAPONFRAME | DF_MODEL;
+
+		VectorCopy(state->origin, origin);
+		VectorCopy(state->viewangles, angles);
+
+		MSG_WriteByte (buf, svc_playerinfo);
+		MSG_WriteByte (buf, i);
+		MSG_WriteShort (buf, flags);
+
+		MSG_WriteByte (buf, state->frame);
+
+		for (j = 0 ; j < 3 ; j++)
+			if (flags & (DF_ORIGIN << j))
+				MSG_WriteCoord (buf, origin[j]);
+
+		for (j = 0 ; j < 3 ; j++)
+			if (flags & (DF_ANGLES << j))
+				MSG_WriteAngle16 (buf, angles[j]);
+
+		if (flags & DF_MODEL)
+			MSG_WriteByte (buf, state->modelindex);
+
+		if (flags & DF_SKINNUM)
+			MSG_WriteByte (buf, state->skinnum);
+
+		if (flags & DF_EFFECTS)
+			MSG_WriteByte (buf, state->effects);
+
+		if (flags & DF_WEAPONFRAME)
+			MSG_WriteByte (buf, state->weaponframe);
+
+		if (buf->cursize > MAX_MSGLEN/2)
+		{
+			write (buf, -1);
+			SZ_Clear (buf);
+		}
+	}
+
+	// we really need clear buffer before sending stats
+	if (buf->cursize)
+	{
+		write (buf, -1);
+		SZ_Clear (buf);
+	}
+
+	// send stats
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		int		*stats;
+		int		j;
+
+		player = cl.players + i;
+
+		if (!player->name[0])
+			continue;
+
+		if (player->spectator)
+			continue; // Ignore spectators.
+
+		stats = cl.players[i].stats;
+
+		for (j = 0; j < MAX_CL_STATS; j++)
+		{
+			if (stats[j] >= 0 && stats[j] <= 255)
+			{
+				MSG_WriteByte(buf, svc_updatestat);
+				MSG_WriteByte(buf, j);
+				MSG_WriteByte(buf, stats[j]);
+			}
+			else
+			{
+				MSG_WriteByte(buf, svc_updatestatlong);
+				MSG_WriteByte(buf, j);
+				MSG_WriteLong(buf, stats[j]);
+			}
+		}
+
+		if (buf->cursize)
+		{
+			write (buf, i);
+			SZ_Clear (buf);
+		}
+	}
+
+	// Above stats writing must clear buffer.
+	if (buf->cursize)
+	{
+		Sys_Error("CL_WriteMVDPlayers: buf.cursize %d", buf->cursize);
+	}
+
+	// 
+	// Send packetentities.
+	//
+	{
+		int ent_index, ent_total;
+		entity_state_t *ent_state;
+
+		// Write the ID byte for a delta entity operation to the demo.
+		MSG_WriteByte (buf, svc_packetentities);
+
+		// Get the entities list from the frame.
+		ent_state = cl.frames[cls.netchan.incoming_sequence & UPDATE_MASK].packet_entities.entities;
+		ent_total = cl.frames[cls.netchan.incoming_sequence & UPDATE_MASK].packet_entities.num_entities;
+
+		// Write all the entity changes since last packet entity message.
+		for (ent_index = 0; ent_index < ent_total; ent_index++, ent_state++) {
+			MSG_WriteDeltaEntity(&cl_entities[ent_state->number].baseline, ent_state, buf, true, cls.fteprotocolextensions, cls.mvdprotocolextensions1);
+		}
+
+		// End of packetentities.
+		MSG_WriteShort (buf, 0);
+	}
+
+	if (buf->cursize)
+	{
+		write (buf, -1);
+		SZ_Clear (buf);
+	}
+}
+
 void CL_WriteMVDStartupData(void)
 {
 	sizebuf_t	buf;
 	unsigned char buf_data[MAX_MSGLEN * 4];
-	player_info_t *player;
 	entity_state_t *es, blankes;
 	entity_t *ent;
 	int i, j, n;
@@ -1194,26 +1452,10 @@ void CL_WriteMVDStartupData(void)
 		SZ_Clear (&buf);
 	}
 
-	//
-	// Send all current light styles.
-	//
-	for (i = 0; i < MAX_LIGHTSTYLES; i++)
-	{
-		// Don't send empty lightstyle strings.
-		if (!cl_lightstyle[i].length)
-			continue;
-
-		MSG_WriteByte (&buf, svc_lightstyle);
-		MSG_WriteByte (&buf, (char)i);
-		MSG_WriteString (&buf, cl_lightstyle[i].map);
+	CL_WriteMVDLightstyles (&buf, CL_WriteRecordMVD);
 
-		// Flush to demo file if buffer is half full.
-		if (buf.cursize > MAX_MSGLEN / 2)
-		{
-			CL_WriteRecordMVDMessage (&buf);
-			SZ_Clear (&buf);
-		}
-	}
+	MSG_WriteByte (&buf, svc_stufftext);
+	MSG_WriteString (&buf, va("cmd spawn %i 0\n", cl.servercount));
 
 	if (buf.cursize)
 	{
@@ -1221,249 +1463,50 @@ void CL_WriteMVDStartupData(void)
 		SZ_Clear (&buf);
 	}
 
+	CL_WriteMVDPlayers (&buf, CL_WriteRecordMVD);
+
+	// Get the client to check and download skins
+	// when that is completed, a begin command will be issued.
 	MSG_WriteByte (&buf, svc_stufftext);
-	MSG_WriteString (&buf, va("cmd spawn %i 0\n", cl.servercount));
+	MSG_WriteString (&buf, "skins\n");
 
-	if (buf.cursize)
+	CL_WriteRecordMVDMessage (&buf);
+}
+
+// ==============
+// Commands
+// ==============
+
+void CL_StopMvd_f(void)
+{
+	if (!cls.mvdrecording && !mvdrecordfile)
 	{
-		CL_WriteRecordMVDMessage (&buf);
-		SZ_Clear (&buf);
+		Com_Printf ("Not recording a demo\n");
+		return;
 	}
 
-	//
-	// Send current status of all other players: frags, ping, pl, enter time, userinfo, player id.
-	//
-	for (i = 0; i < MAX_CLIENTS; i++)
+	if (mvdrecordfile)
 	{
-		player = cl.players + i;
+		sizebuf_t	buf;
+		unsigned char buf_data[MAX_MSGLEN];
 
-		// Do NOT ignore spectators here, since we need at least userinfo.
+		SZ_Init (&buf, buf_data, sizeof(buf_data));
 
-		// Frags.
-		MSG_WriteByte (&buf, svc_updatefrags);
-		MSG_WriteByte (&buf, i);
-		MSG_WriteShort (&buf, player->frags);
+		// Print offensive message.
+#ifdef EZ_MVD_SIGNOFF
+		MSG_WriteByte(&buf, svc_print);
+		MSG_WriteByte(&buf, 2);
+		MSG_WriteString(&buf, EZ_MVD_SIGNOFF);
+#endif
 
-		// Ping.
-		MSG_WriteByte (&buf, svc_updateping);
-		MSG_WriteByte (&buf, i);
-		MSG_WriteShort (&buf, player->ping);
+		// Add disconnect.
+		MSG_WriteByte (&buf, svc_disconnect);
+		MSG_WriteString (&buf, "EndOfDemo");
 
-		// Packet loss.
-		MSG_WriteByte (&buf, svc_updatepl);
-		MSG_WriteByte (&buf, i);
-		MSG_WriteByte (&buf, player->pl);
+		CL_WriteRecordMVDMessage (&buf);
 
-		// Entertime.
-		MSG_WriteByte (&buf, svc_updateentertime);
-		MSG_WriteByte (&buf, i);
-		MSG_WriteFloat (&buf, cls.realtime - player->entertime);
-
-		// User ID and user info.
-		MSG_WriteByte (&buf, svc_updateuserinfo);
-		MSG_WriteByte (&buf, i);
-		MSG_WriteLong (&buf, player->userid);
-		MSG_WriteString (&buf, player->userinfo);
-
-		// Flush buffer to demo file.
-		if (buf.cursize > MAX_MSGLEN / 2)
-		{
-			CL_WriteRecordMVDMessage (&buf);
-			SZ_Clear (&buf);
-		}
-	}
-
-	if (buf.cursize)
-	{
-		CL_WriteRecordMVDMessage (&buf);
-		SZ_Clear (&buf);
-	}
-
-	//
-	// This set proper model, origin, angles etc for players.
-	//
-	for (i = 0; i < MAX_CLIENTS; i++)
-	{
-		vec3_t origin, angles;
-		int j, flags;
-		player_state_t *state;
-
-		player = cl.players + i;
-
-		state = cl.frames[cl.validsequence & UPDATE_MASK].playerstate + i;
-
-		if (!player->name[0])
-			continue;
-
-		if (player->spectator)
-			continue; // Ignore spectators.
-
-		flags =   (DF_ORIGIN << 0) | (DF_ORIGIN << 1) | (DF_ORIGIN << 2)
-				| (DF_ANGLES << 0) | (DF_ANGLES << 1) | (DF_ANGLES << 2)
-				| DF_EFFECTS | DF_SKINNUM 
-				| ((state->flags & PF_DEAD) ? DF_DEAD : 0)
-				| ((state->flags & PF_GIB)  ? DF_GIB  : 0)
-				| DF_WEAPONFRAME | DF_MODEL;
-
-		VectorCopy(state->origin, origin);
-		VectorCopy(state->viewangles, angles);
-
-		MSG_WriteByte (&buf, svc_playerinfo);
-		MSG_WriteByte (&buf, i);
-		MSG_WriteShort (&buf, flags);
-
-		MSG_WriteByte (&buf, state->frame);
-
-		for (j = 0 ; j < 3 ; j++)
-			if (flags & (DF_ORIGIN << j))
-				MSG_WriteCoord (&buf, origin[j]);
-
-		for (j = 0 ; j < 3 ; j++)
-			if (flags & (DF_ANGLES << j))
-				MSG_WriteAngle16 (&buf, angles[j]);
-
-		if (flags & DF_MODEL)
-			MSG_WriteByte (&buf, state->modelindex);
-
-		if (flags & DF_SKINNUM)
-			MSG_WriteByte (&buf, state->skinnum);
-
-		if (flags & DF_EFFECTS)
-			MSG_WriteByte (&buf, state->effects);
-
-		if (flags & DF_WEAPONFRAME)
-			MSG_WriteByte (&buf, state->weaponframe);
-
-		if (buf.cursize > MAX_MSGLEN/2)
-		{
-			CL_WriteRecordMVDMessage (&buf);
-			SZ_Clear (&buf);
-		}
-	}
-
-	// we really need clear buffer before sending stats
-	if (buf.cursize)
-	{
-		CL_WriteRecordMVDMessage (&buf);
-		SZ_Clear (&buf);
-	}
-
-	// send stats
-	for (i = 0; i < MAX_CLIENTS; i++)
-	{
-		int		*stats;
-		int		j;
-
-		player = cl.players + i;
-
-		if (!player->name[0])
-			continue;
-
-		if (player->spectator)
-			continue; // Ignore spectators.
-
-		stats = cl.players[i].stats;
-
-		for (j = 0; j < MAX_CL_STATS; j++)
-		{
-			if (stats[j] >= 0 && stats[j] <= 255)
-			{
-				MSG_WriteByte(&buf, svc_updatestat);
-				MSG_WriteByte(&buf, j);
-				MSG_WriteByte(&buf, stats[j]);
-			}
-			else
-			{
-				MSG_WriteByte(&buf, svc_updatestatlong);
-				MSG_WriteByte(&buf, j);
-				MSG_WriteLong(&buf, stats[j]);
-			}
-		}
-
-		if (buf.cursize)
-		{
-			CL_WriteRecordMVDStatsMessage(&buf, i);
-			SZ_Clear (&buf);
-		}
-	}
-
-	// Above stats writing must clear buffer.
-	if (buf.cursize)
-	{
-		Sys_Error("CL_WriteMVDStartupData: buf.cursize %d", buf.cursize);
-	}
-
-	// 
-	// Send packetentities.
-	//
-	{
-		int ent_index, ent_total;
-		entity_state_t *ent_state;
-
-		// Write the ID byte for a delta entity operation to the demo.
-		MSG_WriteByte (&buf, svc_packetentities);
-
-		// Get the entities list from the frame.
-		ent_state = cl.frames[cls.netchan.incoming_sequence & UPDATE_MASK].packet_entities.entities;
-		ent_total = cl.frames[cls.netchan.incoming_sequence & UPDATE_MASK].packet_entities.num_entities;
-
-		// Write all the entity changes since last packet entity message.
-		for (ent_index = 0; ent_index < ent_total; ent_index++, ent_state++) {
-			MSG_WriteDeltaEntity(&cl_entities[ent_state->number].baseline, ent_state, &buf, true, cls.fteprotocolextensions, cls.mvdprotocolextensions1);
-		}
-
-		// End of packetentities.
-		MSG_WriteShort (&buf, 0);
-	}
-
-	if (buf.cursize)
-	{
-		CL_WriteRecordMVDMessage (&buf);
-		SZ_Clear (&buf);
-	}
-
-	// Get the client to check and download skins
-	// when that is completed, a begin command will be issued.
-	MSG_WriteByte (&buf, svc_stufftext);
-	MSG_WriteString (&buf, "skins\n");
-
-	CL_WriteRecordMVDMessage (&buf);
-}
-
-// ==============
-// Commands
-// ==============
-
-void CL_StopMvd_f(void)
-{
-	if (!cls.mvdrecording && !mvdrecordfile)
-	{
-		Com_Printf ("Not recording a demo\n");
-		return;
-	}
-
-	if (mvdrecordfile)
-	{
-		sizebuf_t	buf;
-		unsigned char buf_data[MAX_MSGLEN];
-
-		SZ_Init (&buf, buf_data, sizeof(buf_data));
-
-		// Print offensive message.
-#ifdef EZ_MVD_SIGNOFF
-		MSG_WriteByte(&buf, svc_print);
-		MSG_WriteByte(&buf, 2);
-		MSG_WriteString(&buf, EZ_MVD_SIGNOFF);
-#endif
-
-		// Add disconnect.
-		MSG_WriteByte (&buf, svc_disconnect);
-		MSG_WriteString (&buf, "EndOfDemo");
-
-		CL_WriteRecordMVDMessage (&buf);
-
-		fclose(mvdrecordfile);
-		mvdrecordfile = NULL;
+		fclose(mvdrecordfile);
+		mvdrecordfile = NULL;
 
 		Com_Printf ("Completed demo\n");
 	}
@@ -2013,6 +2056,7 @@ qbool CL_GetDemoMessage (void)
 	// DEMO REWIND.
 	if (!cls.mvdplayback || cls.mvdplayback != QTV_PLAYBACK) {
 		CL_Demo_Check_For_Rewind(nextdemotime);
+		CL_DemoIndex_Seek();
 	}
 
 	// Adjust the time for MVD playback.
@@ -2038,6 +2082,10 @@ qbool CL_GetDemoMessage (void)
  			return false;
 		}
 
+		// We're between messages, so this is a safe point to snapshot the state for rewinding.
+		CL_Demo_Keyframe_Capture();
+		CL_DemoIndex_Capture();
+
 		// Read the time of the next message in the demo.
 		demotime = CL_PeekDemoTime();
 
@@ -3348,6 +3396,9 @@ void CL_StopPlayback(void)
 		return;
 	}
 
+	// Batch analysis, dump the stats before the playback state goes away.
+	CL_Demo_Stats_Finished();
+
 	// Capturing to avi/images, stop that.
 	if (Movie_IsCapturing()) {
 		Movie_Stop(false);
@@ -3467,6 +3518,8 @@ void CL_StopPlayback(void)
 	// Reset demoseeking and such.
 	cls.demoseeking = DST_SEEKING_NONE;
 	cls.demorewinding = false;
+	CL_Demo_Keyframes_Clear();
+	CL_DemoIndex_Reset();
 
 	TP_ExecTrigger("f_demoend");
 }
@@ -3508,73 +3561,485 @@ typedef enum demoprobe_parse_type_e
 		break;																\
 	}
 
+//=============================================================================
+//								DEMO INDEX
+//=============================================================================
+
 //
-// Probe a demo in different ways.
-//
-qbool CL_ProbeDemo(vfsfile_t *demfile, demoprobe_parse_type_t probetype, float *demotime)
+// Sidecar index (<demo>.idx) caching the length of a demo, so we don't have to
+// probe the whole demo every time it's played back. The index is validated
+// against the size and a CRC of the start of the demo.
+//
+// For MVDs it also holds a table of demo time -> file offset, each entry with
+// the state needed to carry on playing from there (players, stats, entities,
+// lightstyles and serverinfo, stored as MVD messages). Entries are captured
+// while the demo plays and written out when playback stops, jumping forward
+// then starts from the nearest entry instead of parsing every message.
+//
+#define DEMO_INDEX_MAGIC        (('I' << 24) + ('D' << 16) + ('Z' << 8) + 'E')
+#define DEMO_INDEX_VERSION      3
+#define DEMO_INDEX_CRC_BYTES    (64 * 1024)     // How much of the demo to checksum.
+#define DEMO_INDEX_STEP         10000           // Milliseconds of demo time between entries.
+#define DEMO_INDEX_MAX_ENTRIES  (24 * 60 * 60 * 1000 / DEMO_INDEX_STEP)
+#define DEMO_INDEX_MAX_STATE    (64 * 1024 * 1024)
+
+typedef struct demo_index_header_s {
+	int             magic;
+	int             version;
+	unsigned int    demo_size;
+	unsigned int    demo_crc;
+	int             is_mvd;
+	float           length;
+	int             count;          // Entries following the header.
+	int             statesize;      // Bytes of state following the entries.
+} demo_index_header_t;
+
+typedef struct demo_index_entry_s {
+	unsigned int    time;           // Demo time in milliseconds at the start of the frame.
+	unsigned int    offset;         // File offset of the first message of the frame.
+	int             servercount;    // Gamestate the entry belongs to.
+	unsigned int    state;          // Where the state of the entry starts in the state block.
+	unsigned int    statesize;
+} demo_index_entry_t;
+
+typedef struct demo_index_s {
+	qbool               valid;
+	qbool               modified;   // Entries were captured since it was loaded.
+	demo_index_header_t header;
+	demo_index_entry_t  *entries;
+	int                 allocated;
+	byte                *state;
+	int                 stateallocated;
+} demo_index_t;
+
+static demo_index_t playback_index;
+
+static qbool CL_DemoIndex_Write(const char *path, demo_index_t *index);
+
+static void CL_DemoIndex_Free(demo_index_t *index)
 {
-	#define PARSE_AS_MVD()			((probetype == READ_MVD_TIME) || (probetype == TRY_READ_MVD))
-	#define REGARD_AS_MVD_COUNT		4		// Regard this to be an MVD when this count has been reached.
+	Q_free(index->entries);
+	Q_free(index->state);
+	memset(index, 0, sizeof(*index));
+}
 
-	vfserrno_t err;
-	
-	float qwd_time				= 0.0;		// QWD Time = Time since start of demo in seconds.
-	byte mvd_time				= 0;		// MVD Time = Time in miliseconds since last time stamp.
-	unsigned int total_mvd_time = 0;		// Total MVD time in miliseconds.
-	
-	byte command				= 0;		// Holds the command code.
-	unsigned int multiple		= 0;		// Read dem_multiple data into this.
-	unsigned int size			= 0;		// The size of the demo packet (follows dem_multiple, _single, _stats, _all and _read).
+static void CL_DemoIndex_Reset(void)
+{
+	if (playback_index.modified && demo_index.integer && CL_DemoIndex_Write(demo_index_path, &playback_index)) {
+		Com_DPrintf("Demo index written to %s, %d entries\n", demo_index_path, playback_index.header.count);
+	}
 
-	int message_count			= 0;		// The total amount of demo messages.
-	int len						= 0;		// Length of what's been read
-	qbool is_mvd				= false;	// Is this an MVD. (Used when guessing if this is an MVD).
-	int mvd_only_count			= 0;		// Try to figure out if this is a MVD by looking for commands only present in MVDs.
-	qbool abort					= false;	// Something bad happened when reading the demo.
+	CL_DemoIndex_Free(&playback_index);
+	demo_index_path[0] = '\0';
+}
 
-	while (!abort)
-	{
-		// Read the time.
-		if (PARSE_AS_MVD())
-		{
-			// MVD time.
-			len = VFS_READ(demfile, &mvd_time, 1, &err);
-		}
-		else
-		{
-			// QWD time.
-			len = VFS_READ(demfile, &qwd_time, 4, &err);
-			qwd_time = LittleFloat(qwd_time);
+//
+// Returns the last entry at or before the given time, -1 if there is none.
+//
+static int CL_DemoIndex_Find(demo_index_t *index, unsigned int time)
+{
+	int low = 0, high = index->header.count - 1, found = -1;
+
+	while (low <= high) {
+		int mid = (low + high) / 2;
+
+		if (index->entries[mid].time <= time) {
+			found = mid;
+			low = mid + 1;
 		}
-		
-		// Any well formed demo should only end at an expected time stamp.
-		if ((len == 0) || (err == VFSERR_EOF))
-		{
-			Com_DPrintf("CL_ProbeDemo: End of file. All good!\n");
-			break;
+		else {
+			high = mid - 1;
 		}
+	}
 
-		// Read the command.
-		len = VFS_READ(demfile, &command, 1, &err);
-		DEMOPROBE_VALIDATE_READ(1, len, "when reading command");
+	return found;
+}
 
-		size = 0;
+//
+// Fills in the size and checksum used to tell if an index belongs to the demo.
+//
+static void CL_DemoIndex_Identify(vfsfile_t *demfile, demo_index_header_t *header)
+{
+	byte *buffer;
+	int len;
+	unsigned long pos = VFS_TELL(demfile);
 
-		// The first 3 bits contains the command code.
-		// The 5 other bits are:
-		// dem_stats, 
-		// dem_single	= Player number for the player affected.
-		// dem_all		= Nothing, directed to all players.
-		// dem_multiple = Nothing.
-		switch (command & 0x7)
-		{
-			case dem_multiple :
-			{
-				// Only MVD.
+	header->magic = DEMO_INDEX_MAGIC;
+	header->version = DEMO_INDEX_VERSION;
+	header->demo_size = VFS_GETLEN(demfile);
 
-				// Read a 32-bit number containing a bitmask for which the affected players are.
-				// 32-bits, 32 players.
-				len = VFS_READ(demfile, &multiple, 4, &err);
+	buffer = Q_malloc(DEMO_INDEX_CRC_BYTES);
+	VFS_SEEK(demfile, 0, SEEK_SET);
+	len = VFS_READ(demfile, buffer, DEMO_INDEX_CRC_BYTES, NULL);
+	header->demo_crc = CRC_Block(buffer, max(len, 0));
+	VFS_SEEK(demfile, pos, SEEK_SET);
+	Q_free(buffer);
+}
+
+static qbool CL_DemoIndex_Load(const char *path, vfsfile_t *demfile, demo_index_t *index)
+{
+	demo_index_header_t expected, header;
+	vfsfile_t *file;
+	int i, size;
+
+	if (!path[0] || !(file = FS_OpenVFS(path, "rb", FS_NONE_OS))) {
+		return false;
+	}
+
+	memset(index, 0, sizeof(*index));
+	CL_DemoIndex_Identify(demfile, &expected);
+
+	if (VFS_READ(file, &header, sizeof(header), NULL) != sizeof(header)) {
+		VFS_CLOSE(file);
+		return false;
+	}
+
+	header.magic = LittleLong(header.magic);
+	header.version = LittleLong(header.version);
+	header.demo_size = LittleLong(header.demo_size);
+	header.demo_crc = LittleLong(header.demo_crc);
+	header.is_mvd = LittleLong(header.is_mvd);
+	header.length = LittleFloat(header.length);
+	header.count = LittleLong(header.count);
+	header.statesize = LittleLong(header.statesize);
+
+	if (header.magic != expected.magic || header.version != expected.version || header.demo_size != expected.demo_size ||
+		header.demo_crc != expected.demo_crc || header.count < 0 || header.count > DEMO_INDEX_MAX_ENTRIES ||
+		header.statesize < 0 || header.statesize > DEMO_INDEX_MAX_STATE) {
+		Com_DPrintf("Demo index %s is out of date\n", path);
+		VFS_CLOSE(file);
+		return false;
+	}
+
+	index->header = header;
+	index->allocated = max(header.count, 1);
+	index->entries = Q_malloc(index->allocated * sizeof(index->entries[0]));
+	index->stateallocated = max(header.statesize, 1);
+	index->state = Q_malloc(index->stateallocated);
+
+	size = header.count * sizeof(index->entries[0]);
+	if (VFS_READ(file, index->entries, size, NULL) != size || VFS_READ(file, index->state, header.statesize, NULL) != header.statesize) {
+		VFS_CLOSE(file);
+		CL_DemoIndex_Free(index);
+		return false;
+	}
+	VFS_CLOSE(file);
+
+	for (i = 0; i < header.count; ++i) {
+		demo_index_entry_t *entry = &index->entries[i];
+
+		entry->time = LittleLong(entry->time);
+		entry->offset = LittleLong(entry->offset);
+		entry->servercount = LittleLong(entry->servercount);
+		entry->state = LittleLong(entry->state);
+		entry->statesize = LittleLong(entry->statesize);
+
+		if (entry->offset >= header.demo_size || entry->state > (unsigned int)header.statesize ||
+			entry->statesize > header.statesize - entry->state || (i && entry->time <= index->entries[i - 1].time)) {
+			Com_DPrintf("Demo index %s is corrupt\n", path);
+			CL_DemoIndex_Free(index);
+			return false;
+		}
+	}
+
+	index->valid = true;
+	return true;
+}
+
+static qbool CL_DemoIndex_Write(const char *path, demo_index_t *index)
+{
+	demo_index_header_t header;
+	vfsfile_t *file;
+	int i;
+
+	if (!path[0] || !index->valid || !(file = FS_OpenVFS(path, "wb", FS_NONE_OS))) {
+		return false;
+	}
+
+	header.magic = LittleLong(index->header.magic);
+	header.version = LittleLong(index->header.version);
+	header.demo_size = LittleLong(index->header.demo_size);
+	header.demo_crc = LittleLong(index->header.demo_crc);
+	header.is_mvd = LittleLong(index->header.is_mvd);
+	header.length = LittleFloat(index->header.length);
+	header.count = LittleLong(index->header.count);
+	header.statesize = LittleLong(index->header.statesize);
+	VFS_WRITE(file, &header, sizeof(header));
+
+	for (i = 0; i < index->header.count; ++i) {
+		demo_index_entry_t entry;
+
+		entry.time = LittleLong(index->entries[i].time);
+		entry.offset = LittleLong(index->entries[i].offset);
+		entry.servercount = LittleLong(index->entries[i].servercount);
+		entry.state = LittleLong(index->entries[i].state);
+		entry.statesize = LittleLong(index->entries[i].statesize);
+		VFS_WRITE(file, &entry, sizeof(entry));
+	}
+	VFS_WRITE(file, index->state, index->header.statesize);
+
+	VFS_CLOSE(file);
+	return true;
+}
+
+//
+// Appends a message to the state of the entry being captured, in the MVD format
+// minus the time byte.
+//
+static void CL_DemoIndex_WriteState(sizebuf_t *msg, int client)
+{
+	demo_index_t *index = &playback_index;
+	int len = LittleLong(msg->cursize);
+	byte c = (client < 0 ? dem_all : (dem_stats | (client << 3)));
+
+	if (!msg->cursize) {
+		return;
+	}
+
+	if (index->header.statesize + 1 + 4 + msg->cursize > index->stateallocated) {
+		index->stateallocated = max(64 * 1024, max(index->stateallocated * 2, index->header.statesize + 1 + 4 + msg->cursize));
+		index->state = Q_realloc(index->state, index->stateallocated);
+	}
+
+	index->state[index->header.statesize++] = c;
+	memcpy(index->state + index->header.statesize, &len, 4);
+	index->header.statesize += 4;
+	memcpy(index->state + index->header.statesize, msg->data, msg->cursize);
+	index->header.statesize += msg->cursize;
+}
+
+static void CL_DemoIndex_WriteServerinfo(sizebuf_t *buf, mvd_write_func_t write)
+{
+	char info[MAX_SERVERINFO_STRING], *key, *value;
+
+	strlcpy(info, cl.serverinfo, sizeof(info));
+
+	for (key = strtok(info, "\\"); key && (value = strtok(NULL, "\\")); key = strtok(NULL, "\\")) {
+		MSG_WriteByte(buf, svc_serverinfo);
+		MSG_WriteString(buf, key);
+		MSG_WriteString(buf, value);
+	}
+
+	if (buf->cursize) {
+		write(buf, -1);
+		SZ_Clear(buf);
+	}
+}
+
+//
+// Called between demo messages, adds an entry for the current point of the demo if
+// it's at the start of a frame and there isn't an entry close to it yet.
+//
+static void CL_DemoIndex_Capture(void)
+{
+	demo_index_t *index = &playback_index;
+	demo_index_entry_t *entry;
+	sizebuf_t buf;
+	unsigned char buf_data[MAX_MSGLEN * 4];
+	unsigned int time;
+	int i, state;
+	byte mvd_time;
+
+	if (!demo_index.integer || !index->valid || !demo_index_path[0] || !playbackfile) {
+		return;
+	}
+	if (!cls.mvdplayback || cls.mvdplayback == QTV_PLAYBACK || cls.state != ca_active || cl.intermission) {
+		return;
+	}
+	// The last frame we parsed has to be complete, and the next message has to start a new one.
+	if (!cl.validsequence || cl.validsequence != cls.netchan.incoming_sequence || nextdemotime > cls.demopackettime) {
+		return;
+	}
+	if (index->header.count >= DEMO_INDEX_MAX_ENTRIES || index->header.statesize >= DEMO_INDEX_MAX_STATE) {
+		return;
+	}
+
+	time = (unsigned int)(cls.demopackettime * 1000 + 0.5);
+	i = CL_DemoIndex_Find(index, time);
+	if (i >= 0 && time < index->entries[i].time + DEMO_INDEX_STEP) {
+		return;
+	}
+	if (i + 1 < index->header.count && index->entries[i + 1].time < time + DEMO_INDEX_STEP) {
+		return;
+	}
+
+	CL_Demo_Read(&mvd_time, sizeof(mvd_time), true);
+	if (!mvd_time) {
+		return;
+	}
+
+	state = index->header.statesize;
+	SZ_Init(&buf, buf_data, sizeof(buf_data));
+	CL_DemoIndex_WriteServerinfo(&buf, CL_DemoIndex_WriteState);
+	CL_WriteMVDLightstyles(&buf, CL_DemoIndex_WriteState);
+	CL_WriteMVDPlayers(&buf, CL_DemoIndex_WriteState);
+
+	if (index->header.count >= index->allocated) {
+		index->allocated = max(64, index->allocated * 2);
+		index->entries = Q_realloc(index->entries, index->allocated * sizeof(index->entries[0]));
+	}
+
+	// Keep the entries sorted, playback may have jumped past parts of the demo.
+	entry = &index->entries[++i];
+	memmove(entry + 1, entry, (index->header.count - i) * sizeof(*entry));
+	index->header.count++;
+
+	entry->time = time;
+	entry->offset = CL_Demo_Keyframe_FileOffset();
+	entry->servercount = cl.servercount;
+	entry->state = state;
+	entry->statesize = index->header.statesize - state;
+	index->modified = true;
+}
+
+//
+// When seeking forward, skips to the last entry before the seek target if that's
+// far enough ahead, and loads the state stored with it.
+//
+static void CL_DemoIndex_Seek(void)
+{
+	demo_index_t *index = &playback_index;
+	demo_index_entry_t *entry;
+	double time, seektime, gametime;
+	int i, lastto, lasttype;
+	byte *state, *end;
+
+	if (cls.demoseeking != DST_SEEKING_NORMAL || !demo_index.integer || !index->header.count) {
+		return;
+	}
+	// Skipping would leave a hole in an MVD being recorded from the playback.
+	if (!cls.mvdplayback || cls.mvdplayback == QTV_PLAYBACK || cls.state != ca_active || !playbackfile || cls.mvdrecording) {
+		return;
+	}
+
+	i = CL_DemoIndex_Find(index, (unsigned int)(max(cls.demotime, 0) * 1000));
+	if (i < 0) {
+		return;
+	}
+
+	// Parsing our way there is quicker than reloading for short jumps.
+	entry = &index->entries[i];
+	time = entry->time * 0.001;
+	if (time < cls.demopackettime + DEMO_INDEX_STEP * 0.001 || entry->servercount != cl.servercount) {
+		return;
+	}
+
+	if (VFS_SEEK(playbackfile, entry->offset, SEEK_SET) == -1) {
+		return;
+	}
+	CL_Demo_PB_Init(NULL, 0);
+
+	// The state is parsed like the demo messages it was written as, at the time it was captured.
+	seektime = cls.demotime;
+	gametime = cl.gametime + (time - cls.demopackettime);
+	lastto = cls.lastto;
+	lasttype = cls.lasttype;
+	cls.demotime = cls.demopackettime = nextdemotime = olddemotime = time;
+
+	state = index->state + entry->state;
+	end = state + entry->statesize;
+	while (state + 1 + 4 <= end) {
+		byte c = *state;
+		int len;
+
+		memcpy(&len, state + 1, 4);
+		len = LittleLong(len);
+		state += 1 + 4;
+		if (len < 0 || len > net_message.maxsize || len > end - state) {
+			break;
+		}
+
+		cls.lasttype = (c & 7);
+		cls.lastto = (cls.lasttype == dem_stats ? (c >> 3) : 0);
+		memcpy(net_message.data, state, len);
+		net_message.cursize = len;
+		state += len;
+
+		MSG_BeginReading();
+		CL_ParseServerMessage();
+	}
+
+	cls.demotime = seektime;
+	cl.gametime = gametime;
+	cls.lastto = lastto;
+	cls.lasttype = lasttype;
+
+	// Transient effects from the past shouldn't linger.
+	memset(cl_dlight_active, 0, sizeof(cl_dlight_active));
+	CL_ClearTEnts();
+	CL_ClearScene();
+	CL_ClearPredict();
+
+	Com_DPrintf("Demo jumped to index entry @ %.1f\n", time - demostarttime);
+}
+
+//
+// Probe a demo in different ways.
+//
+qbool CL_ProbeDemo(vfsfile_t *demfile, demoprobe_parse_type_t probetype, float *demotime, demo_index_t *index)
+{
+	#define PARSE_AS_MVD()			((probetype == READ_MVD_TIME) || (probetype == TRY_READ_MVD))
+	#define REGARD_AS_MVD_COUNT		4		// Regard this to be an MVD when this count has been reached.
+
+	vfserrno_t err;
+	
+	float qwd_time				= 0.0;		// QWD Time = Time since start of demo in seconds.
+	byte mvd_time				= 0;		// MVD Time = Time in miliseconds since last time stamp.
+	unsigned int total_mvd_time = 0;		// Total MVD time in miliseconds.
+	
+	byte command				= 0;		// Holds the command code.
+	unsigned int multiple		= 0;		// Read dem_multiple data into this.
+	unsigned int size			= 0;		// The size of the demo packet (follows dem_multiple, _single, _stats, _all and _read).
+
+	int message_count			= 0;		// The total amount of demo messages.
+	int len						= 0;		// Length of what's been read
+	qbool is_mvd				= false;	// Is this an MVD. (Used when guessing if this is an MVD).
+	int mvd_only_count			= 0;		// Try to figure out if this is a MVD by looking for commands only present in MVDs.
+	qbool abort					= false;	// Something bad happened when reading the demo.
+
+	while (!abort)
+	{
+		// Read the time.
+		if (PARSE_AS_MVD())
+		{
+			// MVD time.
+			len = VFS_READ(demfile, &mvd_time, 1, &err);
+		}
+		else
+		{
+			// QWD time.
+			len = VFS_READ(demfile, &qwd_time, 4, &err);
+			qwd_time = LittleFloat(qwd_time);
+		}
+		
+		// Any well formed demo should only end at an expected time stamp.
+		if ((len == 0) || (err == VFSERR_EOF))
+		{
+			Com_DPrintf("CL_ProbeDemo: End of file. All good!\n");
+			break;
+		}
+
+		// Read the command.
+		len = VFS_READ(demfile, &command, 1, &err);
+		DEMOPROBE_VALIDATE_READ(1, len, "when reading command");
+
+		size = 0;
+
+		// The first 3 bits contains the command code.
+		// The 5 other bits are:
+		// dem_stats, 
+		// dem_single	= Player number for the player affected.
+		// dem_all		= Nothing, directed to all players.
+		// dem_multiple = Nothing.
+		switch (command & 0x7)
+		{
+			case dem_multiple :
+			{
+				// Only MVD.
+
+				// Read a 32-bit number containing a bitmask for which the affected players are.
+				// 32-bits, 32 players.
+				len = VFS_READ(demfile, &multiple, 4, &err);
 
 				if (err == VFSERR_EOF)
 				{
@@ -3655,6 +4120,12 @@ qbool CL_ProbeDemo(vfsfile_t *demfile, demoprobe_parse_type_t probetype, float *
 		}
 
 		Com_DPrintf("CL_DemoProbe: Time: %f\n", *demotime);
+
+		if (index) {
+			index->header.is_mvd = (probetype == READ_MVD_TIME);
+			index->header.length = *demotime;
+			index->valid = !abort;
+		}
 	}
 
 	// Is this a really short MVD, that doesn't contain our threshold of MVD only messages
@@ -3675,7 +4146,7 @@ qbool CL_ProbeDemo(vfsfile_t *demfile, demoprobe_parse_type_t probetype, float *
 //
 qbool CL_GetIsMVD(vfsfile_t *demfile)
 {
-	return CL_ProbeDemo(demfile, TRY_READ_MVD, NULL);
+	return CL_ProbeDemo(demfile, TRY_READ_MVD, NULL, NULL);
 }
 
 //
@@ -3685,11 +4156,108 @@ float CL_CalculateDemoTime(vfsfile_t *demfile)
 {
 	float demotime = 0.0;
 
-	CL_ProbeDemo(demfile, (cls.mvdplayback ? READ_MVD_TIME : READ_QWD_TIME), &demotime);
+	CL_ProbeDemo(demfile, (cls.mvdplayback ? READ_MVD_TIME : READ_QWD_TIME), &demotime, NULL);
 
 	return demotime;
 }
 
+//
+// Returns the length of the demo being played, from the index if we can.
+// Otherwise the demo is probed and the index (re)built as we go.
+//
+static float CL_DemoIndex_DemoTime(void)
+{
+	float demotime = 0.0;
+
+	// Also hit when rewinding restarts the demo.
+	if (playback_index.valid) {
+		return playback_index.header.length;
+	}
+
+	if (demo_index.integer && CL_DemoIndex_Load(demo_index_path, playbackfile, &playback_index)) {
+		if (playback_index.header.is_mvd == (cls.mvdplayback ? 1 : 0)) {
+			return playback_index.header.length;
+		}
+		CL_DemoIndex_Free(&playback_index);
+	}
+
+	CL_DemoIndex_Identify(playbackfile, &playback_index.header);
+	CL_ProbeDemo(playbackfile, (cls.mvdplayback ? READ_MVD_TIME : READ_QWD_TIME), &demotime, &playback_index);
+
+	if (demo_index.integer && CL_DemoIndex_Write(demo_index_path, &playback_index)) {
+		Com_DPrintf("Demo index written to %s\n", demo_index_path);
+	}
+
+	return demotime;
+}
+
+static int CL_DemoIndex_Build(char *filename, int size, void *parm)
+{
+	demo_index_t index;
+	vfsfile_t *demfile;
+	char path[MAX_OSPATH];
+	char *ext = COM_FileExtension(filename);
+	int *count = (int *)parm;
+	float demotime = 0;
+
+	// Sys_EnumerateFiles() gives us directories with a trailing slash
+	if (strcasecmp(ext, "mvd") && strcasecmp(ext, "qwd")) {
+		return true;
+	}
+
+	// Leave room for the .idx extension.
+	if (snprintf(path, sizeof(path), "%s/%s", CL_DemoDirectory(), filename) >= (int)sizeof(path) - 4) {
+		Com_Printf("Path too long for %s\n", filename);
+		return true;
+	}
+	if (!(demfile = FS_OpenVFS(path, "rb", FS_NONE_OS))) {
+		Com_Printf("Couldn't open %s\n", filename);
+		return true;
+	}
+
+	memset(&index, 0, sizeof(index));
+	CL_DemoIndex_Identify(demfile, &index.header);
+	CL_ProbeDemo(demfile, (!strcasecmp(ext, "mvd") ? READ_MVD_TIME : READ_QWD_TIME), &demotime, &index);
+	VFS_CLOSE(demfile);
+
+	strlcat(path, ".idx", sizeof(path));
+	if (CL_DemoIndex_Write(path, &index)) {
+		Com_Printf("%s: %d:%02d\n", filename, (int)demotime / 60, (int)demotime % 60);
+		++*count;
+	}
+	else {
+		Com_Printf("Couldn't write index for %s\n", filename);
+	}
+	CL_DemoIndex_Free(&index);
+
+	return true;
+}
+
+//
+// Builds sidecar indexes for demos in the demo dir matching the specified pattern.
+//
+static void CL_DemoIndex_Build_f(void)
+{
+	int i, count = 0;
+
+	if (Cmd_Argc() < 2) {
+		Com_Printf("Usage: %s <pattern> [pattern ...]\n", Cmd_Argv(0));
+		Com_Printf("Builds length indexes for demos in %s, e.g. %s \"*.mvd\"\n", CL_DemoDirectory(), Cmd_Argv(0));
+		return;
+	}
+
+	for (i = 1; i < Cmd_Argc(); ++i) {
+		Sys_EnumerateFiles(CL_DemoDirectory(), Cmd_Argv(i), CL_DemoIndex_Build, &count);
+	}
+
+	Com_Printf("%d demo index%s written\n", count, count == 1 ? "" : "es");
+}
+
+static void CL_DemoIndex_Init(void)
+{
+	Cmd_AddCommand("demo_index_build", CL_DemoIndex_Build_f);
+}
+
 //
 // Returns true if the specified filename has a demo extension.
 //
@@ -3730,7 +4298,7 @@ static void CL_DemoPlaybackInit(void)
 	{
 		// Calculate the demo time.
 		double start = Sys_DoubleTime();
-		demo_time_length = CL_CalculateDemoTime(playbackfile);
+		demo_time_length = CL_DemoIndex_DemoTime();
 		Com_DPrintf("Demo probe took %f seconds.\n", Sys_DoubleTime() - start);
 	}
 
@@ -3846,6 +4414,7 @@ static void CL_StartDemoCommand(void)
 	else if (!playbackfile) {
 		int i;
 		static char* demo_file_extensions[] = { "qwd", "mvd", "dem" };
+		char *fullpath = NULL;
 
 		//
 		// Find the demo path, trying different extensions if needed.
@@ -3854,7 +4423,7 @@ static void CL_StartDemoCommand(void)
 		// If they specified a valid extension, try that first
 		for (i = 0; playbackfile == NULL && i < sizeof(demo_file_extensions) / sizeof(demo_file_extensions[0]); ++i) {
 			if (!strcasecmp(COM_FileExtension(name), demo_file_extensions[i])) {
-				playbackfile = CL_Open_Demo_File(name, true, NULL);
+				playbackfile = CL_Open_Demo_File(name, true, &fullpath);
 			}
 		}
 
@@ -3865,7 +4434,12 @@ static void CL_StartDemoCommand(void)
 			strlcat(name, ".", sizeof(name));
 			strlcat(name, demo_file_extensions[i], sizeof(name));
 
-			playbackfile = CL_Open_Demo_File(name, true, NULL);
+			playbackfile = CL_Open_Demo_File(name, true, &fullpath);
+		}
+
+		// Only demos we found on disk get a sidecar index, we can't write into paks.
+		if (playbackfile && demo_file_on_disk) {
+			snprintf(demo_index_path, sizeof(demo_index_path), "%s.idx", fullpath);
 		}
 	}
 
@@ -3892,157 +4466,612 @@ static void CL_StartDemoCommand(void)
 		}
 	}
 
-	// Failed to open the demo from any path :(
-	if (!playbackfile) {
-		Com_Printf ("Error: Couldn't open %s\n", Cmd_Argv(1));
-		key_dest = failure_dest;
-		return;
+	// Failed to open the demo from any path :(
+	if (!playbackfile) {
+		Com_Printf ("Error: Couldn't open %s\n", Cmd_Argv(1));
+		key_dest = failure_dest;
+		return;
+	}
+
+	CL_DemoStartPlayback(name);
+}
+
+static void CL_DemoStartPlayback(const char* name)
+{
+	strlcpy(cls.demoname, name, sizeof(cls.demoname));
+
+	// Reset multiview track slots.
+	CL_MultiviewDemoStart ();
+
+	// Reset stuff so demo rewinding works.
+	cls.demoseeking		= DST_SEEKING_NONE;
+	cls.demorewinding	= false;
+	cls.demo_rewindtime = 0;
+
+	CL_DemoPlaybackInit();
+	TP_ExecTrigger("f_demostart");
+
+	Com_Printf("Playing demo from %s\n", COM_SkipPath(name));
+}
+
+qbool CL_DemoExtensionMatch(const char* path)
+{
+	const char* file_ext = COM_FileExtension(path);
+	const char* demo_file_extensions[] = {
+		"qwd", "mvd", "dem", "qwz"
+	};
+	int i;
+
+	for (i = 0; i < sizeof(demo_file_extensions) / sizeof(demo_file_extensions[0]); ++i) {
+		if (!strcasecmp(file_ext, demo_file_extensions[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//
+// Starts playback of a demo.
+//
+static void CL_Play_f(void)
+{
+	// Show usage.
+	if (Cmd_Argc() != 2)
+	{
+		keydest_t failure_dest = KeyDestStartupDemo(key_dest) ? key_console : key_dest;
+
+		Com_Printf("Usage: %s <demoname>\n", Cmd_Argv(0));
+		key_dest = failure_dest;
+		return;
+	}
+
+	CL_StartDemoCommand();
+}
+
+static vfsfile_t* CL_Open_Demo_File(const char* name, qbool searchpaks, char** fullPath)
+{
+	static char fullname[MAX_OSPATH];
+	vfsfile_t *file = NULL;
+
+	memset(fullname, 0, sizeof(fullname));
+	if (fullPath != NULL)
+		*fullPath = fullname;
+	demo_file_on_disk = false;
+
+	// Look for the file in the above directory if it has ../ prepended to the filename.
+	if (!strncmp(name, "../", 3) || !strncmp(name, "..\\", 3))
+	{
+		snprintf(fullname, MAX_OSPATH, "%s/%s", com_basedir, name + 3);
+		file = FS_OpenVFS(fullname, "rb", FS_NONE_OS);
+	}
+	else if (searchpaks)
+	{
+		// Search demo on quake file system, even in paks.
+		strlcpy(fullname, name, sizeof(fullname));
+		file = FS_OpenVFS(name, "rb", FS_ANY);
+		if (file) {
+			return file;
+		}
+	}
+
+	// Look in the demo dir (user specified).
+	if (!file)
+	{
+		snprintf(fullname, MAX_OSPATH, "%s/%s", CL_DemoDirectory(), name);
+		file = FS_OpenVFS(fullname, "rb", FS_NONE_OS);
+	}
+
+	// Check the full system path (Run a demo anywhere on the file system).
+	if (!file)
+	{
+		strlcpy(fullname, name, sizeof(fullname));
+		file = FS_OpenVFS(name, "rb", FS_NONE_OS);
+	}
+
+	demo_file_on_disk = (file != NULL);
+	return file;
+}
+
+//
+// Renders a demo as quickly as possible.
+//
+void CL_TimeDemo_f(void)
+{
+	const char* command = Cmd_Argv(0);
+	qbool classic = !strcasecmp(command, "timedemo");
+
+	if (classic && Cmd_Argc() != 2)
+	{
+		Com_Printf("%s <demoname> : gets demo speeds\n", Cmd_Argv(0));
+		return;
+	}
+	else if (!classic)
+	{
+		int desired_fps = TIMEDEMO_FIXEDFPS_DEFAULT;
+
+		if (Cmd_Argc() < 2) {
+			Com_Printf("%s <demoname> [<fps>]: gets demo speeds (default fps %d) \n", Cmd_Argv(0), desired_fps);
+			return;
+		}
+
+		if (Cmd_Argc() >= 3) {
+			desired_fps = atoi(Cmd_Argv(2));
+			if (desired_fps < TIMEDEMO_FIXEDFPS_MINIMUM || desired_fps > TIMEDEMO_FIXEDFPS_MAXIMUM) {
+				Com_Printf("Desired FPS must be between %d and %d\n", TIMEDEMO_FIXEDFPS_MINIMUM, TIMEDEMO_FIXEDFPS_MAXIMUM);
+				return;
+			}
+		}
+
+		cls.td_frametime = 1.0 / desired_fps;
+	}
+
+	CL_StartDemoCommand();
+
+	// We failed to start demoplayback.
+	if (cls.state != ca_demostart) {
+		return;
+	}
+
+	// cls.td_starttime will be grabbed at the second frame of the demo,
+	// so all the loading time doesn't get counted.
+
+	cls.timedemo = (classic ? TIMEDEMO_CLASSIC : TIMEDEMO_FIXEDFPS);
+	cls.td_starttime = 0;
+	cls.td_startframe = cls.framecount;
+	cls.td_lastframe = -1;		// Get a new message this frame.
+	cls.td_nonrendering = 0;
+	cls.td_frametime_max_frame = cls.td_frametime_max = 0;
+	memset(cls.td_frametime_stats, 0, sizeof(cls.td_frametime_stats));
+}
+
+//=============================================================================
+//							DEMO STATS BATCH
+//=============================================================================
+
+cvar_t demo_stats_workers = { "demo_stats_workers", "1" };
+
+#define DEMO_STATS_MAX_WORKERS 64
+#define DEMO_STATS_MAX_ARGS    64
+#define DEMO_STATS_MAX_PATH    (MAX_OSPATH + 16) // Output name plus a ".<worker>.lst" style suffix.
+
+typedef struct demo_stats_batch_s {
+	qbool   active;
+	char    **demos;
+	int     count;
+	int     allocated;
+	int     next;                 // Index of the next demo to play.
+	qbool   playing;              // demos[next - 1] is being played.
+	char    output[MAX_OSPATH];
+	FILE    *out;
+	qbool   csv;
+	int     processed;
+	int     failed;
+	double  starttime;
+#ifndef _WIN32
+	pid_t   workers[DEMO_STATS_MAX_WORKERS];
+	int     workers_total;            // Demo i belongs to worker (i % workers_total)...
+	int     workers_spawned;          // ...if that is below workers_spawned, otherwise to us.
+	int     workers_running;
+#endif
+} demo_stats_batch_t;
+
+static demo_stats_batch_t demo_stats_batch;
+
+//
+// Returns true when started with -demostats: no renderer or sound, quit once the batch is done.
+//
+qbool CL_Demo_Stats_Headless(void)
+{
+	static int headless = -1;
+
+	if (headless < 0) {
+		headless = (COM_CheckParm(cmdline_param_client_demostats) ? 1 : 0);
+	}
+
+	return headless;
+}
+
+static void CL_Demo_Stats_Add(const char *name)
+{
+	if (demo_stats_batch.count >= demo_stats_batch.allocated) {
+		demo_stats_batch.allocated = max(64, demo_stats_batch.allocated * 2);
+		demo_stats_batch.demos = Q_realloc(demo_stats_batch.demos, demo_stats_batch.allocated * sizeof(demo_stats_batch.demos[0]));
+	}
+
+	demo_stats_batch.demos[demo_stats_batch.count++] = Q_strdup(name);
+}
+
+static int CL_Demo_Stats_Enumerate(char *filename, int size, void *parm)
+{
+	// Sys_EnumerateFiles() gives us directories with a trailing slash
+	if (CL_IsDemoExtension(filename)) {
+		CL_Demo_Stats_Add(filename);
+	}
+
+	return true;
+}
+
+//
+// Adds the demos listed in a text file, one path per line.
+//
+static void CL_Demo_Stats_AddList(const char *listname)
+{
+	char line[MAX_OSPATH];
+	FILE *f;
+
+	if (!(f = fopen(listname, "rb"))) {
+		Com_Printf("Couldn't open %s\n", listname);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		size_t len = strlen(line);
+
+		while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+
+		if (line[0]) {
+			CL_Demo_Stats_Add(line);
+		}
+	}
+
+	fclose(f);
+}
+
+static void CL_Demo_Stats_Free(void)
+{
+	int i;
+
+	for (i = 0; i < demo_stats_batch.count; ++i) {
+		Q_free(demo_stats_batch.demos[i]);
+	}
+	Q_free(demo_stats_batch.demos);
+
+	if (demo_stats_batch.out) {
+		fclose(demo_stats_batch.out);
+	}
+
+	memset(&demo_stats_batch, 0, sizeof(demo_stats_batch));
+}
+
+static void CL_Demo_Stats_Finish(void)
+{
+#ifndef _WIN32
+	// Worker processes leave their counts next to their output for the parent to pick up.
+	if (CL_Demo_Stats_Headless() && demo_stats_workers.integer == 0) {
+		char counts[DEMO_STATS_MAX_PATH];
+		FILE *f;
+
+		snprintf(counts, sizeof(counts), "%s.cnt", demo_stats_batch.output);
+		if ((f = fopen(counts, "wb"))) {
+			fprintf(f, "%d %d\n", demo_stats_batch.processed, demo_stats_batch.failed);
+			fclose(f);
+		}
+	}
+#endif
+
+	Com_Printf("demo_stats: %d demo%s analysed, %d failed, %.1f seconds, results in %s\n",
+		demo_stats_batch.processed, demo_stats_batch.processed == 1 ? "" : "s", demo_stats_batch.failed,
+		Sys_DoubleTime() - demo_stats_batch.starttime, demo_stats_batch.output);
+
+	CL_Demo_Stats_Free();
+
+	if (CL_Demo_Stats_Headless()) {
+		Host_Quit();
+	}
+}
+
+#ifndef _WIN32
+//
+// Builds the name of a worker's output file, with an optional extension such as ".lst".
+//
+static void CL_Demo_Stats_WorkerPath(char *path, size_t size, int worker, const char *ext)
+{
+	snprintf(path, size, "%s.%d%s", demo_stats_batch.output, worker, ext);
+}
+
+//
+// Splits the batch over worker processes, each running "-demostats" on every n-th demo.
+//
+static void CL_Demo_Stats_SpawnWorkers(int workers)
+{
+	char part[DEMO_STATS_MAX_PATH], list[DEMO_STATS_MAX_PATH], listarg[DEMO_STATS_MAX_PATH + 1];
+	char *argv[DEMO_STATS_MAX_ARGS + 10];
+	int i, k, argc = 0;
+	qbool has_flag = false;
+
+	for (i = 0; i < COM_Argc() && i < DEMO_STATS_MAX_ARGS && COM_Argv(i)[0] != '+'; ++i) {
+		argv[argc++] = COM_Argv(i);
+		has_flag |= !strcmp(COM_Argv(i), "-demostats");
+	}
+	if (!has_flag) {
+		argv[argc++] = "-demostats";
+	}
+	argv[argc++] = "+set";
+	argv[argc++] = "demo_stats_workers";
+	argv[argc++] = "0";
+	argv[argc++] = "+demo_stats";
+	argv[argc++] = part;
+	argv[argc++] = listarg;
+	argv[argc] = NULL;
+
+	for (k = 0; k < workers; ++k) {
+		FILE *f;
+		pid_t child;
+
+		CL_Demo_Stats_WorkerPath(part, sizeof(part), k, "");
+		CL_Demo_Stats_WorkerPath(list, sizeof(list), k, ".lst");
+		snprintf(listarg, sizeof(listarg), "@%s", list);
+
+		if (!(f = fopen(list, "wb"))) {
+			Com_Printf("Couldn't write %s\n", list);
+			break;
+		}
+		for (i = k; i < demo_stats_batch.count; i += workers) {
+			fprintf(f, "%s\n", demo_stats_batch.demos[i]);
+		}
+		fclose(f);
+
+		child = fork();
+		if (child == -1) {
+			Con_Printf("Failed to create sub-process\n");
+			remove(list);
+			break;
+		}
+
+		if (child == 0) {
+#ifdef __linux__
+			execv("/proc/self/exe", argv);
+#endif
+			execvp(argv[0], argv);
+			_exit(EXIT_FAILURE);
+		}
+
+		demo_stats_batch.workers[demo_stats_batch.workers_spawned++] = child;
+	}
+
+	demo_stats_batch.workers_total = workers;
+	demo_stats_batch.workers_running = demo_stats_batch.workers_spawned;
+	Com_Printf("demo_stats: %d demos over %d workers\n", demo_stats_batch.count, demo_stats_batch.workers_spawned);
+}
+
+static qbool CL_Demo_Stats_WorkerOwned(int demo)
+{
+	return demo_stats_batch.workers_spawned && (demo % demo_stats_batch.workers_total) < demo_stats_batch.workers_spawned;
+}
+
+static int CL_Demo_Stats_WorkerDemos(int worker)
+{
+	return (demo_stats_batch.count - worker + demo_stats_batch.workers_total - 1) / demo_stats_batch.workers_total;
+}
+
+//
+// Adds the processed/failed counts a worker wrote on exit, false if it left none.
+//
+static qbool CL_Demo_Stats_WorkerCounts(int worker)
+{
+	char counts[DEMO_STATS_MAX_PATH];
+	int processed, failed;
+	qbool ok = false;
+	FILE *f;
+
+	CL_Demo_Stats_WorkerPath(counts, sizeof(counts), worker, ".cnt");
+	if ((f = fopen(counts, "rb"))) {
+		if (fscanf(f, "%d %d", &processed, &failed) == 2 && processed >= 0 && failed >= 0) {
+			demo_stats_batch.processed += processed;
+			demo_stats_batch.failed += failed;
+			ok = true;
+		}
+		fclose(f);
 	}
 
-	CL_DemoStartPlayback(name);
+	return ok;
 }
 
-static void CL_DemoStartPlayback(const char* name)
+//
+// Concatenates the worker outputs once all of them have exited.
+//
+static void CL_Demo_Stats_MergeWorkers(void)
 {
-	strlcpy(cls.demoname, name, sizeof(cls.demoname));
-
-	// Reset multiview track slots.
-	CL_MultiviewDemoStart ();
+	char part[DEMO_STATS_MAX_PATH], buf[16 * 1024];
+	int k;
 
-	// Reset stuff so demo rewinding works.
-	cls.demoseeking		= DST_SEEKING_NONE;
-	cls.demorewinding	= false;
-	cls.demo_rewindtime = 0;
+	for (k = 0; k < demo_stats_batch.workers_spawned; ++k) {
+		FILE *f;
+		size_t len;
 
-	CL_DemoPlaybackInit();
-	TP_ExecTrigger("f_demostart");
+		CL_Demo_Stats_WorkerPath(part, sizeof(part), k, "");
+		if ((f = fopen(part, "rb"))) {
+			while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+				fwrite(buf, 1, len, demo_stats_batch.out);
+			}
+			fclose(f);
+			remove(part);
+		}
 
-	Com_Printf("Playing demo from %s\n", COM_SkipPath(name));
+		CL_Demo_Stats_WorkerPath(part, sizeof(part), k, ".lst");
+		remove(part);
+		CL_Demo_Stats_WorkerPath(part, sizeof(part), k, ".cnt");
+		remove(part);
+	}
 }
 
-qbool CL_DemoExtensionMatch(const char* path)
+static void CL_Demo_Stats_PollWorkers(void)
 {
-	const char* file_ext = COM_FileExtension(path);
-	const char* demo_file_extensions[] = {
-		"qwd", "mvd", "dem", "qwz"
-	};
-	int i;
+	int i, status;
 
-	for (i = 0; i < sizeof(demo_file_extensions) / sizeof(demo_file_extensions[0]); ++i) {
-		if (!strcasecmp(file_ext, demo_file_extensions[i])) {
-			return true;
+	for (i = 0; i < demo_stats_batch.workers_spawned; ++i) {
+		pid_t result;
+
+		if (!demo_stats_batch.workers[i]) {
+			continue;
+		}
+
+		result = waitpid(demo_stats_batch.workers[i], &status, WNOHANG);
+		if (result == 0) {
+			continue;
+		}
+
+		// A crashed worker may still have written part of its demos, count them all as failed anyway.
+		if (result < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !CL_Demo_Stats_WorkerCounts(i)) {
+			Com_Printf("demo_stats: worker %d failed\n", i);
+			demo_stats_batch.failed += CL_Demo_Stats_WorkerDemos(i);
 		}
+		demo_stats_batch.workers[i] = 0;
+		demo_stats_batch.workers_running--;
 	}
+}
+#else
+static qbool CL_Demo_Stats_WorkerOwned(int demo)
+{
 	return false;
 }
+#endif
 
 //
-// Starts playback of a demo.
+// Called from CL_StopPlayback(), writes out the stats of the batch demo that just finished.
 //
-static void CL_Play_f(void)
+static void CL_Demo_Stats_Finished(void)
 {
-	// Show usage.
-	if (Cmd_Argc() != 2)
-	{
-		keydest_t failure_dest = KeyDestStartupDemo(key_dest) ? key_console : key_dest;
-
-		Com_Printf("Usage: %s <demoname>\n", Cmd_Argv(0));
-		key_dest = failure_dest;
+	if (!demo_stats_batch.active || !demo_stats_batch.playing) {
 		return;
 	}
 
-	CL_StartDemoCommand();
+	demo_stats_batch.playing = false;
+	demo_stats_batch.processed++;
+
+	MVD_Stats_Export(demo_stats_batch.out, demo_stats_batch.demos[demo_stats_batch.next - 1], demo_time_length > 0 ? demo_time_length : cls.demotime, demo_stats_batch.csv);
+	fflush(demo_stats_batch.out);
+
+	// No timedemo report for batch demos.
+	cls.timedemo = false;
 }
 
-static vfsfile_t* CL_Open_Demo_File(const char* name, qbool searchpaks, char** fullPath)
+//
+// Runs every client frame, starts the next demo of the batch once the previous one has finished.
+//
+void CL_Demo_Stats_Frame(void)
 {
-	static char fullname[MAX_OSPATH];
-	vfsfile_t *file = NULL;
+	const char *name;
 
-	memset(fullname, 0, sizeof(fullname));
-	if (fullPath != NULL)
-		*fullPath = fullname;
+	if (!demo_stats_batch.active) {
+		return;
+	}
 
-	// Look for the file in the above directory if it has ../ prepended to the filename.
-	if (!strncmp(name, "../", 3) || !strncmp(name, "..\\", 3))
-	{
-		snprintf(fullname, MAX_OSPATH, "%s/%s", com_basedir, name + 3);
-		file = FS_OpenVFS(fullname, "rb", FS_NONE_OS);
+#ifndef _WIN32
+	if (demo_stats_batch.workers_running) {
+		CL_Demo_Stats_PollWorkers();
 	}
-	else if (searchpaks)
-	{
-		// Search demo on quake file system, even in paks.
-		strlcpy(fullname, name, sizeof(fullname));
-		file = FS_OpenVFS(name, "rb", FS_ANY);
+#endif
+
+	if (demo_stats_batch.playing) {
+		return;
 	}
 
-	// Look in the demo dir (user specified).
-	if (!file)
-	{
-		snprintf(fullname, MAX_OSPATH, "%s/%s", CL_DemoDirectory(), name);
-		file = FS_OpenVFS(fullname, "rb", FS_NONE_OS);
+	while (demo_stats_batch.next < demo_stats_batch.count && CL_Demo_Stats_WorkerOwned(demo_stats_batch.next)) {
+		demo_stats_batch.next++;
 	}
 
-	// Check the full system path (Run a demo anywhere on the file system).
-	if (!file)
-	{
-		strlcpy(fullname, name, sizeof(fullname));
-		file = FS_OpenVFS(name, "rb", FS_NONE_OS);
+	if (demo_stats_batch.next >= demo_stats_batch.count) {
+#ifndef _WIN32
+		if (demo_stats_batch.workers_running) {
+			return;
+		}
+		CL_Demo_Stats_MergeWorkers();
+#endif
+		CL_Demo_Stats_Finish();
+		return;
 	}
 
-	return file;
+	name = demo_stats_batch.demos[demo_stats_batch.next++];
+
+	// Same as "timedemo <name>", one message per frame and nothing rendered when headless.
+	Cmd_TokenizeString(va("timedemo \"%s\"", name));
+	CL_TimeDemo_f();
+
+	if (cls.state == ca_demostart) {
+		demo_stats_batch.playing = true;
+	}
+	else {
+		Com_Printf("demo_stats: couldn't play %s\n", name);
+		demo_stats_batch.failed++;
+	}
 }
 
 //
-// Renders a demo as quickly as possible.
+// Plays demos back to back as fast as possible, exporting per-demo stats as JSON lines or CSV.
 //
-void CL_TimeDemo_f(void)
+static void CL_Demo_Stats_f(void)
 {
-	const char* command = Cmd_Argv(0);
-	qbool classic = !strcasecmp(command, "timedemo");
+	int i, workers;
 
-	if (classic && Cmd_Argc() != 2)
-	{
-		Com_Printf("%s <demoname> : gets demo speeds\n", Cmd_Argv(0));
+	if (Cmd_Argc() < 3) {
+		Com_Printf("Usage: %s <output.json|output.csv> <pattern|@listfile> [...]\n", Cmd_Argv(0));
+		Com_Printf("Patterns are relative to %s, list files contain one demo per line\n", CL_DemoDirectory());
 		return;
 	}
-	else if (!classic)
-	{
-		int desired_fps = TIMEDEMO_FIXEDFPS_DEFAULT;
 
-		if (Cmd_Argc() < 2) {
-			Com_Printf("%s <demoname> [<fps>]: gets demo speeds (default fps %d) \n", Cmd_Argv(0), desired_fps);
-			return;
+	if (demo_stats_batch.active) {
+		Com_Printf("demo_stats: a batch is already running\n");
+		return;
+	}
+
+	for (i = 2; i < Cmd_Argc(); ++i) {
+		const char *arg = Cmd_Argv(i);
+
+		if (arg[0] == '@') {
+			CL_Demo_Stats_AddList(arg + 1);
+		}
+		else if (strchr(arg, '*') || strchr(arg, '?')) {
+			Sys_EnumerateFiles(CL_DemoDirectory(), (char *)arg, CL_Demo_Stats_Enumerate, NULL);
+		}
+		else {
+			CL_Demo_Stats_Add(arg);
 		}
+	}
 
-		if (Cmd_Argc() >= 3) {
-			desired_fps = atoi(Cmd_Argv(2));
-			if (desired_fps < TIMEDEMO_FIXEDFPS_MINIMUM || desired_fps > TIMEDEMO_FIXEDFPS_MAXIMUM) {
-				Com_Printf("Desired FPS must be between %d and %d\n", TIMEDEMO_FIXEDFPS_MINIMUM, TIMEDEMO_FIXEDFPS_MAXIMUM);
-				return;
-			}
+	if (!demo_stats_batch.count) {
+		Com_Printf("demo_stats: no demos found\n");
+		CL_Demo_Stats_Free();
+		if (CL_Demo_Stats_Headless()) {
+			Host_Quit();
 		}
+		return;
+	}
 
-		cls.td_frametime = 1.0 / desired_fps;
+	strlcpy(demo_stats_batch.output, Cmd_Argv(1), sizeof(demo_stats_batch.output));
+	demo_stats_batch.csv = !strcasecmp(COM_FileExtension(demo_stats_batch.output), "csv");
+	if (!(demo_stats_batch.out = fopen(demo_stats_batch.output, "wb"))) {
+		Com_Printf("Couldn't open %s\n", demo_stats_batch.output);
+		CL_Demo_Stats_Free();
+		return;
 	}
 
-	CL_StartDemoCommand();
+	// Worker parts (demo_stats_workers 0) are concatenated, only the final file gets a header.
+	if (demo_stats_workers.integer != 0) {
+		MVD_Stats_ExportHeader(demo_stats_batch.out, demo_stats_batch.csv);
+	}
 
-	// We failed to start demoplayback.
-	if (cls.state != ca_demostart) {
-		return;
+	demo_stats_batch.active = true;
+	demo_stats_batch.starttime = Sys_DoubleTime();
+
+	workers = bound(1, demo_stats_workers.integer, DEMO_STATS_MAX_WORKERS);
+	workers = min(workers, demo_stats_batch.count);
+#ifndef _WIN32
+	if (workers > 1) {
+		CL_Demo_Stats_SpawnWorkers(workers);
 	}
+#endif
+}
 
-	// cls.td_starttime will be grabbed at the second frame of the demo,
-	// so all the loading time doesn't get counted.
+static void CL_Demo_Stats_Init(void)
+{
+	Cmd_AddCommand("demo_stats", CL_Demo_Stats_f);
 
-	cls.timedemo = (classic ? TIMEDEMO_CLASSIC : TIMEDEMO_FIXEDFPS);
-	cls.td_starttime = 0;
-	cls.td_startframe = cls.framecount;
-	cls.td_lastframe = -1;		// Get a new message this frame.
-	cls.td_nonrendering = 0;
-	cls.td_frametime_max_frame = cls.td_frametime_max = 0;
-	memset(cls.td_frametime_stats, 0, sizeof(cls.td_frametime_stats));
+	Cvar_SetCurrentGroup(CVAR_GROUP_DEMO);
+	Cvar_Register(&demo_stats_workers);
+	Cvar_ResetCurrentGroup();
 }
 
 void CL_QTVPlay (vfsfile_t *newf, void *buf, int buflen);
@@ -4785,6 +5814,215 @@ void CL_Demo_SetSpeed_f (void)
 	Cvar_SetValue(&cl_demospeed, atof(Cmd_Argv(1)) / 100.0);
 }
 
+//=============================================================================
+//								DEMO KEYFRAMES
+//=============================================================================
+
+//
+// Snapshots of the client state taken during playback, so rewinding can restart
+// from the nearest keyframe instead of replaying the demo from the beginning.
+// Keyframes are only valid for the current gamestate and are flushed on CL_ClearState().
+//
+typedef struct demo_keyframe_s {
+	double          demotime;       // cls.demopackettime when captured
+	unsigned long   offset;         // File offset of the next unread demo message
+	double          nextdemotime;
+	double          olddemotime;
+	netchan_t       netchan;
+	int             lastto;
+	int             lasttype;
+	void*           mvd_state;
+	int             servercount;
+	byte            cl[sizeof(clientState_t)];  // Raw copy, clientState_t wants 64-byte alignment
+	centity_t       entities[CL_MAX_EDICTS];
+	lightstyle_t    lightstyles[MAX_LIGHTSTYLES];
+} demo_keyframe_t;
+
+#define DEMO_KEYFRAMES_LIMIT 256
+
+static demo_keyframe_t* demo_keyframe_list[DEMO_KEYFRAMES_LIMIT];
+static int demo_keyframe_count = 0;
+static double demo_keyframe_interval = 0;
+
+static void CL_Demo_Keyframe_Free(demo_keyframe_t* keyframe)
+{
+	Q_free(keyframe->mvd_state);
+	Q_free(keyframe);
+}
+
+void CL_Demo_Keyframes_Clear(void)
+{
+	int i;
+
+	for (i = 0; i < demo_keyframe_count; ++i) {
+		CL_Demo_Keyframe_Free(demo_keyframe_list[i]);
+		demo_keyframe_list[i] = NULL;
+	}
+	demo_keyframe_count = 0;
+	demo_keyframe_interval = 0;
+}
+
+//
+// Returns the file offset of the next unread byte in the demo.
+//
+static unsigned long CL_Demo_Keyframe_FileOffset(void)
+{
+	unsigned long pos = VFS_TELL(playbackfile);
+
+	return FSMMAP_IsMemoryMapped(playbackfile) ? pos : pos - stream_buffer_cnt;
+}
+
+//
+// Drops every second keyframe, so we keep covering the whole demo with a sparser set.
+//
+static void CL_Demo_Keyframes_Thin(void)
+{
+	int i, count = 0;
+
+	for (i = 0; i < demo_keyframe_count; ++i) {
+		if (i % 2) {
+			CL_Demo_Keyframe_Free(demo_keyframe_list[i]);
+		}
+		else {
+			demo_keyframe_list[count++] = demo_keyframe_list[i];
+		}
+	}
+	for (i = count; i < demo_keyframe_count; ++i) {
+		demo_keyframe_list[i] = NULL;
+	}
+
+	demo_keyframe_count = count;
+	demo_keyframe_interval *= 2;
+}
+
+//
+// Returns how many keyframes we may keep, demo_keyframes_max or what fits in
+// demo_keyframes_memory (in MB), whichever is lower.
+//
+static int CL_Demo_Keyframes_Max(void)
+{
+	double fit = demo_keyframes_memory.value * 1024 * 1024 / sizeof(demo_keyframe_t);
+
+	return bound(2, min(demo_keyframes_max.integer, (int)bound(0, fit, DEMO_KEYFRAMES_LIMIT)), DEMO_KEYFRAMES_LIMIT);
+}
+
+//
+// Called between demo messages, takes a keyframe if enough demo time has passed since the last one.
+//
+static void CL_Demo_Keyframe_Capture(void)
+{
+	demo_keyframe_t* keyframe;
+	int max_keyframes = CL_Demo_Keyframes_Max();
+
+	if (demo_keyframes.value <= 0 || cls.timedemo || cls.nqdemoplayback || cls.mvdplayback == QTV_PLAYBACK) {
+		return;
+	}
+	if (cls.state != ca_active || !cl.validsequence || !playbackfile) {
+		return;
+	}
+
+	if (demo_keyframe_interval <= 0) {
+		// If we know the length up front, spread the keyframes over the whole demo.
+		demo_keyframe_interval = max(demo_keyframes.value, demo_time_length / max_keyframes);
+	}
+	if (demo_keyframe_count && cls.demopackettime < demo_keyframe_list[demo_keyframe_count - 1]->demotime + demo_keyframe_interval) {
+		return;
+	}
+
+	if (demo_keyframe_count >= max_keyframes) {
+		// The limits may have been lowered since the last keyframe.
+		while (demo_keyframe_count >= max_keyframes) {
+			CL_Demo_Keyframes_Thin();
+		}
+
+		if (cls.demopackettime < demo_keyframe_list[demo_keyframe_count - 1]->demotime + demo_keyframe_interval) {
+			return;
+		}
+	}
+
+	keyframe = Q_malloc(sizeof(*keyframe));
+	keyframe->demotime = cls.demopackettime;
+	keyframe->offset = CL_Demo_Keyframe_FileOffset();
+	keyframe->nextdemotime = nextdemotime;
+	keyframe->olddemotime = olddemotime;
+	keyframe->netchan = cls.netchan;
+	keyframe->lastto = cls.lastto;
+	keyframe->lasttype = cls.lasttype;
+	keyframe->mvd_state = cls.mvdplayback ? MVD_State_Save() : NULL;
+	keyframe->servercount = cl.servercount;
+	memcpy(keyframe->cl, &cl, sizeof(keyframe->cl));
+	memcpy(keyframe->entities, cl_entities, sizeof(keyframe->entities));
+	memcpy(keyframe->lightstyles, cl_lightstyle, sizeof(keyframe->lightstyles));
+
+	demo_keyframe_list[demo_keyframe_count++] = keyframe;
+
+	Com_DPrintf("Demo keyframe %d captured @ %.1f\n", demo_keyframe_count, keyframe->demotime - demostarttime);
+}
+
+//
+// Restores the latest keyframe at or before the given demo time. Returns false if
+// there is no usable keyframe and the demo has to be restarted from the beginning.
+//
+static qbool CL_Demo_Keyframe_Restore(double demotime)
+{
+	demo_keyframe_t* keyframe = NULL;
+	int i, ideal_track, autocam, paused;
+
+	if (cls.nqdemoplayback || cls.mvdplayback == QTV_PLAYBACK || cls.state != ca_active) {
+		return false;
+	}
+
+	for (i = demo_keyframe_count - 1; i >= 0; --i) {
+		if (demo_keyframe_list[i]->demotime <= demotime) {
+			keyframe = demo_keyframe_list[i];
+			break;
+		}
+	}
+
+	if (!keyframe || keyframe->servercount != cl.servercount) {
+		return false;
+	}
+
+	if (VFS_SEEK(playbackfile, keyframe->offset, SEEK_SET) == -1) {
+		return false;
+	}
+	CL_Demo_PB_Init(NULL, 0);
+
+	// Keep the user's own view settings, the rest comes from the keyframe.
+	ideal_track = cl.ideal_track;
+	autocam = cl.autocam;
+	paused = cl.paused & PAUSED_DEMO;
+
+	memcpy(&cl, keyframe->cl, sizeof(cl));
+	memcpy(cl_entities, keyframe->entities, sizeof(cl_entities));
+	memcpy(cl_lightstyle, keyframe->lightstyles, sizeof(cl_lightstyle));
+
+	cl.ideal_track = ideal_track;
+	cl.autocam = autocam;
+	cl.paused = (cl.paused & ~PAUSED_DEMO) | paused;
+
+	cls.netchan = keyframe->netchan;
+	cls.lastto = keyframe->lastto;
+	cls.lasttype = keyframe->lasttype;
+	cls.demopackettime = keyframe->demotime;
+	nextdemotime = keyframe->nextdemotime;
+	olddemotime = keyframe->olddemotime;
+
+	if (keyframe->mvd_state) {
+		MVD_State_Restore(keyframe->mvd_state);
+	}
+
+	// Transient effects from the future shouldn't linger.
+	memset(cl_dlight_active, 0, sizeof(cl_dlight_active));
+	CL_ClearTEnts();
+	CL_ClearScene();
+	CL_ClearPredict();
+
+	Com_DPrintf("Demo rewound to keyframe @ %.1f\n", keyframe->demotime - demostarttime);
+
+	return true;
+}
+
 //
 // Cleans up after demo has been rewound to the correct point
 //
@@ -4818,9 +6056,6 @@ void CL_Demo_Check_For_Rewind(float nextdemotime)
 	// If we're seeking and our seek destination is in the past we need to rewind.
 	if (cls.demoseeking && !cls.demorewinding && (cls.demotime < nextdemotime))
 	{
-		// Restart playback from the start of the file and then demo seek to the rewind spot.
-		VFS_SEEK(playbackfile, 0, SEEK_SET);
-
 		// We need to save track information.
 		CL_MultiviewDemoStartRewind ();
 		rewind_spec_track = WhoIsSpectated(); //spec_track;
@@ -4829,10 +6064,18 @@ void CL_Demo_Check_For_Rewind(float nextdemotime)
 		VectorCopy(cl.viewangles, rewind_angle);
 		VectorCopy(cl.simorg, rewind_pos);
 
-		// Restart the demo from scratch.
-		CL_DemoPlaybackInit();
+		// Jump back to the nearest keyframe if we have one, otherwise restart
+		// playback from the start of the file and then demo seek to the rewind spot.
+		if (!CL_Demo_Keyframe_Restore(cls.demotime))
+		{
+			VFS_SEEK(playbackfile, 0, SEEK_SET);
+
+			// Restart the demo from scratch.
+			CL_DemoPlaybackInit();
+
+			cls.demopackettime  = 0.0;
+		}
 
-		cls.demopackettime  = 0.0;
 		cls.demorewinding   = true;
 	}
 	
@@ -5489,6 +6732,8 @@ void CL_Demo_Init(void)
 	Cmd_AddCommand("demo_jump_status", CL_Demo_Jump_Status_f);
 	Cmd_AddCommand("demo_jump_end", CL_Demo_Jump_End_f);
 	Cmd_AddCommand("demo_controls", DemoControls_f);
+	CL_DemoIndex_Init();
+	CL_Demo_Stats_Init();
 
 	//
 	// mvd "recording"
@@ -5517,6 +6762,10 @@ void CL_Demo_Init(void)
 	Cvar_Register(&demo_jump_rewind);
 	Cvar_Register(&cl_demo_qwd_delta);
 	Cvar_Register(&demo_jump_skip_messages);
+	Cvar_Register(&demo_keyframes);
+	Cvar_Register(&demo_keyframes_max);
+	Cvar_Register(&demo_keyframes_memory);
+	Cvar_Register(&demo_index);
 
 	Cvar_ResetCurrentGroup();
 }
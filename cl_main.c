@@ -224,6 +224,7 @@ cvar_t r_shaftalpha             = {"r_shaftalpha", "1"};
 cvar_t r_lightdecayrate         = {"r_lightdecayrate", "2"}; // default 2, as CL_DecayLights() used to get called twice per frame
 cvar_t r_lightmap_lateupload    = {"r_lightmap_lateupload", "0"};
 cvar_t r_lightmap_packbytexture = {"r_lightmap_packbytexture", "2"};
+cvar_t r_lightmap_threads       = {"r_lightmap_threads", "0"};
 
 // info mirrors
 cvar_t  password                = {"password", "", CVAR_USERINFO};
@@ -1132,6 +1133,10 @@ void CL_ClearState (void)
 	CL_ClearScene ();
 
 	CL_ClearPredict();
+	CL_ClearPredictionCache();
+
+	// Demo keyframes point into the old gamestate.
+	CL_Demo_Keyframes_Clear();
 
 	if (cls.state == ca_active) {
 		int ideal_track = cl.ideal_track;
@@ -1769,6 +1774,7 @@ static void CL_InitLocal(void)
 	Cvar_Register(&r_lightflicker);
 	Cvar_Register(&r_lightmap_lateupload);
 	Cvar_Register(&r_lightmap_packbytexture);
+	Cvar_Register(&r_lightmap_threads);
 	Cvar_Register(&r_rockettrail);
 	Cvar_Register(&r_grenadetrail);
 	Cvar_Register(&r_railtrail);
@@ -2305,6 +2311,94 @@ static void CL_ServerFrame(double frametime)
 #endif
 }
 
+// Draws the views and updates sound for this frame.
+static void CL_FrameRender(void)
+{
+	VID_ReloadCheck();
+
+	R_ParticleFrame();
+
+	buffers.StartFrame();
+
+	CachePics_AtlasFrame();
+
+	CL_MultiviewPreUpdateScreen();
+
+	// update video
+	if (CL_MultiviewEnabled()) {
+		qbool draw_next_view = true;
+		qbool first_view = true;
+
+		R_PerformanceBeginFrame();
+		if (SCR_UpdateScreenPrePlayerView()) {
+			qbool two_pass_rendering = GL_FramebufferEnabled2D();
+			renderer.ScreenDrawStart();
+
+			while (draw_next_view) {
+				draw_next_view = CL_MultiviewAdvanceView();
+				if (!first_view) {
+					buffers.EndFrame();
+					buffers.StartFrame();
+				}
+				first_view = false;
+
+				CL_LinkEntities();
+
+				SCR_CalcRefdef();
+
+				SCR_UpdateScreenPlayerView((draw_next_view ? 0 : UPDATESCREEN_POSTPROCESS) | (two_pass_rendering ? UPDATESCREEN_3D_ONLY : 0));
+
+				if (!two_pass_rendering) {
+					SCR_DrawMultiviewIndividualElements();
+				}
+				else {
+					SCR_SaveAutoID();
+				}
+
+				if (CL_MultiviewCurrentView() == 2 || (CL_MultiviewCurrentView() == 1 && CL_MultiviewActiveViews() == 1)) {
+					CL_SoundFrame();
+				}
+
+				// Multiview: advance to next player
+				CL_MultiviewFrameFinish();
+			}
+
+			if (two_pass_rendering) {
+				buffers.EndFrame();
+
+				draw_next_view = true;
+				while (draw_next_view) {
+					draw_next_view = CL_MultiviewAdvanceView();
+
+					// Need to call this again to keep autoid correct
+					SCR_RestoreAutoID();
+
+					SCR_UpdateScreenPlayerView(UPDATESCREEN_2D_ONLY);
+					SCR_DrawMultiviewIndividualElements();
+
+					// Multiview: advance to next player
+					CL_MultiviewFrameFinish();
+				}
+			}
+
+			SCR_UpdateScreenPostPlayerView();
+		}
+		else {
+			VID_RenderFrameEnd();
+		}
+		R_PerformanceEndFrame();
+	}
+	else {
+		CL_LinkEntities();
+
+		R_PerformanceBeginFrame();
+		SCR_UpdateScreen();
+		R_PerformanceEndFrame();
+
+		CL_SoundFrame();
+	}
+}
+
 void CL_Frame(double time)
 {
 	static double extratime = 0.001;
@@ -2566,88 +2660,12 @@ void CL_Frame(double time)
 		}
 	}
 
-	VID_ReloadCheck();
-
-	R_ParticleFrame();
-
-	buffers.StartFrame();
-
-	CachePics_AtlasFrame();
-
-	CL_MultiviewPreUpdateScreen();
-
-	// update video
-	if (CL_MultiviewEnabled()) {
-		qbool draw_next_view = true;
-		qbool first_view = true;
-
-		R_PerformanceBeginFrame();
-		if (SCR_UpdateScreenPrePlayerView()) {
-			qbool two_pass_rendering = GL_FramebufferEnabled2D();
-			renderer.ScreenDrawStart();
-
-			while (draw_next_view) {
-				draw_next_view = CL_MultiviewAdvanceView();
-				if (!first_view) {
-					buffers.EndFrame();
-					buffers.StartFrame();
-				}
-				first_view = false;
-
-				CL_LinkEntities();
-
-				SCR_CalcRefdef();
-
-				SCR_UpdateScreenPlayerView((draw_next_view ? 0 : UPDATESCREEN_POSTPROCESS) | (two_pass_rendering ? UPDATESCREEN_3D_ONLY : 0));
-
-				if (!two_pass_rendering) {
-					SCR_DrawMultiviewIndividualElements();
-				}
-				else {
-					SCR_SaveAutoID();
-				}
-
-				if (CL_MultiviewCurrentView() == 2 || (CL_MultiviewCurrentView() == 1 && CL_MultiviewActiveViews() == 1)) {
-					CL_SoundFrame();
-				}
-
-				// Multiview: advance to next player
-				CL_MultiviewFrameFinish();
-			}
-
-			if (two_pass_rendering) {
-				buffers.EndFrame();
-
-				draw_next_view = true;
-				while (draw_next_view) {
-					draw_next_view = CL_MultiviewAdvanceView();
-
-					// Need to call this again to keep autoid correct
-					SCR_RestoreAutoID();
-
-					SCR_UpdateScreenPlayerView(UPDATESCREEN_2D_ONLY);
-					SCR_DrawMultiviewIndividualElements();
-
-					// Multiview: advance to next player
-					CL_MultiviewFrameFinish();
-				}
-			}
-
-			SCR_UpdateScreenPostPlayerView();
-		}
-		else {
-			VID_RenderFrameEnd();
-		}
-		R_PerformanceEndFrame();
-	}
-	else {
-		CL_LinkEntities();
-
-		R_PerformanceBeginFrame();
-		SCR_UpdateScreen();
-		R_PerformanceEndFrame();
+	// Batch demo analysis, start the next demo once the last one has stopped.
+	CL_Demo_Stats_Frame();
 
-		CL_SoundFrame();
+	// -demostats: messages and stats only, no renderer or sound.
+	if (!CL_Demo_Stats_Headless()) {
+		CL_FrameRender();
 	}
 
 	CL_DecayLights();
@@ -2764,7 +2782,7 @@ void Dev_PhysicsNormalShow(void)
 		return;
 	}
 
-	trace = PM_PlayerTrace(pmove.origin, point);
+	trace = PM_PlayerTrace(cl.simorg, point);
 	if (trace.fraction == 1 || trace.plane.normal[2] < MIN_STEP_NORMAL) {
 		Con_Printf("Not on ground\n");
 	}
@@ -2835,7 +2853,7 @@ void Dev_PhysicsNormalSet(void)
 		}
 	}
 
-	trace = PM_PlayerTrace(pmove.origin, point);
+	trace = PM_PlayerTrace(cl.simorg, point);
 	if (trace.fraction == 1 || trace.plane.normal[2] < MIN_STEP_NORMAL) {
 		Con_Printf("Not on ground\n");
 	}
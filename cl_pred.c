@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 cvar_t	cl_nopred	= {"cl_nopred", "0"};
+cvar_t	cl_predict_cache = {"cl_predict_cache", "1"};
 
 extern cvar_t cl_independentPhysics;
 
@@ -289,17 +290,225 @@ qbool cl_nolerp_on_entity_flag = false;
 // function check_standing_on_entity(void)
 // raises flag cl_nolerp_on_entity_flag if standing on entity
 // and cl_nolerp_on_entity.value is 1
-static void check_standing_on_entity(void)
+static void check_standing_on_entity(qbool on_entity)
 {
   extern cvar_t cl_nolerp;
   extern cvar_t cl_nolerp_on_entity;
   extern cvar_t cl_independentPhysics;
   cl_nolerp_on_entity_flag = 
-       (pmove.onground && pmove.groundent > 0 &&
+       (on_entity &&
         cl_nolerp_on_entity.value &&
         cl_independentPhysics.value);
 }
 
+/*
+===============================================================================
+PREDICTION CACHE
+
+Our own predicted states are kept per outgoing sequence, so CL_PredictMove
+only runs pmove for commands it hasn't predicted yet.  When a new frame is
+acknowledged and the server agrees with what we predicted for it, to within
+what the network can carry, the rest of the chain is kept as well.  Anything
+else that goes into pmove (movevars, the physents near the predicted path)
+has to be unchanged for the chain to be reused.
+===============================================================================
+*/
+
+#define PREDCACHE_ORIGIN_EPSILON	(1.0f / 8)	// coords are sent in 1/8 units
+#define PREDCACHE_VELOCITY_EPSILON	1.0f		// velocity is sent as shorts
+#define PREDCACHE_MARGIN			32			// room for stepping and ground checks around the path
+
+typedef struct predcache_state_s {
+	player_state_t	state;
+	int				waterlevel;
+	qbool			on_entity;			// standing on something other than the world
+} predcache_state_t;
+
+typedef struct predcache_s {
+	qbool			valid;
+	int				base;				// acknowledged sequence the chain starts from
+	int				end;				// first sequence not predicted
+	player_state_t	basestate;			// server state at base
+	int				playernum;
+	int				z_ext;
+	movevars_t		movevars;
+	vec3_t			mins, maxs;			// bounds of the predicted path
+	physent_t		physents[MAX_PHYSENTS];
+	int				numphysent;
+	predcache_state_t states[UPDATE_BACKUP];
+} predcache_t;
+
+static predcache_t predcache;
+static unsigned int predcache_predicted, predcache_reused;
+
+void CL_ClearPredictionCache (void)
+{
+	predcache.valid = false;
+}
+
+static void CL_PredictStats_f (void)
+{
+	unsigned int total = predcache_predicted + predcache_reused;
+
+	Com_Printf ("predicted commands: %u, reused %u (%.1f%%)\n", total, predcache_reused,
+		total ? 100.0 * predcache_reused / total : 0);
+	predcache_predicted = predcache_reused = 0;
+}
+
+// the world and brush models are always compared, players only near the path
+static qbool CL_PredCachePhysentNear (const physent_t *pe)
+{
+	int i;
+
+	if (pe->model)
+		return true;
+
+	for (i = 0; i < 3; i++) {
+		if (pe->origin[i] + pe->mins[i] > predcache.maxs[i] || pe->origin[i] + pe->maxs[i] < predcache.mins[i])
+			return false;
+	}
+	return true;
+}
+
+static qbool CL_PredCachePhysentsMatch (void)
+{
+	const physent_t *a, *b;
+	int i = 0, j = 0;
+
+	while (true) {
+		while (i < predcache.numphysent && !CL_PredCachePhysentNear (&predcache.physents[i]))
+			i++;
+		while (j < pmove.numphysent && !CL_PredCachePhysentNear (&pmove.physents[j]))
+			j++;
+		if (i == predcache.numphysent || j == pmove.numphysent)
+			return i == predcache.numphysent && j == pmove.numphysent;
+
+		a = &predcache.physents[i++];
+		b = &pmove.physents[j++];
+		if (a->model != b->model || !VectorCompare (a->origin, b->origin))
+			return false;
+		if (!a->model && (!VectorCompare (a->mins, b->mins) || !VectorCompare (a->maxs, b->maxs)))
+			return false;
+	}
+}
+
+static qbool CL_PredCacheStateMatches (const player_state_t *server, const player_state_t *predicted, float origin_epsilon, float velocity_epsilon)
+{
+	int i;
+
+	if (server->pm_type != predicted->pm_type)
+		return false;
+	if ((cl.z_ext & Z_EXT_PF_ONGROUND) && server->onground != predicted->onground)
+		return false;
+	if ((cl.z_ext & Z_EXT_PM_TYPE) && server->pm_type == PM_NORMAL && server->jump_held != predicted->jump_held)
+		return false;
+
+	for (i = 0; i < 3; i++) {
+		if (fabs (server->origin[i] - predicted->origin[i]) > origin_epsilon)
+			return false;
+		if (fabs (server->velocity[i] - predicted->velocity[i]) > velocity_epsilon)
+			return false;
+	}
+	return true;
+}
+
+static void CL_PredCacheAddBounds (const vec3_t origin)
+{
+	extern vec3_t player_mins, player_maxs;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		predcache.mins[i] = min (predcache.mins[i], origin[i] + player_mins[i] - PREDCACHE_MARGIN);
+		predcache.maxs[i] = max (predcache.maxs[i], origin[i] + player_maxs[i] + PREDCACHE_MARGIN);
+	}
+}
+
+// Returns the last sequence whose cached prediction can be used as it is,
+// cl.validsequence if everything has to be predicted again.
+// Physents must be set up already.
+static int CL_PredCacheStart (void)
+{
+	const player_state_t *server = &cl.frames[cl.validsequence & UPDATE_MASK].playerstate[cl.playernum];
+	int last = cl.validsequence;
+
+	// as CL_PredictUsercmd sets them
+	movevars.entgravity = cl.entgravity;
+	movevars.maxspeed = cl.maxspeed;
+	movevars.bunnyspeedcap = cl.bunnyspeedcap;
+
+	if (cl_predict_cache.integer && predcache.valid
+#ifdef JSS_CAM
+		&& !cam_lockdir.value
+#endif
+		&& predcache.playernum == cl.playernum && predcache.z_ext == cl.z_ext
+		&& predcache.base <= cl.validsequence && cl.validsequence < predcache.end
+		&& predcache.end <= cls.netchan.outgoing_sequence
+		&& !memcmp (&predcache.movevars, &movevars, sizeof (movevars))
+		&& CL_PredCachePhysentsMatch ()) {
+		if (predcache.base == cl.validsequence) {
+			if (CL_PredCacheStateMatches (server, &predcache.basestate, 0, 0) && server->jump_msec == predcache.basestate.jump_msec
+				&& server->waterjumptime == predcache.basestate.waterjumptime)
+				last = predcache.end - 1;
+		}
+		else if (CL_PredCacheStateMatches (server, &predcache.states[cl.validsequence & UPDATE_MASK].state, PREDCACHE_ORIGIN_EPSILON, PREDCACHE_VELOCITY_EPSILON)) {
+			last = predcache.end - 1;
+		}
+	}
+
+	if (last == cl.validsequence) {
+		// start a new chain
+		VectorCopy (server->origin, predcache.mins);
+		VectorCopy (server->origin, predcache.maxs);
+		CL_PredCacheAddBounds (server->origin);
+		predcache.end = cl.validsequence + 1;
+	}
+	predcache.base = cl.validsequence;
+	predcache.basestate = *server;
+
+	return last;
+}
+
+// copies what CL_PredictUsercmd would have written
+static void CL_PredCacheRestore (int sequence, player_state_t *to)
+{
+	const player_state_t *cached = &predcache.states[sequence & UPDATE_MASK].state;
+
+	to->waterjumptime = cached->waterjumptime;
+	to->pm_type = cached->pm_type;
+	to->jump_held = cached->jump_held;
+	to->jump_msec = cached->jump_msec;
+	VectorCopy (cached->origin, to->origin);
+	VectorCopy (cached->viewangles, to->viewangles);
+	VectorCopy (cached->velocity, to->velocity);
+	to->onground = cached->onground;
+	to->weaponframe = predcache.basestate.weaponframe;
+	predcache_reused++;
+}
+
+// called after pmove has run for sequence
+static void CL_PredCacheStore (int sequence, const player_state_t *to)
+{
+	predcache_state_t *cached = &predcache.states[sequence & UPDATE_MASK];
+
+	cached->state = *to;
+	cached->waterlevel = pmove.waterlevel;
+	cached->on_entity = pmove.groundent > 0;
+	CL_PredCacheAddBounds (to->origin);
+	predcache.end = sequence + 1;
+	predcache_predicted++;
+}
+
+// remembers everything else the chain was predicted with
+static void CL_PredCacheFinish (void)
+{
+	predcache.valid = true;
+	predcache.playernum = cl.playernum;
+	predcache.z_ext = cl.z_ext;
+	predcache.movevars = movevars;
+	predcache.numphysent = pmove.numphysent;
+	memcpy (predcache.physents, pmove.physents, pmove.numphysent * sizeof (pmove.physents[0]));
+}
+
 void CL_PredictMove (qbool physframe) {
 	int i, oldphysent;
 	frame_t *from = NULL, *to;
@@ -361,24 +570,42 @@ void CL_PredictMove (qbool physframe) {
 	}
 	else if (physframe || !cl_independentPhysics.value)
 	{
+		predcache_state_t *last;
+		int cached;
+
 		oldphysent = pmove.numphysent;
 		CL_SetSolidPlayers (cl.playernum);
+		cached = CL_PredCacheStart ();
 
 		// run frames
 		for (i = 1; i < UPDATE_BACKUP - 1 && cl.validsequence + i < cls.netchan.outgoing_sequence; i++) {
 			from = to;
 			to = &cl.frames[(cl.validsequence + i) & UPDATE_MASK];
-			CL_PredictUsercmd (&from->playerstate[cl.playernum], &to->playerstate[cl.playernum], &to->cmd);
+			if (cl.validsequence + i <= cached) {
+				CL_PredCacheRestore (cl.validsequence + i, &to->playerstate[cl.playernum]);
+			}
+			else {
+				CL_PredictUsercmd (&from->playerstate[cl.playernum], &to->playerstate[cl.playernum], &to->cmd);
+				CL_PredCacheStore (cl.validsequence + i, &to->playerstate[cl.playernum]);
+			}
 		}
 
+		CL_PredCacheFinish ();
 		pmove.numphysent = oldphysent;
 
 		// save results
 		VectorCopy (to->playerstate[cl.playernum].velocity, cl.simvel);
 		VectorCopy (to->playerstate[cl.playernum].origin, cl.simorg);
-		cl.onground = pmove.onground;
-		cl.waterlevel = pmove.waterlevel;
-		check_standing_on_entity();
+		if (i > 1) {
+			// the cache slot of the last frame restored or predicted above
+			last = &predcache.states[(cl.validsequence + i - 1) & UPDATE_MASK];
+			cl.onground = last->state.onground;
+			cl.waterlevel = last->waterlevel;
+			check_standing_on_entity(last->on_entity);
+		}
+		else {
+			CL_CategorizePosition ();
+		}
 	}
 
 	if (!cls.mvdplayback && cl_independentPhysics.value != 0) {
@@ -419,8 +646,11 @@ void CL_InitPrediction(void)
 {
 	Cvar_SetCurrentGroup(CVAR_GROUP_NETWORK);
 	Cvar_Register(&cl_nopred);
+	Cvar_Register(&cl_predict_cache);
 	Cvar_ResetCurrentGroup();
 
+	Cmd_AddCommand("cl_predict_stats", CL_PredictStats_f);
+
 #ifdef JSS_CAM
 	Cvar_SetCurrentGroup(CVAR_GROUP_SPECTATOR);
 	Cvar_Register(&cam_thirdperson);
@@ -831,6 +831,7 @@ extern cvar_t r_explosiontype;
 extern cvar_t r_flagcolor;
 extern cvar_t r_lightflicker;
 extern cvar_t r_lightmap_lateupload;
+extern cvar_t r_lightmap_threads;
 extern cvar_t r_lightmap_packbytexture;
 extern cvar_t r_telesplash;
 extern cvar_t r_shaftalpha;
@@ -910,6 +911,9 @@ void CL_Demo_Init(void);
 void CL_Demo_Jump_Status_Check (void);
 void CL_Demo_Check_For_Rewind(float nextdemotime);
 void CL_Demo_Stop_Rewinding(void);
+void CL_Demo_Keyframes_Clear(void);
+qbool CL_Demo_Stats_Headless(void);
+void CL_Demo_Stats_Frame(void);
 double Demo_GetSpeed(void);
 void Demo_AdjustSpeed(void);
 qbool CL_IsDemoExtension(const char *filename);
@@ -1078,6 +1082,7 @@ void CL_ParseProjectiles(qbool indexed);
 
 // cl_pred.c
 void CL_InitPrediction(void);
+void CL_ClearPredictionCache(void);
 void CL_PredictMove(qbool physframe);
 void CL_PredictUsercmd(player_state_t *from, player_state_t *to, usercmd_t *u);
 void CL_DisableLerpMove(void);
@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "parser.h"
 #include "utils.h"
 #include "keys.h"
+#include "hash.h"
 
 typedef struct {
 	char name[MAX_MACRO_NAME];
@@ -541,34 +542,26 @@ void Cmd_Echo_f (void)
 =============================================================================
 */
 #define ALIAS_HASHPOOL_SIZE 256
-cmd_alias_t *cmd_alias_hash[ALIAS_HASHPOOL_SIZE];
+static hashtable_t *cmd_alias_hash;
 cmd_alias_t	*cmd_alias;
 
-cmd_alias_t *Cmd_FindAlias (const char *name)
+static void Cmd_AddAliasToHash (cmd_alias_t *alias)
 {
-	int key;
-	cmd_alias_t *alias;
+	if (!cmd_alias_hash)
+		cmd_alias_hash = Hash_InitTable(ALIAS_HASHPOOL_SIZE);
+	Hash_AddInsensitive(cmd_alias_hash, alias->name, alias);
+}
 
-	key = Com_HashKey (name) % ALIAS_HASHPOOL_SIZE;
-	for (alias = cmd_alias_hash[key]; alias; alias = alias->hash_next) {
-		if (!strcasecmp(name, alias->name))
-			return alias;
-	}
-	return NULL;
+cmd_alias_t *Cmd_FindAlias (const char *name)
+{
+	return cmd_alias_hash ? Hash_GetInsensitive(cmd_alias_hash, name) : NULL;
 }
 
 char *Cmd_AliasString (char *name)
 {
-	int key;
-	cmd_alias_t *alias;
+	cmd_alias_t *alias = Cmd_FindAlias(name);
 
-	key = Com_HashKey (name) % ALIAS_HASHPOOL_SIZE;
-	for (alias = cmd_alias_hash[key]; alias; alias = alias->hash_next) {
-		if (!strcasecmp(name, alias->name)) {
-			return alias->value;
-		}
-	}
-	return NULL;
+	return alias ? alias->value : NULL;
 }
 
 void Cmd_Viewalias_f (void)
@@ -701,17 +694,13 @@ void Cmd_EditAlias_f (void)
 static cmd_alias_t* Cmd_AliasCreate (char* name)
 {
 	cmd_alias_t	*a;
-	int key;
-
-	key = Com_HashKey(name) % ALIAS_HASHPOOL_SIZE;
 
 	a = (cmd_alias_t *) Q_malloc(sizeof(cmd_alias_t));
 	a->next = cmd_alias;
 	cmd_alias = a;
-	a->hash_next = cmd_alias_hash[key];
-	cmd_alias_hash[key] = a;
 
 	strlcpy (a->name, name, sizeof (a->name));
+	Cmd_AddAliasToHash(a);
 	return a;
 }
 
@@ -720,7 +709,7 @@ void Cmd_Alias_f (void)
 {
 	cmd_alias_t	*a;
 	char *s;
-	int c, key;
+	int c;
 
 	c = Cmd_Argc();
 	if (c == 1)	{
@@ -740,31 +729,20 @@ void Cmd_Alias_f (void)
 		return;
 	}
 
-	key = Com_HashKey(s) % ALIAS_HASHPOOL_SIZE;
-
 	// if the alias already exists, reuse it
-	for (a = cmd_alias_hash[key]; a; a = a->hash_next) {
-		if (!strcasecmp(a->name, s)) {
-			if (Cmd_Argc() == 2) {
-				Com_Printf("\x02%s :", a->name);
-				Com_Printf(" %s\n", a->value);
-				return;
-			}
-			Q_free(a->value);
-			break;
+	if ((a = Cmd_FindAlias(s))) {
+		if (Cmd_Argc() == 2) {
+			Com_Printf("\x02%s :", a->name);
+			Com_Printf(" %s\n", a->value);
+			return;
 		}
+		Q_free(a->value);
+		strlcpy (a->name, s, sizeof (a->name));
 	}
-
-	if (!a)	{
-		a = (cmd_alias_t *) Q_malloc(sizeof(cmd_alias_t));
-		a->next = cmd_alias;
-		cmd_alias = a;
-		a->hash_next = cmd_alias_hash[key];
-		cmd_alias_hash[key] = a;
+	else {
+		a = Cmd_AliasCreate(s);
 	}
 
-	strlcpy (a->name, s, sizeof (a->name));
-
 	a->flags = 0;
 	// QW262 -->
 	s=Cmd_MakeArgs(2);
@@ -789,26 +767,13 @@ void Cmd_Alias_f (void)
 qbool Cmd_DeleteAlias (char *name)
 {
 	cmd_alias_t *a, *prev;
-	int key;
 
-	key = Com_HashKey (name) % ALIAS_HASHPOOL_SIZE;
-
-	prev = NULL;
-	for (a = cmd_alias_hash[key]; a; a = a->hash_next) {
-		if (!strcasecmp(a->name, name)) {
-			// unlink from hash
-			if (prev)
-				prev->hash_next = a->hash_next;
-			else
-				cmd_alias_hash[key] = a->hash_next;
-			break;
-		}
-		prev = a;
-	}
-
-	if (!a)
+	if (!(a = Cmd_FindAlias(name)))
 		return false;	// not found
 
+	// unlink from hash
+	Hash_RemoveDataInsensitive(cmd_alias_hash, name, a);
+
 	prev = NULL;
 	for (a = cmd_alias; a; a = a->next) {
 		if (!strcasecmp(a->name, name)) {
@@ -912,7 +877,8 @@ void Cmd_UnAliasAll_f (void)
 		cmd_alias = NULL;
 
 		// clear hash
-		memset (cmd_alias_hash, 0, sizeof(cmd_alias_t*) * ALIAS_HASHPOOL_SIZE);
+		if (cmd_alias_hash)
+			Hash_Flush(cmd_alias_hash);
 	}
 }
 
@@ -1000,7 +966,7 @@ static qbool Cmd_LegacyCommand (void)
 */
 
 #define CMD_HASHPOOL_SIZE 512
-cmd_function_t	*cmd_hash_array[CMD_HASHPOOL_SIZE];
+static hashtable_t *cmd_hash;
 /*static*/ cmd_function_t	*cmd_functions;		// possible commands to execute
 
 static  tokenizecontext_t cmd_tokenizecontext;
@@ -1138,10 +1104,16 @@ void Cmd_RestoreContext(tokenizecontext_t *ctx)
 	cmd_tokenizecontext = ctx[0];
 }
 
+static void Cmd_AddCommandToHash (cmd_function_t *cmd)
+{
+	if (!cmd_hash)
+		cmd_hash = Hash_InitTable(CMD_HASHPOOL_SIZE);
+	Hash_AddInsensitive(cmd_hash, cmd->name, cmd);
+}
+
 void Cmd_AddCommand (char *cmd_name, xcommand_t function)
 {
 	cmd_function_t *cmd;
-	int	key;
 
 	/* commented out when vid_restart was added
 	if (host_initialized)	// because hunk allocation would get stomped
@@ -1154,14 +1126,10 @@ void Cmd_AddCommand (char *cmd_name, xcommand_t function)
 		return;
 	} */
 
-	key = Com_HashKey (cmd_name) % CMD_HASHPOOL_SIZE;
-
 	// fail if the command already exists
-	for (cmd = cmd_hash_array[key]; cmd; cmd=cmd->hash_next) {
-		if (!strcasecmp (cmd_name, cmd->name)) {
-			Com_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+	if (Cmd_FindCommand(cmd_name)) {
+		Com_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = (cmd_function_t *) Hunk_Alloc (sizeof(cmd_function_t));
@@ -1170,23 +1138,17 @@ void Cmd_AddCommand (char *cmd_name, xcommand_t function)
 	cmd->zmalloced = false;
 	cmd->next = cmd_functions;
 	cmd_functions = cmd;
-	cmd->hash_next = cmd_hash_array[key];
-	cmd_hash_array[key] = cmd;
+	Cmd_AddCommandToHash(cmd);
 }
 
 qbool Cmd_AddRemCommand (char *cmd_name, xcommand_t function)
 {
 	cmd_function_t *cmd;
-	int	key;
-
-	key = Com_HashKey (cmd_name) % CMD_HASHPOOL_SIZE;
 
 	// fail if the command already exists
-	for (cmd = cmd_hash_array[key]; cmd; cmd=cmd->hash_next) {
-		if (!strcasecmp (cmd_name, cmd->name)) {
-			Com_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return false;
-		}
+	if (Cmd_FindCommand(cmd_name)) {
+		Com_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return false;
 	}
 
 	cmd = (cmd_function_t*)Q_malloc(sizeof(cmd_function_t)+strlen(cmd_name)+1);
@@ -1196,8 +1158,7 @@ qbool Cmd_AddRemCommand (char *cmd_name, xcommand_t function)
 	cmd->zmalloced = true;
 	cmd->next = cmd_functions;
 	cmd_functions = cmd;
-	cmd->hash_next = cmd_hash_array[key];
-	cmd_hash_array[key] = cmd;
+	Cmd_AddCommandToHash(cmd);
 
 	return true;
 }
@@ -1205,27 +1166,13 @@ qbool Cmd_AddRemCommand (char *cmd_name, xcommand_t function)
 // removes command from the hash map of the commands
 cmd_function_t *Cmd_RemoveCommand_Hash(char *cmd_name)
 {
-	int key = Com_HashKey (cmd_name) % CMD_HASHPOOL_SIZE;
-	cmd_function_t *cmd = cmd_hash_array[key];
-	cmd_function_t *prev = NULL;
-	cmd_function_t *retval = NULL;
+	cmd_function_t *cmd = Cmd_FindCommand(cmd_name);
 
-	if (strcasecmp(cmd_name, cmd->name) == 0) {
-		retval = cmd;
-		cmd_hash_array[key] = cmd_hash_array[key]->hash_next;
-	}
-	else
-	{
-		prev = cmd;
-		for (cmd = cmd->hash_next; cmd; cmd = cmd->hash_next) {
-			if (strcasecmp(cmd_name, cmd->name) == 0) {
-				retval = cmd;
-				prev->hash_next = cmd->hash_next;
-			}
-		}
+	if (cmd) {
+		Hash_RemoveDataInsensitive(cmd_hash, cmd_name, cmd);
 	}
 
-	return retval;
+	return cmd;
 }
 
 // removes command from the linked list of all commands
@@ -1272,28 +1219,12 @@ void Cmd_RemoveCommand (char *cmd_name)
 
 qbool Cmd_Exists (char *cmd_name)
 {
-	int	key;
-	cmd_function_t	*cmd;
-
-	key = Com_HashKey (cmd_name) % CMD_HASHPOOL_SIZE;
-	for (cmd=cmd_hash_array[key]; cmd; cmd = cmd->hash_next) {
-		if (!strcasecmp (cmd_name, cmd->name))
-			return true;
-	}
-	return false;
+	return Cmd_FindCommand(cmd_name) != NULL;
 }
 
 cmd_function_t *Cmd_FindCommand (const char *cmd_name)
 {
-	int	key;
-	cmd_function_t *cmd;
-
-	key = Com_HashKey (cmd_name) % CMD_HASHPOOL_SIZE;
-	for (cmd = cmd_hash_array[key]; cmd; cmd = cmd->hash_next) {
-		if (!strcasecmp (cmd_name, cmd->name))
-			return cmd;
-	}
-	return NULL;
+	return cmd_hash ? Hash_GetInsensitive(cmd_hash, cmd_name) : NULL;
 }
 
 char *Cmd_CompleteCommand (char *partial)
@@ -2379,6 +2310,7 @@ void Cmd_Init (void)
 	Cmd_AddCommand ("cvar_in", Cmd_Cvar_In_f);
 	Cmd_AddCommand ("cvar_out", Cmd_Cvar_Out_f);
 // <-- QW262
+	Hash_Init();
 
 	Cvar_Register(&cl_curlybraces);
     Cvar_Register(&cl_warnexec);
@@ -2391,7 +2323,6 @@ void Cmd_Init (void)
 
 void Cmd_Shutdown(void)
 {
-	int i;
 	cmd_alias_t* alias;
 	cmd_alias_t* next_alias;
 	cmd_function_t* cmd;
@@ -2400,9 +2331,8 @@ void Cmd_Shutdown(void)
 	legacycmd_t* next_legacycmd;
 
 	Sys_Printf("Cmd_Shutdown(aliases)\n");
-	for (i = 0; i < sizeof(cmd_alias_hash) / sizeof(cmd_alias_hash[0]); ++i) {
-		cmd_alias_hash[i] = NULL;
-	}
+	Hash_ShutdownTable(cmd_alias_hash);
+	cmd_alias_hash = NULL;
 
 	for (alias = cmd_alias; alias; alias = next_alias) {
 		next_alias = alias->next;
@@ -2412,6 +2342,8 @@ void Cmd_Shutdown(void)
 	cmd_alias = NULL;
 
 	Sys_Printf("Cmd_Shutdown(functions)\n");
+	Hash_ShutdownTable(cmd_hash);
+	cmd_hash = NULL;
 	for (cmd = cmd_functions; cmd; cmd = next_cmd) {
 		next_cmd = cmd->next;
 
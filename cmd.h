@@ -84,7 +84,6 @@ then searches for a command or variable that matches the first token.
 typedef void (*xcommand_t) (void);
 
 typedef struct cmd_function_s {
-	struct cmd_function_s	*hash_next;
 	struct cmd_function_s	*next;
 	char					*name;
 	xcommand_t				function;
@@ -193,7 +192,6 @@ void Cmd_AddLegacyCommand (char *oldname, char *newname);
 #define	ALIAS_HAS_PARAMETERS	8
 
 typedef struct cmd_alias_s {
-	struct cmd_alias_s	*hash_next;
 	struct cmd_alias_s	*next;
 	char				name[MAX_ALIAS_NAME];
 	char				*value;
@@ -48,6 +48,7 @@ CMDLINE_DEF(client_novao, "-r-novao"),
 CMDLINE_DEF(client_nocallback, "-r-nocallback"),
 CMDLINE_DEF(client_nomultibind, "-r-nomultibind"),
 CMDLINE_DEF(client_no_amd_fix, "-r-no-amd-fix"),
+CMDLINE_DEF(client_demostats, "-demostats"),
 
 CMDLINE_DEF(filesystem_basedir, "-basedir"),
 CMDLINE_DEF(filesystem_nohome, "-nohome"),
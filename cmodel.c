@@ -340,7 +340,7 @@ start:
 	return TR_BLOCKED;
 }
 
-trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
+static trace_t CM_HullTraceFromNode (hull_t *hull, int num, const vec3_t start, const vec3_t end)
 {
 	int check;
 
@@ -355,7 +355,7 @@ trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 	htl.trace.startsolid = false;
 	VectorCopy (end, htl.trace.endpos);
 
-	check = RecursiveHullTrace (&htl, hull->firstclipnode, 0, 1, start, end);
+	check = RecursiveHullTrace (&htl, num, 0, 1, start, end);
 
 	if (check == TR_SOLID) {
 		htl.trace.startsolid = htl.trace.allsolid = true;
@@ -369,6 +369,173 @@ trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 	return htl.trace;
 }
 
+/*
+===============================================================================
+
+TRACE CACHE
+
+Hull traces only depend on the hull and the end points (moving brush models
+are traced in their own space), so identical traces within a frame are
+answered from a small direct mapped cache. The box hull is rebuilt for every
+entity and never cached.
+
+===============================================================================
+*/
+
+#define	TRACE_CACHE_SIZE	1024	// power of two
+
+typedef struct tracecache_s {
+	unsigned int	frame;
+	hull_t			*hull;
+	vec3_t			start, end;
+	trace_t			trace;
+} tracecache_t;
+
+static cvar_t cm_tracecache = {"cm_tracecache", "1"};
+
+static tracecache_t	trace_cache[TRACE_CACHE_SIZE];
+static unsigned int	trace_cache_frame = 1;
+static unsigned int	trace_cache_hits, trace_cache_misses, trace_batched;
+
+// starts a new frame, called each host frame and when the map changes
+void CM_TraceCacheNewFrame (void)
+{
+	if (++trace_cache_frame == 0) {
+		memset (trace_cache, 0, sizeof(trace_cache));
+		trace_cache_frame = 1;
+	}
+}
+
+static tracecache_t *CM_TraceCacheSlot (hull_t *hull, const vec3_t start, const vec3_t end)
+{
+	unsigned int h = (unsigned int) (uintptr_t) hull, bits[6];
+	int i;
+
+	memcpy (bits, start, sizeof(vec3_t));
+	memcpy (bits + 3, end, sizeof(vec3_t));
+	for (i = 0; i < 6; i++) {
+		h = (h ^ bits[i]) * 16777619u;
+	}
+	h ^= h >> 15;
+
+	return &trace_cache[h & (TRACE_CACHE_SIZE - 1)];
+}
+
+trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
+{
+	tracecache_t *slot;
+
+	if (!cm_tracecache.integer || hull == &box_hull) {
+		return CM_HullTraceFromNode (hull, hull->firstclipnode, start, end);
+	}
+
+	slot = CM_TraceCacheSlot (hull, start, end);
+	if (slot->frame == trace_cache_frame && slot->hull == hull && VectorCompare (slot->start, start) && VectorCompare (slot->end, end)) {
+		trace_cache_hits++;
+		return slot->trace;
+	}
+
+	trace_cache_misses++;
+	slot->trace = CM_HullTraceFromNode (hull, hull->firstclipnode, start, end);
+	slot->frame = trace_cache_frame;
+	slot->hull = hull;
+	VectorCopy (start, slot->start);
+	VectorCopy (end, slot->end);
+
+	return slot->trace;
+}
+
+static void CM_TraceCacheStats_f (void)
+{
+	unsigned int total = trace_cache_hits + trace_cache_misses;
+
+	Com_Printf ("hull traces: %u, cache hits %u (%.1f%%), batched rays %u\n", total, trace_cache_hits,
+		total ? 100.0 * trace_cache_hits / total : 0, trace_batched);
+	trace_cache_hits = trace_cache_misses = trace_batched = 0;
+}
+
+//====================
+// Moves the rays idx[0..count) down from node num together for as long as they
+// are all on the same side of the planes, each ray crossing a plane or reaching
+// a leaf is finished on its own from there.
+static void CM_HullTraceBatchNode (hull_t *hull, int num, int *idx, int count, vec3_t *starts, vec3_t *ends, trace_t *traces)
+{
+	mclipnode_t *node;
+	mplane_t *plane;
+	float t1, t2;
+	int i, front, back, tmp;
+
+	while (count > 0) {
+		if (num < hull->firstclipnode || num > hull->lastclipnode) {
+			// leaf or bad node, RecursiveHullTrace deals with it
+			for (i = 0; i < count; i++) {
+				traces[idx[i]] = CM_HullTraceFromNode (hull, num, starts[idx[i]], ends[idx[i]]);
+			}
+			return;
+		}
+
+		node = hull->clipnodes + num;
+		plane = hull->planes + node->planenum;
+
+		// partition into [front | back | crossing]
+		front = back = 0;
+		for (i = 0; i < count; i++) {
+			float *p1 = starts[idx[i]], *p2 = ends[idx[i]];
+
+			if (plane->type < 3) {
+				t1 = p1[plane->type] - plane->dist;
+				t2 = p2[plane->type] - plane->dist;
+			}
+			else {
+				t1 = DotProduct (plane->normal, p1) - plane->dist;
+				t2 = DotProduct (plane->normal, p2) - plane->dist;
+			}
+
+			if (t1 >= 0 && t2 >= 0) {
+				tmp = idx[i];
+				idx[i] = idx[front + back];
+				idx[front + back] = idx[front];
+				idx[front++] = tmp;
+			}
+			else if (t1 < 0 && t2 < 0) {
+				tmp = idx[i];
+				idx[i] = idx[front + back];
+				idx[front + back++] = tmp;
+			}
+		}
+
+		for (i = front + back; i < count; i++) {
+			traces[idx[i]] = CM_HullTraceFromNode (hull, num, starts[idx[i]], ends[idx[i]]);
+		}
+
+		CM_HullTraceBatchNode (hull, node->children[0], idx, front, starts, ends, traces);
+
+		idx += front;
+		count = back;
+		num = node->children[1];
+	}
+}
+
+// Same results as calling CM_HullTrace for each ray, but the part of the BSP
+// walk the rays have in common is done once. Handy for fans of rays from one
+// point, such as visibility or splash checks.
+void CM_HullTraceBatch (hull_t *hull, int count, vec3_t *starts, vec3_t *ends, trace_t *traces)
+{
+	int idx_local[64], *idx = (count <= 64 ? idx_local : Q_malloc (count * sizeof(int)));
+	int i;
+
+	for (i = 0; i < count; i++) {
+		idx[i] = i;
+	}
+	trace_batched += count;
+
+	CM_HullTraceBatchNode (hull, hull->firstclipnode, idx, count, starts, ends, traces);
+
+	if (idx != idx_local) {
+		Q_free (idx);
+	}
+}
+
 //===========================================================================
 
 int	CM_NumInlineModels (void)
@@ -1409,6 +1576,7 @@ static void CM_BuildPHS (void)
 void CM_InvalidateMap (void)
 {
 	map_name[0] = 0;
+	CM_TraceCacheNewFrame ();
 
 	// null out the pointers to turn up any attempt to call CM functions
 	map_planes = NULL;
@@ -1433,7 +1601,8 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 
 	unsigned int i;
 	dheader_t *header;
-	unsigned int *buf;
+	byte *buf;
+	byte *aligned_buf = NULL;
 	unsigned int *padded_buf = NULL;
 	BuildPVSFunction cm_load_pvs_func = CM_BuildPVS;
 	qbool pad_lumps = false;
@@ -1449,10 +1618,21 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 		return &map_cmodels[0]; // still have the right version
 	}
 
+	CM_TraceCacheNewFrame ();
+
 	// load the file
-	buf = (unsigned int *) FS_LoadTempFile (name, &filelen);
+	buf = FS_MapTempFile (name, &filelen);
 	if (!buf)
 		Host_Error ("CM_LoadMap: %s not found", name);
+	if (filelen < (int)sizeof(dheader_t))
+		Host_Error ("CM_LoadMap: %s is too short", name);
+
+	// a mapped file starts wherever it is inside its .pak, copy it if that isn't 4-byte aligned
+	if ((uintptr_t)buf % 4) {
+		aligned_buf = Q_malloc (filelen);
+		memcpy (aligned_buf, buf, filelen);
+		buf = aligned_buf;
+	}
 
 	COM_FileBase (name, loadname);
 
@@ -1506,14 +1686,14 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 			if (position + header->lumps[i].filelen > required_size) {
 				Host_Error("CM_LoadMap: %s caused error while aligning lumps", name);
 			}
-			memcpy((byte*)padded_buf + position, ((byte*)buf) + header->lumps[i].fileofs, header->lumps[i].filelen);
+			memcpy((byte*)padded_buf + position, buf + header->lumps[i].fileofs, header->lumps[i].filelen);
 			header->lumps[i].fileofs = position;
 
 			position += header->lumps[i].filelen;
 		}
 
 		// Use the new buffer
-		buf = padded_buf;
+		buf = (byte *)padded_buf;
 	}
 
 	cmod_base = (byte *)header;
@@ -1567,6 +1747,7 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 	strlcpy (map_name, name, sizeof(map_name));
 
 	Q_free(padded_buf);
+	Q_free(aligned_buf);
 
 	return &map_cmodels[0];
 }
@@ -1589,6 +1770,9 @@ void CM_Init (void)
 {
 	memset (map_novis, 0xff, sizeof(map_novis));
 	CM_InitBoxHull ();
+
+	Cvar_Register (&cm_tracecache);
+	Cmd_AddCommand ("cm_tracecache_stats", CM_TraceCacheStats_f);
 }
 
 #ifndef SERVER_ONLY
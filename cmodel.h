@@ -96,6 +96,8 @@ hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs);
 int CM_HullPointContents (hull_t *hull, int num, vec3_t p);
 int CM_CachedHullPointContents(hull_t* hull, int num, vec3_t p, float* min_dist);
 trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end);
+void CM_HullTraceBatch (hull_t *hull, int count, vec3_t *starts, vec3_t *ends, trace_t *traces);
+void CM_TraceCacheNewFrame (void);
 struct cleaf_s *CM_PointInLeaf (const vec3_t p);
 int CM_Leafnum (const struct cleaf_s *leaf);
 int CM_LeafAmbientLevel (const struct cleaf_s *leaf, int ambient_channel);
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #ifdef SERVERONLY
 #include "qwsvdef.h"
+#include "hash.h"
 
 #define VAR_HASHPOOL_SIZE 32
 #else
@@ -32,6 +33,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "utils.h"
 #include "parser.h"
 #include "r_renderer.h"
+#include "hash.h"
 
 static void Cvar_ApplyLatchedUpdate(cvar_t* var);
 
@@ -53,10 +55,18 @@ static cvar_t cvar_viewlatched = {"cvar_viewlatched", "1"};
 static void Cvar_AddCvarToGroup(cvar_t *var);
 #endif
 
-static cvar_t *cvar_hash[VAR_HASHPOOL_SIZE];
+static hashtable_t *cvar_hash;
 cvar_t *cvar_vars;
 static char	*cvar_null_string = "";
 
+static void Cvar_AddToHash(cvar_t *var)
+{
+	if (!cvar_hash) {
+		cvar_hash = Hash_InitTable(VAR_HASHPOOL_SIZE);
+	}
+	Hash_AddInsensitive(cvar_hash, var->name, var);
+}
+
 // Use this to walk through all vars
 cvar_t* Cvar_Next(cvar_t *var)
 {
@@ -70,16 +80,7 @@ cvar_t* Cvar_Next(cvar_t *var)
 
 cvar_t *Cvar_Find(const char *var_name)
 {
-	cvar_t *var;
-	int key = Com_HashKey (var_name) % VAR_HASHPOOL_SIZE;
-
-	for (var = cvar_hash[key]; var; var = var->hash_next) {
-		if (!strcasecmp(var_name, var->name)) {
-			return var;
-		}
-	}
-
-	return NULL;
+	return cvar_hash ? Hash_GetInsensitive(cvar_hash, var_name) : NULL;
 }
 
 float Cvar_Value (const char *var_name)
@@ -335,7 +336,6 @@ void Cvar_SetValueByName(const char *var_name, const float value)
 
 void Cvar_Register(cvar_t *var)
 {
-	int key;
 	cvar_t *old = Cvar_Find(var->name);
 
 	// All variables must be named :)
@@ -358,9 +358,7 @@ void Cvar_Register(cvar_t *var)
 	}
 
 	// link the variable in
-	key = Com_HashKey(var->name);
-	var->hash_next = cvar_hash[key];
-	cvar_hash[key] = var;
+	Cvar_AddToHash(var);
 	var->next = cvar_vars;
 	cvar_vars = var;
 
@@ -434,9 +432,7 @@ void Cvar_Register(cvar_t *var)
 	var->modified = true;
 
 	// link the variable in
-	key = Com_HashKey(var->name) % VAR_HASHPOOL_SIZE;
-	var->hash_next = cvar_hash[key];
-	cvar_hash[key] = var;
+	Cvar_AddToHash(var);
 	var->next = cvar_vars;
 	cvar_vars = var;
 
@@ -692,7 +688,6 @@ static void Cvar_CvarEdit_f(void)
 cvar_t *Cvar_Create(const char *name, const char *string, int cvarflags)
 {
 	cvar_t *v;
-	int key;
 
 	v = Cvar_Find(name);
 	if (v) {
@@ -707,11 +702,8 @@ cvar_t *Cvar_Create(const char *name, const char *string, int cvarflags)
 	v->next = cvar_vars;
 	cvar_vars = v;
 
-	key = Com_HashKey(name) % VAR_HASHPOOL_SIZE;
-	v->hash_next = cvar_hash[key];
-	cvar_hash[key] = v;
-
 	v->name = Q_strdup_named(name, name);
+	Cvar_AddToHash(v);
 	v->string = Q_strdup_named(string, name);
 	v->value = Q_atof(v->string);
 	v->flags = cvarflags;
@@ -733,26 +725,14 @@ cvar_t *Cvar_Create(const char *name, const char *string, int cvarflags)
 qbool Cvar_Delete(const char *name)
 {
 	cvar_t *var, *prev = NULL;
-	int key = Com_HashKey(name) % VAR_HASHPOOL_SIZE;
 
-	for (var = cvar_hash[key]; var; var = var->hash_next) {
-		if (!strcasecmp(var->name, name)) {
-			// unlink from hash
-			if (prev) {
-				prev->hash_next = var->hash_next;
-			}
-			else {
-				cvar_hash[key] = var->hash_next;
-			}
-			break;
-		}
-		prev = var;
-	}
-
-	if (!var) {
+	if (!(var = Cvar_Find(name))) {
 		return false;
 	}
 
+	// unlink from hash
+	Hash_RemoveDataInsensitive(cvar_hash, name, var);
+
 	prev = NULL;
 	for (var = cvar_vars; var; var = var->next) {
 		if (!strcasecmp(var->name, name)) {
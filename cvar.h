@@ -80,7 +80,6 @@ typedef struct cvar_s {
 	struct cvar_s       *next_in_group;
 #endif
 
-	struct cvar_s *hash_next;
 	struct cvar_s *next;
 } cvar_t;
 
@@ -37,6 +37,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #else
 #include <unistd.h>
 #include <strings.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 static void FS_RebuildFSHash(void);
@@ -88,6 +91,7 @@ int fs_hash_files;
 
 cvar_t fs_cache = {"fs_cache", "1"};
 static cvar_t fs_savegame_home = { "fs_savegame_home", "1" };
+static cvar_t fs_mmap = { "fs_mmap", "1" };
 
 static void FS_CreatePathRelative(const char *pname, int relativeto);
 void FS_ForceToPure(char *str, const char *crcs, int seed);
@@ -108,6 +112,7 @@ void FS_Locate_f (void);
 
 // VFS-FIXME: Debug file for trying to open files
 static void FS_DiffFile_f(void);
+static void FS_SeekTest_f(void);
 
 
 //============================================================================
@@ -409,6 +414,147 @@ byte *FS_LoadHeapFile (const char *path, int *len)
 	return FS_LoadFile (path, 5, len);
 }
 
+//=============================================================================
+// Memory mapped files
+//=============================================================================
+// Files stored uncompressed on disk (plain files, .pak members and stored .pk3
+// members) can be mapped instead of copied. Views are private copy-on-write, so
+// loaders that swap or patch the data in place only copy the pages they touch
+// and all processes loading the same map share the rest through the page cache.
+
+struct fs_mapping_s {
+	void    *base;		// start of the view, aligned down to the mapping granularity
+	size_t  size;
+#ifdef _WIN32
+	HANDLE  mapping;
+#endif
+};
+
+static byte *FS_MapRegion(const char *ospath, unsigned long offset, int len, fs_mapping_t **mapping)
+{
+	fs_mapping_t *map;
+	unsigned long aligned;
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	HANDLE file, filemapping;
+	LARGE_INTEGER filesize;
+	void *base;
+
+	GetSystemInfo(&si);
+	aligned = offset - (offset % si.dwAllocationGranularity);
+
+	file = CreateFile(ospath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	if (!GetFileSizeEx(file, &filesize) || filesize.QuadPart < (LONGLONG)offset + len) {
+		CloseHandle(file);
+		return NULL;
+	}
+
+	filemapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!filemapping)
+		return NULL;
+
+	base = MapViewOfFile(filemapping, FILE_MAP_COPY, 0, aligned, offset - aligned + len);
+	if (!base) {
+		CloseHandle(filemapping);
+		return NULL;
+	}
+
+	map = Q_malloc(sizeof(*map));
+	map->mapping = filemapping;
+#else
+	struct stat st;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	void *base;
+	int fd;
+
+	aligned = offset - (offset % (pagesize > 0 ? pagesize : 4096));
+
+	if ((fd = open(ospath, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st) || st.st_size < (off_t)offset + len) {
+		close(fd);
+		return NULL;
+	}
+
+	base = mmap(NULL, offset - aligned + len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, aligned);
+	close(fd);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	map = Q_malloc(sizeof(*map));
+#endif
+
+	map->base = base;
+	map->size = offset - aligned + len;
+	*mapping = map;
+
+	return (byte *)base + (offset - aligned);
+}
+
+// Maps a file stored uncompressed on disk, copy-on-write. Unlike FS_LoadFile(), no 0 byte
+// is appended. Returns NULL if the file can't be mapped, release with FS_UnmapFile().
+byte *FS_MapFile(const char *path, int *len, fs_mapping_t **mapping)
+{
+	flocation_t loc;
+	char ospath[MAX_OSPATH];
+	unsigned long offset;
+	byte *data;
+
+	*mapping = NULL;
+
+	if (!fs_mmap.integer || Sys_PathProtection(path))
+		return NULL;
+
+	FS_FLocateFile(path, FSLFRT_LENGTH, &loc);
+	if (!loc.search || !loc.search->funcs->RawLocation || loc.len <= 0)
+		return NULL;
+	if (!loc.search->funcs->RawLocation(loc.search->handle, &loc, ospath, sizeof(ospath), &offset))
+		return NULL;
+
+	if (!(data = FS_MapRegion(ospath, offset, loc.len, mapping)))
+		return NULL;
+
+	if (len)
+		*len = loc.len;
+
+	return data;
+}
+
+void FS_UnmapFile(fs_mapping_t *mapping)
+{
+	if (!mapping)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapping->base);
+	CloseHandle(mapping->mapping);
+#else
+	munmap(mapping->base, mapping->size);
+#endif
+	Q_free(mapping);
+}
+
+// Drop-in for FS_LoadTempFile() in loaders of binary data that don't need a trailing 0:
+// maps the file when possible, the data stays valid until the next call.
+// A mapped file inside a .pak/.pk3 may start at any alignment, read it bytewise or copy it out.
+// Truncating the file on disk while it is mapped makes reads past the new end raise SIGBUS.
+byte *FS_MapTempFile(char *path, int *len)
+{
+	static fs_mapping_t *temp_mapping;
+	byte *data;
+
+	FS_UnmapFile(temp_mapping);
+	temp_mapping = NULL;
+
+	if ((data = FS_MapFile(path, len, &temp_mapping)))
+		return data;
+
+	return FS_LoadTempFile(path, len);
+}
+
 // QW262 -->
 /*
 ================
@@ -1931,6 +2077,7 @@ void FS_InitModuleFS (void)
 	Cmd_AddLegacyCommand("path", "fs_path");
 	Cmd_AddCommand("fs_restart", FS_ReloadPackFiles_f);
 	Cmd_AddCommand("fs_diff", FS_DiffFile_f); 		// VFS-FIXME <-- Only a debug function
+	Cmd_AddCommand("fs_seektest", FS_SeekTest_f);	// debug too
 	Cmd_AddCommand("fs_dir", FS_Dir_f);
 	Cmd_AddLegacyCommand("dir", "fs_dir");
 	Cmd_AddCommand("fs_locate", FS_Locate_f);
@@ -1940,6 +2087,7 @@ void FS_InitModuleFS (void)
 	Cvar_SetCurrentGroup(CVAR_GROUP_FILESYSTEM);
 	Cvar_Register(&fs_cache);
 	Cvar_Register(&fs_savegame_home);
+	Cvar_Register(&fs_mmap);
 	Cvar_ResetCurrentGroup();
 
 	Com_Printf("Initialising quake VFS filesystem\n");
@@ -3047,14 +3195,15 @@ void FS_ListFiles_f(void)
 		size_t ext_len = strlen(ext);
 
 		for (i = 0; i < filesystemhash->numbuckets; i++) {
-			bucket_t *b = filesystemhash->bucket[i];
-			while (b) {
-				char *key = b->keystring;
-				size_t len = strlen(key);
-				if (strcmp(key+len-ext_len, ext) == 0) {
-					Com_Printf("%s\n", b->keystring);
-				}
-				b = b->next;
+			char *key = filesystemhash->bucket[i].keystring;
+			size_t len;
+
+			if (!key) {
+				continue;
+			}
+			len = strlen(key);
+			if (len >= ext_len && strcmp(key+len-ext_len, ext) == 0) {
+				Com_Printf("%s\n", key);
 			}
 		}
 	}
@@ -3139,6 +3288,56 @@ end:
 	VFS_CLOSE(file2);
 }
 
+// DEBUG FUNCTION
+// ===============
+// FS_SeekTest_f
+// ===============
+// Reads a file in one go, then seeks to random offsets and checks
+// what is read there matches. Deflated zip members keep 64 inflate
+// checkpoints, anything over 32 MB makes them get thinned out.
+static void FS_SeekTest_f(void)
+{
+	char buf[CHUNK];
+	byte *data;
+	vfsfile_t *file;
+	unsigned long len, pos;
+	int i, count, chunk, failed = 0;
+
+	if (Cmd_Argc() < 2) {
+		Com_Printf("Usage: %s <filename> [seeks]\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (!(file = FS_OpenVFS(Cmd_Argv(1), "rb", FS_ANY))) {
+		Com_Printf("Unable to open %s\n", Cmd_Argv(1));
+		return;
+	}
+
+	len = VFS_GETLEN(file);
+	data = Q_malloc(len + 1);
+	if (VFS_READ(file, data, len, NULL) != len) {
+		Com_Printf("%s: couldn't read %lu bytes\n", Cmd_Argv(0), len);
+		failed = 1;
+	}
+
+	count = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 1000;
+	for (i = 0; i < count && !failed && len; i++) {
+		pos = (((unsigned long) rand() << 15) ^ rand()) % len;
+		chunk = (int) min(sizeof(buf), len - pos);
+
+		if (VFS_SEEK(file, pos, SEEK_SET) || VFS_READ(file, buf, chunk, NULL) != chunk || memcmp(buf, data + pos, chunk)) {
+			Com_Printf("%s: mismatch reading %d bytes at %lu\n", Cmd_Argv(0), chunk, pos);
+			failed = 1;
+		}
+	}
+
+	if (!failed)
+		Com_Printf("%s: %d seeks ok\n", Cmd_Argv(1), count);
+
+	Q_free(data);
+	VFS_CLOSE(file);
+}
+
 #ifdef SERVERONLY
 /*
 ================
@@ -93,6 +93,12 @@ vfsfile_t *FS_OpenVFS(const char *filename, char *mode,relativeto_t relativeto);
 // TCP VFS file
 vfsfile_t *FS_OpenTCP(char *name);
 
+// zero-copy views of files stored uncompressed on disk (plain, .pak or stored .pk3 member)
+typedef struct fs_mapping_s fs_mapping_t;
+byte *FS_MapFile(const char *path, int *len, fs_mapping_t **mapping);
+void FS_UnmapFile(fs_mapping_t *mapping);
+byte *FS_MapTempFile(char *path, int *len);
+
 typedef enum {
 	FS_LOAD_NONE     = 1,
 	FS_LOAD_FILE_PAK = 2,
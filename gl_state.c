@@ -295,6 +295,7 @@ rendering_state_t* R_InitRenderingState(r_state_id id, qbool default_state, cons
 
 	// Not applied each time, kept distinct
 	state->pack_alignment = 4;
+	state->unpack_row_length = 0;
 
 	state->vao_id = vao;
 
@@ -1384,6 +1385,15 @@ void GL_PackAlignment(int alignment_in_bytes)
 	}
 }
 
+// pixels per row of the source image for texture uploads, 0 to use the upload width
+void GL_UnpackRowLength(int pixels)
+{
+	if (opengl.rendering_state.unpack_row_length != pixels) {
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, pixels);
+		opengl.rendering_state.unpack_row_length = pixels;
+	}
+}
+
 #ifdef RENDERER_OPTION_CLASSIC_OPENGL
 void GLC_MultiTexCoord2f(GLenum target, float s, float t)
 {
@@ -1749,6 +1759,7 @@ static void GL_DownloadState(rendering_state_t* state, GLuint* gl_bound2d, GLuin
 
 	// pack offset
 	glGetIntegerv(GL_PACK_ALIGNMENT, &state->pack_alignment);
+	glGetIntegerv(GL_UNPACK_ROW_LENGTH, &state->unpack_row_length);
 
 	GL_ProcessErrors("VerifyState[end-2]");
 	GLC_DownloadVAOState(state);
@@ -214,16 +214,24 @@ void GLC_BuildLightmap(int i)
 void GLC_UploadLightmap(int textureUnit, int lightmapnum)
 {
 	const lightmap_data_t* lm = &lightmaps[lightmapnum];
-	const void* data_source = lm->rawdata + (lm->change_area.t) * LIGHTMAP_WIDTH * 4;
+	const glRect_t* rect = &lm->change_area;
+	const void* data_source = lm->rawdata + (rect->t * LIGHTMAP_WIDTH + rect->l) * 4;
 	GLenum format = GL_Supported(R_SUPPORT_BGRA_LIGHTMAPS) ? GL_BGRA : GL_RGBA;
 	GLenum type = GL_Supported(R_SUPPORT_INT8888R_LIGHTMAPS) ? GL_UNSIGNED_INT_8_8_8_8_REV : GL_UNSIGNED_BYTE;
 
+	if (rect->w <= 0 || rect->h <= 0) {
+		return;
+	}
+
+	// only send the columns that changed, rows are still LIGHTMAP_WIDTH apart in rawdata
+	GL_UnpackRowLength(LIGHTMAP_WIDTH);
 	if (R_TextureReferenceIsValid(lightmap_texture_array)) {
-		GL_TexSubImage3D(textureUnit, lightmap_texture_array, 0, 0, lm->change_area.t, lightmapnum, LIGHTMAP_WIDTH, lm->change_area.h, 1, format, type, data_source);
+		GL_TexSubImage3D(textureUnit, lightmap_texture_array, 0, rect->l, rect->t, lightmapnum, rect->w, rect->h, 1, format, type, data_source);
 	}
 	else {
-		GL_TexSubImage2D(GL_TEXTURE0 + textureUnit, lm->gl_texref, 0, 0, lm->change_area.t, LIGHTMAP_WIDTH, lm->change_area.h, format, type, data_source);
+		GL_TexSubImage2D(GL_TEXTURE0 + textureUnit, lm->gl_texref, 0, rect->l, rect->t, rect->w, rect->h, format, type, data_source);
 	}
+	GL_UnpackRowLength(0);
 }
 
 #endif // #ifdef RENDERER_OPTION_CLASSIC_OPENGL
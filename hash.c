@@ -22,7 +22,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #else
 
-#include <stdio.h> // <-- only needed for Hash_BucketStats
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -33,42 +32,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #endif
 
-hashtable_t *Hash_InitTable(int numbucks)
-{
-	hashtable_t *table;
-
-	table = Q_malloc(sizeof(*table));
-
-	table->bucket = (bucket_t**)Q_calloc(numbucks, sizeof(bucket_t *));
-	table->numbuckets = numbucks;
-
-	return table;
-}
-
-void Hash_ShutdownTable(hashtable_t* table)
-{
-	int i;
-
-	if (!table) {
-		return;
-	}
-
-	for (i = 0; i < table->numbuckets; ++i) {
-		bucket_t* list = table->bucket[i];
-
-		while (list) {
-			bucket_t* next = list->next;
-			if (list->flags & HASH_BUCKET_KEYSTRING_OWNED) {
-				Q_free(list->keystring);
-			}
-			Q_free(list);
-			list = next;
-		}
-	}
-
-	Q_free(table->bucket);
-	Q_free(table);
-}
+#define HASH_MIN_BUCKETS 16
 
 /* http://www.cse.yorku.ca/~oz/hash.html
  * djb2
@@ -78,333 +42,429 @@ void Hash_ShutdownTable(hashtable_t* table)
  * it works better than many other constants, prime or not) has never been 
  * adequately explained.
  */
-int Hash_Key(char *name, int modulus) {
-	unsigned int key = 5381;
+static unsigned int Hash_String(const char *name)
+{
+	unsigned int key;
 
 	for (key = 5381; *name; name++)
 		key = ((key << 5) + key) + *name; /* key * 33 + c */
 
-	return (int) (key % modulus);
+	return key;
 }
 
-int Hash_KeyInsensitive(const char *name, int modulus) {
-	unsigned int key = 5381;
+static unsigned int Hash_StringInsensitive(const char *name)
+{
+	unsigned int key;
 
 	for (key = 5381; *name; name++)
-		key = ((key << 5) + key) + tolower(*name); /* key * 33 + c */
+		key = ((key << 5) + key) + tolower((unsigned char)*name); /* key * 33 + c */
 
-	return (int) (key % modulus);
+	return key;
+}
+
+static unsigned int Hash_Pointer(const void *key)
+{
+	uintptr_t p = (uintptr_t) key;
+
+	return (unsigned int) (p ^ (p >> 16 >> 16)); // >> 32 is undefined for 32 bit pointers
 }
 
-#if 0
 int Hash_Key(char *name, int modulus)
-{	//fixme: optimize.
-	unsigned int key;
-	for (key=0;*name; name++)
-		key += ((key<<3) + (key>>28) + *name);
-		
-	return (int)(key%modulus);
+{
+	return (int) (Hash_String(name) % modulus);
 }
-int Hash_KeyInsensitive(char *name, int modulus)
-{	//fixme: optimize.
-	unsigned int key;
-	for (key=0;*name; name++)
-	{
-		if (*name >= 'A' && *name <= 'Z')
-			key += ((key<<3) + (key>>28) + (*name-'A'+'a'));
-		else
-			key += ((key<<3) + (key>>28) + *name);
-	}
-		
-	return (int)(key%modulus);
+
+int Hash_KeyInsensitive(const char *name, int modulus)
+{
+	return (int) (Hash_StringInsensitive(name) % modulus);
 }
-#endif
 
-void *Hash_Get(hashtable_t *table, char *name)
+// djb2's low bits are weak and the table is masked, not taken modulo a prime
+static unsigned int Hash_Slot(unsigned int hash, unsigned int mask)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;
+	hash ^= hash >> 16;
+	hash *= 0x45d9f3b;
+	hash ^= hash >> 16;
 
-	buck = table->bucket[bucknum];
+	return hash & mask;
+}
 
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
+hashtable_t *Hash_InitTable(int numbucks)
+{
+	hashtable_t *table;
+	int numbuckets = HASH_MIN_BUCKETS;
+
+	while (numbuckets < numbucks)
+		numbuckets <<= 1;
+
+	table = Q_malloc(sizeof(*table));
+
+	table->bucket = (bucket_t *)Q_calloc(numbuckets, sizeof(bucket_t));
+	table->numbuckets = numbuckets;
+	table->numused = table->numdeleted = 0;
 
-		buck = buck->next;
+	return table;
+}
+
+void Hash_ShutdownTable(hashtable_t* table)
+{
+	if (!table) {
+		return;
 	}
-	return NULL;
+
+	Hash_Flush(table);
+	Q_free(table->bucket);
+	Q_free(table);
 }
 
-void *Hash_GetInsensitive(hashtable_t *table, const char *name)
+// Returns the next bucket after 'from' (or the first one if NULL) in the probe
+// sequence of 'hash' whose key matches name.
+static bucket_t *Hash_Lookup(hashtable_t *table, const char *name, unsigned int hash, qbool insensitive, bucket_t *from)
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
+	unsigned int mask = table->numbuckets - 1;
+	unsigned int i = from ? (unsigned int) ((from - table->bucket) + 1) & mask : Hash_Slot(hash, mask);
 	bucket_t *buck;
 
-	buck = table->bucket[bucknum];
+	for ( ; ; i = (i + 1) & mask) {
+		buck = &table->bucket[i];
 
-	while(buck)
-	{
-		if (!strcasecmp(name, buck->keystring))
-			return buck->data;
+		if (!buck->keystring) {
+			if (buck->flags & HASH_BUCKET_DELETED)
+				continue;
+			return NULL;
+		}
 
-		buck = buck->next;
+		if (buck->hash == hash && !(insensitive ? strcasecmp(name, buck->keystring) : STRCMP(name, buck->keystring)))
+			return buck;
 	}
-	return NULL;
 }
 
-void *Hash_GetKey(hashtable_t *table, char *key)
+static bucket_t *Hash_LookupKey(hashtable_t *table, const char *key)
 {
-	int bucknum = ((uintptr_t) key) % table->numbuckets;
+	unsigned int hash = Hash_Pointer(key);
+	unsigned int mask = table->numbuckets - 1;
+	unsigned int i;
 	bucket_t *buck;
 
-	buck = table->bucket[bucknum];
+	for (i = Hash_Slot(hash, mask); ; i = (i + 1) & mask) {
+		buck = &table->bucket[i];
 
-	while(buck)
-	{
-		if (buck->keystring == key)
-			return buck->data;
+		if (!buck->keystring) {
+			if (buck->flags & HASH_BUCKET_DELETED)
+				continue;
+			return NULL;
+		}
 
-		buck = buck->next;
+		if (buck->keystring == key)
+			return buck;
 	}
-	return NULL;
 }
 
-void *Hash_GetNext(hashtable_t *table, char *name, void *old)
+static void Hash_Place(hashtable_t *table, char *keystring, unsigned int hash, void *data, int flags)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
+	unsigned int mask = table->numbuckets - 1;
+	unsigned int i;
 	bucket_t *buck;
 
-	buck = table->bucket[bucknum];
+	for (i = Hash_Slot(hash, mask); ; i = (i + 1) & mask) {
+		buck = &table->bucket[i];
+		if (!buck->keystring)
+			break;
+	}
 
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-		{
-			if (buck->data == old)	//found the old one
-				break;
-		}
+	if (buck->flags & HASH_BUCKET_DELETED)
+		table->numdeleted--;
+
+	buck->data = data;
+	buck->keystring = keystring;
+	buck->hash = hash;
+	buck->flags = flags;
+	table->numused++;
+}
 
-		buck = buck->next;
+// Rehashes into numbuckets buckets, dropping the tombstones
+static void Hash_Resize(hashtable_t *table, int numbuckets)
+{
+	bucket_t *old = table->bucket;
+	int i, oldnum = table->numbuckets;
+
+	table->bucket = (bucket_t *)Q_calloc(numbuckets, sizeof(bucket_t));
+	table->numbuckets = numbuckets;
+	table->numused = table->numdeleted = 0;
+
+	for (i = 0; i < oldnum; i++) {
+		if (old[i].keystring)
+			Hash_Place(table, old[i].keystring, old[i].hash, old[i].data, old[i].flags);
 	}
-	if (!buck)
-		return NULL;
 
-	buck = buck->next;//don't return old
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
+	Q_free(old);
+}
 
-		buck = buck->next;
+static void *Hash_Insert(hashtable_t *table, char *keystring, unsigned int hash, void *data, int flags)
+{
+	// keep at least a quarter of the buckets empty so probes stay short and terminate
+	if ((table->numused + table->numdeleted + 1) * 4 > table->numbuckets * 3) {
+		if ((table->numused + 1) * 2 > table->numbuckets)
+			Hash_Resize(table, table->numbuckets * 2);
+		else
+			Hash_Resize(table, table->numbuckets);
 	}
-	return NULL;
+
+	Hash_Place(table, keystring, hash, data, flags);
+
+	return data;
 }
 
-void *Hash_GetNextInsensitive(hashtable_t *table, char *name, void *old)
+static void Hash_RemoveBucket(hashtable_t *table, bucket_t *buck)
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
-	bucket_t *buck;
+	bucket_t *next = &table->bucket[((buck - table->bucket) + 1) & (table->numbuckets - 1)];
 
-	buck = table->bucket[bucknum];
+	if (buck->flags & HASH_BUCKET_KEYSTRING_OWNED)
+		Q_free(buck->keystring);
 
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-		{
-			if (buck->data == old)	//found the old one
-				break;
-		}
+	buck->keystring = NULL;
+	buck->data = NULL;
+	table->numused--;
 
-		buck = buck->next;
+	// no probe sequence continues past an empty bucket, so this one can be emptied too
+	if (!next->keystring && !(next->flags & HASH_BUCKET_DELETED)) {
+		buck->flags = 0;
 	}
-	if (!buck)
-		return NULL;
+	else {
+		buck->flags = HASH_BUCKET_DELETED;
+		table->numdeleted++;
+	}
+}
 
-	buck = buck->next;//don't return old
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
+void *Hash_Get(hashtable_t *table, char *name)
+{
+	bucket_t *buck = Hash_Lookup(table, name, Hash_String(name), false, NULL);
 
-		buck = buck->next;
-	}
-	return NULL;
+	return buck ? buck->data : NULL;
 }
 
-void *Hash_Add(hashtable_t *table, char *name, void *data) 
+void *Hash_GetInsensitive(hashtable_t *table, const char *name)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
+	bucket_t *buck = Hash_Lookup(table, name, Hash_StringInsensitive(name), true, NULL);
 
-	bucket_t *buck = (bucket_t *) Q_malloc(sizeof(bucket_t));
-	char *keystring = Q_strdup(name);
+	return buck ? buck->data : NULL;
+}
 
-	buck->data = data;
-	buck->keystring = keystring;
-	buck->next = table->bucket[bucknum];
-	buck->flags = HASH_BUCKET_KEYSTRING_OWNED;
-	table->bucket[bucknum] = buck;
+void *Hash_GetKey(hashtable_t *table, char *key)
+{
+	bucket_t *buck = Hash_LookupKey(table, key);
 
-	return buck;
+	return buck ? buck->data : NULL;
 }
 
-void *Hash_AddInsensitive(hashtable_t *table, char *name, void *data) 
+static void *Hash_GetNextMatch(hashtable_t *table, const char *name, unsigned int hash, qbool insensitive, void *old)
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
+	bucket_t *buck = NULL;
+
+	while ((buck = Hash_Lookup(table, name, hash, insensitive, buck))) {
+		if (buck->data == old)	//found the old one
+			break;
+	}
+	if (!buck)
+		return NULL;
 
-	bucket_t *buck = (bucket_t *) Q_malloc(sizeof(bucket_t));
-	char *keystring = Q_strdup(name);
+	buck = Hash_Lookup(table, name, hash, insensitive, buck);//don't return old
 
-	buck->data = data;
-	buck->keystring = keystring;
-	buck->next = table->bucket[bucknum];
-	buck->flags = HASH_BUCKET_KEYSTRING_OWNED;
-	table->bucket[bucknum] = buck;
+	return buck ? buck->data : NULL;
+}
 
-	return buck;
+void *Hash_GetNext(hashtable_t *table, char *name, void *old)
+{
+	return Hash_GetNextMatch(table, name, Hash_String(name), false, old);
 }
 
-void *Hash_AddKey(hashtable_t *table, char *key, void *data, bucket_t *buck)
+void *Hash_GetNextInsensitive(hashtable_t *table, char *name, void *old)
 {
-	int bucknum = ((uintptr_t) key) % table->numbuckets;
+	return Hash_GetNextMatch(table, name, Hash_StringInsensitive(name), true, old);
+}
 
-	buck->data = data;
-	buck->keystring = key;
-	buck->next = table->bucket[bucknum];
-	table->bucket[bucknum] = buck;
+void *Hash_Add(hashtable_t *table, char *name, void *data) 
+{
+	return Hash_Insert(table, Q_strdup(name), Hash_String(name), data, HASH_BUCKET_KEYSTRING_OWNED);
+}
 
-	return buck;
+void *Hash_AddInsensitive(hashtable_t *table, char *name, void *data) 
+{
+	return Hash_Insert(table, Q_strdup(name), Hash_StringInsensitive(name), data, HASH_BUCKET_KEYSTRING_OWNED);
 }
 
-void Hash_Remove(hashtable_t *table, char *name)
+void *Hash_AddKey(hashtable_t *table, char *key, void *data)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;	
+	return Hash_Insert(table, key, Hash_Pointer(key), data, 0);
+}
 
-	buck = table->bucket[bucknum];
+void Hash_Remove(hashtable_t *table, char *name)
+{
+	bucket_t *buck = Hash_Lookup(table, name, Hash_String(name), false, NULL);
 
-	if (!STRCMP(name, buck->keystring))
-	{
-		table->bucket[bucknum] = buck->next;
-		Q_free(buck->keystring);
-		Q_free(buck);
-		return;
-	}
+	if (buck)
+		Hash_RemoveBucket(table, buck);
+}
 
+static void Hash_RemoveMatch(hashtable_t *table, const char *name, unsigned int hash, qbool insensitive, void *data)
+{
+	bucket_t *buck = NULL;
 
-	while(buck->next)
-	{
-		if (!STRCMP(name, buck->next->keystring))
-		{
-			buck->next = buck->next->next;
-			Q_free(buck->next->keystring);
-			Q_free(buck->next);
+	while ((buck = Hash_Lookup(table, name, hash, insensitive, buck))) {
+		if (buck->data == data) {
+			Hash_RemoveBucket(table, buck);
 			return;
 		}
-
-		buck = buck->next;
 	}
-	return;
 }
 
 void Hash_RemoveData(hashtable_t *table, char *name, void *data)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;	
+	Hash_RemoveMatch(table, name, Hash_String(name), false, data);
+}
 
-	buck = table->bucket[bucknum];
+void Hash_RemoveDataInsensitive(hashtable_t *table, const char *name, void *data)
+{
+	Hash_RemoveMatch(table, name, Hash_StringInsensitive(name), true, data);
+}
 
-	if (buck->data == data)
-		if (!STRCMP(name, buck->keystring))
-		{
-			table->bucket[bucknum] = buck->next;
-			Q_free(buck->keystring);
-			Q_free(buck);
-			return;
-		}
+void Hash_RemoveKey(hashtable_t *table, char *key)
+{
+	bucket_t *buck = Hash_LookupKey(table, key);
 
+	if (buck)
+		Hash_RemoveBucket(table, buck);
+}
 
-	while(buck->next)
-	{
-		if (buck->next->data == data)
-			if (!STRCMP(name, buck->next->keystring))
-			{
-				buck->next = buck->next->next;
-				Q_free(buck->next->keystring);
-				Q_free(buck->next);
-				return;
-			}
+void Hash_Flush(hashtable_t *table) 
+{
+	int i;
 
-		buck = buck->next;
+	for (i = 0; i < table->numbuckets; i++) {
+		if (table->bucket[i].flags & HASH_BUCKET_KEYSTRING_OWNED)
+			Q_free(table->bucket[i].keystring);
 	}
-	return;
-}
 
-void Hash_RemoveKey(hashtable_t *table, char *key)
-{
-	int bucknum = ((uintptr_t) key) % table->numbuckets;
-	bucket_t *buck;	
+	memset(table->bucket, 0, table->numbuckets * sizeof(bucket_t));
+	table->numused = table->numdeleted = 0;
+}
 
-	buck = table->bucket[bucknum];
+/*
+=============================================================================
+								BENCHMARK
+=============================================================================
+*/
 
-	if (buck->keystring == key)
-	{
-		table->bucket[bucknum] = buck->next;
-		Q_free(buck->keystring);
-		Q_free(buck);
-		return;
-	}
+// The separately chained layout hash.c had before, kept as the baseline
+typedef struct hash_bench_chain_s {
+	char *keystring;
+	void *data;
+	struct hash_bench_chain_s *next;
+} hash_bench_chain_t;
 
+#define HASH_BENCH_CHAINS 1024
 
-	while(buck->next)
-	{
-		if (buck->next->keystring == key)
-		{
-			buck->next = buck->next->next;
-			Q_free(buck->next->keystring);
-			Q_free(buck->next);
-			return;
-		}
+static void *Hash_BenchChainGet(hash_bench_chain_t **chains, const char *name)
+{
+	hash_bench_chain_t *buck;
 
-		buck = buck->next;
+	for (buck = chains[Hash_KeyInsensitive(name, HASH_BENCH_CHAINS)]; buck; buck = buck->next) {
+		if (!strcasecmp(name, buck->keystring))
+			return buck->data;
 	}
-	return;
+
+	return NULL;
 }
 
-void Hash_Flush(hashtable_t *table) 
+// Looks up every cvar and command name, and as many misses, in both layouts
+static void Hash_Benchmark_f(void)
 {
-	int i;
-	for (i = 0; i < table->numbuckets; i++)
-	{
-		bucket_t *bucket, *next;
-		bucket = table->bucket[i];
-		table->bucket[i] = NULL;
-		
-		while (bucket)
-		{
-			next = bucket->next;
-			Q_free(bucket->keystring);
-			Q_free(bucket);
-			bucket = next;
+	extern cmd_function_t *cmd_functions;
+	hash_bench_chain_t **chains, *buck;
+	hashtable_t *table;
+	cmd_function_t *cmd;
+	cvar_t *var;
+	char **keys, **misses;
+	int numkeys = 0, rounds, round, i, found = 0;
+	double start, chain_hit, chain_miss, open_hit, open_miss;
+
+	rounds = Cmd_Argc() > 1 ? max(1, Q_atoi(Cmd_Argv(1))) : 1000;
+
+	for (var = Cvar_Next(NULL); var; var = Cvar_Next(var))
+		numkeys++;
+	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+		numkeys++;
+
+	keys = (char **)Q_malloc(numkeys * sizeof(char *));
+	misses = (char **)Q_malloc(numkeys * sizeof(char *));
+	numkeys = 0;
+	for (var = Cvar_Next(NULL); var; var = Cvar_Next(var))
+		keys[numkeys++] = var->name;
+	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+		keys[numkeys++] = cmd->name;
+
+	chains = (hash_bench_chain_t **)Q_calloc(HASH_BENCH_CHAINS, sizeof(hash_bench_chain_t *));
+	table = Hash_InitTable(HASH_BENCH_CHAINS);
+	for (i = 0; i < numkeys; i++) {
+		int bucknum = Hash_KeyInsensitive(keys[i], HASH_BENCH_CHAINS);
+
+		buck = (hash_bench_chain_t *)Q_malloc(sizeof(hash_bench_chain_t));
+		buck->keystring = Q_strdup(keys[i]);
+		buck->data = keys[i];
+		buck->next = chains[bucknum];
+		chains[bucknum] = buck;
+
+		Hash_AddInsensitive(table, keys[i], keys[i]);
+		misses[i] = Q_strdup(va("%s_", keys[i]));
+	}
+
+	start = Sys_DoubleTime();
+	for (round = 0; round < rounds; round++)
+		for (i = 0; i < numkeys; i++)
+			found += (Hash_BenchChainGet(chains, keys[i]) != NULL);
+	chain_hit = Sys_DoubleTime() - start;
+
+	start = Sys_DoubleTime();
+	for (round = 0; round < rounds; round++)
+		for (i = 0; i < numkeys; i++)
+			found += (Hash_BenchChainGet(chains, misses[i]) != NULL);
+	chain_miss = Sys_DoubleTime() - start;
+
+	start = Sys_DoubleTime();
+	for (round = 0; round < rounds; round++)
+		for (i = 0; i < numkeys; i++)
+			found += (Hash_GetInsensitive(table, keys[i]) != NULL);
+	open_hit = Sys_DoubleTime() - start;
+
+	start = Sys_DoubleTime();
+	for (round = 0; round < rounds; round++)
+		for (i = 0; i < numkeys; i++)
+			found += (Hash_GetInsensitive(table, misses[i]) != NULL);
+	open_miss = Sys_DoubleTime() - start;
+
+	Com_Printf("%d keys x %d rounds, %d found\n", numkeys, rounds, found);
+	Com_Printf("chained:         hit %6.1f ns, miss %6.1f ns\n",
+		chain_hit * 1e9 / ((double)numkeys * rounds), chain_miss * 1e9 / ((double)numkeys * rounds));
+	Com_Printf("open addressing: hit %6.1f ns, miss %6.1f ns (%d/%d buckets used)\n",
+		open_hit * 1e9 / ((double)numkeys * rounds), open_miss * 1e9 / ((double)numkeys * rounds),
+		table->numused, table->numbuckets);
+
+	for (i = 0; i < HASH_BENCH_CHAINS; i++) {
+		while ((buck = chains[i])) {
+			chains[i] = buck->next;
+			Q_free(buck->keystring);
+			Q_free(buck);
 		}
 	}
-	return;
+	for (i = 0; i < numkeys; i++)
+		Q_free(misses[i]);
+	Q_free(chains);
+	Q_free(keys);
+	Q_free(misses);
+	Hash_ShutdownTable(table);
 }
 
-#if 0
-void Hash_BucketStats(hashtable_t *table)
+void Hash_Init(void)
 {
-	int i;
-	bucket_t *buck;	
-	int bucket_count;
-
-	for (i = 0; i < table->numbuckets; i++) {
-		bucket_count = 0;
-		for (buck = table->bucket[i]; buck; buck = buck->next) {
-			bucket_count++;
-		}
-		printf("table[%d] = %d\n", i, bucket_count);
-	}
+	Cmd_AddCommand("hash_benchmark", Hash_Benchmark_f);
 }
-#endif
@@ -23,24 +23,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define __HASH_H__
 
 #define STRCMP(s1,s2) (((*s1)!=(*s2)) || strcmp(s1+1,s2+1))	//saves about 2-6 out of 120 - expansion of idea from fastqcc
+
+// Open addressing with linear probing: the buckets are one flat array and
+// every bucket keeps the full hash of its key, so a probe only touches the
+// key string when the hashes match.
 typedef struct bucket_s {
 	void *data;
 	char *keystring;
-	struct bucket_s *next;
+	unsigned int hash;
 	int flags;
 } bucket_t;
 
 #define HASH_BUCKET_KEYSTRING_OWNED 1
+#define HASH_BUCKET_DELETED         2	// tombstone, keeps probe sequences intact
 
 typedef struct hashtable_s {
-	int numbuckets;
-	bucket_t **bucket;
+	int numbuckets;		// always a power of two
+	int numused;
+	int numdeleted;
+	bucket_t *bucket;	// bucket in use if keystring != NULL
 } hashtable_t;
 
 hashtable_t *Hash_InitTable(int numbucks);
 void Hash_ShutdownTable(hashtable_t* table);
 
 int Hash_Key(char *name, int modulus);
+int Hash_KeyInsensitive(const char *name, int modulus);
 void *Hash_Get(hashtable_t *table, char *name);
 void *Hash_GetInsensitive(hashtable_t *table, const char *name);
 void *Hash_GetKey(hashtable_t *table, char *key);
@@ -50,13 +58,11 @@ void *Hash_Add(hashtable_t *table, char *name, void *data);
 void *Hash_AddInsensitive(hashtable_t *table, char *name, void *data); 
 void Hash_Remove(hashtable_t *table, char *name);
 void Hash_RemoveData(hashtable_t *table, char *name, void *data);
+void Hash_RemoveDataInsensitive(hashtable_t *table, const char *name, void *data);
 void Hash_RemoveKey(hashtable_t *table, char *key);
-void *Hash_AddKey(hashtable_t *table, char *key, void *data, bucket_t *buck);
+void *Hash_AddKey(hashtable_t *table, char *key, void *data);
 void Hash_Flush(hashtable_t *table);
 
-#if 0
-/* Print some stats on the bucket distrubution */
-void Hash_BucketStats(hashtable_t *table);
-#endif
+void Hash_Init(void);
 
 #endif // __HASH_H__
@@ -476,6 +476,7 @@ void Host_Frame (double time)
 
 	curtime += time;
 
+	CM_TraceCacheNewFrame ();
 	CL_Frame (time);	// will also call SV_Frame
 
 	Central_ProcessResponses();
@@ -763,7 +764,7 @@ void Host_Init (int argc, char **argv, int default_memsize)
 		if (COM_CheckArgsForPlayableFiles(cmd, sizeof(cmd))) {
 			Cbuf_AddText(cmd);
 		}
-		else {
+		else if (!COM_CheckParm(cmdline_param_client_demostats)) {
 			Startup_Place();
 		}
 	}
@@ -1325,6 +1325,86 @@ void MVD_Stats_Cleanup(void)
 	fixed_ordering = 0;
 }
 
+// Snapshot of the mvd stats/itemsclock state, used by demo keyframes so
+// a rewind can restore it instead of replaying the demo from the start.
+typedef struct mvd_state_snapshot_s {
+	mvd_new_info_t new_info[MAX_CLIENTS];
+	mvd_cg_info_s  cg_info;
+	qbool          quad_is_active;
+	qbool          pent_is_active;
+	double         quad_time;
+	double         pent_time;
+	qbool          was_standby;
+	int            fixed_ordering;
+	int            clock_count;
+	mvd_clock_t    clocks[1];       // clock_count entries, in list order
+} mvd_state_snapshot_t;
+
+void* MVD_State_Save(void)
+{
+	mvd_state_snapshot_t* snapshot;
+	mvd_clock_t* current;
+	int count = 0;
+
+	for (current = mvd_clocklist; current; current = current->next) {
+		++count;
+	}
+
+	snapshot = Q_malloc(sizeof(*snapshot) + max(count - 1, 0) * sizeof(mvd_clock_t));
+	memcpy(snapshot->new_info, mvd_new_info, sizeof(snapshot->new_info));
+	memcpy(&snapshot->cg_info, &mvd_cg_info, sizeof(snapshot->cg_info));
+	snapshot->quad_is_active = quad_is_active;
+	snapshot->pent_is_active = pent_is_active;
+	snapshot->quad_time = quad_time;
+	snapshot->pent_time = pent_time;
+	snapshot->was_standby = was_standby;
+	snapshot->fixed_ordering = fixed_ordering;
+	snapshot->clock_count = count;
+
+	count = 0;
+	for (current = mvd_clocklist; current; current = current->next) {
+		snapshot->clocks[count++] = *current;
+	}
+
+	return snapshot;
+}
+
+void MVD_State_Restore(const void* state)
+{
+	const mvd_state_snapshot_t* snapshot = (const mvd_state_snapshot_t*)state;
+	mvd_clock_t* last = NULL;
+	int i;
+
+	while (mvd_clocklist) {
+		MVD_ClockList_Remove(mvd_clocklist);
+	}
+
+	memcpy(mvd_new_info, snapshot->new_info, sizeof(mvd_new_info));
+	memcpy(&mvd_cg_info, &snapshot->cg_info, sizeof(mvd_cg_info));
+	quad_is_active = snapshot->quad_is_active;
+	pent_is_active = snapshot->pent_is_active;
+	quad_time = snapshot->quad_time;
+	pent_time = snapshot->pent_time;
+	was_standby = snapshot->was_standby;
+	fixed_ordering = snapshot->fixed_ordering;
+
+	// List was saved in order, so just link the copies back up
+	for (i = 0; i < snapshot->clock_count; ++i) {
+		mvd_clock_t* clock = (mvd_clock_t*)Q_malloc(sizeof(mvd_clock_t));
+
+		*clock = snapshot->clocks[i];
+		clock->prev = last;
+		clock->next = NULL;
+		if (last) {
+			last->next = clock;
+		}
+		else {
+			mvd_clocklist = clock;
+		}
+		last = clock;
+	}
+}
+
 void MVD_Set_Armor_Stats(int z, int i) {
 	switch (z) {
 	case GA_INFO:
@@ -37,6 +37,14 @@ void MVD_Init_Info(int player_slot);
 void MVD_GameStart(void);
 void MVD_Initialise(void);
 
+// snapshot/restore of stats & itemsclock state (demo keyframes), free with Q_free()
+void* MVD_State_Save(void);
+void MVD_State_Restore(const void* state);
+
+// flat per-demo stats export (demo_stats), JSON lines or CSV rows
+void MVD_Stats_ExportHeader(FILE *f, qbool csv);
+void MVD_Stats_Export(FILE *f, const char *demoname, double duration, qbool csv);
+
 // //ktx event notifications
 void MVDAnnouncer_MatchStart(void);
 void MVDAnnouncer_ItemTaken(const char* s);
@@ -24,6 +24,8 @@ $Id: mvd_xmlstats.c,v 1.1 2007-09-24 21:34:52 johnnycz Exp $
 
 #include "quakedef.h"
 #include "mvd_utils_common.h"
+#include "mvd_utils.h"
+#include "teamplay.h"
 
 static char *mvd_name_to_xml(char *s){
 	static char buf[1024];
@@ -276,6 +278,174 @@ static void MVD_Status_Xml (void){
 	fclose(f);
 }
 
+//
+// Flat per-demo stats for batch analysis (demo_stats), one JSON object per
+// line or one CSV row per player.
+//
+
+static void mvd_s_string(FILE *f, const char *s, qbool csv)
+{
+	char buf[1024];
+	unsigned char *p;
+
+	strlcpy(buf, s ? s : "", sizeof(buf));
+	Q_normalizetext(buf);
+
+	fputc('"', f);
+	for (p = (unsigned char *)buf; *p; p++) {
+		if (*p == '"') {
+			fputs(csv ? "\"\"" : "\\\"", f);
+		}
+		else if (*p == '\\' && !csv) {
+			fputs("\\\\", f);
+		}
+		else if (*p < 32 || *p >= 127) {
+			if (!csv) {
+				fprintf(f, "\\u%04x", *p);
+			}
+		}
+		else {
+			fputc(*p, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static const char *mvd_s_gametype(void)
+{
+	if (!cls.mvdplayback || !mvd_cg_info.pcount || mvd_cg_info.gametype < 0 || mvd_cg_info.gametype >= mvd_gt_types) {
+		return "";
+	}
+	return mvd_gt_info[mvd_cg_info.gametype].name;
+}
+
+void MVD_Stats_ExportHeader(FILE *f, qbool csv)
+{
+	int x;
+
+	if (!csv) {
+		return;
+	}
+
+	fprintf(f, "demo,map,gametype,hostname,duration,name,team,frags,deaths,spawnfrags,teamspawnfrags");
+	for (x = AXE_INFO; x <= LG_INFO; x++) {
+		fprintf(f, ",kills_%s", mvd_wp_info[x].name);
+	}
+	for (x = AXE_INFO; x <= LG_INFO; x++) {
+		fprintf(f, ",teamkills_%s", mvd_wp_info[x].name);
+	}
+	for (x = SSG_INFO; x <= MH_INFO; x++) {
+		fprintf(f, ",took_%s", mvd_wp_info[x].name);
+	}
+	for (x = SSG_INFO; x <= MH_INFO; x++) {
+		fprintf(f, ",lost_%s", mvd_wp_info[x].name);
+	}
+	fprintf(f, "\n");
+}
+
+static void mvd_s_csv_player(FILE *f, const char *demoname, double duration, player_info_t *player, mvd_new_info_t *stats)
+{
+	int x;
+
+	mvd_s_string(f, demoname, true);
+	fputc(',', f);
+	mvd_s_string(f, TP_MapName(), true);
+	fprintf(f, ",%s,", mvd_s_gametype());
+	mvd_s_string(f, cls.mvdplayback ? mvd_cg_info.hostname : "", true);
+	fprintf(f, ",%.3f,", duration);
+	mvd_s_string(f, player->name, true);
+	fputc(',', f);
+	mvd_s_string(f, player->team, true);
+	fprintf(f, ",%d,%d,%d,%d", player->frags, stats ? stats->mvdinfo.das.deathcount : 0,
+		stats ? stats->mvdinfo.spawntelefrags : 0, stats ? stats->mvdinfo.teamspawntelefrags : 0);
+	for (x = AXE_INFO; x <= LG_INFO; x++) {
+		fprintf(f, ",%d", stats ? stats->mvdinfo.killstats.normal[x].kills : 0);
+	}
+	for (x = AXE_INFO; x <= LG_INFO; x++) {
+		fprintf(f, ",%d", stats ? stats->mvdinfo.killstats.normal[x].teamkills : 0);
+	}
+	for (x = SSG_INFO; x <= MH_INFO; x++) {
+		fprintf(f, ",%d", stats ? stats->mvdinfo.itemstats[x].count : 0);
+	}
+	for (x = SSG_INFO; x <= MH_INFO; x++) {
+		fprintf(f, ",%d", stats ? stats->mvdinfo.itemstats[x].lost : 0);
+	}
+	fprintf(f, "\n");
+}
+
+static void mvd_s_json_player(FILE *f, player_info_t *player, mvd_new_info_t *stats)
+{
+	int x;
+
+	fprintf(f, "{\"name\":");
+	mvd_s_string(f, player->name, false);
+	fprintf(f, ",\"team\":");
+	mvd_s_string(f, player->team, false);
+	fprintf(f, ",\"frags\":%d", player->frags);
+	if (stats) {
+		fprintf(f, ",\"deaths\":%d,\"spawnfrags\":%d,\"teamspawnfrags\":%d", stats->mvdinfo.das.deathcount,
+			stats->mvdinfo.spawntelefrags, stats->mvdinfo.teamspawntelefrags);
+		fprintf(f, ",\"kills\":{");
+		for (x = AXE_INFO; x <= LG_INFO; x++) {
+			fprintf(f, "%s\"%s\":%d", x == AXE_INFO ? "" : ",", mvd_wp_info[x].name, stats->mvdinfo.killstats.normal[x].kills);
+		}
+		fprintf(f, "},\"teamkills\":{");
+		for (x = AXE_INFO; x <= LG_INFO; x++) {
+			fprintf(f, "%s\"%s\":%d", x == AXE_INFO ? "" : ",", mvd_wp_info[x].name, stats->mvdinfo.killstats.normal[x].teamkills);
+		}
+		fprintf(f, "},\"took\":{");
+		for (x = SSG_INFO; x <= MH_INFO; x++) {
+			fprintf(f, "%s\"%s\":%d", x == SSG_INFO ? "" : ",", mvd_wp_info[x].name, stats->mvdinfo.itemstats[x].count);
+		}
+		fprintf(f, "},\"lost\":{");
+		for (x = SSG_INFO; x <= MH_INFO; x++) {
+			fprintf(f, "%s\"%s\":%d", x == SSG_INFO ? "" : ",", mvd_wp_info[x].name, stats->mvdinfo.itemstats[x].lost);
+		}
+		fprintf(f, "}");
+	}
+	fprintf(f, "}");
+}
+
+void MVD_Stats_Export(FILE *f, const char *demoname, double duration, qbool csv)
+{
+	int i, players = 0;
+
+	if (!csv) {
+		fprintf(f, "{\"demo\":");
+		mvd_s_string(f, demoname, false);
+		fprintf(f, ",\"map\":");
+		mvd_s_string(f, TP_MapName(), false);
+		fprintf(f, ",\"mvd\":%s,\"gametype\":\"%s\",\"hostname\":", cls.mvdplayback ? "true" : "false", mvd_s_gametype());
+		mvd_s_string(f, cls.mvdplayback ? mvd_cg_info.hostname : "", false);
+		fprintf(f, ",\"duration\":%.3f,\"players\":[", duration);
+	}
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		player_info_t *player = &cl.players[i];
+		mvd_new_info_t *stats;
+
+		if (!player->name[0] || player->spectator) {
+			continue;
+		}
+
+		stats = (cls.mvdplayback ? MVD_StatsForPlayer(player) : NULL);
+		if (csv) {
+			mvd_s_csv_player(f, demoname, duration, player, stats);
+		}
+		else {
+			if (players) {
+				fputc(',', f);
+			}
+			mvd_s_json_player(f, player, stats);
+		}
+		players++;
+	}
+
+	if (!csv) {
+		fprintf(f, "]}\n");
+	}
+}
+
 void MVD_XMLStats_Init(void)
 {
 	Cmd_AddCommand ("mvd_dumpstats",MVD_Status_Xml);
@@ -20,6 +20,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // net.c
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg/sendmmsg
+#endif
+
 #ifdef SERVERONLY
 #include "qwsvdef.h"
 #else
@@ -56,6 +60,11 @@ netadr_t	net_local_sv_ipadr;
 netadr_t	net_local_sv_tcpipadr;
 
 cvar_t		sv_local_addr = {"sv_local_addr", "", CVAR_ROM};
+
+#ifdef __linux__
+#define NET_UDP_BATCH
+cvar_t		sv_udp_batch = {"sv_udp_batch", "1"};
+#endif
 #endif
 
 netadr_t	net_from;
@@ -67,6 +76,12 @@ static byte net_message_buffer[MSG_BUF_SIZE];
 qbool NET_GetPacketEx (netsrc_t netsrc, qbool delay);
 void NET_SendPacketEx (netsrc_t netsrc, int length, void *data, netadr_t to, qbool delay);
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define NET_EPOLL
+static int net_epollfd = -1;
+#endif
+
 #ifdef SERVERONLY
 #define TCP_LISTEN_BACKLOG 2
 #else
@@ -480,6 +495,94 @@ void NET_ClearLoopback (void)
 // SV TCP connection.
 //
 
+//=============================================================================
+//
+// Socket readiness.
+// Server TCP connections and QTV streams are registered edge triggered, so
+// idle ones are not recv()/send() to every frame.
+//
+
+void NET_PollAdd (netpoll_t *p, int socket)
+{
+#ifdef NET_EPOLL
+	struct epoll_event ev;
+#endif
+
+	p->readable = p->writable = true;
+	p->registered = false;
+
+#ifdef NET_EPOLL
+	if (socket == INVALID_SOCKET)
+		return;
+
+	if (net_epollfd == -1)
+	{
+		net_epollfd = epoll_create1 (EPOLL_CLOEXEC);
+		if (net_epollfd == -1)
+		{
+			Con_Printf ("NET_PollAdd: epoll_create1: (%i): %s\n", qerrno, strerror(qerrno));
+			net_epollfd = -2; // do not try again
+		}
+	}
+
+	if (net_epollfd < 0)
+		return;
+
+	memset (&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.ptr = p;
+
+	if (epoll_ctl (net_epollfd, EPOLL_CTL_ADD, socket, &ev) == -1
+		&& (qerrno != EEXIST || epoll_ctl (net_epollfd, EPOLL_CTL_MOD, socket, &ev) == -1))
+	{
+		Con_DPrintf ("NET_PollAdd: epoll_ctl: (%i): %s\n", qerrno, strerror(qerrno));
+		return;
+	}
+
+	p->registered = true;
+#endif
+}
+
+void NET_PollBlocked (netpoll_t *p, qbool write)
+{
+	if (!p->registered)
+		return;
+
+	if (write)
+		p->writable = false;
+	else
+		p->readable = false;
+}
+
+void NET_PollEvents (void)
+{
+#ifdef NET_EPOLL
+	struct epoll_event ev[64];
+	netpoll_t *p;
+	int i, count;
+
+	if (net_epollfd < 0)
+		return;
+
+	do
+	{
+		count = epoll_wait (net_epollfd, ev, sizeof(ev) / sizeof(ev[0]), 0);
+
+		for (i = 0; i < count; i++)
+		{
+			p = (netpoll_t *) ev[i].data.ptr;
+
+			if (ev[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+				p->readable = true;
+			if (ev[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+				p->writable = true;
+		}
+	} while (count == sizeof(ev) / sizeof(ev[0]));
+#endif
+}
+
+//=============================================================================
+
 // allocate, may link it in, if requested
 svtcpstream_t *sv_tcp_connection_new(int sock, netadr_t from, char *buf, int buf_len, qbool link)
 {
@@ -489,6 +592,7 @@ svtcpstream_t *sv_tcp_connection_new(int sock, netadr_t from, char *buf, int buf
 	st->waitingforprotocolconfirmation = true;
 	st->socketnum = sock;
 	st->remoteaddr = from;
+	NET_PollAdd (&st->poll, sock);
 	if (buf_len > 0 && buf_len < sizeof(st->inbuffer))
 	{
 		memmove(st->inbuffer, buf, buf_len);
@@ -555,10 +659,187 @@ int sv_tcp_connection_count(void)
 #endif
 
 //=============================================================================
+//
+// Batched UDP I/O for the server socket.
+// Incoming datagrams are drained NET_UDP_BATCH_RECV at a time with recvmmsg(),
+// outgoing ones are queued and sent with sendmmsg() by NET_FlushServerPackets().
+//
+
+#ifdef NET_UDP_BATCH
+
+#define NET_UDP_BATCH_RECV	32
+#define NET_UDP_BATCH_SEND	64
+#define NET_UDP_BATCH_POOL	(64 * 1024)
+
+typedef struct {
+	struct mmsghdr			hdr[NET_UDP_BATCH_RECV];
+	struct iovec			iov[NET_UDP_BATCH_RECV];
+	struct sockaddr_storage	addr[NET_UDP_BATCH_RECV];
+	byte					data[NET_UDP_BATCH_RECV][MSG_BUF_SIZE];
+	int						count, next;
+} udp_recvbatch_t;
+
+typedef struct {
+	struct mmsghdr			hdr[NET_UDP_BATCH_SEND];
+	struct iovec			iov[NET_UDP_BATCH_SEND];
+	struct sockaddr_storage	addr[NET_UDP_BATCH_SEND];
+	byte					pool[NET_UDP_BATCH_POOL];
+	int						count, poolused;
+} udp_sendbatch_t;
+
+static udp_recvbatch_t udp_recvbatch;
+static udp_sendbatch_t udp_sendbatch;
+
+#endif
+
+static void NET_UDPRecvError (int err, const netadr_t *from_adr)
+{
+	if (err == EWOULDBLOCK)
+		return; // common error, does not spam in logs.
+
+	if (err == EMSGSIZE)
+	{
+		Con_DPrintf ("Warning: Oversize packet from %s\n", NET_AdrToString (*from_adr));
+		return;
+	}
+
+	if (err == ECONNABORTED || err == ECONNRESET)
+	{
+		Con_DPrintf ("Connection lost or aborted\n");
+		return;
+	}
+
+	Con_Printf ("NET_GetPacket: recvfrom: (%i): %s\n", err, strerror(err));
+}
+
+static void NET_UDPSendError (int err, int socket)
+{
+	if (err == EWOULDBLOCK || err == ECONNREFUSED || err == EADDRNOTAVAIL)
+		; // nothing
+	else
+		Con_Printf ("NET_SendPacket: sendto: (%i): %s %i\n", err, strerror(err), socket);
+}
+
+#ifdef NET_UDP_BATCH
+static qbool NET_GetUDPPacketBatch (int socket, netadr_t *from_adr, sizebuf_t *message)
+{
+	udp_recvbatch_t *b = &udp_recvbatch;
+	int i, ret;
+
+	for (;;)
+	{
+		if (b->next >= b->count)
+		{
+			b->count = b->next = 0;
+
+			for (i = 0; i < NET_UDP_BATCH_RECV; i++)
+			{
+				memset (&b->hdr[i], 0, sizeof(b->hdr[i]));
+				b->iov[i].iov_base = b->data[i];
+				b->iov[i].iov_len = sizeof(b->data[i]);
+				b->hdr[i].msg_hdr.msg_name = &b->addr[i];
+				b->hdr[i].msg_hdr.msg_namelen = sizeof(b->addr[i]);
+				b->hdr[i].msg_hdr.msg_iov = &b->iov[i];
+				b->hdr[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			ret = recvmmsg (socket, b->hdr, NET_UDP_BATCH_RECV, MSG_DONTWAIT, NULL);
+			if (ret <= 0)
+			{
+				if (ret == -1)
+				{
+					memset (from_adr, 0, sizeof(*from_adr));
+					NET_UDPRecvError (qerrno, from_adr);
+				}
+				return false;
+			}
+
+			b->count = ret;
+		}
+
+		i = b->next++;
+		SockadrToNetadr (&b->addr[i], from_adr);
+
+		if (b->hdr[i].msg_len >= message->maxsize || (b->hdr[i].msg_hdr.msg_flags & MSG_TRUNC))
+		{
+			Con_Printf ("Oversize packet from %s\n", NET_AdrToString (*from_adr));
+			continue;
+		}
+
+		memcpy (message->data, b->data[i], b->hdr[i].msg_len);
+		message->cursize = b->hdr[i].msg_len;
+
+		return true;
+	}
+}
+
+static void NET_FlushUDPBatch (int socket)
+{
+	udp_sendbatch_t *b = &udp_sendbatch;
+	int sent = 0, ret;
+
+	while (sent < b->count)
+	{
+		ret = sendmmsg (socket, b->hdr + sent, b->count - sent, 0);
+		if (ret <= 0)
+		{
+			// sendmmsg stops at the first failing datagram, drop it like sendto would
+			NET_UDPSendError (qerrno, socket);
+			sent++;
+		}
+		else
+		{
+			sent += ret;
+		}
+	}
+
+	b->count = b->poolused = 0;
+}
+
+static qbool NET_SendUDPPacketBatch (int socket, int length, void *data, netadr_t to)
+{
+	udp_sendbatch_t *b = &udp_sendbatch;
+	int i;
+
+	if (length > sizeof(b->pool))
+		return false;
+
+	if (b->count == NET_UDP_BATCH_SEND || b->poolused + length > sizeof(b->pool))
+		NET_FlushUDPBatch (socket);
+
+	i = b->count++;
+	NetadrToSockadr (&to, &b->addr[i]);
+	memcpy (b->pool + b->poolused, data, length);
+
+	memset (&b->hdr[i], 0, sizeof(b->hdr[i]));
+	b->iov[i].iov_base = b->pool + b->poolused;
+	b->iov[i].iov_len = length;
+	b->hdr[i].msg_hdr.msg_name = &b->addr[i];
+	b->hdr[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	b->hdr[i].msg_hdr.msg_iov = &b->iov[i];
+	b->hdr[i].msg_hdr.msg_iovlen = 1;
+
+	b->poolused += length;
+
+	return true;
+}
+#endif
+
+#ifndef CLIENTONLY
+// Sends the server datagrams queued during this frame.
+void NET_FlushServerPackets (void)
+{
+#ifdef NET_UDP_BATCH
+	if (udp_sendbatch.count && svs.socketip != INVALID_SOCKET)
+		NET_FlushUDPBatch (svs.socketip);
+	udp_sendbatch.count = udp_sendbatch.poolused = 0;
+#endif
+}
+#endif
 
 qbool NET_GetUDPPacket (netsrc_t netsrc, netadr_t *from_adr, sizebuf_t *message)
 {
-	int ret, err;
+	int ret;
 	struct sockaddr_storage from = {0};
 	socklen_t fromlen;
 	int socket = NET_GetSocket(netsrc, false);
@@ -566,30 +847,18 @@ qbool NET_GetUDPPacket (netsrc_t netsrc, netadr_t *from_adr, sizebuf_t *message)
 	if (socket == INVALID_SOCKET)
 		return false;
 
+#ifdef NET_UDP_BATCH
+	if (netsrc == NS_SERVER && (sv_udp_batch.integer || udp_recvbatch.next < udp_recvbatch.count))
+		return NET_GetUDPPacketBatch (socket, from_adr, message);
+#endif
+
 	fromlen = sizeof(from);
 	ret = recvfrom (socket, (char *)message->data, message->maxsize, 0, (struct sockaddr *)&from, &fromlen);
 	SockadrToNetadr (&from, from_adr);
 
 	if (ret == -1)
 	{
-		err = qerrno;
-
-		if (err == EWOULDBLOCK)
-			return false; // common error, does not spam in logs.
-
-		if (err == EMSGSIZE)
-		{
-			Con_DPrintf ("Warning: Oversize packet from %s\n", NET_AdrToString (*from_adr));
-			return false;
-		}
-
-		if (err == ECONNABORTED || err == ECONNRESET)
-		{
-			Con_DPrintf ("Connection lost or aborted\n");
-			return false;
-		}
-
-		Con_Printf ("NET_GetPacket: recvfrom: (%i): %s\n", err, strerror(err));
+		NET_UDPRecvError (qerrno, from_adr);
 		return false;
 	}
 
@@ -703,8 +972,11 @@ qbool NET_GetTCPPacket_SV (netsrc_t netsrc, netadr_t *from, sizebuf_t *message)
 			continue;
 		}
 
-		ret = recv(st->socketnum, st->inbuffer+st->inlen, sizeof(st->inbuffer)-st->inlen, 0);
-		if (ret == 0)
+		if (!st->poll.readable)
+		{
+			ret = 0; // nothing arrived since recv() would block
+		}
+		else if ((ret = recv(st->socketnum, st->inbuffer+st->inlen, sizeof(st->inbuffer)-st->inlen, 0)) == 0)
 		{
 			// connection closed
 			st->drop = true;
@@ -716,6 +988,7 @@ qbool NET_GetTCPPacket_SV (netsrc_t netsrc, netadr_t *from, sizebuf_t *message)
 
 			if (err == EWOULDBLOCK)
 			{
+				NET_PollBlocked (&st->poll, false);
 				ret = 0; // it's OK
 			}
 			else
@@ -892,6 +1165,9 @@ qbool NET_SendTCPPacket_SV (netsrc_t netsrc, int length, void *data, netadr_t to
 			memmove(st->outbuffer + st->outlen, data, length);
 			st->outlen += length;
 
+			if (!st->poll.writable)
+				break; // keep it buffered until the socket drains
+
 			sent = send(st->socketnum, st->outbuffer, st->outlen, 0);
 
 			if (sent == 0)
@@ -909,6 +1185,10 @@ qbool NET_SendTCPPacket_SV (netsrc_t netsrc, int length, void *data, netadr_t to
 				{
 					st->drop = true; // something cricial, drop than
 				}
+				else
+				{
+					NET_PollBlocked (&st->poll, true);
+				}
 			}
 
 			break;
@@ -931,18 +1211,16 @@ qbool NET_SendUDPPacket (netsrc_t netsrc, int length, void *data, netadr_t to)
 	if (socket == INVALID_SOCKET)
 		return false;
 
+#ifdef NET_UDP_BATCH
+	if (netsrc == NS_SERVER && sv_udp_batch.integer && NET_SendUDPPacketBatch (socket, length, data, to))
+		return true;
+#endif
+
 	NetadrToSockadr (&to, &addr);
 
 	ret = sendto (socket, data, length, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
 	if (ret == -1)
-	{
-		int err = qerrno;
-
-		if (err == EWOULDBLOCK || err == ECONNREFUSED || err == EADDRNOTAVAIL)
-			; // nothing
-		else
-			Con_Printf ("NET_SendPacket: sendto: (%i): %s %i\n", err, strerror(err), socket);
-	}
+		NET_UDPSendError (qerrno, socket);
 
 	return true;
 }
@@ -1286,6 +1564,13 @@ qbool NET_Sleep(int msec, qbool stdinissocket)
 	}
 #endif
 
+#ifdef NET_EPOLL
+	if (net_epollfd >= 0) {
+		FD_SET(net_epollfd, &fdset); // readable when a TCP connection has events
+		maxfd = max(net_epollfd, maxfd);
+	}
+#endif
+
 	timeout.tv_sec = msec/1000;
 	timeout.tv_usec = (msec%1000)*1000;
 	switch (select(maxfd + 1, &fdset, NULL, NULL, &timeout))
@@ -1368,6 +1653,9 @@ void NET_Init (void)
 
 #ifndef CLIENTONLY
 	Cvar_Register (&sv_local_addr);
+#ifdef NET_UDP_BATCH
+	Cvar_Register (&sv_udp_batch);
+#endif
 
 	svs.socketip = INVALID_SOCKET;
 // TCPCONNECT -->
@@ -1392,6 +1680,12 @@ void NET_Shutdown (void)
 	NET_CloseClient();
 #endif
 
+#ifdef NET_EPOLL
+	if (net_epollfd >= 0)
+		closesocket(net_epollfd);
+	net_epollfd = -1;
+#endif
+
 #ifdef _WIN32
 	WSACleanup ();
 #endif
@@ -1561,6 +1855,7 @@ void NET_InitServer_TCP(unsigned short int port)
 
 		if (svs.sockettcp != INVALID_SOCKET)
 		{
+			NET_PollAdd (&svs.sockettcp_poll, svs.sockettcp);
 			// get local address.
 			NET_GetLocalAddress (svs.sockettcp, &net_local_sv_tcpipadr);
 			Con_Printf("Opening server TCP port %u\n", (unsigned int)port);
@@ -1612,11 +1907,17 @@ void NET_InitServer (void)
 
 void NET_CloseServer (void)
 {
+	NET_FlushServerPackets();
+
 	if (svs.socketip != INVALID_SOCKET) {
 		closesocket(svs.socketip);
 		svs.socketip = INVALID_SOCKET;
 	}
 
+#ifdef NET_UDP_BATCH
+	udp_recvbatch.count = udp_recvbatch.next = 0;
+#endif
+
 	net_local_sv_ipadr.type = NA_LOOPBACK; // FIXME: why not NA_INVALID?
 
 // TCPCONNECT -->
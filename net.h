@@ -183,6 +183,8 @@ void	NET_Shutdown (void);
 void	NET_InitClient (void);
 void	NET_InitServer (void);
 void	NET_CloseServer (void);
+// send the server UDP datagrams queued by the batched send path.
+void	NET_FlushServerPackets (void);
 qbool	NET_GetPacket (netsrc_t sock);
 void	NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to);
 
@@ -200,6 +202,21 @@ int		NET_GetSocket(netsrc_t netsrc, qbool tcp);
 // open server TCP socket.
 void	NET_InitServer_TCP(unsigned short int port);
 
+// readiness of a non blocking TCP socket, kept up to date by NET_PollEvents().
+// without epoll (or if registering failed) a socket is always considered ready.
+typedef struct netpoll_s {
+	qbool	readable;		// recv() until it would block
+	qbool	writable;		// send() until it would block
+	qbool	registered;		// readiness is reported by epoll
+} netpoll_t;
+
+// start watching socket, also used to hand a socket over to a new owner.
+void	NET_PollAdd (netpoll_t *p, int socket);
+// recv() or send() would block, wait for the next event.
+void	NET_PollBlocked (netpoll_t *p, qbool write);
+// collect socket events without waiting.
+void	NET_PollEvents (void);
+
 // UTILITY: set KEEPALIVE option on TCP socket (useful for faster timeout detection).
 qbool 	TCP_Set_KEEPALIVE(int sock);
 // UTILITY: open TCP socket for remove address (useful for client connection).
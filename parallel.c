@@ -0,0 +1,194 @@
+/*
+Copyright (C) 2021 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+// parallel.c -- SIMD kernel selection and worker threads
+
+#include <SDL.h>
+#include "quakedef.h"
+#include "parallel.h"
+
+/*
+===============================================================================
+SIMD KERNELS
+===============================================================================
+*/
+
+// true if the CPU can run kernel
+qbool SIMD_Supported(const simd_kernel_t *kernel)
+{
+	int cpu = 0;
+
+#ifdef SIMD_AVX2
+	if (SDL_HasAVX2() == SDL_TRUE)
+		cpu |= SIMD_CPU_AVX2;
+#endif
+
+	return (kernel->cpu & cpu) == kernel->cpu;
+}
+
+// returns the last entry of the table the CPU can run, size is that of an entry
+const void *SIMD_SelectKernel(const void *table, size_t size, int count)
+{
+	const simd_kernel_t *kernel;
+	int i;
+
+	for (i = count - 1; i > 0; i--) {
+		kernel = (const simd_kernel_t *) ((const byte *) table + i * size);
+		if (SIMD_Supported(kernel))
+			return kernel;
+	}
+
+	return table;
+}
+
+/*
+===============================================================================
+WORKER THREADS
+===============================================================================
+*/
+
+typedef struct worker_s {
+	SDL_Thread *thread;
+	SDL_sem *start;
+	SDL_sem *done;
+	struct workers_s *workers;
+	int index;
+	void *local;
+} worker_t;
+
+struct workers_s {
+	worker_func_t func;
+	int requested;			// count it was started for, bounded
+	int count;				// threads actually running
+	qbool quit;
+	worker_t worker[MAX_WORKERS];
+};
+
+static int Workers_Thread(void *data)
+{
+	worker_t *worker = (worker_t *) data;
+
+	while (true) {
+		SDL_SemWait(worker->start);
+		if (worker->workers->quit)
+			break;
+
+		worker->workers->func(worker->index, worker->local);
+		SDL_SemPost(worker->done);
+	}
+
+	return 0;
+}
+
+static void Workers_Free(worker_t *worker)
+{
+	if (worker->start)
+		SDL_DestroySemaphore(worker->start);
+	if (worker->done)
+		SDL_DestroySemaphore(worker->done);
+	Q_free(worker->local);
+}
+
+// NULL if count is 0, if threads can't be started fewer run
+workers_t *Workers_Start(const char *name, int count, worker_func_t func, size_t localsize)
+{
+	workers_t *workers;
+	worker_t *worker;
+
+	count = bound(0, count, MAX_WORKERS);
+	if (!count)
+		return NULL;
+
+	workers = (workers_t *) Q_calloc(1, sizeof(*workers));
+	workers->func = func;
+	workers->requested = count;
+
+	while (workers->count < count) {
+		worker = &workers->worker[workers->count];
+		worker->workers = workers;
+		worker->index = workers->count + 1;	// the caller is 0
+		worker->local = Q_malloc(localsize);
+		worker->start = SDL_CreateSemaphore(0);
+		worker->done = SDL_CreateSemaphore(0);
+		if (worker->start && worker->done)
+			worker->thread = SDL_CreateThread(Workers_Thread, name, worker);
+
+		if (!worker->thread) {
+			Com_Printf("Couldn't start %s thread: %s\n", name, SDL_GetError());
+			Workers_Free(worker);
+			break;
+		}
+		workers->count++;
+	}
+
+	return workers;
+}
+
+// must not be running
+void Workers_Stop(workers_t *workers)
+{
+	int i;
+
+	if (!workers)
+		return;
+
+	workers->quit = true;
+	for (i = 0; i < workers->count; i++)
+		SDL_SemPost(workers->worker[i].start);
+
+	for (i = 0; i < workers->count; i++) {
+		SDL_WaitThread(workers->worker[i].thread, NULL);
+		Workers_Free(&workers->worker[i]);
+	}
+
+	Q_free(workers);
+}
+
+// true if workers wasn't started for count threads
+qbool Workers_Changed(const workers_t *workers, int count)
+{
+	return bound(0, count, MAX_WORKERS) != (workers ? workers->requested : 0);
+}
+
+int Workers_Count(const workers_t *workers)
+{
+	return workers ? workers->count : 0;
+}
+
+void *Workers_Local(const workers_t *workers, int index)
+{
+	return workers->worker[index - 1].local;
+}
+
+// wakes the first count threads
+void Workers_Run(workers_t *workers, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		SDL_SemPost(workers->worker[i].start);
+}
+
+// waits for the threads Workers_Run woke
+void Workers_Wait(workers_t *workers, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		SDL_SemWait(workers->worker[i].done);
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2021 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+// parallel.h -- SIMD kernel selection and worker threads, for the sound mixer and lightmaps
+
+#ifndef EZQUAKE_PARALLEL_HEADER
+#define EZQUAKE_PARALLEL_HEADER
+
+// instruction sets kernels can be written for, SSE2 and NEON are always
+// there when they build, AVX2 has to be checked for at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_SSE2
+#define SIMD_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET(x) __attribute__((target(x)))
+#else
+#define SIMD_TARGET(x)
+#endif
+
+#define SIMD_CPU_AVX2	1
+
+// every kernel set starts with this, tables are ordered slowest first
+// and their first entry is plain C
+typedef struct simd_kernel_s {
+	const char *name;
+	int cpu;			// SIMD_CPU_ flags it needs
+} simd_kernel_t;
+
+qbool SIMD_Supported(const simd_kernel_t *kernel);
+const void *SIMD_SelectKernel(const void *table, size_t size, int count);
+
+// Worker threads sleep until Workers_Run wakes them, then call func with
+// their index (1 up, the calling thread being 0) and private memory of the
+// size asked for.  Only one thread may drive a set at a time.
+#define MAX_WORKERS 8
+
+typedef struct workers_s workers_t;
+typedef void (*worker_func_t)(int index, void *local);
+
+workers_t *Workers_Start(const char *name, int count, worker_func_t func, size_t localsize);
+void Workers_Stop(workers_t *workers);
+qbool Workers_Changed(const workers_t *workers, int count);
+int Workers_Count(const workers_t *workers);
+void *Workers_Local(const workers_t *workers, int index);
+void Workers_Run(workers_t *workers, int count);
+void Workers_Wait(workers_t *workers, int count);
+
+#endif // EZQUAKE_PARALLEL_HEADER
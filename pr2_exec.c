@@ -39,6 +39,9 @@ cvar_t sv_pr2references = {"sv_pr2references", "0"};
 #ifdef QVM_PROFILE
 extern cvar_t sv_enableprofile;
 #endif
+#ifdef QVM_JIT
+extern cvar_t sv_enablejit;
+#endif
 //int usedll;
 
 void ED2_PrintEdicts (void);
@@ -58,6 +61,9 @@ void PR2_Init(void)
 #ifdef QVM_PROFILE
 	Cvar_Register(&sv_enableprofile);
 #endif
+#ifdef QVM_JIT
+	Cvar_Register(&sv_enablejit);
+#endif
 
 	p = SV_CommandLineProgTypeArgument();
 
@@ -31,6 +31,14 @@
 #ifdef USE_PR2
 
 #include "qwsvdef.h"
+#ifdef QVM_JIT
+#include <stddef.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef QVM_JIT
+cvar_t	sv_enablejit = {"sv_enablejit","0"};
+#endif
 
 #ifdef QVM_PROFILE
 cvar_t	sv_enableprofile = {"sv_enableprofile","0"};
@@ -178,7 +186,12 @@ void PR2_Profile_f(void)
 void VM_UnloadQVM( qvm_t * qvm )
 {
 	if(qvm)
+	{
+#ifdef QVM_JIT
+		QVM_JitFree( qvm );
+#endif
 		Q_free( qvm );
+	}
 }
 
 void VM_Unload( vm_t * vm )
@@ -258,8 +271,14 @@ void VM_PrintInfo( vm_t * vm)
 		Con_DPrintf("native\n");
 		break;
 	case VM_BYTECODE:
+		qvm = (qvm_t *)vm->hInst;
+#ifdef QVM_JIT
+		if (qvm && qvm->jit_code)
+			Con_DPrintf("bytecode compiled\n");
+		else
+#endif
 		Con_DPrintf("bytecode interpreted\n");
-		if((qvm=(qvm_t *)vm->hInst))
+		if(qvm)
 		{
 			Con_DPrintf("     code  length: %8xh\n", qvm->len_cs*sizeof(qvm->cs[0]));
 			Con_DPrintf("instruction count: %8d\n", qvm->len_cs);
@@ -480,6 +499,12 @@ qbool VM_LoadBytecode( vm_t * vm, sys_callex_t syscall1 )
 	}
 
 	LoadMapFile( qvm, vm->name );
+#ifdef QVM_JIT
+	if ( (int)sv_enablejit.value )
+		QVM_JitCompile( qvm );
+	else
+		QVM_JitFree( qvm );
+#endif
 	vm->type = VM_BYTECODE;
 	vm->hInst = qvm;
 	return true;
@@ -640,6 +665,734 @@ int trap_Call( qvm_t * qvm, int apinum )
 	return ret;
 }
 
+#ifdef QVM_JIT
+/*
+========================================================================
+
+x86-64 translation of the bytecode
+
+Every instruction becomes a short run of native code. The opStack lives in
+the native frame with its index in bl, so it wraps inside its 256 entries
+instead of being checked. LP stays in r15d and is written back to qvm->LP
+before any call into C. Data accesses inside the data segment are done
+inline, anything else goes through the same checks as the interpreter.
+Rare paths (errors, out of segment accesses) are emitted as stubs after
+the code. The bytecode is translated twice: the first pass only measures,
+so the second one knows every forward target.
+
+  rbx	opStack index (bl)		r12	opStack
+  r13	ds						r14	qvm
+  r15	LP						rbp	jit_table
+  [rsp] call depth			[rsp+8] runaway budget
+========================================================================
+*/
+
+#define JIT_FRAME		1080	// keeps rsp 16 byte aligned after the 6 pushes
+#define JIT_OPSTACK		32		// opStack offset in the frame, room for 258 entries
+
+typedef enum
+{
+	JIT_STUB_LOAD,
+	JIT_STUB_STORE,
+	JIT_STUB_PC,
+	JIT_STUB_STACK,
+	JIT_STUB_PROC_CALL,
+	JIT_STUB_RUNAWAY,
+	JIT_STUB_DIVIDE,
+	JIT_STUB_OPCODE
+} jitstubkind_t;
+
+typedef struct
+{
+	jitstubkind_t	kind;
+	int				pc;			// instruction index
+	int				arg;		// access size, branch target or opcode
+	int				resume;		// where LOAD/STORE stubs continue
+} jitstub_t;
+
+typedef struct
+{
+	qvm_t		*qvm;
+	byte		*buf;			// NULL while measuring
+	int			pos;
+	int			*instrofs;		// native offset of every instruction
+	qbool		*loophead;		// target of a backward conditional branch
+	jitstub_t	*stubs;
+	int			*stubofs;
+	int			numstubs;
+	int			exitofs;
+} qvmjit_t;
+
+static void JIT_Emit1( qvmjit_t *j, int b )
+{
+	if ( j->buf )
+		j->buf[j->pos] = b;
+	j->pos++;
+}
+
+static void JIT_Emit4( qvmjit_t *j, int v )
+{
+	if ( j->buf )
+		memcpy( j->buf + j->pos, &v, 4 );
+	j->pos += 4;
+}
+
+static void JIT_Emit8( qvmjit_t *j, void *p )
+{
+	if ( j->buf )
+		memcpy( j->buf + j->pos, &p, 8 );
+	j->pos += 8;
+}
+
+// emits a byte sequence given as a string of hex pairs
+static void JIT_Bytes( qvmjit_t *j, const char *s )
+{
+	int hi, lo;
+
+	while ( *s )
+	{
+		if ( *s == ' ' )
+		{
+			s++;
+			continue;
+		}
+		hi = isdigit( s[0] ) ? s[0] - '0' : s[0] - 'A' + 10;
+		lo = isdigit( s[1] ) ? s[1] - '0' : s[1] - 'A' + 10;
+		JIT_Emit1( j, hi << 4 | lo );
+		s += 2;
+	}
+}
+
+static void JIT_Jump( qvmjit_t *j, int target )
+{
+	JIT_Emit1( j, 0xE9 );
+	JIT_Emit4( j, target - (j->pos + 4) );
+}
+
+static void JIT_JumpCond( qvmjit_t *j, int cc, int target )
+{
+	JIT_Emit1( j, 0x0F );
+	JIT_Emit1( j, cc );
+	JIT_Emit4( j, target - (j->pos + 4) );
+}
+
+// returns the native offset of a new stub, known from the measuring pass
+static int JIT_Stub( qvmjit_t *j, jitstubkind_t kind, int pc, int arg )
+{
+	jitstub_t *stub = &j->stubs[j->numstubs];
+
+	stub->kind = kind;
+	stub->pc = pc;
+	stub->arg = arg;
+	stub->resume = 0;
+	return j->stubofs[j->numstubs++];
+}
+
+// resolves a static branch the way the interpreter loop would take it
+static int JIT_Target( qvmjit_t *j, int pc, int target )
+{
+	if ( target <= 0 )
+		return j->exitofs;
+	if ( target >= j->qvm->len_cs )
+		return JIT_Stub( j, JIT_STUB_PC, pc, target );
+	return j->instrofs[target];
+}
+
+static void JIT_Budget( qvmjit_t *j, int pc )
+{
+	JIT_Bytes( j, "FF 4C 24 08" );					// dec dword [rsp+8]
+	JIT_JumpCond( j, 0x84, JIT_Stub( j, JIT_STUB_RUNAWAY, pc, 0 ) );
+}
+
+// jumps to the instruction index in eax
+static void JIT_JumpDynamic( qvmjit_t *j, int pc )
+{
+	JIT_Bytes( j, "85 C0" );						// test eax, eax
+	JIT_JumpCond( j, 0x8E, j->exitofs );			// jle exit
+	JIT_Emit1( j, 0x3D );							// cmp eax, len_cs
+	JIT_Emit4( j, j->qvm->len_cs );
+	JIT_JumpCond( j, 0x83, JIT_Stub( j, JIT_STUB_PC, pc, -1 ) );
+	JIT_Bytes( j, "FF 64 C5 00" );					// jmp [rbp+rax*8]
+}
+
+// calls fn with qvm in rdi, the other arguments are already in place
+static void JIT_CallC( qvmjit_t *j, int pc, void *fn )
+{
+	JIT_Bytes( j, "45 89 7E" );						// mov [r14+LP], r15d
+	JIT_Emit1( j, offsetof( qvm_t, LP ) );
+	JIT_Bytes( j, "41 C7 46" );						// mov dword [r14+PC], pc + 1
+	JIT_Emit1( j, offsetof( qvm_t, PC ) );
+	JIT_Emit4( j, pc + 1 );
+	JIT_Bytes( j, "4C 89 F7 48 B8" );				// mov rdi, r14; mov rax, fn
+	JIT_Emit8( j, fn );
+	JIT_Bytes( j, "FF D0" );						// call rax
+}
+
+// checks the data address in eax, the slow path continues at the returned stub
+static int JIT_CheckAddress( qvmjit_t *j, jitstubkind_t kind, int pc, int size )
+{
+#ifdef QVM_DATA_PROTECTION
+	int stub;
+
+	JIT_Emit1( j, 0x3D );							// cmp eax, len_ds - size
+	JIT_Emit4( j, j->qvm->len_ds - size );
+	stub = j->numstubs;
+	JIT_JumpCond( j, 0x87, JIT_Stub( j, kind, pc, size ) );
+	return stub;
+#else
+	JIT_Emit1( j, 0x25 );							// and eax, ds_mask
+	JIT_Emit4( j, j->qvm->ds_mask );
+	return -1;
+#endif
+}
+
+static void JIT_Resume( qvmjit_t *j, int stub )
+{
+	if ( stub >= 0 )
+		j->stubs[stub].resume = j->pos;
+}
+
+static void QVM_JitError( qvm_t * qvm, jitstubkind_t kind, int value )
+{
+	switch ( kind )
+	{
+	case JIT_STUB_PC:
+		QVM_RunError( qvm, "QVM PC out of range, %8d\n", value );
+		break;
+	case JIT_STUB_STACK:
+		if ( qvm->LP >= qvm->len_ds - (int) sizeof( int ) )
+			QVM_RunError( qvm, "QVM Stack underflow at %8x", qvm->PC );
+		QVM_RunError( qvm, "QVM Stack overflow at %8x", qvm->PC );
+		break;
+	case JIT_STUB_PROC_CALL:
+		QVM_RunError( qvm, "MAX_PROC_CALL reached\n" );
+		break;
+	case JIT_STUB_RUNAWAY:
+		QVM_RunError( qvm, "QVM runaway loop error" );
+		break;
+	case JIT_STUB_DIVIDE:
+		QVM_RunError( qvm, "QVM division by zero at %8x", qvm->PC - 1 );
+		break;
+	case JIT_STUB_OPCODE:
+		if ( value == OP_UNDEF )
+			QVM_RunError( qvm, "OP_UNDEF\n" );
+		if ( value == OP_BREAK )
+			QVM_RunError( qvm, "OP_BREAK\n" );
+		QVM_RunError( qvm, "invalid opcode %2.2x at off=%8x\n", value, qvm->PC - 1 );
+		break;
+	default:
+		QVM_RunError( qvm, "QVM JIT error %d", kind );
+		break;
+	}
+}
+
+static int QVM_JitLoad( qvm_t * qvm, int address, int size )
+{
+	if ( !PR2_IsValidReadAddress( qvm, (intptr_t)qvm->ds + address ) )
+		QVM_RunError( qvm, "data load %d out of range %8x\n", size, address );
+
+	if ( size == 1 )
+		return *( char * ) ( qvm->ds + address );
+	if ( size == 2 )
+		return *( short * ) ( qvm->ds + address );
+	return *( int * ) ( qvm->ds + address );
+}
+
+static void QVM_JitStore( qvm_t * qvm, int address, int value, int size )
+{
+	if ( !PR2_IsValidWriteAddress( qvm, (intptr_t)qvm->ds + address ) )
+		QVM_RunError( qvm, "data store %d out of range %8x\n", size, address );
+
+	if ( size == 1 )
+		*( char * ) ( qvm->ds + address ) = value & 0xff;
+	else if ( size == 2 )
+		*( short * ) ( qvm->ds + address ) = value & 0xffff;
+	else
+		*( int * ) ( qvm->ds + address ) = value;
+}
+
+static void QVM_JitBlockCopy( qvm_t * qvm, int off1, int off2, int len )
+{
+#ifdef QVM_DATA_PROTECTION
+	if (!PR2_IsValidWriteAddress(qvm, (intptr_t)qvm->ds + off1) || !PR2_IsValidWriteAddress(qvm, (intptr_t)qvm->ds + off1 + len) ||
+		!PR2_IsValidReadAddress(qvm, (intptr_t)qvm->ds + off2) || !PR2_IsValidReadAddress(qvm, (intptr_t)qvm->ds + off2 + len)) {
+		QVM_RunError(qvm, "block copy out of range %8x\n", off1);
+	}
+	memmove( qvm->ds + off1, qvm->ds + off2, len );
+#else
+	memmove( qvm->ds + (off1 & qvm->ds_mask), qvm->ds + (off2 & qvm->ds_mask), len );
+#endif
+}
+
+static int QVM_JitSyscall( qvm_t * qvm, int apinum )
+{
+	return qvm->syscall( qvm->ds, qvm->ds_mask, apinum, ( pr2val_t* ) ( qvm->ds + qvm->LP + 2*sizeof(int) ) );
+}
+
+static void JIT_EmitStubs( qvmjit_t *j )
+{
+	jitstub_t *stub;
+	int i;
+
+	for ( i = 0; i < j->numstubs; i++ )
+	{
+		stub = &j->stubs[i];
+		j->stubofs[i] = j->pos;
+
+		switch ( stub->kind )
+		{
+		case JIT_STUB_LOAD:
+			JIT_Bytes( j, "89 C6 BA" );				// mov esi, eax; mov edx, size
+			JIT_Emit4( j, stub->arg );
+			JIT_CallC( j, stub->pc, (void *) QVM_JitLoad );
+			JIT_Bytes( j, "41 89 04 9C" );			// mov TOP, eax
+			JIT_Jump( j, stub->resume );
+			break;
+
+		case JIT_STUB_STORE:
+			JIT_Bytes( j, "89 C6 89 CA B9" );		// mov esi, eax; mov edx, ecx; mov ecx, size
+			JIT_Emit4( j, stub->arg );
+			JIT_CallC( j, stub->pc, (void *) QVM_JitStore );
+			JIT_Jump( j, stub->resume );
+			break;
+
+		default:
+			JIT_Bytes( j, "89 C2 BE" );				// mov edx, eax; mov esi, kind
+			JIT_Emit4( j, stub->kind );
+			if ( stub->kind == JIT_STUB_PC && stub->arg >= 0 )
+			{
+				JIT_Emit1( j, 0xBA );				// mov edx, target
+				JIT_Emit4( j, stub->arg );
+			}
+			else if ( stub->kind == JIT_STUB_OPCODE )
+			{
+				JIT_Emit1( j, 0xBA );				// mov edx, opcode
+				JIT_Emit4( j, stub->arg );
+			}
+			JIT_CallC( j, stub->pc, (void *) QVM_JitError );
+			JIT_Bytes( j, "0F 0B" );				// ud2
+			break;
+		}
+	}
+}
+
+// integer and float compares: condition codes of the taken branch
+static int JIT_CompareCC( opcode_t op )
+{
+	switch ( op )
+	{
+	case OP_EQ:		return 0x84;	// je
+	case OP_NE:		return 0x85;	// jne
+	case OP_LTI:	return 0x8C;	// jl
+	case OP_LEI:	return 0x8E;	// jle
+	case OP_GTI:	return 0x8F;	// jg
+	case OP_GEI:	return 0x8D;	// jge
+	case OP_LTU:	return 0x82;	// jb
+	case OP_LEU:	return 0x86;	// jbe
+	case OP_GTU:	return 0x87;	// ja
+	case OP_GEU:	return 0x83;	// jae
+	case OP_GTF:
+	case OP_LTF:	return 0x87;	// ja, operands swapped for LTF
+	case OP_GEF:
+	case OP_LEF:	return 0x83;	// jae, operands swapped for LEF
+	default:		return 0;
+	}
+}
+
+static void JIT_EmitInstruction( qvmjit_t *j, int pc )
+{
+	qvm_instruction_t *op = &j->qvm->cs[pc];
+	qvm_instruction_t *next = pc + 1 < j->qvm->len_cs ? op + 1 : NULL;
+	int parm = op->parm._int;
+	int stub, target;
+
+	if ( j->loophead[pc] )
+		JIT_Budget( j, pc );
+
+	switch ( op->opcode )
+	{
+	case OP_IGNORE:
+		break;
+
+	case OP_ENTER:
+		JIT_Bytes( j, "41 81 EF" );					// sub r15d, parm
+		JIT_Emit4( j, parm );
+		JIT_Bytes( j, "44 89 F8 2D" );				// mov eax, r15d; sub eax, stack base
+		JIT_Emit4( j, j->qvm->len_ds - j->qvm->len_ss );
+		JIT_Emit1( j, 0x3D );						// cmp eax, len_ss - 8
+		JIT_Emit4( j, j->qvm->len_ss - 2 * sizeof(int) );
+		JIT_JumpCond( j, 0x87, JIT_Stub( j, JIT_STUB_STACK, pc, 0 ) );
+		JIT_Bytes( j, "43 C7 44 3D 04" );			// mov dword [r13+r15+4], parm
+		JIT_Emit4( j, parm );
+		JIT_Bytes( j, "FF 04 24 81 3C 24" );		// inc dword [rsp]; cmp dword [rsp], MAX_PROC_CALL
+		JIT_Emit4( j, MAX_PROC_CALL );
+		JIT_JumpCond( j, 0x8D, JIT_Stub( j, JIT_STUB_PROC_CALL, pc, 0 ) );
+		break;
+
+	case OP_LEAVE:
+		JIT_Bytes( j, "41 81 C7" );					// add r15d, parm
+		JIT_Emit4( j, parm );
+		JIT_Bytes( j, "41 81 FF" );					// cmp r15d, len_ds - 4
+		JIT_Emit4( j, j->qvm->len_ds - sizeof(int) );
+		JIT_JumpCond( j, 0x87, JIT_Stub( j, JIT_STUB_STACK, pc, 0 ) );
+		JIT_Bytes( j, "43 8B 44 3D 00" );			// mov eax, [r13+r15]
+		JIT_Bytes( j, "FF 0C 24" );					// dec dword [rsp]
+		JIT_JumpDynamic( j, pc );
+		break;
+
+	case OP_CALL:
+		JIT_Bytes( j, "41 8B 04 9C" );				// mov eax, TOP
+		JIT_Bytes( j, "43 C7 44 3D 00" );			// mov dword [r13+r15], pc + 1
+		JIT_Emit4( j, pc + 1 );
+		JIT_Bytes( j, "85 C0 78 19" );				// test eax, eax; js syscall
+		JIT_Bytes( j, "FE CB" );					// dec bl
+		JIT_JumpDynamic( j, pc );
+		JIT_Bytes( j, "F7 D0 89 C6" );				// syscall: not eax; mov esi, eax
+		JIT_CallC( j, pc, (void *) QVM_JitSyscall );
+		JIT_Bytes( j, "41 89 04 9C" );				// mov TOP, eax
+		break;
+
+	case OP_PUSH:
+		JIT_Bytes( j, "FE C3" );					// inc bl
+		break;
+
+	case OP_POP:
+		JIT_Bytes( j, "FE CB" );					// dec bl
+		break;
+
+	case OP_CONST:
+		if ( next && next->opcode == OP_JUMP )
+		{	// the JUMP itself is still emitted, something may branch to it
+			target = JIT_Target( j, pc, parm );
+			if ( parm > 0 && parm <= pc )
+				JIT_Budget( j, pc );
+			JIT_Jump( j, target );
+			break;
+		}
+		if ( next && next->opcode == OP_CALL )
+		{
+			JIT_Bytes( j, "43 C7 44 3D 00" );		// mov dword [r13+r15], pc + 2
+			JIT_Emit4( j, pc + 2 );
+			if ( parm < 0 )
+			{
+				JIT_Emit1( j, 0xBE );				// mov esi, apinum
+				JIT_Emit4( j, -parm - 1 );
+				JIT_CallC( j, pc + 1, (void *) QVM_JitSyscall );
+				JIT_Bytes( j, "FE C3 41 89 04 9C" );	// inc bl; mov TOP, eax
+				JIT_Jump( j, JIT_Target( j, pc + 1, pc + 2 ) );	// the CALL may be the last instruction
+			}
+			else
+				JIT_Jump( j, JIT_Target( j, pc + 1, parm ) );
+			break;
+		}
+		JIT_Bytes( j, "FE C3 41 C7 04 9C" );		// inc bl; mov dword TOP, parm
+		JIT_Emit4( j, parm );
+		break;
+
+	case OP_LOCAL:
+		JIT_Bytes( j, "FE C3 41 8D 87" );			// inc bl; lea eax, [r15+parm]
+		JIT_Emit4( j, parm );
+		JIT_Bytes( j, "41 89 04 9C" );				// mov TOP, eax
+		break;
+
+	case OP_JUMP:
+		JIT_Bytes( j, "41 8B 04 9C FE CB" );		// mov eax, TOP; dec bl
+		JIT_Budget( j, pc );
+		JIT_JumpDynamic( j, pc );
+		break;
+
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+		target = JIT_Target( j, pc, parm );
+		JIT_Bytes( j, "80 EB 02" );					// sub bl, 2
+		JIT_Bytes( j, "41 8B 44 9C 04" );			// mov eax, [r12+rbx*4+4]
+		JIT_Bytes( j, "41 3B 44 9C 08" );			// cmp eax, [r12+rbx*4+8]
+		JIT_JumpCond( j, JIT_CompareCC( op->opcode ), target );
+		break;
+
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+		target = JIT_Target( j, pc, parm );
+		JIT_Bytes( j, "80 EB 02" );					// sub bl, 2
+		JIT_Bytes( j, "F3 41 0F 10 44 9C 04" );		// movss xmm0, [r12+rbx*4+4]
+		JIT_Bytes( j, "F3 41 0F 10 4C 9C 08" );		// movss xmm1, [r12+rbx*4+8]
+		if ( op->opcode == OP_LTF || op->opcode == OP_LEF )
+			JIT_Bytes( j, "0F 2E C8" );				// ucomiss xmm1, xmm0
+		else
+			JIT_Bytes( j, "0F 2E C1" );				// ucomiss xmm0, xmm1
+		if ( op->opcode == OP_EQF )
+		{	// unordered compares set ZF too
+			JIT_Bytes( j, "7A 06" );				// jp +6
+			JIT_JumpCond( j, 0x84, target );
+		}
+		else if ( op->opcode == OP_NEF )
+		{
+			JIT_JumpCond( j, 0x8A, target );		// jp
+			JIT_JumpCond( j, 0x85, target );		// jne
+		}
+		else
+			JIT_JumpCond( j, JIT_CompareCC( op->opcode ), target );
+		break;
+
+	case OP_LOAD1:
+	case OP_LOAD2:
+	case OP_LOAD4:
+		JIT_Bytes( j, "41 8B 04 9C" );				// mov eax, TOP
+		stub = JIT_CheckAddress( j, JIT_STUB_LOAD, pc, op->opcode == OP_LOAD1 ? 1 : op->opcode == OP_LOAD2 ? 2 : 4 );
+		if ( op->opcode == OP_LOAD1 )
+			JIT_Bytes( j, "41 0F BE 44 05 00" );	// movsx eax, byte [r13+rax]
+		else if ( op->opcode == OP_LOAD2 )
+			JIT_Bytes( j, "41 0F BF 44 05 00" );	// movsx eax, word [r13+rax]
+		else
+			JIT_Bytes( j, "41 8B 44 05 00" );		// mov eax, [r13+rax]
+		JIT_Bytes( j, "41 89 04 9C" );				// mov TOP, eax
+		JIT_Resume( j, stub );
+		break;
+
+	case OP_STORE1:
+	case OP_STORE2:
+	case OP_STORE4:
+		JIT_Bytes( j, "41 8B 44 9C FC" );			// mov eax, [r12+rbx*4-4]
+		JIT_Bytes( j, "41 8B 0C 9C" );				// mov ecx, TOP
+		stub = JIT_CheckAddress( j, JIT_STUB_STORE, pc, op->opcode == OP_STORE1 ? 1 : op->opcode == OP_STORE2 ? 2 : 4 );
+		if ( op->opcode == OP_STORE1 )
+			JIT_Bytes( j, "41 88 4C 05 00" );		// mov [r13+rax], cl
+		else if ( op->opcode == OP_STORE2 )
+			JIT_Bytes( j, "66 41 89 4C 05 00" );	// mov [r13+rax], cx
+		else
+			JIT_Bytes( j, "41 89 4C 05 00" );		// mov [r13+rax], ecx
+		JIT_Resume( j, stub );
+		JIT_Bytes( j, "80 EB 02" );					// sub bl, 2
+		break;
+
+	case OP_ARG:
+		JIT_Bytes( j, "41 8B 0C 9C 41 8D 87" );		// mov ecx, TOP; lea eax, [r15+parm]
+		JIT_Emit4( j, parm );
+		stub = JIT_CheckAddress( j, JIT_STUB_STORE, pc, 4 );
+		JIT_Bytes( j, "41 89 4C 05 00" );			// mov [r13+rax], ecx
+		JIT_Resume( j, stub );
+		JIT_Bytes( j, "FE CB" );					// dec bl
+		break;
+
+	case OP_BLOCK_COPY:
+		JIT_Bytes( j, "41 8B 74 9C FC" );			// mov esi, [r12+rbx*4-4]
+		JIT_Bytes( j, "41 8B 14 9C B9" );			// mov edx, TOP; mov ecx, parm
+		JIT_Emit4( j, parm );
+		JIT_CallC( j, pc, (void *) QVM_JitBlockCopy );
+		JIT_Bytes( j, "80 EB 02" );					// sub bl, 2
+		break;
+
+	case OP_SEX8:
+		JIT_Bytes( j, "41 0F BE 04 9C 41 89 04 9C" );	// movsx eax, byte TOP; mov TOP, eax
+		break;
+
+	case OP_SEX16:
+		JIT_Bytes( j, "41 0F BF 04 9C 41 89 04 9C" );	// movsx eax, word TOP; mov TOP, eax
+		break;
+
+	case OP_NEGI:
+		JIT_Bytes( j, "41 F7 1C 9C" );				// neg dword TOP
+		break;
+
+	case OP_BCOM:
+		JIT_Bytes( j, "41 F7 14 9C" );				// not dword TOP
+		break;
+
+	case OP_ADD:
+	case OP_SUB:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+		JIT_Bytes( j, "41 8B 04 9C FE CB 41" );		// mov eax, TOP; dec bl
+		JIT_Emit1( j, op->opcode == OP_ADD ? 0x01 : op->opcode == OP_SUB ? 0x29 :
+		              op->opcode == OP_BAND ? 0x21 : op->opcode == OP_BOR ? 0x09 : 0x31 );
+		JIT_Bytes( j, "04 9C" );					// op TOP, eax
+		break;
+
+	case OP_MULI:
+	case OP_MULU:
+		JIT_Bytes( j, "41 8B 04 9C FE CB" );		// mov eax, TOP; dec bl
+		JIT_Bytes( j, "41 0F AF 04 9C" );			// imul eax, TOP
+		JIT_Bytes( j, "41 89 04 9C" );				// mov TOP, eax
+		break;
+
+	case OP_DIVI:
+	case OP_MODI:
+	case OP_DIVU:
+	case OP_MODU:
+		JIT_Bytes( j, "41 8B 0C 9C FE CB 85 C9" );	// mov ecx, TOP; dec bl; test ecx, ecx
+		JIT_JumpCond( j, 0x84, JIT_Stub( j, JIT_STUB_DIVIDE, pc, 0 ) );
+		JIT_Bytes( j, "41 8B 04 9C" );				// mov eax, TOP
+		if ( op->opcode == OP_DIVI )				// INT_MIN / -1 would fault
+			JIT_Bytes( j, "83 F9 FF 75 04 F7 D8 EB 03 99 F7 F9" );
+		else if ( op->opcode == OP_MODI )
+			JIT_Bytes( j, "83 F9 FF 75 04 31 C0 EB 05 99 F7 F9 89 D0" );
+		else if ( op->opcode == OP_DIVU )
+			JIT_Bytes( j, "31 D2 F7 F1" );			// xor edx, edx; div ecx
+		else
+			JIT_Bytes( j, "31 D2 F7 F1 89 D0" );	// xor edx, edx; div ecx; mov eax, edx
+		JIT_Bytes( j, "41 89 04 9C" );				// mov TOP, eax
+		break;
+
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		JIT_Bytes( j, "41 8B 0C 9C FE CB 41 D3" );	// mov ecx, TOP; dec bl
+		JIT_Emit1( j, op->opcode == OP_LSH ? 0x24 : op->opcode == OP_RSHI ? 0x3C : 0x2C );
+		JIT_Bytes( j, "9C" );						// shl/sar/shr dword TOP, cl
+		break;
+
+	case OP_NEGF:
+		JIT_Bytes( j, "41 81 34 9C 00 00 00 80" );	// xor dword TOP, 0x80000000
+		break;
+
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_MULF:
+	case OP_DIVF:
+		JIT_Bytes( j, "F3 41 0F 10 44 9C FC" );		// movss xmm0, [r12+rbx*4-4]
+		JIT_Bytes( j, "F3 41 0F" );
+		JIT_Emit1( j, op->opcode == OP_ADDF ? 0x58 : op->opcode == OP_SUBF ? 0x5C :
+		              op->opcode == OP_MULF ? 0x59 : 0x5E );
+		JIT_Bytes( j, "04 9C" );					// addss/subss/mulss/divss xmm0, TOP
+		JIT_Bytes( j, "F3 41 0F 11 44 9C FC" );		// movss [r12+rbx*4-4], xmm0
+		JIT_Bytes( j, "FE CB" );					// dec bl
+		break;
+
+	case OP_CVIF:
+		JIT_Bytes( j, "F3 41 0F 2A 04 9C" );		// cvtsi2ss xmm0, dword TOP
+		JIT_Bytes( j, "F3 41 0F 11 04 9C" );		// movss TOP, xmm0
+		break;
+
+	case OP_CVFI:
+		JIT_Bytes( j, "F3 41 0F 2C 04 9C" );		// cvttss2si eax, dword TOP
+		JIT_Bytes( j, "41 89 04 9C" );				// mov TOP, eax
+		break;
+
+	default:	// OP_UNDEF, OP_BREAK and anything unknown
+		JIT_Jump( j, JIT_Stub( j, JIT_STUB_OPCODE, pc, op->opcode ) );
+		break;
+	}
+}
+
+static void JIT_EmitProgram( qvmjit_t *j )
+{
+	int i;
+
+	j->pos = 0;
+	j->numstubs = 0;
+
+	JIT_Bytes( j, "55 53 41 54 41 55 41 56 41 57" );	// push rbp, rbx, r12-r15
+	JIT_Bytes( j, "48 81 EC" );						// sub rsp, JIT_FRAME
+	JIT_Emit4( j, JIT_FRAME );
+	JIT_Bytes( j, "49 89 FE 4D 8B 6E" );			// mov r14, rdi; mov r13, [r14+ds]
+	JIT_Emit1( j, offsetof( qvm_t, ds ) );
+	JIT_Bytes( j, "45 8B 7E" );						// mov r15d, [r14+LP]
+	JIT_Emit1( j, offsetof( qvm_t, LP ) );
+	JIT_Bytes( j, "48 BD" );						// mov rbp, jit_table
+	JIT_Emit8( j, j->qvm->jit_table );
+	JIT_Bytes( j, "4C 8D 64 24" );					// lea r12, [rsp+JIT_OPSTACK]
+	JIT_Emit1( j, JIT_OPSTACK );
+	JIT_Bytes( j, "31 DB C7 04 24 00 00 00 00" );	// xor ebx, ebx; mov dword [rsp], 0
+	JIT_Bytes( j, "41 C7 04 24 00 00 00 00" );		// mov dword [r12], 0
+	JIT_Bytes( j, "C7 44 24 08" );					// mov dword [rsp+8], MAX_CYCLES
+	JIT_Emit4( j, MAX_CYCLES );
+
+	for ( i = 0; i < j->qvm->len_cs; i++ )
+	{
+		j->instrofs[i] = j->pos;
+		JIT_EmitInstruction( j, i );
+	}
+
+	j->exitofs = j->pos;
+	JIT_Bytes( j, "41 8B 04 9C 48 81 C4" );			// mov eax, TOP; add rsp, JIT_FRAME
+	JIT_Emit4( j, JIT_FRAME );
+	JIT_Bytes( j, "41 5F 41 5E 41 5D 41 5C 5B 5D C3" );	// pop r15-r12, rbx, rbp; ret
+
+	JIT_EmitStubs( j );
+}
+
+void QVM_JitFree( qvm_t * qvm )
+{
+	if ( qvm->jit_code )
+		munmap( qvm->jit_code, qvm->jit_size );
+	qvm->jit_code = NULL;
+	qvm->jit_size = 0;
+	Q_free( qvm->jit_table );
+}
+
+qbool QVM_JitCompile( qvm_t * qvm )
+{
+	qvmjit_t j;
+	int i, target;
+
+	QVM_JitFree( qvm );
+
+	memset( &j, 0, sizeof( j ) );
+	j.qvm = qvm;
+	j.instrofs = (int *) Q_malloc( qvm->len_cs * sizeof( int ) );
+	j.loophead = (qbool *) Q_malloc( qvm->len_cs * sizeof( qbool ) );
+	j.stubs = (jitstub_t *) Q_malloc( (4 * qvm->len_cs + 1) * sizeof( jitstub_t ) );
+	j.stubofs = (int *) Q_malloc( (4 * qvm->len_cs + 1) * sizeof( int ) );
+	qvm->jit_table = (void **) Q_malloc( qvm->len_cs * sizeof( void * ) );
+
+	// conditional branches back in the code are loops, charge them where they land
+	for ( i = 0; i < qvm->len_cs; i++ )
+	{
+		target = qvm->cs[i].parm._int;
+		if ( qvm->cs[i].opcode >= OP_EQ && qvm->cs[i].opcode <= OP_GEF && target > 0 && target <= i )
+			j.loophead[target] = true;
+	}
+
+	// measure, then emit for real into executable memory
+	JIT_EmitProgram( &j );
+	qvm->jit_size = j.pos;
+	qvm->jit_code = (byte *) mmap( NULL, qvm->jit_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( qvm->jit_code == MAP_FAILED )
+	{
+		qvm->jit_code = NULL;
+	}
+	else
+	{
+		j.buf = qvm->jit_code;
+		JIT_EmitProgram( &j );
+
+		for ( i = 0; i < qvm->len_cs; i++ )
+			qvm->jit_table[i] = qvm->jit_code + j.instrofs[i];
+
+		if ( mprotect( qvm->jit_code, qvm->jit_size, PROT_READ | PROT_EXEC ) )
+			QVM_JitFree( qvm );
+	}
+
+	Q_free( j.instrofs );
+	Q_free( j.loophead );
+	Q_free( j.stubs );
+	Q_free( j.stubofs );
+
+	if ( !qvm->jit_code )
+	{
+		Con_Printf( "QVM_JitCompile: couldn't allocate native code, interpreting\n" );
+		QVM_JitFree( qvm );
+		return false;
+	}
+
+	Con_DPrintf( "QVM_JitCompile: %d instructions, %d bytes of native code\n", qvm->len_cs, (int) qvm->jit_size );
+	return true;
+}
+#endif
+
 
 void PrintInstruction( qvm_t * qvm );
 
@@ -697,6 +1450,22 @@ int QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, i
 	cycles[cycles_p] = 0;
 #endif
 
+#ifdef QVM_JIT
+	if ( qvm->jit_code && (int)sv_enablejit.value
+#ifdef QVM_PROFILE
+	        && !(int)sv_enableprofile.value
+#endif
+	   )
+	{
+		ivar = ( (int (*)( qvm_t * )) qvm->jit_code )( qvm );
+		qvm->PC = savePC;
+		qvm->SP = saveSP;
+		qvm->LP = saveLP;
+		qvm->reenter--;
+		return ivar;
+	}
+#endif
+
 	do
 	{
 #ifdef SAFE_QVM
@@ -27,6 +27,11 @@
 #define QVM_DATA_PROTECTION
 #define QVM_PROFILE
 
+// translate bytecode to native code at load time
+#if defined(__x86_64__) && !defined(_WIN32)
+#define QVM_JIT
+#endif
+
 #ifdef _WIN32
 #define EXPORT_FN __cdecl
 #else
@@ -210,6 +215,12 @@ typedef struct {
 	int	reenter;
 	symbols_t* sym_info;
 	sys_callex_t syscall;
+
+#ifdef QVM_JIT
+	byte	*jit_code;	// native translation of cs, NULL when interpreted
+	size_t	jit_size;
+	void	**jit_table;	// native address of every instruction
+#endif
 } qvm_t;
 
 
@@ -253,6 +264,10 @@ vm_t* VM_Load(vm_t *vm, vm_type_t type, char *name,sys_call_t syscall,sys_callex
 extern intptr_t VM_Call(vm_t *vm, int /*command*/, int /*arg0*/, int , int , int , int , int , 
 				int , int , int , int , int , int /*arg11*/);
 void  QVM_StackTrace( qvm_t * qvm );
+#ifdef QVM_JIT
+qbool QVM_JitCompile( qvm_t * qvm );
+void QVM_JitFree( qvm_t * qvm );
+#endif
 void VM_PrintInfo( vm_t * vm);
 
 #endif /* !__PR2_VM_H__ */
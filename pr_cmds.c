@@ -184,6 +184,8 @@ ok:
 
 	e->v.model = G_INT(OFS_PARM1);
 	e->v.modelindex = i;
+	if (pr_findindexactive)
+		PR_FindIndexTouch ((byte *)&e->v.model - (byte *)sv.edicts);
 
 // if it is an inline model, get the size information for it
 	if (m[0] == '*')
@@ -1301,7 +1303,7 @@ void PF_Remove (void)
 // entity (entity start, .string field, string match) find = #5;
 void PF_Find (void)
 {
-	int		e;
+	int		e, i;
 	int		f;
 	char	*s, *t;
 	edict_t	*ed;
@@ -1312,6 +1314,12 @@ void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
+	if ((i = PR_FindIndexed (e, f, s)) >= 0)
+	{
+		RETURN_EDICT(EDICT_NUM(i));
+		return;
+	}
+
 	for (e++ ; e < sv.num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
@@ -83,6 +83,46 @@ cvar_t	sv_progsname = {"sv_progsname", "qwprogs"};
 cvar_t  sv_forcenqprogs = {"sv_forcenqprogs", "0"};
 #endif
 
+/*
+=================
+ED_UnlinkFree / ED_LinkFree
+
+Free edicts above the clients wait in a list ordered by freetime
+=================
+*/
+static void ED_UnlinkFree (sv_edict_t *e)
+{
+	if (!e->freeprev && sv.free_edicts_head != e->entnum)
+		return;
+
+	if (e->freeprev)
+		sv.sv_edicts[e->freeprev].freenext = e->freenext;
+	else
+		sv.free_edicts_head = e->freenext;
+	if (e->freenext)
+		sv.sv_edicts[e->freenext].freeprev = e->freeprev;
+	else
+		sv.free_edicts_tail = e->freeprev;
+	e->freenext = e->freeprev = 0;
+	sv.num_free_edicts--;
+}
+
+static void ED_LinkFree (sv_edict_t *e)
+{
+	ED_UnlinkFree (e);
+	if (e->entnum <= MAX_CLIENTS)
+		return;
+
+	e->freeprev = sv.free_edicts_tail;
+	e->freenext = 0;
+	if (sv.free_edicts_tail)
+		sv.sv_edicts[sv.free_edicts_tail].freenext = e->entnum;
+	else
+		sv.free_edicts_head = e->entnum;
+	sv.free_edicts_tail = e->entnum;
+	sv.num_free_edicts++;
+}
+
 /*
 =================
 ED_ClearEdict
@@ -92,6 +132,7 @@ Sets everything to NULL
 */
 void ED_ClearEdict (edict_t *e)
 {
+	ED_UnlinkFree (e->e);
 	memset(&e->v, 0, pr_edict_size - sizeof(edict_t) + sizeof(entvars_t));
 	e->e->lastruntime = 0;
 	e->e->free = false;
@@ -114,29 +155,35 @@ edict_t *ED_Alloc (void)
 	int			i;
 	edict_t		*e;
 
-	for (i = MAX_CLIENTS + 1; i < sv.num_edicts; i++)
+	// the free list is in freeing order, so if the edict freed longest ago
+	// can't be reused yet, none of the others can either
+	if (sv.free_edicts_head)
 	{
-		e = EDICT_NUM(i);
+		e = EDICT_NUM(sv.free_edicts_head);
 		// the first couple seconds of server time can involve a lot of
 		// freeing and allocating, so relax the replacement policy
-		if (e->e->free && (e->e->freetime < 2 || sv.time - e->e->freetime > 0.5))
+		if (e->e->freetime < 2 || sv.time - e->e->freetime > 0.5)
 		{
 			ED_ClearEdict(e);
+			sv.alloc_reused++;
 			return e;
 		}
 	}
 
+	i = sv.num_edicts;
 	if (i == sv.max_edicts)
 	{
 		Con_Printf ("WARNING: ED_Alloc: no free edicts [%d]\n", sv.max_edicts);
 		i--;	// step on whatever is the last edict
 		e = EDICT_NUM(i);
 		SV_UnlinkEdict(e);
+		sv.alloc_overflow++;
 	}
 	else
 	{
 		sv.num_edicts++;
 		e = EDICT_NUM(i);
+		sv.alloc_new++;
 	}
 
 	ED_ClearEdict(e);
@@ -171,6 +218,7 @@ void ED_Free (edict_t *ed)
 	ed->v.solid = 0;
 
 	ed->e->freetime = sv.time;
+	ED_LinkFree (ed->e);
 }
 
 //===========================================================================
@@ -669,9 +717,271 @@ void ED_Count (void)
 	Con_Printf ("view      :%3i\n", models);
 	Con_Printf ("touch     :%3i\n", solid);
 	Con_Printf ("step      :%3i\n", step);
+	Con_Printf ("free list :%3i\n", sv.num_free_edicts);
+	Con_Printf ("reused    :%3i\n", sv.alloc_reused);
+	Con_Printf ("new       :%3i\n", sv.alloc_new);
+	Con_Printf ("overflow  :%3i\n", sv.alloc_overflow);
 
 }
 
+/*
+==============================================================================
+
+					FIND INDEX
+
+Mods walk entities of one kind with find() every frame, which is a scan over
+all edicts per call.  String fields named in sv_progsfindindex get a hash from
+value to a chain of edicts sorted by number.  Stores to an indexed field only
+mark the edict dirty, chains are brought up to date by the next find() on that
+field.  Strings outside the low hunk (temp buffers, client names, strzone) can
+change in place without a store, edicts holding those are kept on a separate
+chain which find() always checks.
+==============================================================================
+*/
+
+#define	FINDINDEX_MAXFIELDS	8
+#define	FINDINDEX_HASHSIZE	256
+#define	FINDINDEX_VOLATILE	FINDINDEX_HASHSIZE	// chain for strings that may change in place
+
+typedef struct
+{
+	int		ofs;							// field offset in entvars, in ints
+	int		head[FINDINDEX_HASHSIZE + 1];	// lowest edict on each chain, -1 if empty
+	int		tail[FINDINDEX_HASHSIZE + 1];
+	int		chain[MAX_EDICTS];				// chain an edict is on, -1 if none
+	int		next[MAX_EDICTS];
+	int		prev[MAX_EDICTS];
+	int		dirtylist[MAX_EDICTS];
+	int		numdirty;
+	byte	dirty[MAX_EDICTS];
+} findindex_t;
+
+static void OnChange_progsfindindex_var (cvar_t *var, char *value, qbool *cancel);
+cvar_t	sv_progsfindindex = {"sv_progsfindindex", "", 0, OnChange_progsfindindex_var};
+
+static findindex_t	*pr_findindex[FINDINDEX_MAXFIELDS];
+static int			pr_findindexnum;
+static byte			*pr_findindexslot;		// field offset -> index number + 1
+static int			pr_findindexslots;
+static qbool		pr_findindexstale = true;
+qbool				pr_findindexactive;		// stores to edicts must call PR_FindIndexTouch
+
+extern byte	*hunk_base;
+
+static void OnChange_progsfindindex_var (cvar_t *var, char *value, qbool *cancel)
+{
+	pr_findindexstale = true;
+}
+
+void PR_ClearFindIndex (void)
+{
+	int		i;
+
+	for (i = 0; i < pr_findindexnum; i++)
+		Q_free (pr_findindex[i]);
+	Q_free (pr_findindexslot);
+	pr_findindexnum = 0;
+	pr_findindexslots = 0;
+	pr_findindexactive = false;
+	pr_findindexstale = true;
+}
+
+static void PR_FindIndexMark (findindex_t *ix, int e)
+{
+	if (ix->dirty[e])
+		return;
+	ix->dirty[e] = true;
+	ix->dirtylist[ix->numdirty++] = e;
+}
+
+static void PR_BuildFindIndex (void)
+{
+	findindex_t	*ix;
+	ddef_t		*def;
+	const char	*data;
+	int			e, ofs;
+
+	PR_ClearFindIndex ();
+	pr_findindexstale = false;
+
+	if (!progs || !sv_progsfindindex.string[0])
+		return;
+
+	pr_findindexslots = (pr_edict_size - (int) offsetof (edict_t, v)) / 4;
+	pr_findindexslot = (byte *) Q_malloc (pr_findindexslots);
+
+	for (data = sv_progsfindindex.string; (data = COM_Parse (data)) != NULL; )
+	{
+		def = ED_FindField (com_token);
+		if (!def || (def->type & ~DEF_SAVEGLOBAL) != ev_string)
+		{
+			Con_Printf ("sv_progsfindindex: %s is not a string field\n", com_token);
+			continue;
+		}
+		ofs = PR_FIELDOFS(def->ofs);
+		if (ofs < 0 || ofs >= pr_findindexslots || pr_findindexslot[ofs])
+			continue;
+		if (pr_findindexnum == FINDINDEX_MAXFIELDS)
+		{
+			Con_Printf ("sv_progsfindindex: only %i fields can be indexed\n", FINDINDEX_MAXFIELDS);
+			break;
+		}
+
+		ix = pr_findindex[pr_findindexnum++] = (findindex_t *) Q_malloc (sizeof (*ix));
+		pr_findindexslot[ofs] = pr_findindexnum;
+		ix->ofs = ofs;
+		memset (ix->head, -1, sizeof (ix->head));
+		memset (ix->tail, -1, sizeof (ix->tail));
+		memset (ix->chain, -1, sizeof (ix->chain));
+		for (e = 1; e < sv.num_edicts; e++)
+			PR_FindIndexMark (ix, e);
+	}
+
+	pr_findindexactive = (pr_findindexnum > 0);
+}
+
+/*
+=============
+PR_FindIndexTouch
+
+Called with the byte offset from sv.edicts of every store into an edict
+=============
+*/
+void PR_FindIndexTouch (int ofs)
+{
+	int		e, slot;
+
+	if (ofs < 0)
+		return;
+	e = ofs / pr_edict_size;
+	ofs -= e * pr_edict_size + (int) offsetof (edict_t, v);
+	if (e >= MAX_EDICTS || ofs < 0 || (ofs >>= 2) >= pr_findindexslots)
+		return;
+	if ((slot = pr_findindexslot[ofs]))
+		PR_FindIndexMark (pr_findindex[slot - 1], e);
+}
+
+static void PR_FindIndexUnlink (findindex_t *ix, int e)
+{
+	int		c = ix->chain[e];
+
+	if (c < 0)
+		return;
+	if (ix->prev[e] >= 0)
+		ix->next[ix->prev[e]] = ix->next[e];
+	else
+		ix->head[c] = ix->next[e];
+	if (ix->next[e] >= 0)
+		ix->prev[ix->next[e]] = ix->prev[e];
+	else
+		ix->tail[c] = ix->prev[e];
+	ix->chain[e] = -1;
+}
+
+static void PR_FindIndexLink (findindex_t *ix, int e, int c)
+{
+	int		after;
+
+	// edicts mostly get their value in spawn order, so search from the tail
+	for (after = ix->tail[c]; after > e; after = ix->prev[after])
+		;
+	ix->prev[e] = after;
+	ix->next[e] = after >= 0 ? ix->next[after] : ix->head[c];
+	if (after >= 0)
+		ix->next[after] = e;
+	else
+		ix->head[c] = e;
+	if (ix->next[e] >= 0)
+		ix->prev[ix->next[e]] = e;
+	else
+		ix->tail[c] = e;
+	ix->chain[e] = c;
+}
+
+static void PR_FindIndexUpdate (findindex_t *ix)
+{
+	edict_t	*ed;
+	char	*s;
+	int		i, e;
+
+	for (i = 0; i < ix->numdirty; i++)
+	{
+		e = ix->dirtylist[i];
+		ix->dirty[e] = false;
+		PR_FindIndexUnlink (ix, e);
+
+		if (e >= sv.num_edicts)
+			continue;
+		ed = EDICT_NUM(e);
+		if (ed->e->free)
+			continue;
+		s = PR1_GetString (((string_t *)&ed->v)[ix->ofs]);
+		if (!s || !s[0])
+			continue;
+
+		// ED_NewString and progs strings live in the low hunk until the next map
+		if ((byte *)s >= hunk_base && (byte *)s < hunk_base + Hunk_LowMark ())
+			PR_FindIndexLink (ix, e, Hash_Key (s, FINDINDEX_HASHSIZE));
+		else
+			PR_FindIndexLink (ix, e, FINDINDEX_VOLATILE);
+	}
+	ix->numdirty = 0;
+}
+
+/*
+=============
+PR_FindIndexed
+
+Returns the first edict after start whose field equals s, 0 if there is none,
+or -1 if the field is not indexed.  Chains may hold edicts that were freed or
+cleared without a store, so every candidate is checked like PF_Find does.
+=============
+*/
+int PR_FindIndexed (int start, int field, char *s)
+{
+	findindex_t	*ix;
+	edict_t		*ed;
+	char		*t;
+	int			ofs, e, best, pass;
+
+	if (pr_findindexstale)
+		PR_BuildFindIndex ();
+
+	ofs = PR_FIELDOFS(field);
+	if (!s[0] || ofs < 0 || ofs >= pr_findindexslots || !pr_findindexslot[ofs])
+		return -1;	// edicts with an empty value are not on any chain
+
+	ix = pr_findindex[pr_findindexslot[ofs] - 1];
+	PR_FindIndexUpdate (ix);
+
+	best = sv.num_edicts;
+	for (pass = 0; pass < 2; pass++)
+	{
+		int c = pass ? FINDINDEX_VOLATILE : Hash_Key (s, FINDINDEX_HASHSIZE);
+
+		if (ix->chain[start] == c)
+			e = ix->next[start];
+		else
+			for (e = ix->head[c]; e >= 0 && e <= start; e = ix->next[e])
+				;
+
+		for ( ; e >= 0 && e < best; e = ix->next[e])
+		{
+			ed = EDICT_NUM(e);
+			if (ed->e->free)
+				continue;
+			t = PR1_GetString (((string_t *)&ed->v)[ofs]);
+			if (t && !strcmp (t, s))
+			{
+				best = e;
+				break;
+			}
+		}
+	}
+
+	return best < sv.num_edicts ? best : 0;
+}
+
 /*
 ==============================================================================
  
@@ -941,7 +1251,10 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 	}
 
 	if (!init)
+	{
 		ent->e->free = true;
+		ED_LinkFree (ent->e);
+	}
 
 	return data;
 }
@@ -1181,6 +1494,8 @@ void PR1_LoadProgs (void)
 	pr_globaldefs = (ddef_t *)((byte *)progs + progs->ofs_globaldefs);
 	pr_fielddefs = (ddef_t *)((byte *)progs + progs->ofs_fielddefs);
 	pr_statements = (dstatement_t *)((byte *)progs + progs->ofs_statements);
+	PR_ClearDecodedStatements ();
+	PR_ClearFindIndex ();
 
 	num_prstr = 0;
 
@@ -1244,6 +1559,8 @@ PR1_Init
 void PR1_Init (void)
 {
 	Cvar_Register(&sv_progsname);
+	Cvar_Register(&sv_progsfast);
+	Cvar_Register(&sv_progsfindindex);
 #ifdef WITH_NQPROGS
 	Cvar_Register(&sv_forcenqprogs);
 #endif
@@ -349,6 +349,614 @@ int PR_LeaveFunction (void)
 	return pr_stack[pr_depth].s;
 }
 
+/*
+============================================================================
+Decoded statement stream
+
+PR_ExecuteProgram runs the progs from a pre-decoded copy of pr_statements:
+global operands are resolved to pointers, aliased opcodes are folded together,
+branch targets are made absolute and a few common pairs are fused into one
+instruction. The second statement of a fused pair is kept as is, so a branch
+landing on it still works. Tracing and "profile" counts use the plain loop.
+============================================================================
+*/
+
+#if defined(__GNUC__) && !defined(PR_NO_COMPUTED_GOTO)
+#define PR_COMPUTED_GOTO
+#endif
+
+enum
+{
+	PRX_ADDRESS_STOREP = OP_BITOR + 1,	// ADDRESS + STOREP_F/S/ENT/FLD/FNC
+	PRX_ADDRESS_STOREP_V,				// ADDRESS + STOREP_V
+	PRX_EQ_F_IF,						// comparison + IF/IFNOT on its result
+	PRX_NE_F_IF,
+	PRX_LE_IF,
+	PRX_GE_IF,
+	PRX_LT_IF,
+	PRX_GT_IF,
+	PRX_EQ_E_IF,
+	PRX_NE_E_IF,
+	PRX_NOT_F_IF,
+	PRX_BAD,							// unknown opcode or branch out of range
+	PRX_NUMOPS
+};
+
+typedef struct prinstr_s
+{
+#ifdef PR_COMPUTED_GOTO
+	void		*handler;
+#endif
+	int			op;
+	int			jump;		// absolute statement of a taken branch
+	int			cost;		// statements it stands for, charged to runaway
+	int			cond;		// branch sense of fused compares, argc of calls
+	eval_t		*a, *b, *c;
+	eval_t		*d;			// value stored by a fused ADDRESS + STOREP
+} prinstr_t;
+
+static prinstr_t	*pr_code;
+
+cvar_t	sv_progsfast = {"sv_progsfast", "1"};
+
+/*
+====================
+PR_ClearDecodedStatements
+
+Called whenever pr_statements changes
+====================
+*/
+void PR_ClearDecodedStatements (void)
+{
+	Q_free (pr_code);
+}
+
+static int PR_FusedCompare (int op)
+{
+	switch (op)
+	{
+	case OP_EQ_F:	return PRX_EQ_F_IF;
+	case OP_NE_F:	return PRX_NE_F_IF;
+	case OP_LE:		return PRX_LE_IF;
+	case OP_GE:		return PRX_GE_IF;
+	case OP_LT:		return PRX_LT_IF;
+	case OP_GT:		return PRX_GT_IF;
+	case OP_EQ_E:	return PRX_EQ_E_IF;
+	case OP_NE_E:	return PRX_NE_E_IF;
+	case OP_NOT_F:	return PRX_NOT_F_IF;
+	default:		return 0;
+	}
+}
+
+static void PR_SetBranch (prinstr_t *ins, int target)
+{
+	// out of range branches land on the trailing PRX_BAD
+	if (target < 0 || target >= progs->numstatements)
+		target = progs->numstatements;
+
+	ins->jump = target;
+}
+
+static void PR_DecodeStatements (void **handlers)
+{
+	dstatement_t *st, *next;
+	prinstr_t *ins;
+	int i, n, fused;
+
+	n = progs->numstatements;
+	pr_code = (prinstr_t *) Q_malloc ((n + 1) * sizeof(prinstr_t));
+
+	for (i = 0; i < n; i++)
+	{
+		st = &pr_statements[i];
+		next = i + 1 < n ? st + 1 : NULL;
+		ins = &pr_code[i];
+
+		ins->op = st->op;
+		ins->cost = 1;
+		ins->a = (eval_t *)&pr_globals[st->a];
+		ins->b = (eval_t *)&pr_globals[st->b];
+		ins->c = (eval_t *)&pr_globals[st->c];
+
+		switch (st->op)
+		{
+		case OP_STORE_S:
+		case OP_STORE_ENT:
+		case OP_STORE_FLD:
+		case OP_STORE_FNC:
+			ins->op = OP_STORE_F;
+			break;
+
+		case OP_STOREP_S:
+		case OP_STOREP_ENT:
+		case OP_STOREP_FLD:
+		case OP_STOREP_FNC:
+			ins->op = OP_STOREP_F;
+			break;
+
+		case OP_LOAD_S:
+		case OP_LOAD_ENT:
+		case OP_LOAD_FLD:
+		case OP_LOAD_FNC:
+			ins->op = OP_LOAD_F;
+			break;
+
+		case OP_CALL1:
+		case OP_CALL2:
+		case OP_CALL3:
+		case OP_CALL4:
+		case OP_CALL5:
+		case OP_CALL6:
+		case OP_CALL7:
+		case OP_CALL8:
+			ins->op = OP_CALL0;
+			ins->cond = st->op - OP_CALL0;
+			break;
+
+		case OP_DONE:
+			ins->op = OP_RETURN;
+			break;
+
+		case OP_IF:
+		case OP_IFNOT:
+			PR_SetBranch (ins, i + st->b);
+			break;
+
+		case OP_GOTO:
+			PR_SetBranch (ins, i + st->a);
+			break;
+
+		case OP_ADDRESS:
+			if (next && next->b == st->c && next->op >= OP_STOREP_F && next->op <= OP_STOREP_FNC)
+			{
+				ins->op = next->op == OP_STOREP_V ? PRX_ADDRESS_STOREP_V : PRX_ADDRESS_STOREP;
+				ins->d = (eval_t *)&pr_globals[next->a];
+				ins->cost = 2;
+			}
+			break;
+
+		default:
+			if (st->op > OP_BITOR)
+				ins->op = PRX_BAD;
+			else if (next && (next->op == OP_IF || next->op == OP_IFNOT) && next->a == st->c
+				&& (fused = PR_FusedCompare (st->op)))
+			{
+				ins->op = fused;
+				ins->cond = next->op == OP_IF;
+				ins->cost = 2;
+				PR_SetBranch (ins, i + 1 + next->b);
+			}
+			break;
+		}
+	}
+
+	pr_code[n].op = PRX_BAD;
+	pr_code[n].cost = 1;
+
+#ifdef PR_COMPUTED_GOTO
+	for (i = 0; i <= n; i++)
+		pr_code[i].handler = handlers[pr_code[i].op];
+#endif
+}
+
+// every statement counts against runaway, as in the plain loop
+#define PRX_CHARGE		if ((budget -= ins->cost) <= 0) goto runaway_loop;
+
+#ifdef PR_COMPUTED_GOTO
+#define PRX_OP(x)		prx_##x:
+#define PRX_DISPATCH	PRX_CHARGE goto *ins->handler;
+#define PRX_NEXT		PRX_CHARGE goto *ins->handler
+#define PRX_END
+#else
+#define PRX_OP(x)		case x:
+#define PRX_DISPATCH	for (;;) { PRX_CHARGE switch (ins->op) {
+#define PRX_NEXT		continue
+#define PRX_END			default: goto bad_opcode; } }
+#endif
+
+#define PRX_STEP		ins++; PRX_NEXT
+#define PRX_JUMP		ins = code + ins->jump; PRX_NEXT
+#define PRX_BRANCH(r)	if ((r) == ins->cond) { PRX_JUMP; } ins += 2; PRX_NEXT
+
+/*
+====================
+PR_ExecuteDecoded
+
+Runs from the statement after s until the frame at exitdepth returns (-1),
+or until a builtin turns tracing on, in which case the statement to continue
+after in the plain loop is returned
+====================
+*/
+static int PR_ExecuteDecoded (int s, int exitdepth, int *runaway)
+{
+#ifdef PR_COMPUTED_GOTO
+	static void *handlers[PRX_NUMOPS] =
+	{
+		[OP_ADD_F] = &&prx_OP_ADD_F, [OP_ADD_V] = &&prx_OP_ADD_V,
+		[OP_SUB_F] = &&prx_OP_SUB_F, [OP_SUB_V] = &&prx_OP_SUB_V,
+		[OP_MUL_F] = &&prx_OP_MUL_F, [OP_MUL_V] = &&prx_OP_MUL_V,
+		[OP_MUL_FV] = &&prx_OP_MUL_FV, [OP_MUL_VF] = &&prx_OP_MUL_VF,
+		[OP_DIV_F] = &&prx_OP_DIV_F,
+		[OP_BITAND] = &&prx_OP_BITAND, [OP_BITOR] = &&prx_OP_BITOR,
+		[OP_GE] = &&prx_OP_GE, [OP_LE] = &&prx_OP_LE,
+		[OP_GT] = &&prx_OP_GT, [OP_LT] = &&prx_OP_LT,
+		[OP_AND] = &&prx_OP_AND, [OP_OR] = &&prx_OP_OR,
+		[OP_NOT_F] = &&prx_OP_NOT_F, [OP_NOT_V] = &&prx_OP_NOT_V,
+		[OP_NOT_S] = &&prx_OP_NOT_S, [OP_NOT_FNC] = &&prx_OP_NOT_FNC,
+		[OP_NOT_ENT] = &&prx_OP_NOT_ENT,
+		[OP_EQ_F] = &&prx_OP_EQ_F, [OP_EQ_V] = &&prx_OP_EQ_V,
+		[OP_EQ_S] = &&prx_OP_EQ_S, [OP_EQ_E] = &&prx_OP_EQ_E,
+		[OP_EQ_FNC] = &&prx_OP_EQ_FNC,
+		[OP_NE_F] = &&prx_OP_NE_F, [OP_NE_V] = &&prx_OP_NE_V,
+		[OP_NE_S] = &&prx_OP_NE_S, [OP_NE_E] = &&prx_OP_NE_E,
+		[OP_NE_FNC] = &&prx_OP_NE_FNC,
+		[OP_STORE_F] = &&prx_OP_STORE_F, [OP_STORE_V] = &&prx_OP_STORE_V,
+		[OP_STOREP_F] = &&prx_OP_STOREP_F, [OP_STOREP_V] = &&prx_OP_STOREP_V,
+		[OP_ADDRESS] = &&prx_OP_ADDRESS,
+		[OP_LOAD_F] = &&prx_OP_LOAD_F, [OP_LOAD_V] = &&prx_OP_LOAD_V,
+		[OP_IFNOT] = &&prx_OP_IFNOT, [OP_IF] = &&prx_OP_IF,
+		[OP_GOTO] = &&prx_OP_GOTO,
+		[OP_CALL0] = &&prx_OP_CALL0,
+		[OP_RETURN] = &&prx_OP_RETURN,
+		[OP_STATE] = &&prx_OP_STATE,
+		[PRX_ADDRESS_STOREP] = &&prx_PRX_ADDRESS_STOREP,
+		[PRX_ADDRESS_STOREP_V] = &&prx_PRX_ADDRESS_STOREP_V,
+		[PRX_EQ_F_IF] = &&prx_PRX_EQ_F_IF, [PRX_NE_F_IF] = &&prx_PRX_NE_F_IF,
+		[PRX_LE_IF] = &&prx_PRX_LE_IF, [PRX_GE_IF] = &&prx_PRX_GE_IF,
+		[PRX_LT_IF] = &&prx_PRX_LT_IF, [PRX_GT_IF] = &&prx_PRX_GT_IF,
+		[PRX_EQ_E_IF] = &&prx_PRX_EQ_E_IF, [PRX_NE_E_IF] = &&prx_PRX_NE_E_IF,
+		[PRX_NOT_F_IF] = &&prx_PRX_NOT_F_IF,
+		[PRX_BAD] = &&bad_opcode
+	};
+#else
+	void **handlers = NULL;
+#endif
+	prinstr_t *code, *ins;
+	dfunction_t *newf;
+	edict_t *ed;
+	eval_t *ptr;
+	int budget, i;
+
+	if (!pr_code)
+		PR_DecodeStatements (handlers);
+
+	code = pr_code;
+	ins = code + s + 1;
+	budget = *runaway;
+
+	PRX_DISPATCH
+
+	PRX_OP(OP_ADD_F)
+		ins->c->_float = ins->a->_float + ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_ADD_V)
+		ins->c->vector[0] = ins->a->vector[0] + ins->b->vector[0];
+		ins->c->vector[1] = ins->a->vector[1] + ins->b->vector[1];
+		ins->c->vector[2] = ins->a->vector[2] + ins->b->vector[2];
+		PRX_STEP;
+
+	PRX_OP(OP_SUB_F)
+		ins->c->_float = ins->a->_float - ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_SUB_V)
+		ins->c->vector[0] = ins->a->vector[0] - ins->b->vector[0];
+		ins->c->vector[1] = ins->a->vector[1] - ins->b->vector[1];
+		ins->c->vector[2] = ins->a->vector[2] - ins->b->vector[2];
+		PRX_STEP;
+
+	PRX_OP(OP_MUL_F)
+		ins->c->_float = ins->a->_float * ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_MUL_V)
+		ins->c->_float = ins->a->vector[0]*ins->b->vector[0]
+		                 + ins->a->vector[1]*ins->b->vector[1]
+		                 + ins->a->vector[2]*ins->b->vector[2];
+		PRX_STEP;
+	PRX_OP(OP_MUL_FV)
+		ins->c->vector[0] = ins->a->_float * ins->b->vector[0];
+		ins->c->vector[1] = ins->a->_float * ins->b->vector[1];
+		ins->c->vector[2] = ins->a->_float * ins->b->vector[2];
+		PRX_STEP;
+	PRX_OP(OP_MUL_VF)
+		ins->c->vector[0] = ins->b->_float * ins->a->vector[0];
+		ins->c->vector[1] = ins->b->_float * ins->a->vector[1];
+		ins->c->vector[2] = ins->b->_float * ins->a->vector[2];
+		PRX_STEP;
+
+	PRX_OP(OP_DIV_F)
+		ins->c->_float = ins->a->_float / ins->b->_float;
+		PRX_STEP;
+
+	PRX_OP(OP_BITAND)
+		ins->c->_float = (int)ins->a->_float & (int)ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_BITOR)
+		ins->c->_float = (int)ins->a->_float | (int)ins->b->_float;
+		PRX_STEP;
+
+	PRX_OP(OP_GE)
+		ins->c->_float = ins->a->_float >= ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_LE)
+		ins->c->_float = ins->a->_float <= ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_GT)
+		ins->c->_float = ins->a->_float > ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_LT)
+		ins->c->_float = ins->a->_float < ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_AND)
+		ins->c->_float = ins->a->_float && ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_OR)
+		ins->c->_float = ins->a->_float || ins->b->_float;
+		PRX_STEP;
+
+	PRX_OP(OP_NOT_F)
+		ins->c->_float = !ins->a->_float;
+		PRX_STEP;
+	PRX_OP(OP_NOT_V)
+		ins->c->_float = !ins->a->vector[0] && !ins->a->vector[1] && !ins->a->vector[2];
+		PRX_STEP;
+	PRX_OP(OP_NOT_S)
+		ins->c->_float = !ins->a->string || !*PR1_GetString(ins->a->string);
+		PRX_STEP;
+	PRX_OP(OP_NOT_FNC)
+		ins->c->_float = !ins->a->function;
+		PRX_STEP;
+	PRX_OP(OP_NOT_ENT)
+		ins->c->_float = (PROG_TO_EDICT(ins->a->edict) == sv.edicts);
+		PRX_STEP;
+
+	PRX_OP(OP_EQ_F)
+		ins->c->_float = ins->a->_float == ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_EQ_V)
+		ins->c->_float = (ins->a->vector[0] == ins->b->vector[0]) &&
+		                 (ins->a->vector[1] == ins->b->vector[1]) &&
+		                 (ins->a->vector[2] == ins->b->vector[2]);
+		PRX_STEP;
+	PRX_OP(OP_EQ_S)
+		ins->c->_float = !strcmp(PR1_GetString(ins->a->string), PR1_GetString(ins->b->string));
+		PRX_STEP;
+	PRX_OP(OP_EQ_E)
+		ins->c->_float = ins->a->_int == ins->b->_int;
+		PRX_STEP;
+	PRX_OP(OP_EQ_FNC)
+		ins->c->_float = ins->a->function == ins->b->function;
+		PRX_STEP;
+
+	PRX_OP(OP_NE_F)
+		ins->c->_float = ins->a->_float != ins->b->_float;
+		PRX_STEP;
+	PRX_OP(OP_NE_V)
+		ins->c->_float = (ins->a->vector[0] != ins->b->vector[0]) ||
+		                 (ins->a->vector[1] != ins->b->vector[1]) ||
+		                 (ins->a->vector[2] != ins->b->vector[2]);
+		PRX_STEP;
+	PRX_OP(OP_NE_S)
+		ins->c->_float = strcmp(PR1_GetString(ins->a->string), PR1_GetString(ins->b->string));
+		PRX_STEP;
+	PRX_OP(OP_NE_E)
+		ins->c->_float = ins->a->_int != ins->b->_int;
+		PRX_STEP;
+	PRX_OP(OP_NE_FNC)
+		ins->c->_float = ins->a->function != ins->b->function;
+		PRX_STEP;
+
+		//==================
+	PRX_OP(OP_STORE_F)
+		ins->b->_int = ins->a->_int;
+		PRX_STEP;
+	PRX_OP(OP_STORE_V)
+		ins->b->vector[0] = ins->a->vector[0];
+		ins->b->vector[1] = ins->a->vector[1];
+		ins->b->vector[2] = ins->a->vector[2];
+		PRX_STEP;
+
+	PRX_OP(OP_STOREP_F)
+		ptr = (eval_t *)((byte *)sv.edicts + ins->b->_int);
+		ptr->_int = ins->a->_int;
+		if (pr_findindexactive)
+			PR_FindIndexTouch (ins->b->_int);
+		PRX_STEP;
+	PRX_OP(OP_STOREP_V)
+		ptr = (eval_t *)((byte *)sv.edicts + ins->b->_int);
+		ptr->vector[0] = ins->a->vector[0];
+		ptr->vector[1] = ins->a->vector[1];
+		ptr->vector[2] = ins->a->vector[2];
+		PRX_STEP;
+
+	PRX_OP(OP_ADDRESS)
+		ed = PROG_TO_EDICT(ins->a->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+			goto world_assignment;
+		ins->c->_int = (byte *)((int *)&ed->v + PR_FIELDOFS(ins->b->_int)) - (byte *)sv.edicts;
+		PRX_STEP;
+
+	PRX_OP(PRX_ADDRESS_STOREP)
+		ed = PROG_TO_EDICT(ins->a->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+			goto world_assignment;
+		ptr = (eval_t *)((int *)&ed->v + PR_FIELDOFS(ins->b->_int));
+		ins->c->_int = (byte *)ptr - (byte *)sv.edicts;
+		ptr->_int = ins->d->_int;
+		if (pr_findindexactive)
+			PR_FindIndexTouch (ins->c->_int);
+		ins += 2;
+		PRX_NEXT;
+	PRX_OP(PRX_ADDRESS_STOREP_V)
+		ed = PROG_TO_EDICT(ins->a->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+			goto world_assignment;
+		ptr = (eval_t *)((int *)&ed->v + PR_FIELDOFS(ins->b->_int));
+		ins->c->_int = (byte *)ptr - (byte *)sv.edicts;
+		ptr->vector[0] = ins->d->vector[0];
+		ptr->vector[1] = ins->d->vector[1];
+		ptr->vector[2] = ins->d->vector[2];
+		ins += 2;
+		PRX_NEXT;
+
+	PRX_OP(OP_LOAD_F)
+		ed = PROG_TO_EDICT(ins->a->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		//need for checking 'cmd mmode player N', if N >= 0x10000000 =(signed)=> negative
+		if (ins->b->_int >= 0)
+			ins->c->_int = ((eval_t *)((int *)&ed->v + PR_FIELDOFS(ins->b->_int)))->_int;
+		else
+			ins->c->_int = 0;
+		PRX_STEP;
+	PRX_OP(OP_LOAD_V)
+		ed = PROG_TO_EDICT(ins->a->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		ptr = (eval_t *)((int *)&ed->v + PR_FIELDOFS(ins->b->_int));
+		ins->c->vector[0] = ptr->vector[0];
+		ins->c->vector[1] = ptr->vector[1];
+		ins->c->vector[2] = ptr->vector[2];
+		PRX_STEP;
+
+		//==================
+
+	PRX_OP(OP_IFNOT)
+		if (!ins->a->_int)
+		{
+			PRX_JUMP;
+		}
+		PRX_STEP;
+	PRX_OP(OP_IF)
+		if (ins->a->_int)
+		{
+			PRX_JUMP;
+		}
+		PRX_STEP;
+	PRX_OP(OP_GOTO)
+		PRX_JUMP;
+
+	PRX_OP(PRX_EQ_F_IF)
+		i = ins->a->_float == ins->b->_float;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+	PRX_OP(PRX_NE_F_IF)
+		i = ins->a->_float != ins->b->_float;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+	PRX_OP(PRX_LE_IF)
+		i = ins->a->_float <= ins->b->_float;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+	PRX_OP(PRX_GE_IF)
+		i = ins->a->_float >= ins->b->_float;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+	PRX_OP(PRX_LT_IF)
+		i = ins->a->_float < ins->b->_float;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+	PRX_OP(PRX_GT_IF)
+		i = ins->a->_float > ins->b->_float;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+	PRX_OP(PRX_EQ_E_IF)
+		i = ins->a->_int == ins->b->_int;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+	PRX_OP(PRX_NE_E_IF)
+		i = ins->a->_int != ins->b->_int;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+	PRX_OP(PRX_NOT_F_IF)
+		i = !ins->a->_float;
+		ins->c->_float = i;
+		PRX_BRANCH(i);
+
+	PRX_OP(OP_CALL0)
+		s = pr_xstatement = ins - code;
+		pr_argc = ins->cond;
+		if (!ins->a->function)
+			PR_RunError ("NULL function");
+
+		newf = &pr_functions[ins->a->function];
+
+		if (newf->first_statement < 0)
+		{	// negative statements are built in functions
+			i = -newf->first_statement;
+			if (i >= pr_numbuiltins)
+				PR_RunError ("Bad builtin call number");
+			pr_builtins[i] ();
+
+			if (pr_trace)
+			{	// finish in the plain loop, it prints each statement
+				*runaway = budget;
+				return s;
+			}
+			PRX_STEP;
+		}
+
+		ins = code + PR_EnterFunction (newf) + 1;
+		PRX_NEXT;
+
+	PRX_OP(OP_RETURN)
+		pr_xstatement = ins - code;
+		pr_globals[OFS_RETURN] = ins->a->vector[0];
+		pr_globals[OFS_RETURN+1] = ins->a->vector[1];
+		pr_globals[OFS_RETURN+2] = ins->a->vector[2];
+
+		s = PR_LeaveFunction ();
+		if (pr_depth == exitdepth)
+		{
+			*runaway = budget;
+			return -1;		// all done
+		}
+		ins = code + s + 1;
+		PRX_NEXT;
+
+	PRX_OP(OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		if (ins->a->_float != ed->v.frame)
+		{
+			ed->v.frame = ins->a->_float;
+		}
+		ed->v.think = ins->b->function;
+		PRX_STEP;
+
+	PRX_END
+
+bad_opcode:
+	pr_xstatement = ins - code;
+	if (pr_xstatement >= progs->numstatements)
+	{
+		pr_xstatement = progs->numstatements - 1;
+		PR_RunError ("Statement out of range");
+	}
+	PR_RunError ("Bad opcode %i", pr_statements[pr_xstatement].op);
+	return -1;
+
+world_assignment:
+	pr_xstatement = ins - code;
+	PR_RunError ("assignment to world entity");
+	return -1;
+
+runaway_loop:
+	pr_xstatement = ins - code;
+	PR_RunError ("runaway loop error");
+	return -1;
+}
+
 /*
 ============================================================================
 PR_ExecuteProgram
@@ -385,6 +993,13 @@ void PR_ExecuteProgram (func_t fnum)
 
 	s = PR_EnterFunction (f);
 
+	if (sv_progsfast.value && !pr_trace)
+	{
+		s = PR_ExecuteDecoded (s, exitdepth, &runaway);
+		if (s < 0)
+			return;
+	}
+
 	while (1)
 	{
 		s++; // next statement
@@ -548,6 +1163,8 @@ void PR_ExecuteProgram (func_t fnum)
 		case OP_STOREP_FNC:		// pointers
 			ptr = (eval_t *)((byte *)sv.edicts + b->_int);
 			ptr->_int = a->_int;
+			if (pr_findindexactive)
+				PR_FindIndexTouch (b->_int);
 			break;
 		case OP_STOREP_V:
 			ptr = (eval_t *)((byte *)sv.edicts + b->_int);
@@ -701,6 +1318,11 @@ void PR1_SetString(string_t* address, char* s)
 		return;
 	}
 
+	if (pr_findindexactive && (byte *)address >= (byte *)sv.edicts
+		&& (byte *)address < (byte *)sv.edicts + sv.max_edicts * pr_edict_size) {
+		PR_FindIndexTouch ((byte *)address - (byte *)sv.edicts);
+	}
+
 	if (!s || !s[0]) {
 		*address = 0;
 		return;
@@ -872,6 +1494,8 @@ void PR1_UnLoadProgs(void)
 #endif
 		progs = NULL;
 	}
+
+	PR_ClearDecodedStatements ();
 }
 
 #endif // !CLIENTONLY
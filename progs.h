@@ -46,11 +46,15 @@ typedef struct link_s
 #define	EDICT_FROM_AREA(l)	((l)->ed)
 
 #define	MAX_ENT_LEAFS	16
+#define	MAX_ENT_GRIDCELLS	9	// bigger entities go to the grid's overflow lists
 
 typedef struct sv_edict_s
 {
 	qbool		free;
 	link_t		area;			// linked to a division node or leaf
+	link_t		gridlinks[MAX_ENT_GRIDCELLS];	// linked to spatial hash cells (sv_broadphase 1)
+	int			num_gridlinks;
+	unsigned int	areaquery;	// last SV_AreaEdicts() that looked at this edict
 
 	int         entnum;
 
@@ -60,6 +64,8 @@ typedef struct sv_edict_s
 	entity_state_t	baseline;
 
 	float		freetime;		// sv.time when the object was freed
+	int			freenext;		// ED_Alloc free list in freeing order, 0 if none
+	int			freeprev;
 	double		lastruntime;	// sv.time when SV_RunEntity was last called for this edict (Tonik)
 } sv_edict_t;
 
@@ -119,6 +125,10 @@ void NQP_Reset (void);
 void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
+void PR_ClearDecodedStatements (void);
+void PR_ClearFindIndex (void);
+void PR_FindIndexTouch (int ofs);
+int PR_FindIndexed (int start, int field, char *s);
 void PR_InitPatchTables (void);	// NQ progs support
 
 void PR_Profile_f (void);
@@ -172,6 +182,10 @@ extern	qbool	pr_trace;
 extern	dfunction_t	*pr_xfunction;
 extern	int		pr_xstatement;
 
+extern	cvar_t	sv_progsfast;
+extern	cvar_t	sv_progsfindindex;
+extern	qbool	pr_findindexactive;
+
 extern func_t mod_ConsoleCmd, mod_UserCmd;
 extern func_t mod_UserInfo_Changed, mod_localinfoChanged;
 extern func_t mod_ChatMessage;
@@ -100,6 +100,12 @@ void S_LocalSoundWithVol(char *sound, float volume);
 sfxcache_t *S_LoadSound (sfx_t *s);
 
 void SND_InitScaletable (void);
+const char *SND_MixerName (void);
+void S_MixBench_f (void);
+void SND_UpdateMixThreads (void);
+void SND_ShutdownMixThreads (void);
+void S_LockMixer(void);
+void S_UnlockMixer(void);
 int SND_Rate(int rate);
 
 void SND_ResampleStream(void *in, int inrate, int inwidth, int inchannels, int insamps,
@@ -129,6 +135,7 @@ extern cvar_t		s_loadas8bit;
 extern cvar_t		s_khz;
 extern cvar_t		s_volume;
 extern cvar_t		s_swapstereo;
+extern cvar_t		s_mixthreads;
 extern cvar_t		bgmvolume;
 
 #endif
@@ -33,6 +33,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "r_trace.h"
 #include "r_renderer.h"
 #include "tr_types.h"
+#include "parallel.h"
+#include <SDL.h>
 
 typedef struct dlightinfo_s {
 	int local[2];
@@ -160,16 +162,16 @@ static void R_BuildDlightList (msurface_t *surf)
 }
 
 //R_BuildDlightList must be called first!
-static void R_AddDynamicLights(msurface_t *surf)
+static void R_AddDynamicLights(msurface_t *surf, unsigned int *blocklights, const dlightinfo_t *lights, int count)
 {
 	int i, smax, tmax, s, t, sd, td, _sd, _td, irad, idist, iminlight, tmp;
-	dlightinfo_t *light;
+	const dlightinfo_t *light;
 	unsigned *dest;
 
 	smax = (surf->extents[0] >> 4) + 1;
 	tmax = (surf->extents[1] >> 4) + 1;
 
-	for (i = 0, light = dlightlist; i < numdlights; i++, light++) {
+	for (i = 0, light = lights; i < count; i++, light++) {
 		irad = light->rad;
 		iminlight = light->minlight;
 
@@ -209,28 +211,237 @@ static void R_AddDynamicLights(msurface_t *surf)
 	}
 }
 
-//Combine and scale multiple lightmaps into the 8.8 format in blocklights
-static void R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
+/*
+===============================================================================
+LIGHTMAP KERNELS
+
+accumulate adds one 8 bit lightmap scaled by a lightstyle into blocklights,
+store bounds and shifts a row of blocklights into the texture.  Any entry of
+lightmap_kernels builds the same texels, R_BuildLightmaps selects one.
+===============================================================================
+*/
+
+// brightest texel the store pass writes without scaling the colour down, in 8.16
+#define LIGHTMAP_SATURATION ((255 << 16) + (1 << 15))
+
+typedef struct lightmap_buildparams_s {
+	qbool fullbright;
+	unsigned int scale;   // gl_modulate and lightmode, applied when storing
+	int red, blue;        // byte offsets in the texel
+	byte invert;          // 255 for gl_invlightmaps, xor'ed into each colour
+} lightmap_buildparams_t;
+
+typedef struct lightmap_kernel_s {
+	simd_kernel_t kernel;
+	void (*accumulate)(unsigned int* bl, const byte* lightmap, int count, unsigned int scale);
+	void (*store)(byte* dest, const unsigned int* bl, int count, const lightmap_buildparams_t* params);
+} lightmap_kernel_t;
+
+static void R_LightmapBuildParams(lightmap_buildparams_t* params)
 {
-	int smax, tmax, i, j, size, blocksize, maps;
-	byte *lightmap;
-	unsigned scale, *bl;
-	qbool fullbright = false;
+	params->fullbright = (R_FullBrightAllowed() || !cl.worldmodel || !cl.worldmodel->lightdata);
+	params->scale = (lightmode == 2) ? (int)(256 * 1.5) : 256 * 2;
+	params->scale *= bound(0.5, gl_modulate.value, 3);
+	params->red = GL_Supported(R_SUPPORT_BGRA_LIGHTMAPS) ? 2 : 0;
+	params->blue = 2 - params->red;
+	params->invert = gl_invlightmaps ? 255 : 0;
+}
 
-	R_TraceEnterRegion(va("R_BuildLightMap(%d)", surf->surfacenum), true);
+static void R_LightmapAccumulate_C(unsigned int* bl, const byte* lightmap, int count, unsigned int scale)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		bl[i] += lightmap[i] * scale;
+	}
+}
+
+static void R_LightmapStoreTexel(byte* dest, const unsigned int* bl, const lightmap_buildparams_t* params)
+{
+	unsigned r, g, b, m;
+
+	r = bl[0] * params->scale;
+	g = bl[1] * params->scale;
+	b = bl[2] * params->scale;
+	m = max(r, g);
+	m = max(m, b);
+	if (m > LIGHTMAP_SATURATION) {
+		unsigned s = (LIGHTMAP_SATURATION << 8) / m;
+		r = (r >> 8) * s;
+		g = (g >> 8) * s;
+		b = (b >> 8) * s;
+	}
+	dest[params->red] = (r >> 16) ^ params->invert;
+	dest[1] = (g >> 16) ^ params->invert;
+	dest[params->blue] = (b >> 16) ^ params->invert;
+	dest[3] = 255;
+}
+
+static void R_LightmapStore_C(byte* dest, const unsigned int* bl, int count, const lightmap_buildparams_t* params)
+{
+	int i;
+
+	for (i = 0; i < count; i++, bl += 3, dest += 4) {
+		R_LightmapStoreTexel(dest, bl, params);
+	}
+}
+
+#ifdef SIMD_SSE2
+// the 16 bit multiply needs the lightstyle to fit, which all of the standard ones do
+static void R_LightmapAccumulate_SSE2(unsigned int* bl, const byte* lightmap, int count, unsigned int scale)
+{
+	int i = 0;
+
+	if (scale <= 0xFFFF) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i s = _mm_set1_epi16((short)scale);
+
+		for ( ; i + 16 <= count; i += 16) {
+			__m128i src = _mm_loadu_si128((const __m128i*)(lightmap + i));
+			__m128i lo = _mm_unpacklo_epi8(src, zero);
+			__m128i hi = _mm_unpackhi_epi8(src, zero);
+			__m128i lo_l = _mm_mullo_epi16(lo, s), lo_h = _mm_mulhi_epu16(lo, s);
+			__m128i hi_l = _mm_mullo_epi16(hi, s), hi_h = _mm_mulhi_epu16(hi, s);
+			__m128i* out = (__m128i*)(bl + i);
+
+			_mm_storeu_si128(out + 0, _mm_add_epi32(_mm_loadu_si128(out + 0), _mm_unpacklo_epi16(lo_l, lo_h)));
+			_mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_unpackhi_epi16(lo_l, lo_h)));
+			_mm_storeu_si128(out + 2, _mm_add_epi32(_mm_loadu_si128(out + 2), _mm_unpacklo_epi16(hi_l, hi_h)));
+			_mm_storeu_si128(out + 3, _mm_add_epi32(_mm_loadu_si128(out + 3), _mm_unpackhi_epi16(hi_l, hi_h)));
+		}
+	}
+
+	R_LightmapAccumulate_C(bl + i, lightmap + i, count - i, scale);
+}
+#endif
+
+#ifdef SIMD_AVX2
+SIMD_TARGET("avx2")
+static void R_LightmapAccumulate_AVX2(unsigned int* bl, const byte* lightmap, int count, unsigned int scale)
+{
+	const __m256i s = _mm256_set1_epi32(scale);
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m256i src = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(lightmap + i)));
+		__m256i* out = (__m256i*)(bl + i);
+
+		_mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), _mm256_mullo_epi32(src, s)));
+	}
+
+	R_LightmapAccumulate_C(bl + i, lightmap + i, count - i, scale);
+}
+
+// four texels at a time, groups with a texel over LIGHTMAP_SATURATION go
+// through the C path for the division
+SIMD_TARGET("avx2")
+static void R_LightmapStore_AVX2(byte* dest, const unsigned int* bl, int count, const lightmap_buildparams_t* params)
+{
+	const __m128i scale = _mm_set1_epi32(params->scale);
+	const __m128i sign = _mm_set1_epi32(0x80000000);
+	const __m128i limit = _mm_set1_epi32((int)(LIGHTMAP_SATURATION ^ 0x80000000));
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	const __m128i invert = _mm_set1_epi32(params->invert ? 0x00FFFFFF : 0);
+	const __m128i order = params->red ?
+		_mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) :
+		_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4, bl += 12, dest += 16) {
+		__m128i v0 = _mm_mullo_epi32(_mm_loadu_si128((const __m128i*)bl + 0), scale);
+		__m128i v1 = _mm_mullo_epi32(_mm_loadu_si128((const __m128i*)bl + 1), scale);
+		__m128i v2 = _mm_mullo_epi32(_mm_loadu_si128((const __m128i*)bl + 2), scale);
+		__m128i over = _mm_or_si128(
+			_mm_or_si128(_mm_cmpgt_epi32(_mm_xor_si128(v0, sign), limit), _mm_cmpgt_epi32(_mm_xor_si128(v1, sign), limit)),
+			_mm_cmpgt_epi32(_mm_xor_si128(v2, sign), limit)
+		);
+		__m128i texels;
+
+		if (_mm_movemask_epi8(over)) {
+			R_LightmapStore_C(dest, bl, 4, params);
+			continue;
+		}
+
+		// every channel is at most 255 now, so the saturating packs keep them
+		texels = _mm_packus_epi16(
+			_mm_packs_epi32(_mm_srli_epi32(v0, 16), _mm_srli_epi32(v1, 16)),
+			_mm_packs_epi32(_mm_srli_epi32(v2, 16), _mm_setzero_si128())
+		);
+		texels = _mm_or_si128(_mm_xor_si128(_mm_shuffle_epi8(texels, order), invert), alpha);
+		_mm_storeu_si128((__m128i*)dest, texels);
+	}
+
+	R_LightmapStore_C(dest, bl, count - i, params);
+}
+#endif
+
+#ifdef SIMD_NEON
+static void R_LightmapAccumulate_NEON(unsigned int* bl, const byte* lightmap, int count, unsigned int scale)
+{
+	int i = 0;
+
+	if (scale <= 0xFFFF) {
+		for ( ; i + 16 <= count; i += 16) {
+			uint8x16_t src = vld1q_u8(lightmap + i);
+			uint16x8_t lo = vmovl_u8(vget_low_u8(src));
+			uint16x8_t hi = vmovl_u8(vget_high_u8(src));
+
+			vst1q_u32(bl + i + 0, vmlal_n_u16(vld1q_u32(bl + i + 0), vget_low_u16(lo), (uint16_t)scale));
+			vst1q_u32(bl + i + 4, vmlal_n_u16(vld1q_u32(bl + i + 4), vget_high_u16(lo), (uint16_t)scale));
+			vst1q_u32(bl + i + 8, vmlal_n_u16(vld1q_u32(bl + i + 8), vget_low_u16(hi), (uint16_t)scale));
+			vst1q_u32(bl + i + 12, vmlal_n_u16(vld1q_u32(bl + i + 12), vget_high_u16(hi), (uint16_t)scale));
+		}
+	}
+
+	R_LightmapAccumulate_C(bl + i, lightmap + i, count - i, scale);
+}
+#endif
+
+static const lightmap_kernel_t lightmap_kernels[] = {
+	{ { "C", 0 }, R_LightmapAccumulate_C, R_LightmapStore_C },
+#ifdef SIMD_SSE2
+	{ { "SSE2", 0 }, R_LightmapAccumulate_SSE2, R_LightmapStore_C },
+#endif
+#ifdef SIMD_AVX2
+	{ { "AVX2", SIMD_CPU_AVX2 }, R_LightmapAccumulate_AVX2, R_LightmapStore_AVX2 },
+#endif
+#ifdef SIMD_NEON
+	{ { "NEON", 0 }, R_LightmapAccumulate_NEON, R_LightmapStore_C },
+#endif
+};
+static const lightmap_kernel_t* lightmap_kernel = &lightmap_kernels[0];
+
+static void R_LightmapSelectKernel(void)
+{
+	lightmap_kernel = (const lightmap_kernel_t*)SIMD_SelectKernel(lightmap_kernels, sizeof(lightmap_kernels[0]), sizeof(lightmap_kernels) / sizeof(lightmap_kernels[0]));
+}
+
+// Remembers the lightstyles and dlights the lightmap is about to be built
+// with, R_RenderDynamicLightmaps compares against these next frame
+static void R_CacheLightMapState(msurface_t *surf)
+{
+	int maps;
 
 	surf->cached_dlight = !!numdlights;
+	for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++) {
+		surf->cached_light[maps] = d_lightstylevalue[surf->styles[maps]];	// 8.8 fraction
+	}
+}
+
+//Combine and scale multiple lightmaps into the 8.8 format in blocklights,
+//then write them to dest.  Only touches surf for reading, so can run on any thread
+static void R_FillLightMap(msurface_t *surf, byte *dest, int stride, unsigned int *blocklights, const dlightinfo_t *lights, int count, const lightmap_buildparams_t *params)
+{
+	int smax, tmax, i, blocksize, maps;
+	byte *lightmap;
+	unsigned *bl;
 
 	smax = (surf->extents[0] >> 4) + 1;
 	tmax = (surf->extents[1] >> 4) + 1;
-	size = smax * tmax;
-	blocksize = size * 3;
+	blocksize = smax * tmax * 3;
 	lightmap = surf->samples;
 
-	// check for full bright or no light data
-	fullbright = (R_FullBrightAllowed() || !cl.worldmodel || !cl.worldmodel->lightdata);
-
-	if (fullbright) {	// set to full bright
+	if (params->fullbright) {	// set to full bright
 		for (i = 0; i < blocksize; i++) {
 			blocklights[i] = 255 << 8;
 		}
@@ -238,80 +449,159 @@ static void R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	else {
 		// clear to no light
 		memset(blocklights, 0, blocksize * sizeof(int));
-	}
-
-	// add all the lightmaps
-	for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++) {
-		scale = d_lightstylevalue[surf->styles[maps]];
-		surf->cached_light[maps] = scale;	// 8.8 fraction
 
-		if (!fullbright && lightmap) {
-			bl = blocklights;
-			for (i = 0; i < blocksize; i++) {
-				*bl++ += lightmap[i] * scale;
+		// add all the lightmaps
+		if (lightmap) {
+			for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++) {
+				lightmap_kernel->accumulate(blocklights, lightmap, blocksize, surf->cached_light[maps]);
+				lightmap += blocksize;		// skip to next lightmap
 			}
-			lightmap += blocksize;		// skip to next lightmap
 		}
-	}
 
-	// add all the dynamic lights
-	if (!fullbright && numdlights) {
-		R_AddDynamicLights(surf);
+		// add all the dynamic lights
+		if (count) {
+			R_AddDynamicLights(surf, blocklights, lights, count);
+		}
 	}
 
 	// bound, invert, and shift
-	bl = blocklights;
-	stride -= smax * 4;
-
-	scale = (lightmode == 2) ? (int)(256 * 1.5) : 256 * 2;
-	scale *= bound(0.5, gl_modulate.value, 3);
-	for (i = 0; i < tmax; i++, dest += stride) {
-		for (j = smax; j; j--) {
-			unsigned r, g, b, m;
-			r = bl[0] * scale;
-			g = bl[1] * scale;
-			b = bl[2] * scale;
-			m = max(r, g);
-			m = max(m, b);
-			if (m > ((255 << 16) + (1 << 15))) {
-				unsigned s = (((255 << 16) + (1 << 15)) << 8) / m;
-				r = (r >> 8) * s;
-				g = (g >> 8) * s;
-				b = (b >> 8) * s;
-			}
-			if (gl_invlightmaps) {
-				if (GL_Supported(R_SUPPORT_BGRA_LIGHTMAPS)) {
-					dest[2] = 255 - (r >> 16);
-					dest[1] = 255 - (g >> 16);
-					dest[0] = 255 - (b >> 16);
-				}
-				else {
-					dest[0] = 255 - (r >> 16);
-					dest[1] = 255 - (g >> 16);
-					dest[2] = 255 - (b >> 16);
-				}
-			}
-			else {
-				if (GL_Supported(R_SUPPORT_BGRA_LIGHTMAPS)) {
-					dest[2] = r >> 16;
-					dest[1] = g >> 16;
-					dest[0] = b >> 16;
-				}
-				else {
-					dest[0] = r >> 16;
-					dest[1] = g >> 16;
-					dest[2] = b >> 16;
-				}
-			}
-			dest[3] = 255;
-			bl += 3;
-			dest += 4;
-		}
+	for (i = 0, bl = blocklights; i < tmax; i++, dest += stride, bl += smax * 3) {
+		lightmap_kernel->store(dest, bl, smax, params);
+	}
+}
+
+static void R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
+{
+	lightmap_buildparams_t params;
+
+	R_TraceEnterRegion(va("R_BuildLightMap(%d)", surf->surfacenum), true);
+
+	R_CacheLightMapState(surf);
+	R_LightmapBuildParams(&params);
+	R_FillLightMap(surf, dest, stride, blocklights, dlightlist, numdlights, &params);
+
+	R_TraceLeaveFunctionRegion;
+}
+
+/*
+===============================================================================
+LIGHTMAP THREADS
+
+With r_lightmap_threads set, R_RenderAllDynamicLightmaps only queues the
+lightmaps that need rebuilding, along with a copy of their dlight list.
+The queue is then built by the calling thread and the lightmap threads
+together, each with its own blocklights, before anything is uploaded.
+Surfaces cover separate parts of the lightmap pages, so the threads never
+write the same texels.
+===============================================================================
+*/
+
+#define LIGHTMAP_THREADS_MIN_QUEUE 16   // smaller queues aren't worth waking the threads for
+
+typedef struct lightmap_job_s {
+	msurface_t* surf;
+	byte* dest;
+	int firstdlight;
+	int numdlights;
+} lightmap_job_t;
+
+static workers_t* lightmap_threads;
+
+static qbool lightmap_queue_active;
+static lightmap_job_t* lightmap_queue;
+static int lightmap_queue_count, lightmap_queue_size;
+static dlightinfo_t* lightmap_queue_dlights;
+static int lightmap_queue_numdlights, lightmap_queue_dlightsize;
+static lightmap_buildparams_t lightmap_queue_params;
+static SDL_atomic_t lightmap_queue_next;
+
+static void R_RunLightMapQueue(unsigned int* bl)
+{
+	const lightmap_job_t* job;
+	int i;
+
+	while ((i = SDL_AtomicAdd(&lightmap_queue_next, 1)) < lightmap_queue_count) {
+		job = &lightmap_queue[i];
+		R_FillLightMap(job->surf, job->dest, LIGHTMAP_WIDTH * 4, bl, lightmap_queue_dlights + job->firstdlight, job->numdlights, &lightmap_queue_params);
+	}
+}
+
+// local is the thread's blocklights
+static void R_LightmapThread(int index, void* local)
+{
+	R_RunLightMapQueue((unsigned int*)local);
+}
+
+static void R_BeginLightMapQueue(void)
+{
+	if (Workers_Changed(lightmap_threads, r_lightmap_threads.integer)) {
+		Workers_Stop(lightmap_threads);
+		lightmap_threads = Workers_Start("lightmap", r_lightmap_threads.integer, R_LightmapThread, sizeof(blocklights));
+	}
+
+	lightmap_queue_active = (Workers_Count(lightmap_threads) > 0);
+	lightmap_queue_count = 0;
+	lightmap_queue_numdlights = 0;
+	if (lightmap_queue_active) {
+		R_LightmapBuildParams(&lightmap_queue_params);
+	}
+}
+
+// takes the dlight list from R_BuildDlightList
+static void R_QueueLightMap(msurface_t* surf, byte* dest)
+{
+	lightmap_job_t* job;
+
+	R_CacheLightMapState(surf);
+
+	if (lightmap_queue_count >= lightmap_queue_size) {
+		lightmap_queue_size = max(256, lightmap_queue_size * 2);
+		lightmap_queue = Q_realloc(lightmap_queue, lightmap_queue_size * sizeof(lightmap_queue[0]));
+	}
+	if (lightmap_queue_numdlights + numdlights > lightmap_queue_dlightsize) {
+		lightmap_queue_dlightsize = max(lightmap_queue_numdlights + numdlights, lightmap_queue_dlightsize * 2);
+		lightmap_queue_dlights = Q_realloc(lightmap_queue_dlights, lightmap_queue_dlightsize * sizeof(lightmap_queue_dlights[0]));
 	}
 
+	job = &lightmap_queue[lightmap_queue_count++];
+	job->surf = surf;
+	job->dest = dest;
+	job->firstdlight = lightmap_queue_numdlights;
+	job->numdlights = numdlights;
+	memcpy(lightmap_queue_dlights + lightmap_queue_numdlights, dlightlist, numdlights * sizeof(dlightlist[0]));
+	lightmap_queue_numdlights += numdlights;
+}
+
+static void R_FlushLightMapQueue(void)
+{
+	int threads;
+
+	lightmap_queue_active = false;
+	if (!lightmap_queue_count) {
+		return;
+	}
+
+	R_TraceEnterFunctionRegion;
+	SDL_AtomicSet(&lightmap_queue_next, 0);
+	threads = (lightmap_queue_count >= LIGHTMAP_THREADS_MIN_QUEUE ? Workers_Count(lightmap_threads) : 0);
+	Workers_Run(lightmap_threads, threads);
+	R_RunLightMapQueue(blocklights);
+	Workers_Wait(lightmap_threads, threads);
+	lightmap_queue_count = 0;
 	R_TraceLeaveFunctionRegion;
 }
 
+static void R_ShutdownLightmapThreads(void)
+{
+	Workers_Stop(lightmap_threads);
+	lightmap_threads = NULL;
+
+	Q_free(lightmap_queue);
+	Q_free(lightmap_queue_dlights);
+	lightmap_queue_size = lightmap_queue_dlightsize = 0;
+	lightmap_queue_count = lightmap_queue_numdlights = 0;
+}
+
 void R_UploadLightMap(int textureUnit, int lightmapnum)
 {
 	lightmap_data_t* lm = &lightmaps[lightmapnum];
@@ -392,7 +682,12 @@ void R_RenderDynamicLightmaps(msurface_t *fa, qbool world)
 		theRect->h = fa->light_t - theRect->t + tmax;
 	}
 	base = lm->rawdata + (fa->light_t * LIGHTMAP_WIDTH + fa->light_s) * 4;
-	R_BuildLightMap (fa, base, LIGHTMAP_WIDTH * 4);
+	if (lightmap_queue_active) {
+		R_QueueLightMap(fa, base);
+	}
+	else {
+		R_BuildLightMap(fa, base, LIGHTMAP_WIDTH * 4);
+	}
 }
 
 void R_LightmapFrameInit(void)
@@ -497,6 +792,8 @@ void R_RenderAllDynamicLightmaps(model_t *model)
 
 	R_TraceEnterFunctionRegion;
 
+	R_BeginLightMapQueue();
+
 	for (i = 0; i < model->numtextures; i++) {
 		if (!model->textures[i]) {
 			continue;
@@ -521,6 +818,8 @@ void R_RenderAllDynamicLightmaps(model_t *model)
 		}
 	}
 
+	R_FlushLightMapQueue();
+
 	if (R_UseImmediateOpenGL()) {
 		R_UploadChangedLightmaps();
 	}
@@ -810,6 +1109,7 @@ void R_BuildLightmaps(void)
 	last_lightmap_updated = 0;
 
 	gl_invlightmaps = R_UseImmediateOpenGL();
+	R_LightmapSelectKernel();
 
 	r_framecount = 1;		// no dlightcache
 	for (j = 1; j < MAX_MODELS; j++) {
@@ -922,6 +1222,8 @@ void R_InvalidateLightmapTextures(void)
 
 void R_LightmapShutdown(void)
 {
+	R_ShutdownLightmapThreads();
+
 	Q_free(lightmaps);
 	lightmap_array_size = 0;
 
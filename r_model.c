@@ -241,6 +241,7 @@ void Mod_ReloadModels(qbool vid_restart)
 model_t *Mod_LoadModel(model_t *mod, qbool crash)
 {
 	unsigned *buf;
+	unsigned *aligned_buf = NULL;
 	int namelen;
 	int filesize;
 
@@ -262,12 +263,12 @@ model_t *Mod_LoadModel(model_t *mod, qbool crash)
 		char newname[MAX_QPATH];
 		COM_StripExtension(mod->name, newname, sizeof(newname));
 		COM_DefaultExtension(newname, ".md3");
-		buf = (unsigned *)FS_LoadTempFile(newname, &filesize);
+		buf = (unsigned *)FS_MapTempFile(newname, &filesize);
 	}
 
 	// load the file
 	if (!buf) {
-		buf = (unsigned *)FS_LoadTempFile(mod->name, &filesize);
+		buf = (unsigned *)FS_MapTempFile(mod->name, &filesize);
 	}
 	if (!buf) {
 		if (crash) {
@@ -276,6 +277,20 @@ model_t *Mod_LoadModel(model_t *mod, qbool crash)
 		return NULL;
 	}
 
+	if (filesize < 4) {
+		if (crash) {
+			Host_Error("Mod_LoadModel: %s is too short", mod->name);
+		}
+		return NULL;
+	}
+
+	// A mapped file starts wherever it is inside its .pak, the loaders read it as structs
+	if ((uintptr_t)buf % 4) {
+		aligned_buf = Q_malloc(filesize);
+		memcpy(aligned_buf, buf, filesize);
+		buf = aligned_buf;
+	}
+
 	// allocate a new model
 	COM_FileBase(mod->name, loadname);
 	loadmodel = mod;
@@ -284,7 +299,7 @@ model_t *Mod_LoadModel(model_t *mod, qbool crash)
 	// call the apropriate loader
 	mod->needload = false;
 
-	switch (LittleLong(*((unsigned *)buf))) {
+	switch (LittleLong(*buf)) {
 	case IDPOLYHEADER:
 		Mod_LoadAliasModel(mod, buf, filesize, loadname);
 		break;
@@ -302,6 +317,8 @@ model_t *Mod_LoadModel(model_t *mod, qbool crash)
 		break;
 	}
 
+	Q_free(aligned_buf);
+
 	return mod;
 }
 
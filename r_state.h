@@ -185,6 +185,7 @@ typedef struct rendering_state_s {
 
 	// misc (texture downloads, screenshots & atlas building)
 	int pack_alignment;
+	int unpack_row_length;
 
 	// meta
 	qbool initialized;
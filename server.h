@@ -100,6 +100,12 @@ typedef struct
 	                                // be used to reference the world ent
 	sv_edict_t  sv_edicts[MAX_EDICTS]; // part of the edict_t
 	int         max_edicts;         // might not MAX_EDICTS if mod allocates memory
+	int         free_edicts_head;   // edict freed longest ago, 0 if none
+	int         free_edicts_tail;
+	int         num_free_edicts;
+	int         alloc_reused;       // ED_Alloc counters for edictcount
+	int         alloc_new;
+	int         alloc_overflow;
 
 	byte		*pvs, *phs;			// fully expanded and decompressed
 
@@ -436,6 +442,7 @@ typedef struct mvdpendingdest_s
 {
 	qbool error; //disables writers, quit ASAP.
 	int socket;
+	netpoll_t poll;
 
 	char inbuffer[2048];
 	char outbuffer[2048];
@@ -456,6 +463,15 @@ typedef struct mvdpendingdest_s
 
 typedef enum {DEST_NONE, DEST_FILE, DEST_BUFFEREDFILE, DEST_STREAM} desttype_t;
 
+#define DEST_MIN_SPANS			1024	// plus one per chunk the cache holds
+
+// part of a demo data chunk shared by several dests
+typedef struct demospan_s
+{
+	struct demochunk_s *chunk;
+	int start, end;
+} demospan_t;
+
 #define MAX_PROXY_INBUFFER		4096 /* qqshka: too small??? */
 
 typedef struct mvddest_s
@@ -465,14 +481,25 @@ typedef struct mvddest_s
 	desttype_t desttype;
 
 	int socket;
+	netpoll_t poll; // DEST_STREAM only
 	FILE *file;
 
 	char name[MAX_QPATH];
 	char path[MAX_QPATH];
 
-	char *cache;
-	int cacheused;
-	int maxcachesize;
+	// DEST_BUFFEREDFILE/DEST_STREAM: spans of shared demo data, written out by the demo I/O thread
+	demospan_t *spans;				// ring of maxspans, see DestInitSpans()
+	int maxspans;
+	volatile int spanhead;			// end of spans visible to the I/O thread, moved by the server thread
+	int spanwrite;					// end of spans queued by the server thread
+	volatile int spantail;			// next span to write, moved by the I/O thread
+	int spanoffset;					// bytes of spans[spantail] already written
+	demospan_t pending;				// not queued yet, grows while writes are contiguous
+	int maxcachesize;				// limit on queued bytes not written yet
+	unsigned int queuedbytes;
+	volatile unsigned int writtenbytes;
+	unsigned int lastwrittenbytes;	// writtenbytes seen by the last DestFlush()
+	volatile qbool ioerror;			// set by the I/O thread
 
 	unsigned int totalsize;
 
@@ -572,6 +599,7 @@ typedef struct svtcpstream_s
 	int                     outlen;                            // how much bytes we have in outbuffer
 	char                    outbuffer[1500 * 5];               // send buffer
 	qbool                   drop;                              // do we need drop that connection ASAP
+	netpoll_t               poll;                              // socket readiness
 	float                   timeouttime;                       // I/O timeout
 	netadr_t                remoteaddr;                        // peer remoter addr
 	struct svtcpstream_s    *next;                             // next tcpconnection in list
@@ -588,6 +616,7 @@ typedef struct
 
 // TCPCONNECT -->
 	int				sockettcp;		// server TCP socket, used for QTV/TCPCONNECT.
+	netpoll_t		sockettcp_poll;	// pending connections on sockettcp
 	svtcpstream_t *	tcpstreams;
 // <-- TCPCONNECT
 
@@ -710,6 +739,7 @@ extern	cvar_t	sv_paused; // 1 - normal, 2 - auto (single player), 3 - both
 extern	cvar_t	sv_maxspeed;
 extern	cvar_t	sv_mintic, sv_maxtic, sv_maxfps;
 extern	cvar_t	sv_antilag, sv_antilag_no_pred, sv_antilag_projectiles;
+extern	cvar_t	sv_broadphase;
 
 extern	int current_skill;
 
@@ -866,6 +896,7 @@ void SV_RunBots(void);
 typedef enum {RD_NONE, RD_CLIENT, RD_PACKET, RD_MOD} redirect_t;
 void SV_BeginRedirect (redirect_t rd);
 void SV_EndRedirect (void);
+extern sizebuf_t *sv_redirect_capture;
 qbool SV_AddToRedirect(char *msg);
 
 void SV_Multicast(vec3_t origin, int to);
@@ -961,6 +992,7 @@ void SV_MVD_SendInitialGamestate(mvddest_t *dest);
 qbool SV_MVD_Record (mvddest_t *dest, qbool mapchange);
 
 mvddest_t	*DestByName (char *name);
+void		DestInitSpans (mvddest_t *d);
 void		DestClose (mvddest_t *d, qbool destroyfiles);
 
 int DemoWriteDest (void *data, int len, mvddest_t *d);
@@ -91,6 +91,7 @@ cvar_t s_ambientlevel = {"s_ambientlevel", "0.3"};
 cvar_t s_ambientfade = {"s_ambientfade", "100"};
 cvar_t s_show = {"s_show", "0"};
 cvar_t s_swapstereo = {"s_swapstereo", "0"};
+cvar_t s_mixthreads = {"s_mixthreads", "0"};
 cvar_t s_linearresample = {"s_linearresample", "0", CVAR_LATCH_SOUND };
 cvar_t s_linearresample_stream = {"s_linearresample_stream", "0"};
 cvar_t s_khz = {"s_khz", "11", CVAR_NONE, OnChange_s_khz}; // If > 11, default sounds are noticeably different.
@@ -137,12 +138,12 @@ static void S_ListAudioDevices(void)
 	S_ListAudioDevicesInternal (true);
 }
 
-static void S_LockMixer(void)
+void S_LockMixer(void)
 {
 	SDL_LockMutex(smutex);
 }
 
-static void S_UnlockMixer(void)
+void S_UnlockMixer(void)
 {
 	SDL_UnlockMutex(smutex);
 }
@@ -159,6 +160,7 @@ static void S_SoundInfo_f (void)
 	Com_Printf("%5d samplebits\n", shw->samplebits);
 	Com_Printf("%5d kHz\n", shw->khz);
 	Com_Printf("%5u total_channels\n", total_channels);
+	Com_Printf("%5s mixer\n", SND_MixerName());
 }
 
 static void S_SDL_callback(void *userdata, Uint8 *stream, int len)
@@ -188,6 +190,7 @@ static void S_SDL_Shutdown(void)
 
 	SDL_CloseAudioDevice(audiodevid);
 	audiodevid = 0;
+	SND_ShutdownMixThreads();
 
 	if (SDL_WasInit(SDL_INIT_AUDIO) != 0)
 		SDL_QuitSubSystem(SDL_INIT_AUDIO);
@@ -436,6 +439,7 @@ static void S_Register_RegularCvarsAndCommands(void)
 	Cvar_Register(&s_ambientfade);
 	Cvar_Register(&s_show);
 	Cvar_Register(&s_swapstereo);
+	Cvar_Register(&s_mixthreads);
 	Cvar_Register(&s_linearresample_stream);
 	Cvar_Register(&s_desiredsamples);
 	Cvar_Register(&s_silent_racing);
@@ -453,6 +457,7 @@ static void S_Register_RegularCvarsAndCommands(void)
 	Cmd_AddCommand("soundlist", S_SoundList_f);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
 	Cmd_AddCommand("s_listdrivers", S_ListDrivers);
+	Cmd_AddCommand("s_mixbench", S_MixBench_f);
 
 	/* Naming it like this to be seen together with s_audiodevice cvar */
 	Cmd_AddCommand("s_audiodevicelist", S_ListAudioDevices);
@@ -479,7 +484,7 @@ void S_Init (void)
 		Com_Printf_State (PRINT_INFO, "[sound] Sound is already initialized!\n");
 		return;
 	}
-	if (COM_CheckParm(cmdline_param_client_nosound)) {
+	if (COM_CheckParm(cmdline_param_client_nosound) || COM_CheckParm(cmdline_param_client_demostats)) {
 		Cmd_AddLegacyCommand ("play", ""); // just suppress warnings
 		return;
 	}	
@@ -834,6 +839,55 @@ static void S_UpdateAmbientSounds (void)
 	}
 }
 
+// Loads the sounds of channels that don't have them yet, so the mixer never
+// has to.  The file is read and decoded into a copy of the sfx with the mixer
+// unlocked, only the finished buffer is handed over under the lock.
+static void S_LoadChannelSounds(void)
+{
+	static sfx_t *pending[MAX_CHANNELS];
+	static void *loaded[MAX_CHANNELS];
+	unsigned int i, j, count = 0;
+	channel_t *ch;
+	sfx_t load;
+
+	S_LockMixer();
+	ch = channels;
+	for (i = 0; i < total_channels; i++, ch++) {
+		if (!ch->sfx || ch->sfx->buf)
+			continue;
+		for (j = 0; j < count && pending[j] != ch->sfx; j++)
+			;
+		if (j == count)
+			pending[count++] = ch->sfx;
+	}
+	S_UnlockMixer();
+
+	if (!count)
+		return;
+
+	for (i = 0; i < count; i++) {
+		load = *pending[i];
+		S_LoadSound(&load);
+		loaded[i] = load.buf;
+	}
+
+	S_LockMixer();
+	for (i = 0; i < count; i++) {
+		if (!pending[i]->buf)
+			pending[i]->buf = loaded[i];
+		else
+			Q_free(loaded[i]);
+	}
+
+	// drop the channels whose sound couldn't be loaded
+	ch = channels;
+	for (i = 0; i < total_channels; i++, ch++) {
+		if (ch->sfx && !ch->sfx->buf)
+			ch->sfx = NULL;
+	}
+	S_UnlockMixer();
+}
+
 //Called once each time through the main loop
 void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 {
@@ -844,6 +898,9 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	if (!snd_initialized || !snd_started || !shw)
 		return;
 
+	SND_UpdateMixThreads();
+	S_LoadChannelSounds();
+
 	S_LockMixer();
 
 	VectorCopy(origin, listener_origin);
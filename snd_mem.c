@@ -687,7 +687,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	// load it in
 	snprintf(namebuffer, sizeof(namebuffer), "sound/%s", s->name);
 
-	if (!(data = FS_LoadTempFile(namebuffer, &filesize))) {
+	if (!(data = FS_MapTempFile(namebuffer, &filesize))) {
 		Com_Printf ("Couldn't load %s\n", namebuffer);
 		return NULL;
 	}
@@ -913,7 +913,7 @@ static void COM_CharBias (signed char *c, int size)
 sfxcache_t *S_LoadSound (sfx_t *s)
 {
 	char namebuffer[256];
-	unsigned char *data;
+	unsigned char *data, *samples, *aligned = NULL;
 	wavinfo_t info;
 	int filesize;
 
@@ -924,7 +924,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	// load it in
 	snprintf(namebuffer, sizeof(namebuffer), "sound/%s", s->name);
 
-	if (!(data = FS_LoadTempFile(namebuffer, &filesize))) {
+	if (!(data = FS_MapTempFile(namebuffer, &filesize))) {
 		Com_Printf ("Couldn't load %s\n", namebuffer);
 		return NULL;
 	}
@@ -939,17 +939,27 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 		return NULL;
 	}
 
-	if (info.dataofs + info.samples * info.channels > filesize) {
+	if (info.dataofs + info.samples * info.channels * info.width > filesize) {
 		Com_Printf("%s is corrupt/truncated, delete and re-download\n", s->name);
 		return NULL;
 	}
 
+	// a mapped file can leave 16-bit samples on an odd address, copy them out then
+	samples = data + info.dataofs;
+	if (info.width == 2 && ((uintptr_t)samples % 2)) {
+		aligned = Q_malloc(info.samples * info.channels * 2);
+		memcpy(aligned, samples, info.samples * info.channels * 2);
+		samples = aligned;
+	}
+
 	if (info.width == 1)
-		COM_CharBias((signed char*)data + info.dataofs, info.samples * info.channels);
+		COM_CharBias((signed char*)samples, info.samples * info.channels);
 	else if (info.width == 2)
-		COM_SwapLittleShortBlock((short *)(data + info.dataofs), info.samples * info.channels);
+		COM_SwapLittleShortBlock((short *)samples, info.samples * info.channels);
+
+	ResampleSfx (s, info.rate, info.channels, info.width, info.samples, info.loopstart, samples);
 
-	ResampleSfx (s, info.rate, info.channels, info.width, info.samples, info.loopstart, data + info.dataofs);
+	Q_free(aligned);
 
 	return s->buf;
 }
@@ -21,9 +21,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // snd_mix.c -- portable code to mix sounds for snd_dma.c
 
+#include <SDL.h>
 #include "quakedef.h"
 #include "qsound.h"
 #include "movie.h" // /demo_capture
+#include "parallel.h"
 
 
 #define PAINTBUFFER_SIZE 512
@@ -38,28 +40,292 @@ int snd_vol, *snd_p;
 static int snd_linear_count;
 static short *snd_out;
 
-static void Snd_WriteLinearBlastStereo16 (int* input_buffer, short* output_buffer, int snd_vol)
+/*
+===============================================================================
+MIXING KERNELS
+
+SND_InitScaletable picks a mixer from snd_mixers, they all produce the
+same samples.  8 bit samples are scaled by snd_scaletable, which maps
+byte j to ((j < 128) ? j : j - 255) * (vol >> 3) * 8.
+===============================================================================
+*/
+
+typedef struct snd_mixer_s {
+	simd_kernel_t kernel;
+	void (*paint8) (portable_samplepair_t *out, const unsigned char *sfx, int count, int leftvol, int rightvol);
+	void (*paint16) (portable_samplepair_t *out, const short *sfx, int count, int leftvol, int rightvol);
+	void (*transfer16) (const int *in, short *out, int count, int vol, qbool swap);
+} snd_mixer_t;
+
+// leftvol and rightvol are 0-255 for 8 bit samples
+static void SND_Paint8_C (portable_samplepair_t *out, const unsigned char *sfx, int count, int leftvol, int rightvol)
+{
+	int data, i;
+	int *lscale, *rscale;
+
+	lscale = snd_scaletable[leftvol >> 3];
+	rscale = snd_scaletable[rightvol >> 3];
+
+	for (i = 0; i < count ;i++) {
+		data = sfx[i];
+		out[i].left += lscale[data];
+		out[i].right += rscale[data];
+	}
+}
+
+static void SND_Paint16_C (portable_samplepair_t *out, const short *sfx, int count, int leftvol, int rightvol)
+{
+	int data, i;
+
+	for (i = 0; i < count ;i++) {
+		data = sfx[i];
+		out[i].left += (data * leftvol) >> 8;
+		out[i].right += (data * rightvol) >> 8;
+	}
+}
+
+// count is in shorts, two per sample pair
+static void SND_Transfer16_C (const int *in, short *out, int count, int vol, qbool swap)
 {
-	int val, i;
+	int val, i, l, r;
+
+	l = swap ? 1 : 0;
+	r = 1 - l;
+	for (i = 0; i < count; i += 2) {
+		val = (in[i + l] * vol) >> 8;
+		out[i] = bound (-32768, val, 32767);
+		val = (in[i + r] * vol) >> 8;
+		out[i + 1] = bound (-32768, val, 32767);
+	}
+}
+
+#ifdef SIMD_SSE2
+// adds two vectors of four 32 bit left and right values to four sample pairs
+#define SND_ADDPAIRS_SSE2(out, l, r) { \
+	__m128i l_ = (l), r_ = (r); \
+	_mm_storeu_si128 ((__m128i *) (out), _mm_add_epi32 (_mm_loadu_si128 ((__m128i *) (out)), _mm_unpacklo_epi32 (l_, r_))); \
+	_mm_storeu_si128 ((__m128i *) (out) + 1, _mm_add_epi32 (_mm_loadu_si128 ((__m128i *) (out) + 1), _mm_unpackhi_epi32 (l_, r_))); \
+}
 
-	for (i = 0; i < snd_linear_count; i += 2) {
-		val = (input_buffer[i]*snd_vol)>>8;
-		output_buffer[i] = bound (-32768, val, 32767);
-		val = (input_buffer[i+1]*snd_vol)>>8;
-		output_buffer[i+1] = bound (-32768, val, 32767);
+static void SND_Paint8_SSE2 (portable_samplepair_t *out, const unsigned char *sfx, int count, int leftvol, int rightvol)
+{
+	__m128i lscale = _mm_set1_epi16 ((leftvol >> 3) * 8);
+	__m128i rscale = _mm_set1_epi16 ((rightvol >> 3) * 8);
+	__m128i data, l, r;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		data = _mm_loadl_epi64 ((const __m128i *) (sfx + i));
+		data = _mm_srai_epi16 (_mm_unpacklo_epi8 (data, data), 8);
+		data = _mm_sub_epi16 (data, _mm_srai_epi16 (data, 15));	// -128..-1 to -127..0
+		// products fit in 16 bits: 127 * 248
+		l = _mm_mullo_epi16 (data, lscale);
+		r = _mm_mullo_epi16 (data, rscale);
+		SND_ADDPAIRS_SSE2 (out + i, _mm_srai_epi32 (_mm_unpacklo_epi16 (l, l), 16), _mm_srai_epi32 (_mm_unpacklo_epi16 (r, r), 16));
+		SND_ADDPAIRS_SSE2 (out + i + 4, _mm_srai_epi32 (_mm_unpackhi_epi16 (l, l), 16), _mm_srai_epi32 (_mm_unpackhi_epi16 (r, r), 16));
 	}
+
+	SND_Paint8_C (out + i, sfx + i, count - i, leftvol, rightvol);
 }
 
-static void Snd_WriteLinearBlastStereo16_SwapStereo (int* input_buffer, short* output_buffer, int snd_vol)
+// volumes must fit in 16 bits
+static void SND_Paint16_SSE2 (portable_samplepair_t *out, const short *sfx, int count, int leftvol, int rightvol)
 {
-	int val, i;
+	__m128i lvol = _mm_set1_epi16 (leftvol);
+	__m128i rvol = _mm_set1_epi16 (rightvol);
+	__m128i data, llo, lhi, rlo, rhi;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		data = _mm_loadu_si128 ((const __m128i *) (sfx + i));
+		// full 32 bit products from the low and high halves
+		llo = _mm_mullo_epi16 (data, lvol);
+		lhi = _mm_mulhi_epi16 (data, lvol);
+		rlo = _mm_mullo_epi16 (data, rvol);
+		rhi = _mm_mulhi_epi16 (data, rvol);
+		SND_ADDPAIRS_SSE2 (out + i, _mm_srai_epi32 (_mm_unpacklo_epi16 (llo, lhi), 8), _mm_srai_epi32 (_mm_unpacklo_epi16 (rlo, rhi), 8));
+		SND_ADDPAIRS_SSE2 (out + i + 4, _mm_srai_epi32 (_mm_unpackhi_epi16 (llo, lhi), 8), _mm_srai_epi32 (_mm_unpackhi_epi16 (rlo, rhi), 8));
+	}
+
+	SND_Paint16_C (out + i, sfx + i, count - i, leftvol, rightvol);
+}
 
-	for (i = 0; i < snd_linear_count; i +=2 ) {
-		val = (input_buffer[i+1]*snd_vol)>>8;
-		output_buffer[i] = bound (-32768, val, 32767);
-		val = (input_buffer[i]*snd_vol)>>8;
-		output_buffer[i+1] = bound (-32768, val, 32767);
+static void SND_Transfer16_SSE2 (const int *in, short *out, int count, int vol, qbool swap)
+{
+	__m128i v = _mm_set1_epi32 (vol);
+	__m128i a, b;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		a = _mm_loadu_si128 ((const __m128i *) (in + i));
+		b = _mm_loadu_si128 ((const __m128i *) (in + i + 4));
+		if (swap) {
+			a = _mm_shuffle_epi32 (a, _MM_SHUFFLE (2, 3, 0, 1));
+			b = _mm_shuffle_epi32 (b, _MM_SHUFFLE (2, 3, 0, 1));
+		}
+		// SSE2 has no 32 bit mullo, multiply even and odd lanes separately
+		a = _mm_unpacklo_epi32 (_mm_shuffle_epi32 (_mm_mul_epu32 (a, v), _MM_SHUFFLE (0, 0, 2, 0)),
+			_mm_shuffle_epi32 (_mm_mul_epu32 (_mm_srli_epi64 (a, 32), v), _MM_SHUFFLE (0, 0, 2, 0)));
+		b = _mm_unpacklo_epi32 (_mm_shuffle_epi32 (_mm_mul_epu32 (b, v), _MM_SHUFFLE (0, 0, 2, 0)),
+			_mm_shuffle_epi32 (_mm_mul_epu32 (_mm_srli_epi64 (b, 32), v), _MM_SHUFFLE (0, 0, 2, 0)));
+		// saturating pack does the clamping
+		_mm_storeu_si128 ((__m128i *) (out + i), _mm_packs_epi32 (_mm_srai_epi32 (a, 8), _mm_srai_epi32 (b, 8)));
 	}
+
+	SND_Transfer16_C (in + i, out + i, count - i, vol, swap);
+}
+#endif // SIMD_SSE2
+
+#ifdef SIMD_AVX2
+// adds two vectors of eight 32 bit left and right values to eight sample pairs
+#define SND_ADDPAIRS_AVX2(out, l, r) { \
+	__m256i lo_ = _mm256_unpacklo_epi32 (l, r), hi_ = _mm256_unpackhi_epi32 (l, r); \
+	_mm256_storeu_si256 ((__m256i *) (out), _mm256_add_epi32 (_mm256_loadu_si256 ((__m256i *) (out)), _mm256_permute2x128_si256 (lo_, hi_, 0x20))); \
+	_mm256_storeu_si256 ((__m256i *) (out) + 1, _mm256_add_epi32 (_mm256_loadu_si256 ((__m256i *) (out) + 1), _mm256_permute2x128_si256 (lo_, hi_, 0x31))); \
+}
+
+SIMD_TARGET("avx2") static void SND_Paint8_AVX2 (portable_samplepair_t *out, const unsigned char *sfx, int count, int leftvol, int rightvol)
+{
+	__m256i lscale = _mm256_set1_epi32 ((leftvol >> 3) * 8);
+	__m256i rscale = _mm256_set1_epi32 ((rightvol >> 3) * 8);
+	__m256i data;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		data = _mm256_cvtepi8_epi32 (_mm_loadl_epi64 ((const __m128i *) (sfx + i)));
+		data = _mm256_sub_epi32 (data, _mm256_srai_epi32 (data, 31));	// -128..-1 to -127..0
+		SND_ADDPAIRS_AVX2 (out + i, _mm256_mullo_epi32 (data, lscale), _mm256_mullo_epi32 (data, rscale));
+	}
+
+	SND_Paint8_C (out + i, sfx + i, count - i, leftvol, rightvol);
+}
+
+SIMD_TARGET("avx2") static void SND_Paint16_AVX2 (portable_samplepair_t *out, const short *sfx, int count, int leftvol, int rightvol)
+{
+	__m256i lvol = _mm256_set1_epi32 (leftvol);
+	__m256i rvol = _mm256_set1_epi32 (rightvol);
+	__m256i data;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		data = _mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *) (sfx + i)));
+		SND_ADDPAIRS_AVX2 (out + i, _mm256_srai_epi32 (_mm256_mullo_epi32 (data, lvol), 8), _mm256_srai_epi32 (_mm256_mullo_epi32 (data, rvol), 8));
+	}
+
+	SND_Paint16_C (out + i, sfx + i, count - i, leftvol, rightvol);
+}
+
+SIMD_TARGET("avx2") static void SND_Transfer16_AVX2 (const int *in, short *out, int count, int vol, qbool swap)
+{
+	__m256i v = _mm256_set1_epi32 (vol);
+	__m256i a, b;
+	int i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		a = _mm256_loadu_si256 ((const __m256i *) (in + i));
+		b = _mm256_loadu_si256 ((const __m256i *) (in + i + 8));
+		if (swap) {
+			a = _mm256_shuffle_epi32 (a, _MM_SHUFFLE (2, 3, 0, 1));
+			b = _mm256_shuffle_epi32 (b, _MM_SHUFFLE (2, 3, 0, 1));
+		}
+		a = _mm256_srai_epi32 (_mm256_mullo_epi32 (a, v), 8);
+		b = _mm256_srai_epi32 (_mm256_mullo_epi32 (b, v), 8);
+		// the pack works within 128 bit lanes, put the quarters back in order
+		_mm256_storeu_si256 ((__m256i *) (out + i), _mm256_permute4x64_epi64 (_mm256_packs_epi32 (a, b), _MM_SHUFFLE (3, 1, 2, 0)));
+	}
+
+	SND_Transfer16_C (in + i, out + i, count - i, vol, swap);
+}
+#endif // SIMD_AVX2
+
+#ifdef SIMD_NEON
+static void SND_Paint8_NEON (portable_samplepair_t *out, const unsigned char *sfx, int count, int leftvol, int rightvol)
+{
+	int16x4_t lscale = vdup_n_s16 ((leftvol >> 3) * 8);
+	int16x4_t rscale = vdup_n_s16 ((rightvol >> 3) * 8);
+	int16x8_t data;
+	int32x4x2_t lo, hi;
+	int32_t *o;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		data = vmovl_s8 (vreinterpret_s8_u8 (vld1_u8 (sfx + i)));
+		data = vsubq_s16 (data, vshrq_n_s16 (data, 15));	// -128..-1 to -127..0
+		lo = vzipq_s32 (vmull_s16 (vget_low_s16 (data), lscale), vmull_s16 (vget_low_s16 (data), rscale));
+		hi = vzipq_s32 (vmull_s16 (vget_high_s16 (data), lscale), vmull_s16 (vget_high_s16 (data), rscale));
+		o = (int32_t *) (out + i);
+		vst1q_s32 (o, vaddq_s32 (vld1q_s32 (o), lo.val[0]));
+		vst1q_s32 (o + 4, vaddq_s32 (vld1q_s32 (o + 4), lo.val[1]));
+		vst1q_s32 (o + 8, vaddq_s32 (vld1q_s32 (o + 8), hi.val[0]));
+		vst1q_s32 (o + 12, vaddq_s32 (vld1q_s32 (o + 12), hi.val[1]));
+	}
+
+	SND_Paint8_C (out + i, sfx + i, count - i, leftvol, rightvol);
+}
+
+// volumes must fit in 16 bits
+static void SND_Paint16_NEON (portable_samplepair_t *out, const short *sfx, int count, int leftvol, int rightvol)
+{
+	int16x4_t lvol = vdup_n_s16 (leftvol);
+	int16x4_t rvol = vdup_n_s16 (rightvol);
+	int16x8_t data;
+	int32x4x2_t lo, hi;
+	int32_t *o;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		data = vld1q_s16 (sfx + i);
+		lo = vzipq_s32 (vshrq_n_s32 (vmull_s16 (vget_low_s16 (data), lvol), 8), vshrq_n_s32 (vmull_s16 (vget_low_s16 (data), rvol), 8));
+		hi = vzipq_s32 (vshrq_n_s32 (vmull_s16 (vget_high_s16 (data), lvol), 8), vshrq_n_s32 (vmull_s16 (vget_high_s16 (data), rvol), 8));
+		o = (int32_t *) (out + i);
+		vst1q_s32 (o, vaddq_s32 (vld1q_s32 (o), lo.val[0]));
+		vst1q_s32 (o + 4, vaddq_s32 (vld1q_s32 (o + 4), lo.val[1]));
+		vst1q_s32 (o + 8, vaddq_s32 (vld1q_s32 (o + 8), hi.val[0]));
+		vst1q_s32 (o + 12, vaddq_s32 (vld1q_s32 (o + 12), hi.val[1]));
+	}
+
+	SND_Paint16_C (out + i, sfx + i, count - i, leftvol, rightvol);
+}
+
+static void SND_Transfer16_NEON (const int *in, short *out, int count, int vol, qbool swap)
+{
+	int32x4_t a, b;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		a = vld1q_s32 (in + i);
+		b = vld1q_s32 (in + i + 4);
+		if (swap) {
+			a = vrev64q_s32 (a);
+			b = vrev64q_s32 (b);
+		}
+		a = vshrq_n_s32 (vmulq_n_s32 (a, vol), 8);
+		b = vshrq_n_s32 (vmulq_n_s32 (b, vol), 8);
+		vst1q_s16 (out + i, vcombine_s16 (vqmovn_s32 (a), vqmovn_s32 (b)));
+	}
+
+	SND_Transfer16_C (in + i, out + i, count - i, vol, swap);
+}
+#endif // SIMD_NEON
+
+// in order of preference, the last supported one is used
+static const snd_mixer_t snd_mixers[] = {
+	{ { "C", 0 }, SND_Paint8_C, SND_Paint16_C, SND_Transfer16_C },
+#ifdef SIMD_SSE2
+	{ { "SSE2", 0 }, SND_Paint8_SSE2, SND_Paint16_SSE2, SND_Transfer16_SSE2 },
+#endif
+#ifdef SIMD_AVX2
+	{ { "AVX2", SIMD_CPU_AVX2 }, SND_Paint8_AVX2, SND_Paint16_AVX2, SND_Transfer16_AVX2 },
+#endif
+#ifdef SIMD_NEON
+	{ { "NEON", 0 }, SND_Paint8_NEON, SND_Paint16_NEON, SND_Transfer16_NEON },
+#endif
+};
+static const snd_mixer_t *snd_mixer = &snd_mixers[0];
+
+const char *SND_MixerName (void)
+{
+	return snd_mixer->kernel.name;
 }
 
 static void S_TransferStereo16 (int endtime)
@@ -86,10 +352,7 @@ static void S_TransferStereo16 (int endtime)
 		snd_linear_count <<= 1;
 
 		// write a linear blast of samples
-		if (s_swapstereo.value)
-			Snd_WriteLinearBlastStereo16_SwapStereo (snd_p, snd_out, clientVolume);
-		else
-			Snd_WriteLinearBlastStereo16 (snd_p, snd_out, clientVolume);
+		snd_mixer->transfer16 (snd_p, snd_out, snd_linear_count, clientVolume, s_swapstereo.value != 0);
 
 		if (Movie_IsCapturing()) {
 			Movie_TransferSound (snd_out, snd_linear_count);
@@ -159,48 +422,128 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count)
+static void SND_PaintChannelFrom8 (portable_samplepair_t *out, channel_t *ch, sfxcache_t *sc, int count)
 {
-	int data, i;
-	int *lscale, *rscale;
-	unsigned char *sfx;
-
 	if (ch->leftvol > 255)
 		ch->leftvol = 255;
 	if (ch->rightvol > 255)
 		ch->rightvol = 255;
 
-	lscale = snd_scaletable[ch->leftvol >> 3];
-	rscale = snd_scaletable[ch->rightvol >> 3];
-	sfx = (unsigned char *) ((signed char *)sc->data + ch->pos);
+	snd_mixer->paint8 (out, sc->data + ch->pos, count, ch->leftvol, ch->rightvol);
 
-	for (i = 0; i < count ;i++) {
-		data = sfx[i];
-		paintbuffer[i].left += lscale[data];
-		paintbuffer[i].right += rscale[data];
-	}
+	ch->pos += count;
+}
+
+static void SND_PaintChannelFrom16 (portable_samplepair_t *out, channel_t *ch, sfxcache_t *sc, int count)
+{
+	signed short *sfx = (signed short *)sc->data + ch->pos;
+
+	// the SIMD kernels multiply by 16 bit volumes
+	if ((unsigned int) ch->leftvol > 32767 || (unsigned int) ch->rightvol > 32767)
+		SND_Paint16_C (out, sfx, count, ch->leftvol, ch->rightvol);
+	else
+		snd_mixer->paint16 (out, sfx, count, ch->leftvol, ch->rightvol);
 
 	ch->pos += count;
 }
 
-static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count)
+// paints one channel from paintedtime up to end, restarting or stopping it at its end
+static void SND_PaintChannel (portable_samplepair_t *out, channel_t *ch, sfxcache_t *sc, int paintedtime, int end)
 {
-	int data, left, right, leftvol, rightvol, i;
-	signed short *sfx;
+	int ltime, count;
 
-	leftvol = ch->leftvol;
-	rightvol = ch->rightvol;
-	sfx = (signed short *)sc->data + ch->pos;
+	ltime = paintedtime;
 
-	for (i = 0; i < count ;i++) {
-		data = sfx[i];
-		left = (data * leftvol) >> 8;
-		right = (data * rightvol) >> 8;
-		paintbuffer[i].left += left;
-		paintbuffer[i].right += right;
+	while (ltime < end) { // paint up to end
+		count = (ch->end < end) ? (ch->end - ltime) : (end - ltime);
+
+		if (count > 0) {
+			if (sc->format.width == 1)
+				SND_PaintChannelFrom8(out, ch, sc, count);
+			else
+				SND_PaintChannelFrom16(out, ch, sc, count);
+
+			ltime += count;
+		}
+
+		// if at end of loop, restart
+		if (ltime >= ch->end) {
+			if (sc->loopstart >= 0) {
+				ch->pos = bound(0, sc->loopstart, (int) sc->total_length - 1);
+				ch->end = ltime + (int) sc->total_length - ch->pos;
+			} else { // channel just stopped
+				ch->sfx = NULL;
+				break;
+			}
+		}
 	}
+}
 
-	ch->pos += count;
+/*
+===============================================================================
+MIXER THREADS
+
+With s_mixthreads set, the channels of each paint buffer are dealt out
+between the calling thread and the mixer threads.  Each thread paints into
+its own buffer and the caller adds them up, so the result is the same as
+mixing on one thread.
+===============================================================================
+*/
+
+typedef struct snd_activechannel_s {
+	channel_t *ch;
+	sfxcache_t *sc;
+} snd_activechannel_t;
+
+static workers_t *snd_mixthreads;		// swapped by SND_UpdateMixThreads under the mixer lock
+
+// the paint buffer being mixed, set up by S_PaintChannels
+static snd_activechannel_t snd_active[MAX_CHANNELS];
+static int snd_numactive;
+static int snd_mixstride;
+static int snd_mixstart, snd_mixend;
+
+static void SND_PaintActive (portable_samplepair_t *out, int first)
+{
+	int i;
+
+	for (i = first; i < snd_numactive; i += snd_mixstride)
+		SND_PaintChannel (out, snd_active[i].ch, snd_active[i].sc, snd_mixstart, snd_mixend);
+}
+
+// paints the channels from index on into its own buffer
+static void SND_MixThread (int index, void *local)
+{
+	portable_samplepair_t *paint = (portable_samplepair_t *) local;
+
+	memset (paint, 0, (snd_mixend - snd_mixstart) * sizeof(portable_samplepair_t));
+	SND_PaintActive (paint, index);
+}
+
+// Starts the threads s_mixthreads asks for.  Called from S_Update, so that
+// the audio callback only ever picks up a finished set under the mixer lock.
+void SND_UpdateMixThreads (void)
+{
+	workers_t *workers, *old;
+
+	if (!Workers_Changed (snd_mixthreads, s_mixthreads.integer))
+		return;
+
+	workers = Workers_Start ("mixer", s_mixthreads.integer, SND_MixThread, PAINTBUFFER_SIZE * sizeof(portable_samplepair_t));
+
+	S_LockMixer ();
+	old = snd_mixthreads;
+	snd_mixthreads = workers;
+	S_UnlockMixer ();
+
+	Workers_Stop (old);
+}
+
+// called once the audio device can no longer run the mixer
+void SND_ShutdownMixThreads (void)
+{
+	Workers_Stop (snd_mixthreads);
+	snd_mixthreads = NULL;
 }
 
 void SND_InitScaletable (void)
@@ -210,14 +553,97 @@ void SND_InitScaletable (void)
 	for (i = 0 ; i < 32; i++)
 		for (j = 0; j < 256; j++)
 			snd_scaletable[i][j] = ((j < 128) ? j : j - 0xff) * i * 8;
+
+	snd_mixer = (const snd_mixer_t *) SIMD_SelectKernel (snd_mixers, sizeof(snd_mixers[0]), sizeof(snd_mixers) / sizeof(snd_mixers[0]));
+}
+
+/*
+===============================================================================
+MIXER BENCHMARK
+===============================================================================
+*/
+
+#define MIXBENCH_SAMPLES 4096
+
+// mixes and transfers one paint buffer with every kernel set the CPU has,
+// so it works without a sound device
+void S_MixBench_f (void)
+{
+	const snd_mixer_t *mixer;
+	portable_samplepair_t *paint;
+	unsigned char *data8;
+	short *data16, *out, *ref;
+	int numchannels, iterations, i, j, c, pos, vol;
+	unsigned int seed = 1;
+	double start, time, reftime = 0;
+
+	numchannels = (Cmd_Argc () > 1) ? bound (1, atoi (Cmd_Argv (1)), 1024) : 100;
+	iterations = (Cmd_Argc () > 2) ? bound (1, atoi (Cmd_Argv (2)), 100000) : 1000;
+
+	// the audio callback may be mixing with these tables
+	S_LockMixer ();
+	SND_InitScaletable ();
+	S_UnlockMixer ();
+
+	paint = (portable_samplepair_t *) Q_malloc (PAINTBUFFER_SIZE * sizeof(*paint));
+	data8 = (unsigned char *) Q_malloc (MIXBENCH_SAMPLES);
+	data16 = (short *) Q_malloc (MIXBENCH_SAMPLES * sizeof(*data16));
+	out = (short *) Q_malloc (PAINTBUFFER_SIZE * 2 * sizeof(*out));
+	ref = (short *) Q_malloc (PAINTBUFFER_SIZE * 2 * sizeof(*ref));
+
+	for (i = 0; i < MIXBENCH_SAMPLES; i++) {
+		seed = seed * 1103515245 + 12345;
+		data8[i] = seed >> 16;
+		data16[i] = seed >> 8;
+	}
+
+	Com_Printf ("mixing %d channels, %d sample pairs, %d times\n", numchannels, PAINTBUFFER_SIZE, iterations);
+
+	for (j = 0; j < sizeof(snd_mixers) / sizeof(snd_mixers[0]); j++) {
+		mixer = &snd_mixers[j];
+		if (!SIMD_Supported (&mixer->kernel))
+			continue;
+
+		start = Sys_DoubleTime ();
+		for (i = 0; i < iterations; i++) {
+			memset (paint, 0, PAINTBUFFER_SIZE * sizeof(*paint));
+			for (c = 0; c < numchannels; c++) {
+				// odd offsets so the kernels see unaligned data too
+				pos = (c * 61) % (MIXBENCH_SAMPLES - PAINTBUFFER_SIZE);
+				vol = (c * 37) & 255;
+				if (c & 1)
+					mixer->paint8 (paint, data8 + pos, PAINTBUFFER_SIZE, vol, 255 - vol);
+				else
+					mixer->paint16 (paint, data16 + pos, PAINTBUFFER_SIZE, vol, 255 - vol);
+			}
+			mixer->transfer16 ((int *) paint, out, PAINTBUFFER_SIZE * 2, 200, (i & 1));
+		}
+		time = Sys_DoubleTime () - start;
+
+		if (j == 0) {
+			memcpy (ref, out, PAINTBUFFER_SIZE * 2 * sizeof(*out));
+			reftime = time;
+		}
+
+		Com_Printf ("%-5s %8.3f ms per buffer  %5.2fx%s%s\n", mixer->kernel.name, time * 1000 / iterations,
+			time > 0 ? reftime / time : 0, mixer == snd_mixer ? "  (active)" : "",
+			memcmp (ref, out, PAINTBUFFER_SIZE * 2 * sizeof(*out)) ? "  MISMATCH" : "");
+	}
+
+	Q_free (paint);
+	Q_free (data8);
+	Q_free (data16);
+	Q_free (out);
+	Q_free (ref);
 }
 
 void S_PaintChannels(int endtime)
 {
-	int ltime, count, end;
+	int end, count, threads, j, k;
 	unsigned int i;
 	sfxcache_t *sc;
 	channel_t *ch;
+	portable_samplepair_t *paint;
 	extern cvar_t s_silent_racing;
 
 	while (shw->paintedtime < endtime) {
@@ -229,7 +655,8 @@ void S_PaintChannels(int endtime)
 		// clear the paint buffer
 		memset (paintbuffer, 0, (end - shw->paintedtime) * sizeof(portable_samplepair_t));
 
-		// paint in the channels.
+		// find the channels to paint, S_Update has already loaded their sounds
+		snd_numactive = 0;
 		ch = channels;
 		for (i = 0; i < total_channels; i++, ch++) {
 			if (!ch->sfx)
@@ -252,34 +679,31 @@ void S_PaintChannels(int endtime)
 					continue;
 				}
 			}
-			sc = S_LoadSound (ch->sfx);
+			sc = (sfxcache_t *) ch->sfx->buf;
 			if (!sc)
 				continue;
 
-			ltime = shw->paintedtime;
-
-			while (ltime < end) { // paint up to end
-				count = (ch->end < end) ? (ch->end - ltime) : (end - ltime);
-
-				if (count > 0) {
-					if (sc->format.width == 1)
-						SND_PaintChannelFrom8(ch, sc, count);
-					else
-						SND_PaintChannelFrom16(ch, sc, count);
-
-					ltime += count;
-				}
+			snd_active[snd_numactive].ch = ch;
+			snd_active[snd_numactive].sc = sc;
+			snd_numactive++;
+		}
 
-				// if at end of loop, restart
-				if (ltime >= ch->end) {
-					if (sc->loopstart >= 0) {
-						ch->pos = bound(0, sc->loopstart, (int) sc->total_length - 1);
-						ch->end = ltime + (int) sc->total_length - ch->pos;
-					} else { // channel just stopped
-						ch->sfx = NULL;
-						break;
-					}
-				}
+		// paint in the channels.
+		snd_mixstart = shw->paintedtime;
+		snd_mixend = end;
+		threads = (snd_numactive > 1) ? min (Workers_Count (snd_mixthreads), snd_numactive - 1) : 0;
+		snd_mixstride = threads + 1;
+
+		Workers_Run (snd_mixthreads, threads);
+		SND_PaintActive (paintbuffer, 0);
+		Workers_Wait (snd_mixthreads, threads);
+
+		count = end - shw->paintedtime;
+		for (j = 1; j <= threads; j++) {
+			paint = (portable_samplepair_t *) Workers_Local (snd_mixthreads, j);
+			for (k = 0; k < count; k++) {
+				paintbuffer[k].left += paint[k].left;
+				paintbuffer[k].right += paint[k].right;
 			}
 		}
 
@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // sv_demo.c - mvd demo related code
 
 #ifndef CLIENTONLY
+#include <SDL_thread.h>
 #include "qwsvdef.h"
 
 // minimal cache which can be used for demos, must be few times greater than DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS
@@ -135,12 +136,138 @@ mvddest_t *DestByName (char *name)
 	return NULL;
 }
 
+//
+// Shared MVD data.
+// Everything written to the demo is copied once into reference counted chunks.
+// BUFFEREDFILE and STREAM dests only queue spans {chunk, start, end} pointing into them,
+// so each extra QTV proxy or recording costs a span instead of a copy of the data.
+// Chunk bytes are never changed once written, a chunk is freed when the last span
+// and the writer let go of it.
+//
+
+#define DEMO_CHUNK_SIZE		65536
+
+typedef struct demochunk_s {
+	SDL_atomic_t	refcount;
+	int				size;
+	int				used;
+	byte			data[1];
+} demochunk_t;
+
+static demochunk_t	*demo_chunk; // chunk being filled
+
+static void DemoChunk_Release (demochunk_t *chunk)
+{
+	if (chunk && SDL_AtomicDecRef(&chunk->refcount))
+		Q_free(chunk);
+}
+
+// copy data into the current chunk, returns its offset there
+static int DemoChunk_Append (const void *data, int len)
+{
+	int start;
+
+	if (!demo_chunk || demo_chunk->used + len > demo_chunk->size)
+	{
+		DemoChunk_Release(demo_chunk);
+		demo_chunk = (demochunk_t *) Q_malloc(sizeof(demochunk_t) + max(len, DEMO_CHUNK_SIZE));
+		demo_chunk->size = max(len, DEMO_CHUNK_SIZE);
+		SDL_AtomicSet(&demo_chunk->refcount, 1); // the writer's reference
+	}
+
+	start = demo_chunk->used;
+	memcpy(demo_chunk->data + start, data, len);
+	demo_chunk->used += len;
+
+	return start;
+}
+
+static int DestSpanNext (mvddest_t *d, int i)
+{
+	return (i + 1) % d->maxspans;
+}
+
+// Contiguous writes share a span, so the ring needs one per chunk that fits in
+// the cache, on top of a fixed number for the writes that aren't contiguous.
+// Call once maxcachesize is set.
+void DestInitSpans (mvddest_t *d)
+{
+	d->maxspans = DEST_MIN_SPANS + d->maxcachesize / DEMO_CHUNK_SIZE;
+	d->spans = (demospan_t *) Q_malloc(d->maxspans * sizeof(demospan_t));
+}
+
+// hand the pending span and everything queued before it to the I/O thread
+static void DestPublish (mvddest_t *d)
+{
+	// spans must be in place before the I/O thread sees them
+	SDL_MemoryBarrierRelease();
+	d->spanhead = d->spanwrite;
+}
+
+// push the pending span in the queue, it is not visible to the I/O thread before DestPublish()
+static qbool DestQueuePending (mvddest_t *d)
+{
+	if (!d->pending.chunk)
+		return true;
+
+	if (DestSpanNext(d, d->spanwrite) == d->spantail)
+		return false;
+
+	SDL_MemoryBarrierAcquire();
+
+	d->spans[d->spanwrite] = d->pending;
+	d->spanwrite = DestSpanNext(d, d->spanwrite);
+	d->pending.chunk = NULL;
+
+	return true;
+}
+
+static qbool DestQueue (mvddest_t *d, demochunk_t *chunk, int start, int len)
+{
+	if (d->pending.chunk == chunk && d->pending.end == start)
+	{
+		d->pending.end += len; // contiguous with what we queued last
+	}
+	else
+	{
+		if (!DestQueuePending(d))
+			return false;
+
+		SDL_AtomicIncRef(&chunk->refcount);
+		d->pending.chunk = chunk;
+		d->pending.start = start;
+		d->pending.end = start + len;
+	}
+
+	d->queuedbytes += len;
+
+	return true;
+}
+
+// drop all spans, the I/O thread must not be using this dest
+static void DestReleaseSpans (mvddest_t *d)
+{
+	int i;
+
+	for (i = d->spantail; i != d->spanwrite; i = DestSpanNext(d, i))
+		DemoChunk_Release(d->spans[i].chunk);
+
+	DemoChunk_Release(d->pending.chunk);
+	d->pending.chunk = NULL;
+	d->spantail = d->spanhead = d->spanwrite;
+}
+
+static int DestCacheUsed (mvddest_t *d)
+{
+	return (int)(d->queuedbytes - d->writtenbytes);
+}
+
 void DestClose (mvddest_t *d, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
 
-	if (d->cache)
-		Q_free(d->cache);
+	DestReleaseSpans(d);
+	Q_free(d->spans);
 	if (d->file)
 		fclose(d->file);
 	if (d->socket)
@@ -163,32 +290,160 @@ void DestClose (mvddest_t *d, qbool destroyfiles)
 }
 
 //
-// complete - just force flush for cached dests (dest->desttype == DEST_BUFFEREDFILE)
+// Demo I/O thread.
+// The server thread queues spans at spanhead, the I/O thread writes them out from spantail,
+// so a slow disk or QTV peer no longer stalls the server frame. The dest list is
+// guarded by demo_io_lock, which the server thread only takes to link or unlink dests.
+//
+
+static SDL_mutex	*demo_io_lock;
+static SDL_sem		*demo_io_wake;
+static qbool		demo_io_thread;
+
+// runs on the I/O thread, or on the server thread with demo_io_lock held
+static void DestWriteOut (mvddest_t *d)
+{
+	int tail = d->spantail, head = d->spanhead;
+	demospan_t *span;
+	int chunk, len;
+
+	SDL_MemoryBarrierAcquire();
+
+	while (tail != head && !d->ioerror)
+	{
+		span = &d->spans[tail];
+		chunk = span->end - span->start - d->spanoffset;
+
+		if (d->desttype == DEST_BUFFEREDFILE)
+		{
+			len = (int)fwrite(span->chunk->data + span->start + d->spanoffset, 1, chunk, d->file);
+			if (len != chunk)
+			{
+				Sys_Printf("DestFlush: fwrite() error\n");
+				d->ioerror = true;
+				break;
+			}
+		}
+		else
+		{
+			len = send(d->socket, (char *) span->chunk->data + span->start + d->spanoffset, chunk, 0);
+			if (len < 0)
+			{ //error of some kind. would block or something
+				if (qerrno != EWOULDBLOCK && qerrno != EAGAIN)
+				{
+					Sys_Printf("DestFlush: error on stream\n");
+					d->ioerror = true;
+				}
+				break;
+			}
+			if (len == 0)
+				break; // man says: The calls return the number of characters sent, or -1 if an error occurred.
+		}
+
+		d->writtenbytes += len;
+
+		if (len < chunk)
+		{
+			d->spanoffset += len; // socket buffer is full
+			break;
+		}
+
+		DemoChunk_Release(span->chunk);
+		d->spanoffset = 0;
+		tail = DestSpanNext(d, tail);
+
+		// span must be consumed before the server thread may reuse it
+		SDL_MemoryBarrierRelease();
+		d->spantail = tail;
+	}
+
+	if (d->desttype == DEST_BUFFEREDFILE)
+		fflush(d->file);
+}
+
+static int DemoIO_Thread (void *unused)
+{
+	mvddest_t *d;
+
+	for (;;)
+	{
+		SDL_SemWait(demo_io_wake);
+
+		SDL_LockMutex(demo_io_lock);
+		for (d = demo.dest; d; d = d->nextdest)
+		{
+			if (d->spantail != d->spanhead)
+				DestWriteOut(d);
+		}
+		SDL_UnlockMutex(demo_io_lock);
+	}
+
+	return 0;
+}
+
+static void DemoIO_Init (void)
+{
+	demo_io_lock = SDL_CreateMutex();
+	demo_io_wake = SDL_CreateSemaphore(0);
+
+	if (!demo_io_lock || !demo_io_wake)
+		Sys_Error("DemoIO_Init: %s", SDL_GetError());
+
+	demo_io_thread = (Sys_CreateDetachedThread(DemoIO_Thread, NULL) >= 0);
+	if (!demo_io_thread)
+		Con_Printf("WARNING: demo I/O thread failed to start, writing demos from the server frame\n");
+}
+
+//
+// complete - write out everything cached by DEST_BUFFEREDFILE and DEST_STREAM dests before returning
 //
 void DestFlush (qbool complete)
 {
-	int len;
 	mvddest_t *d, *t;
+	double now;
 
 	if (!demo.dest)
 		return;
 
-	while (demo.dest->error)
+	for (d = demo.dest; d; d = d->nextdest)
 	{
-		d = demo.dest;
-		demo.dest = d->nextdest;
+		if (d->desttype != DEST_BUFFEREDFILE && d->desttype != DEST_STREAM)
+			continue;
+
+		// buffered files are written in big chunks
+		if (d->desttype == DEST_BUFFEREDFILE && !complete && DestCacheUsed(d) + DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS <= d->maxcachesize)
+			continue;
 
-		DestClose(d, false);
+		DestQueuePending(d); // if the queue is full the pending span waits for the next flush
+		DestPublish(d);
+	}
 
-		if (!demo.dest)
+	if (complete || !demo_io_thread)
+	{
+		SDL_LockMutex(demo_io_lock);
+		for (d = demo.dest; d; d = d->nextdest)
 		{
-			SV_MVDStop(3, false);
-			return;
+			if (d->desttype != DEST_BUFFEREDFILE && d->desttype != DEST_STREAM)
+				continue;
+
+			DestWriteOut(d);
+
+			if (complete && d->pending.chunk && DestQueuePending(d))
+			{
+				DestPublish(d);
+				DestWriteOut(d);
+			}
 		}
+		SDL_UnlockMutex(demo_io_lock);
 	}
 
+	now = Sys_DoubleTime();
+
 	for (d = demo.dest; d; d = d->nextdest)
 	{
+		if (d->ioerror)
+			d->error = true;
+
 		switch(d->desttype)
 		{
 		case DEST_FILE:
@@ -196,55 +451,22 @@ void DestFlush (qbool complete)
 			break;
 
 		case DEST_BUFFEREDFILE:
-			if (d->cacheused + DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS > d->maxcachesize || complete)
-			{
-				len = (int)fwrite(d->cache, 1, d->cacheused, d->file);
-				if (len != d->cacheused)
-				{
-					Sys_Printf("DestFlush: fwrite() error\n");
-					d->error = true;
-				}
-				fflush(d->file);
-
-				d->cacheused = 0;
-			}
 			break;
 
 		case DEST_STREAM:
-			if (d->io_time + qtv_streamtimeout.value <= Sys_DoubleTime())
+			if (d->lastwrittenbytes != d->writtenbytes)
+			{
+				d->lastwrittenbytes = d->writtenbytes;
+				d->io_time = now; // update IO activity
+			}
+
+			if (d->io_time + qtv_streamtimeout.value <= now)
 			{
 				// problem what send() have internal buffer, so send() success some time even peer side does't read,
 				// this may take some time before internal buffer overflow and timeout trigger, depends of buffer size.
 				Sys_Printf("DestFlush: stream timeout\n");
 				d->error = true;
 			}
-
-			if (d->cacheused && !d->error)
-			{
-				len = send(d->socket, d->cache, d->cacheused, 0);
-
-				if (len == 0) //client died
-				{
-//					d->error = true;
-					// man says: The calls return the number of characters sent, or -1 if an error occurred.   
-					// so 0 is legal or what?
-				}
-				else if (len > 0) //we put some data through
-				{ //move up the buffer
-					d->cacheused -= len;
-					memmove(d->cache, d->cache+len, d->cacheused);
-
-					d->io_time = Sys_DoubleTime(); // update IO activity
-				}
-				else
-				{ //error of some kind. would block or something
-					if (qerrno != EWOULDBLOCK && qerrno != EAGAIN)
-					{
-						Sys_Printf("DestFlush: error on stream\n");
-						d->error = true;
-					}
-				}
-			}
 			break;
 
 		case DEST_NONE:
@@ -260,15 +482,49 @@ void DestFlush (qbool complete)
 				d->error = true;
 			}
 		}
+	}
 
-		while (d->nextdest && d->nextdest->error)
+	// unlink and close failed dests, waits for the I/O thread to finish its pass
+	for (d = demo.dest; d; d = d->nextdest)
+	{
+		if (d->error)
+			break;
+	}
+
+	if (d)
+	{
+		SDL_LockMutex(demo_io_lock);
+
+		while (demo.dest && demo.dest->error)
 		{
-			t = d->nextdest;
-			d->nextdest = t->nextdest;
+			d = demo.dest;
+			demo.dest = d->nextdest;
 
-			DestClose(t, false);
+			DestClose(d, false);
+		}
+
+		for (d = demo.dest; d; d = d->nextdest)
+		{
+			while (d->nextdest && d->nextdest->error)
+			{
+				t = d->nextdest;
+				d->nextdest = t->nextdest;
+
+				DestClose(t, false);
+			}
+		}
+
+		SDL_UnlockMutex(demo_io_lock);
+
+		if (!demo.dest)
+		{
+			SV_MVDStop(3, false);
+			return;
 		}
 	}
+
+	if (demo_io_thread && !SDL_SemValue(demo_io_wake))
+		SDL_SemPost(demo_io_wake);
 }
 
 // if param "mvdonly" == true then close only demos, not QTV's steams
@@ -294,8 +550,10 @@ static int DestCloseAllFlush (qbool destroyfiles, qbool mvdonly)
 			strlcpy(dest_name, d->name, sizeof(dest_name));
 			strlcpy(dest_path, d->path, sizeof(dest_path));
 
+			SDL_LockMutex(demo_io_lock);
 			*prev = d->nextdest;
 			DestClose(d, destroyfiles); // NOTE: this free dest struck, so we can't use 'd' below
+			SDL_UnlockMutex(demo_io_lock);
 			numclosed++;
 
 			if (dt != DEST_STREAM && dest_name[0]) // ignore stream or empty file name
@@ -307,12 +565,31 @@ static int DestCloseAllFlush (qbool destroyfiles, qbool mvdonly)
 		d = next;
 	}
 
+	if (!demo.dest)
+	{
+		// nothing left to share the chunk being filled with
+		DemoChunk_Release(demo_chunk);
+		demo_chunk = NULL;
+	}
+
 	return numclosed;
 }
 
+static int DestWriteShared (mvddest_t *d, demochunk_t *chunk, int start, int len)
+{
+	if (DestCacheUsed(d) + len > d->maxcachesize || !DestQueue(d, chunk, start, len))
+	{
+		Sys_Printf("DemoWriteDest: cache overflow %d > %d\n", DestCacheUsed(d) + len, d->maxcachesize);
+		d->error = true;
+		return 0;
+	}
+
+	return len;
+}
+
 int DemoWriteDest (void *data, int len, mvddest_t *d)
 {
-	int ret;
+	int ret, start;
 
 	if (d->error)
 		return 0;
@@ -333,16 +610,9 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 			break;
 		case DEST_BUFFEREDFILE:	//these write to a cache, which is flushed later
 		case DEST_STREAM:
-			if (d->cacheused + len > d->maxcachesize)
-			{
-				Sys_Printf("DemoWriteDest: cache overflow %d > %d\n", d->cacheused + len, d->maxcachesize);
-				d->error = true;
-				return 0;
-			}
-			memcpy(d->cache + d->cacheused, data, len);
-			d->cacheused += len;
+			start = DemoChunk_Append(data, len);
+			return DestWriteShared(d, demo_chunk, start, len);
 
-			break;
 		case DEST_NONE:
 		default:
 			Sys_Error("DemoWriteDest: encountered bad dest.");
@@ -353,12 +623,29 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 static void DemoWrite (void *data, int len) //broadcast to all proxies/mvds
 {
 	mvddest_t *d;
+	int start = -1;
+
 	for (d = demo.dest; d; d = d->nextdest)
 	{
 		if (singledest && singledest != d)
 			continue;
 
-		DemoWriteDest(data, len, d);
+		if (d->desttype == DEST_BUFFEREDFILE || d->desttype == DEST_STREAM)
+		{
+			if (d->error)
+				continue;
+
+			// copied once, shared by all dests
+			if (start < 0)
+				start = DemoChunk_Append(data, len);
+
+			d->totalsize += len;
+			DestWriteShared(d, demo_chunk, start, len);
+		}
+		else
+		{
+			DemoWriteDest(data, len, d);
+		}
 	}
 }
 
@@ -839,7 +1126,7 @@ static mvddest_t *SV_InitRecordFile (char *name)
 		dst->desttype = DEST_BUFFEREDFILE;
 		dst->file = file;
 		dst->maxcachesize = 1024 * (int) sv_demoCacheSize.value;
-		dst->cache = (char *) Q_malloc (dst->maxcachesize);
+		DestInitSpans(dst);
 	}
 
 	s = name + strlen(name);
@@ -1167,8 +1454,10 @@ qbool SV_MVD_Record (mvddest_t *dest, qbool mapchange)
 		//
 		// seems we initializing new dest, sent initial stats only to this dest
 		//
+		SDL_LockMutex(demo_io_lock);
 		dest->nextdest = demo.dest;
 		demo.dest = dest;
+		SDL_UnlockMutex(demo_io_lock);
 
 		SV_MVD_SendInitialGamestate(dest);
 	}
@@ -1874,6 +2163,7 @@ void SV_UserCmdTrace_f(void)
 void SV_MVDInit(void)
 {
 	MVD_Init();
+	DemoIO_Init();
 
 #ifdef SERVERONLY
 	// name clashes with client.
@@ -65,8 +65,9 @@ static mvddest_t *SV_InitStream (int socket1, netadr_t na, char *userinfo)
 
 	dst->desttype = DEST_STREAM;
 	dst->socket = socket1;
+	NET_PollAdd (&dst->poll, socket1);
 	dst->maxcachesize = 65536;	//is this too small?
-	dst->cache = (char *) Q_malloc(dst->maxcachesize);
+	DestInitSpans(dst);
 	dst->io_time = Sys_DoubleTime();
 	dst->id = ++lastdest;
 	dst->na = na;
@@ -89,6 +90,7 @@ static void SV_MVD_InitPendingStream (int socket1, netadr_t na, qbool must_be_qi
 	unsigned int i;
 	dst = (mvdpendingdest_t*) Q_malloc(sizeof(mvdpendingdest_t));
 	dst->socket = socket1;
+	NET_PollAdd (&dst->poll, socket1);
 	dst->io_time = Sys_DoubleTime();
 	dst->na = na;
 	dst->must_be_qizmo_tcp_connect = must_be_qizmo_tcp_connect;
@@ -164,11 +166,18 @@ void SV_MVDStream_Poll (void)
 		return;
 	}
 
+	if (!svs.sockettcp_poll.readable)
+		return; // no pending connections
+
 	addrlen = sizeof(addr);
 	client = accept (NET_GetSocket(NS_SERVER, true), (struct sockaddr *)&addr, &addrlen);
 
 	if (client == INVALID_SOCKET)
+	{
+		if (qerrno == EWOULDBLOCK || qerrno == EAGAIN)
+			NET_PollBlocked (&svs.sockettcp_poll, false);
 		return;
+	}
 
 	if (ioctlsocket (client, FIONBIO, &_true) == SOCKET_ERROR) {
 		Con_Printf ("SV_MVDStream_Poll: ioctl FIONBIO: (%i): %s\n", qerrno, strerror (qerrno));
@@ -263,7 +272,7 @@ void SV_MVD_RunPendingConnections (void)
 
 	for (p = demo.pendingdest; p; p = p->nextdest)
 	{
-		if (p->outsize && !p->error)
+		if (p->outsize && !p->error && p->poll.writable)
 		{
 			len = send(p->socket, p->outbuffer, p->outsize, 0);
 
@@ -286,10 +295,12 @@ void SV_MVD_RunPendingConnections (void)
 			{ //error of some kind. would block or something
 				if (qerrno != EWOULDBLOCK && qerrno != EAGAIN)
 					p->error = true;
+				else
+					NET_PollBlocked (&p->poll, true);
 			}
 		}
 
-		if (!p->error)
+		if (!p->error && p->poll.readable)
 		{
 			len = recv(p->socket, p->inbuffer + p->insize, sizeof(p->inbuffer) - p->insize - 1, 0);
 
@@ -671,6 +682,8 @@ void SV_MVD_RunPendingConnections (void)
 				err = qerrno;
 				if (err != EWOULDBLOCK && err != EAGAIN)
 					p->error = true;
+				else
+					NET_PollBlocked (&p->poll, false);
 			}
 		}
 	}
@@ -1147,7 +1160,7 @@ void QTV_ReadInput( mvddest_t *d )
 
 	len = sizeof(d->inbuffer) - d->inbuffersize - 1; // -1 since it null terminated
 
-	if (len)
+	if (len && d->poll.readable)
 	{
 		len = recv(d->socket, d->inbuffer + d->inbuffersize, len, 0);
 
@@ -1159,6 +1172,8 @@ void QTV_ReadInput( mvddest_t *d )
 		}
 		else if (len < 0)
 		{
+			if (qerrno == EWOULDBLOCK || qerrno == EAGAIN)
+				NET_PollBlocked (&d->poll, false);
 			len = 0;
 		}
 
@@ -35,10 +35,130 @@ static int nailcount = 0;
 extern	int sv_nailmodel, sv_supernailmodel, sv_playermodel;
 
 cvar_t	sv_nailhack	= {"sv_nailhack", "1"};
+cvar_t	sv_deltacache	= {"sv_deltacache", "1"};
 
 // Maximum packet we will send - currently 256 if extension supported
 #define MAX_PACKETENTITIES_POSSIBLE 256
 
+//=============================================================================
+
+// Entity visibility. The leafs touched by any entity get compact numbers, each
+// entity keeps its leafs as (word, bits) pairs of a bitset over those numbers,
+// rebuilt only when something was relinked. A client's PVS is sampled once into
+// the same bitset, so testing an entity is a word AND or two instead of a byte
+// lookup per leaf it touches.
+#define VIS_MAX_LEAFS		(MAX_EDICTS * MAX_ENT_LEAFS)
+#define VIS_MAX_WORDS		(VIS_MAX_LEAFS / 32)
+
+typedef struct entvis_s {
+	int				numwords;
+	unsigned short	word[MAX_ENT_LEAFS];
+	unsigned int	bits[MAX_ENT_LEAFS];
+} entvis_t;
+
+static struct {
+	qbool			valid;
+	unsigned int	linkcount;		// sv_linkcount the entity sets were built for
+	int				num_edicts;
+	int				numleafs;		// compact leafs
+	int				leafs[VIS_MAX_LEAFS];	// compact number -> leafnum
+	entvis_t		ents[MAX_EDICTS];
+
+	byte			*pvs;			// PVS sampled into clientbits, NULL if none
+	unsigned int	clientbits[VIS_MAX_WORDS];
+} sv_vis;
+
+static unsigned int sv_vis_leafstamp[65536];
+static unsigned short sv_vis_leafcompact[65536];
+static unsigned int sv_vis_stamp;
+
+static void SV_BuildEntityVis (void)
+{
+	int e, i;
+
+	if (sv_vis.valid && sv_vis.linkcount == sv_linkcount && sv_vis.num_edicts == sv.num_edicts)
+		return;
+
+	sv_vis.valid = true;
+	sv_vis.linkcount = sv_linkcount;
+	sv_vis.num_edicts = sv.num_edicts;
+	sv_vis.numleafs = 0;
+	if (++sv_vis_stamp == 0) {
+		memset (sv_vis_leafstamp, 0, sizeof(sv_vis_leafstamp));
+		sv_vis_stamp = 1;
+	}
+
+	for (e = 1; e < sv.num_edicts && e < MAX_EDICTS; e++) {
+		edict_t *ent = EDICT_NUM (e);
+		entvis_t *ev = &sv_vis.ents[e];
+
+		ev->numwords = 0;
+		for (i = 0; i < ent->e->num_leafs; i++) {
+			unsigned short leaf = (unsigned short) ent->e->leafnums[i];
+			int k, w;
+
+			if (sv_vis_leafstamp[leaf] != sv_vis_stamp) {
+				sv_vis_leafstamp[leaf] = sv_vis_stamp;
+				sv_vis_leafcompact[leaf] = sv_vis.numleafs;
+				sv_vis.leafs[sv_vis.numleafs++] = ent->e->leafnums[i];
+			}
+
+			k = sv_vis_leafcompact[leaf];
+			w = k >> 5;
+			if (ev->numwords && ev->word[ev->numwords - 1] == w) {
+				ev->bits[ev->numwords - 1] |= 1u << (k & 31);
+			}
+			else {
+				ev->word[ev->numwords] = w;
+				ev->bits[ev->numwords++] = 1u << (k & 31);
+			}
+		}
+	}
+}
+
+// Samples pvs for the compact leafs, entities are then tested against it by SV_EntityInPVS
+static void SV_SetVisPVS (byte *pvs)
+{
+	int k, leaf;
+
+	sv_vis.pvs = NULL;
+	if (!pvs)
+		return;
+
+	SV_BuildEntityVis ();
+
+	memset (sv_vis.clientbits, 0, ((sv_vis.numleafs + 31) >> 5) * sizeof(sv_vis.clientbits[0]));
+	for (k = 0; k < sv_vis.numleafs; k++) {
+		leaf = sv_vis.leafs[k];
+		if (pvs[leaf >> 3] & (1 << (leaf & 7)))
+			sv_vis.clientbits[k >> 5] |= 1u << (k & 31);
+	}
+
+	sv_vis.pvs = pvs;
+}
+
+static qbool SV_EntityInPVS (edict_t *ent, byte *pvs)
+{
+	int i;
+
+	if (pvs == sv_vis.pvs && sv_vis.linkcount == sv_linkcount && ent->e->entnum < sv_vis.num_edicts) {
+		entvis_t *ev = &sv_vis.ents[ent->e->entnum];
+
+		for (i = 0; i < ev->numwords; i++) {
+			if (sv_vis.clientbits[ev->word[i]] & ev->bits[i])
+				return true;
+		}
+		return false;
+	}
+
+	// ignore if not touching a PV leaf
+	for (i = 0; i < ent->e->num_leafs; i++) {
+		if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i] & 7)))
+			return true;
+	}
+	return false;
+}
+
 static qbool SV_AddNailUpdate (edict_t *ent)
 {
 	if ((int)sv_nailhack.value)
@@ -291,6 +411,92 @@ void SV_WriteDelta(client_t* client, entity_state_t *from, entity_state_t *to, s
 	}
 }
 
+/*
+==================
+SV_WriteDeltaCached
+
+Clients watching the same entities mostly delta from the same states, so
+SV_WriteDelta's output is remembered, keyed on everything it depends on: both
+states, force, the client's coord and entity number extensions, and the
+global msg_coordsize and msg_anglesize the MSG_Write functions go by.
+==================
+*/
+#define DELTACACHE_SIZE			4096	// power of two
+#define DELTACACHE_MAX_BYTES	48
+#define DELTACACHE_STATE_BYTES	offsetof(entity_state_t, trans)	// fields SV_WriteDelta looks at
+
+typedef struct deltacache_s {
+	entity_state_t	from, to;
+	qbool			force;
+	unsigned int	fte_extensions;
+	unsigned int	mvd_extensions;
+	int				coordsize, anglesize;
+	int				size;	// -1 if unused
+	byte			data[DELTACACHE_MAX_BYTES];
+} deltacache_t;
+
+static deltacache_t *deltacache;
+
+static void SV_WriteDeltaCached (client_t *client, entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qbool force)
+{
+	unsigned int h = 2166136261u, fte_extensions = 0, mvd_extensions;
+	const byte *p;
+	deltacache_t *slot;
+	byte data[64];
+	sizebuf_t buf;
+	int i;
+
+	// SV_WriteDelta changes 'to' in these cases
+	if (!sv_deltacache.integer || (msg->cursize + 40 > msg->maxsize && !MSG_HasOverflowHandler(msg)) || to->number >= sv.max_edicts || !to->number) {
+		SV_WriteDelta (client, from, to, msg, force);
+		return;
+	}
+
+#ifdef PROTOCOL_VERSION_FTE
+	fte_extensions = client->fteprotocolextensions;
+#endif
+	mvd_extensions = client->mvdprotocolextensions1 & MVD_PEXT1_FLOATCOORDS;
+
+	for (p = (const byte *) from, i = 0; i < DELTACACHE_STATE_BYTES; i++)
+		h = (h ^ p[i]) * 16777619u;
+	for (p = (const byte *) to, i = 0; i < DELTACACHE_STATE_BYTES; i++)
+		h = (h ^ p[i]) * 16777619u;
+
+	if (!deltacache) {
+		deltacache = Q_malloc (DELTACACHE_SIZE * sizeof(deltacache_t));
+		for (i = 0; i < DELTACACHE_SIZE; i++)
+			deltacache[i].size = -1;
+	}
+
+	slot = &deltacache[(h ^ (h >> 16)) & (DELTACACHE_SIZE - 1)];
+	if (slot->size < 0 || slot->force != force || slot->fte_extensions != fte_extensions || slot->mvd_extensions != mvd_extensions
+		|| slot->coordsize != msg_coordsize || slot->anglesize != msg_anglesize
+		|| memcmp (&slot->to, to, DELTACACHE_STATE_BYTES) || memcmp (&slot->from, from, DELTACACHE_STATE_BYTES))
+	{
+		// must leave SV_WriteDelta its 40 bytes of headroom
+		SZ_InitEx (&buf, data, sizeof(data), true);
+		SV_WriteDelta (client, from, to, &buf, force);
+		if (buf.overflowed || buf.cursize > sizeof(slot->data))
+		{
+			SV_WriteDelta (client, from, to, msg, force);
+			return;
+		}
+
+		slot->from = *from;
+		slot->to = *to;
+		slot->force = force;
+		slot->fte_extensions = fte_extensions;
+		slot->mvd_extensions = mvd_extensions;
+		slot->coordsize = msg_coordsize;
+		slot->anglesize = msg_anglesize;
+		slot->size = buf.cursize;
+		memcpy (slot->data, data, buf.cursize);
+	}
+
+	if (slot->size)
+		SZ_Write (msg, slot->data, slot->size);
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -336,7 +542,7 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 		if (newnum == oldnum)
 		{	// delta update from old position
 			//Con_Printf ("delta %i\n", newnum);
-			SV_WriteDelta (client, &from1->entities[oldindex], &to->entities[newindex], msg, false);
+			SV_WriteDeltaCached (client, &from1->entities[oldindex], &to->entities[newindex], msg, false);
 			oldindex++;
 			newindex++;
 			continue;
@@ -355,7 +561,7 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 			}
 			ent = EDICT_NUM(newnum);
 			//Con_Printf ("baseline %i\n", newnum);
-			SV_WriteDelta (client, &ent->e->baseline, &to->entities[newindex], msg, true);
+			SV_WriteDeltaCached (client, &ent->e->baseline, &to->entities[newindex], msg, true);
 			newindex++;
 			continue;
 		}
@@ -481,21 +687,12 @@ qbool SV_PlayerVisibleToClient (client_t* client, int j, byte* pvs, edict_t* sel
 	// ZOID visibility tracking
 	if (ent != self_ent && !(client->spec_track && client->spec_track - 1 == j))
 	{
-		int i;
 
 		if (cl->spectator)
 			return false;
 
-		if (pvs && ent->e->num_leafs >= 0) {
-			// ignore if not touching a PV leaf
-			for (i = 0; i < ent->e->num_leafs; i++) {
-				if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i] & 7))) {
-					break;
-				}
-			}
-			if (i == ent->e->num_leafs) {
-				return false; // not visible
-			}
+		if (pvs && ent->e->num_leafs >= 0 && !SV_EntityInPVS (ent, pvs)) {
+			return false; // not visible
 		}
 	}
 
@@ -753,18 +950,8 @@ qbool SV_EntityVisibleToClient (client_t* client, int e, byte* pvs)
 	if (!ent->v.modelindex || !*PR_GetEntityString(ent->v.model))
 		return false;
 
-	if ( pvs && ent->e->num_leafs >= 0 )
-	{
-		int i;
-
-		// ignore if not touching a PV leaf
-		for (i=0 ; i < ent->e->num_leafs ; i++)
-			if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
-				break;
-
-		if (i == ent->e->num_leafs)
-			return false;		// not visible
-	}
+	if ( pvs && ent->e->num_leafs >= 0 && !SV_EntityInPVS (ent, pvs) )
+		return false;		// not visible
 
 	return true;
 }
@@ -861,6 +1048,8 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 		}
 	}
 
+	SV_SetVisPVS (pvs);
+
 	// send over the players in the PVS
 	if ( recorder )
 		SV_MVD_WritePlayersToClient (); // nice, no params at all!
@@ -958,6 +1147,8 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 		}
 	} // server flash
 
+	sv_vis.pvs = NULL;
+
 	// encode the packet entities as a delta from the
 	// last packetentities acknowledged by the client
 
@@ -1009,6 +1200,7 @@ void SV_SetVisibleEntitiesForBot (client_t* client)
 
 	VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, org);
 	pvs = CM_FatPVS (org); // search some PVS
+	SV_SetVisPVS (pvs);
 
 	// players first
 	for (j = 0; j < MAX_CLIENTS; j++)
@@ -1033,6 +1225,8 @@ void SV_SetVisibleEntitiesForBot (client_t* client)
 			((eval_t *)((byte *)&(ent)->v + fofs_visibility))->_int &= ~client_flag;
 		}
 	}
+
+	sv_vis.pvs = NULL;
 }
 
 qbool SV_SkipCommsBotMessage(client_t* client)
@@ -81,6 +81,8 @@ cvar_t	sv_crypt_rcon = {"sv_crypt_rcon", "1"}; // use SHA1 for encryption of rco
 // Time in seconds during which in rcon command this encryption is valid (change only with master_rcon_password).
 cvar_t	sv_timestamplen = {"sv_timestamplen", "60"};
 cvar_t	sv_rconlim = {"sv_rconlim", "10"};	// rcon bandwith limit: requests per second
+cvar_t	sv_connlesslim = {"sv_connlesslim", "20"};		// connectionless packets per second from one address
+cvar_t	sv_connlessburst = {"sv_connlessburst", "40"};	// connectionless packets one address may send at once
 
 //bliP: telnet log level
 void OnChange_telnetloglevel_var (cvar_t *var, char *string, qbool *cancel);
@@ -592,16 +594,88 @@ This message can be up to around 5k with worst case string lengths.
 #define STATUS_SHOWQTV                  32
 #define STATUS_SHOWFLAGS                64
 
-static void SVC_Status (void)
+// Status replies are rendered once and sent again to everyone asking the same
+// until serverinfo or the player list changes, or STATUS_CACHE_TIME passes
+// (for pings, frags and times).
+#define STATUS_CACHE_ENTRIES    8
+#define STATUS_CACHE_TIME       1.0
+
+typedef struct
 {
-	int top, bottom, ping, i, opt = 0;
-	char *name, *frags;
+	qbool       valid;
+	int         opt;
+	double      time;
+	unsigned    players;                        // SVC_StatusPlayers() when rendered
+	char        info[MAX_SERVERINFO_STRING];
+	sizebuf_t   packets;
+	byte        packets_data[16384];
+} statuscache_t;
+
+static statuscache_t status_cache[STATUS_CACHE_ENTRIES];
+
+// changes whenever somebody connects, drops or changes name, team, colors or skin
+static unsigned SVC_StatusPlayers (void)
+{
+	unsigned h = 2166136261u;
 	client_t *cl;
+	int i;
+
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+	{
+		h = (h ^ (cl->state >= cs_preconnected ? cl->userid : 0)) * 16777619u;
+		if (cl->state >= cs_preconnected)
+		{
+			h = (h ^ cl->spectator) * 16777619u;
+			h = (h ^ Com_HashKey(cl->name)) * 16777619u;
+			h = (h ^ Com_HashKey(cl->team)) * 16777619u;
+			h = (h ^ Com_HashKey(Info_Get (&cl->_userinfo_ctx_, "skin"))) * 16777619u;
+			h = (h ^ Q_atoi(Info_Get (&cl->_userinfo_ctx_, "topcolor")) ^ (Q_atoi(Info_Get (&cl->_userinfo_ctx_, "bottomcolor")) << 4)) * 16777619u;
+		}
+	}
+
+	return h;
+}
 
+static void SVC_StatusRender (int opt);
+
+static void SVC_Status (void)
+{
+	int opt = 0, len;
+	unsigned players;
+	statuscache_t *c;
 
 	if (Cmd_Argc() > 1)
 		opt = Q_atoi(Cmd_Argv(1));
 
+	c = &status_cache[(unsigned) opt % STATUS_CACHE_ENTRIES];
+	players = SVC_StatusPlayers ();
+
+	if (!c->valid || c->opt != opt || c->time + STATUS_CACHE_TIME < realtime || c->players != players || strcmp(c->info, svs.info))
+	{
+		// render and keep a copy of the packets
+		SZ_InitEx (&c->packets, c->packets_data, sizeof(c->packets_data), true);
+		sv_redirect_capture = &c->packets;
+		SVC_StatusRender (opt);
+		sv_redirect_capture = NULL;
+
+		c->valid = !c->packets.overflowed;
+		c->opt = opt;
+		c->time = realtime;
+		c->players = players;
+		strlcpy (c->info, svs.info, sizeof(c->info));
+		return;
+	}
+
+	for (len = 0; len + 2 <= c->packets.cursize; len += 2 + (c->packets.data[len] | (c->packets.data[len + 1] << 8)))
+		NET_SendPacket (NS_SERVER, c->packets.data[len] | (c->packets.data[len + 1] << 8), c->packets.data + len + 2, net_from);
+}
+
+static void SVC_StatusRender (int opt)
+{
+	int top, bottom, ping, i;
+	char *name, *frags;
+	client_t *cl;
+
 	SV_BeginRedirect (RD_PACKET);
 	if (opt == STATUS_OLDSTYLE || (opt & STATUS_SERVERINFO))
 		Con_Printf ("%s\n", svs.info);
@@ -1850,6 +1924,56 @@ static void SVC_IP(void)
 }
 
 
+/*
+=================
+SV_ConnectionlessLimit
+
+Token bucket per source address, so a flood from a few addresses (or one
+spoofed victim address) can't make us build replies for every packet.
+The table is small and hashed, an address landing on a slot used by another
+address takes it over with a full bucket.
+=================
+*/
+#define CONNLESS_BUCKETS	4096	// must be a power of two
+
+typedef struct
+{
+	unsigned	ip;
+	float		tokens;
+	double		time;
+} connlessbucket_t;
+
+static connlessbucket_t connless_buckets[CONNLESS_BUCKETS];
+
+static qbool SV_ConnectionlessLimit (void)
+{
+	unsigned ip = *(unsigned *)net_from.ip;
+	float burst = max(1, sv_connlessburst.value);
+	connlessbucket_t *b;
+
+	if (sv_connlesslim.value <= 0 || net_from.type == NA_LOOPBACK)
+		return false;
+
+	b = &connless_buckets[((ip * 2654435761u) >> 16) & (CONNLESS_BUCKETS - 1)];
+
+	if (b->ip != ip || !b->time)
+	{
+		b->ip = ip;
+		b->tokens = burst;
+	}
+	else
+	{
+		b->tokens = min(burst, b->tokens + (realtime - b->time) * sv_connlesslim.value);
+	}
+	b->time = realtime;
+
+	if (b->tokens < 1)
+		return true;
+
+	b->tokens -= 1;
+	return false;
+}
+
 /*
 =================
 SV_ConnectionlessPacket
@@ -1866,6 +1990,9 @@ static void SV_ConnectionlessPacket (void)
 	char	*s;
 	char	*c;
 
+	if (SV_ConnectionlessLimit ())
+		return;
+
 	MSG_BeginReading ();
 	MSG_ReadLong ();		// skip the -1 marker
 
@@ -1960,6 +2087,104 @@ int		numipfilters;
 ipfilter_t	ipvip[MAX_IPFILTERS];
 int		numipvips;
 
+// Lookup index over a filter list. Filter masks are made of whole octets, so at most
+// 16 different masks exist; entries are grouped by mask and sorted by compare, and a
+// lookup is one binary search per mask in use. Rebuilt on first use after a change.
+typedef struct
+{
+	unsigned	compare;
+	int			index;		// position in the filter list
+} ipfilterkey_t;
+
+typedef struct
+{
+	qbool			dirty;
+	int				nummasks;
+	unsigned		masks[16];
+	int				first[16 + 1];	// keys of masks[i] are keys[first[i]] .. keys[first[i + 1] - 1]
+	ipfilterkey_t	keys[MAX_IPFILTERS];
+} ipfilterindex_t;
+
+static ipfilterindex_t	ipfilters_index = { true }; // ban filters only
+static ipfilterindex_t	ipvip_index = { true };
+
+static const ipfilter_t *ipfilter_sort_list;
+
+static int IPFilter_CompareKeys (const void *a, const void *b)
+{
+	const ipfilterkey_t *ka = (const ipfilterkey_t *) a, *kb = (const ipfilterkey_t *) b;
+	unsigned ma = ipfilter_sort_list[ka->index].mask, mb = ipfilter_sort_list[kb->index].mask;
+
+	if (ma != mb)
+		return ma < mb ? -1 : 1;
+	if (ka->compare != kb->compare)
+		return ka->compare < kb->compare ? -1 : 1;
+	return ka->index - kb->index;
+}
+
+static void IPFilter_BuildIndex (ipfilterindex_t *idx, const ipfilter_t *list, int count, qbool bansonly)
+{
+	int i, n = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		if (bansonly && list[i].type != ipft_ban)
+			continue;
+
+		idx->keys[n].compare = list[i].compare;
+		idx->keys[n].index = i;
+		n++;
+	}
+
+	ipfilter_sort_list = list;
+	qsort (idx->keys, n, sizeof(idx->keys[0]), IPFilter_CompareKeys);
+
+	idx->nummasks = 0;
+	for (i = 0; i < n; i++)
+	{
+		if (!i || list[idx->keys[i].index].mask != idx->masks[idx->nummasks - 1])
+		{
+			idx->masks[idx->nummasks] = list[idx->keys[i].index].mask;
+			idx->first[idx->nummasks++] = i;
+		}
+	}
+	idx->first[idx->nummasks] = n;
+
+	idx->dirty = false;
+}
+
+// returns the lowest list position matching 'in', -1 if none
+static int IPFilter_Lookup (ipfilterindex_t *idx, const ipfilter_t *list, int count, qbool bansonly, unsigned in)
+{
+	int i, lo, hi, mid, best = -1;
+	unsigned key;
+
+	if (idx->dirty)
+		IPFilter_BuildIndex (idx, list, count, bansonly);
+
+	for (i = 0; i < idx->nummasks; i++)
+	{
+		key = in & idx->masks[i];
+
+		// first key >= key, equal keys are ordered by list position
+		lo = idx->first[i];
+		hi = idx->first[i + 1];
+		while (lo < hi)
+		{
+			mid = (lo + hi) / 2;
+			if (idx->keys[mid].compare < key)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo < idx->first[i + 1] && idx->keys[lo].compare == key && (best < 0 || idx->keys[lo].index < best))
+			best = idx->keys[lo].index;
+	}
+
+	return best;
+}
+
 //bliP: cuff, mute ->
 penfilter_t	penfilters[MAX_PENFILTERS];
 int		numpenfilters;
@@ -2050,6 +2275,7 @@ static void SV_AddIPVIP_f (void)
 
 	ipvip[i] = f;
 	ipvip[i].level = l;
+	ipvip_index.dirty = true;
 }
 
 /*
@@ -2074,6 +2300,7 @@ static void SV_RemoveIPVIP_f (void)
 			for (j=i+1 ; j<numipvips ; j++)
 				ipvip[j-1] = ipvip[j];
 			numipvips--;
+			ipvip_index.dirty = true;
 			Con_Printf ("Removed.\n");
 			return;
 		}
@@ -2192,6 +2419,7 @@ static void SV_AddIP_f (void)
 	}
 
 	ipfilters[i] = f;
+	ipfilters_index.dirty = true;
 }
 
 /*
@@ -2217,6 +2445,7 @@ static void SV_RemoveIP_f (void)
 			for (j=i+1 ; j<numipfilters ; j++)
 				ipfilters[j-1] = ipfilters[j];
 			numipfilters--;
+			ipfilters_index.dirty = true;
 			Con_Printf ("Removed.\n");
 			return;
 		}
@@ -2327,14 +2556,12 @@ SV_FilterPacket
 */
 qbool SV_FilterPacket (void)
 {
-	int		i;
 	unsigned	in;
 
 	in = *(unsigned *)net_from.ip;
 
-	for (i=0 ; i<numipfilters ; i++)
-		if ( ipfilters[i].type == ipft_ban && (in & ipfilters[i].mask) == ipfilters[i].compare )
-			return (int)filterban.value;
+	if (IPFilter_Lookup (&ipfilters_index, ipfilters, numipfilters, true, in) >= 0)
+		return (int)filterban.value;
 
 	return !(int)filterban.value;
 }
@@ -2425,6 +2652,7 @@ void SV_RemoveBansIPFilter (int i)
 		ipfilters[i] = ipfilters[i + 1];
 
 	numipfilters--;
+	ipfilters_index.dirty = true;
 }
 
 void SV_CleanBansIPList (void)
@@ -2672,11 +2900,9 @@ int SV_VIPbyIP (netadr_t adr)
 
 	in = *(unsigned *)adr.ip;
 
-	for (i=0 ; i<numipvips ; i++)
-		if ( (in & ipvip[i].mask) == ipvip[i].compare)
-			return ipvip[i].level;
+	i = IPFilter_Lookup (&ipvip_index, ipvip, numipvips, false, in);
 
-	return 0;
+	return i < 0 ? 0 : ipvip[i].level;
 }
 
 /*
@@ -3237,6 +3463,9 @@ void SV_Frame (double time1)
 	// toggle the log buffer if full
 	SV_CheckLog ();
 
+	// find out which TCP/QTV sockets have something for us
+	NET_PollEvents ();
+
 	SV_MVDStream_Poll();
 
 #ifdef SERVERONLY
@@ -3280,6 +3509,9 @@ void SV_Frame (double time1)
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
 
+	// send everything queued for the UDP socket this frame
+	NET_FlushServerPackets ();
+
 	// collect timing statistics
 	end = Sys_DoubleTime ();
 	svs.stats.active += end-start;
@@ -3316,7 +3548,7 @@ void SV_InitLocal (void)
 	extern	cvar_t	sv_wateraccelerate;
 	extern	cvar_t	sv_friction;
 	extern	cvar_t	sv_waterfriction;
-	extern	cvar_t	sv_nailhack;
+	extern	cvar_t	sv_nailhack, sv_deltacache;
 
 	extern cvar_t	sv_maxpitch;
 	extern cvar_t	sv_minpitch;
@@ -3365,6 +3597,8 @@ void SV_InitLocal (void)
 	Cvar_Register (&sv_crypt_rcon);
 	Cvar_Register (&sv_timestamplen);
 	Cvar_Register (&sv_rconlim);
+	Cvar_Register (&sv_connlesslim);
+	Cvar_Register (&sv_connlessburst);
 
 	Cvar_Register (&telnet_log_level);
 
@@ -3387,6 +3621,7 @@ void SV_InitLocal (void)
 	Cvar_Register (&vip_values);
 
 	Cvar_Register (&sv_nailhack);
+	Cvar_Register (&sv_deltacache);
 
 	Cvar_Register (&sv_mintic);
 	Cvar_Register (&sv_maxtic);
@@ -3431,6 +3666,8 @@ void SV_InitLocal (void)
 	Cvar_Register (&sv_antilag_no_pred);
 	Cvar_Register (&sv_antilag_projectiles);
 
+	Cvar_Register (&sv_broadphase);
+
 	//Cvar_Register (&pm_bunnyspeedcap);
 	Cvar_Register (&pm_ktjump);
 	//Cvar_Register (&pm_slidefix);
@@ -3523,6 +3760,8 @@ void SV_InitLocal (void)
 	Cmd_AddCommand ("vip_listip", SV_ListIPVIP_f);
 	Cmd_AddCommand ("vip_writeip", SV_WriteIPVIP_f);
 
+	Cmd_AddCommand ("sv_broadphase_stats", SV_BroadphaseStats_f);
+
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		snprintf (localmodels[i], MODEL_NAME_LEN, "*%i", i);
@@ -36,9 +36,9 @@ is not a staircase.
 */
 qbool SV_CheckBottom (edict_t *ent)
 {
-	vec3_t	mins, maxs, start, stop;
-	trace_t	trace;
-	int		x, y;
+	vec3_t	mins, maxs, start, stop, starts[4], stops[4];
+	trace_t	trace, traces[4];
+	int		x, y, i;
 	float	mid, bottom;
 
 	VectorAdd (ent->v.origin, ent->v.mins, mins);
@@ -74,20 +74,29 @@ realcheck:
 		return false;
 	mid = bottom = trace.endpos[2];
 
-	// the corners must be within 16 of the midpoint
+	// the corners must be within 16 of the midpoint, the four traces
+	// run close to each other so they go through the world together
+	i = 0;
 	for	(x=0 ; x<=1 ; x++)
-		for	(y=0 ; y<=1 ; y++)
+		for	(y=0 ; y<=1 ; y++, i++)
 		{
-			start[0] = stop[0] = x ? maxs[0] : mins[0];
-			start[1] = stop[1] = y ? maxs[1] : mins[1];
+			starts[i][0] = stops[i][0] = x ? maxs[0] : mins[0];
+			starts[i][1] = stops[i][1] = y ? maxs[1] : mins[1];
+			starts[i][2] = start[2];
+			stops[i][2] = stop[2];
+		}
 
-			trace = SV_Trace (start, vec3_origin, vec3_origin, stop, true, ent);
+	SV_TraceBatch (4, starts, vec3_origin, vec3_origin, stops, true, ent, traces);
 
-			if (trace.fraction != 1.0 && trace.endpos[2] > bottom)
-				bottom = trace.endpos[2];
-			if (trace.fraction == 1.0 || mid - trace.endpos[2] > STEPSIZE)
-				return false;
-		}
+	for (i = 0; i < 4; i++)
+	{
+		trace = traces[i];
+
+		if (trace.fraction != 1.0 && trace.endpos[2] > bottom)
+			bottom = trace.endpos[2];
+		if (trace.fraction == 1.0 || mid - trace.endpos[2] > STEPSIZE)
+			return false;
+	}
 	return true;
 }
 
@@ -43,6 +43,9 @@ char	outputbuf[OUTPUTBUF_SIZE];
 redirect_t	sv_redirected;
 static int	sv_redirectbufcount;
 
+// if set, RD_PACKET packets are also stored here as <short length><data>, so they can be sent again
+sizebuf_t	*sv_redirect_capture;
+
 qbool SV_SkipCommsBotMessage(client_t* client);
 extern cvar_t sv_phs, sv_reliable_sound;
 
@@ -64,6 +67,12 @@ void SV_FlushRedirect (void)
 		send1[4] = A2C_PRINT;
 		memcpy (send1 + 5, outputbuf, strlen(outputbuf) + 1);
 
+		if (sv_redirect_capture)
+		{
+			MSG_WriteShort (sv_redirect_capture, strlen(send1) + 1);
+			SZ_Write (sv_redirect_capture, send1, strlen(send1) + 1);
+		}
+
 		NET_SendPacket (NS_SERVER, strlen(send1) + 1, send1, net_from);
 	}
 	else if (sv_redirected == RD_CLIENT && sv_redirectbufcount < MAX_REDIRECTMESSAGES)
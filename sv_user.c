@@ -3357,6 +3357,57 @@ USER CMD EXECUTION
 ===========================================================================
 */
 
+/*
+====================
+AddEdictToPmove
+
+====================
+*/
+static qbool AddEdictToPmove ( edict_t *check, int pl, vec3_t pmove_mins, vec3_t pmove_maxs )
+{
+	int 		i;
+	physent_t	*pe;
+
+	if (check->v.owner == pl)
+		return true;		// player's own missile
+	if (check->v.solid == SOLID_BSP
+			|| check->v.solid == SOLID_BBOX
+			|| check->v.solid == SOLID_SLIDEBOX)
+	{
+		if (check == sv_player)
+			return true;
+
+		for (i=0 ; i<3 ; i++)
+			if (check->v.absmin[i] > pmove_maxs[i]
+			|| check->v.absmax[i] < pmove_mins[i])
+				break;
+		if (i != 3)
+			return true;
+		if (pmove.numphysent == MAX_PHYSENTS)
+			return false;
+		pe = &pmove.physents[pmove.numphysent];
+		pmove.numphysent++;
+
+		VectorCopy (check->v.origin, pe->origin);
+		pe->info = NUM_FOR_EDICT(check);
+		if (check->v.solid == SOLID_BSP) {
+			if ((unsigned)check->v.modelindex >= MAX_MODELS)
+				SV_Error ("AddLinksToPmove: check->v.modelindex >= MAX_MODELS");
+			pe->model = sv.models[(int)(check->v.modelindex)];
+			if (!pe->model)
+				SV_Error ("SOLID_BSP with a non-bsp model");
+		}
+		else
+		{
+			pe->model = NULL;
+			VectorCopy (check->v.mins, pe->mins);
+			VectorCopy (check->v.maxs, pe->maxs);
+		}
+	}
+
+	return true;
+}
+
 /*
 ====================
 AddLinksToPmove
@@ -3369,7 +3420,6 @@ static void AddLinksToPmove ( areanode_t *node )
 	edict_t		*check;
 	int 		pl;
 	int 		i;
-	physent_t	*pe;
 	vec3_t		pmove_mins, pmove_maxs;
 
 	for (i=0 ; i<3 ; i++)
@@ -3380,48 +3430,25 @@ static void AddLinksToPmove ( areanode_t *node )
 
 	pl = EDICT_TO_PROG(sv_player);
 
+	if (sv_areagrid)
+	{
+		edict_t *touchlist[MAX_EDICTS];
+		int numtouch = SV_AreaEdicts (pmove_mins, pmove_maxs, touchlist, sv.max_edicts, AREA_SOLID);
+
+		for (i = 0; i < numtouch; i++)
+			if (!AddEdictToPmove (touchlist[i], pl, pmove_mins, pmove_maxs))
+				return;
+		return;
+	}
+
 	// touch linked edicts
 	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
 	{
 		next = l->next;
 		check = EDICT_FROM_AREA(l);
 
-		if (check->v.owner == pl)
-			continue;		// player's own missile
-		if (check->v.solid == SOLID_BSP
-				|| check->v.solid == SOLID_BBOX
-				|| check->v.solid == SOLID_SLIDEBOX)
-		{
-			if (check == sv_player)
-				continue;
-
-			for (i=0 ; i<3 ; i++)
-				if (check->v.absmin[i] > pmove_maxs[i]
-				|| check->v.absmax[i] < pmove_mins[i])
-					break;
-			if (i != 3)
-				continue;
-			if (pmove.numphysent == MAX_PHYSENTS)
-				return;
-			pe = &pmove.physents[pmove.numphysent];
-			pmove.numphysent++;
-
-			VectorCopy (check->v.origin, pe->origin);
-			pe->info = NUM_FOR_EDICT(check);
-			if (check->v.solid == SOLID_BSP) {
-				if ((unsigned)check->v.modelindex >= MAX_MODELS)
-					SV_Error ("AddLinksToPmove: check->v.modelindex >= MAX_MODELS");
-				pe->model = sv.models[(int)(check->v.modelindex)];
-				if (!pe->model)
-					SV_Error ("SOLID_BSP with a non-bsp model");
-			}
-			else
-			{
-				pe->model = NULL;
-				VectorCopy (check->v.mins, pe->mins);
-				VectorCopy (check->v.maxs, pe->maxs);
-			}
-		}
+		if (!AddEdictToPmove (check, pl, pmove_mins, pmove_maxs))
+			return;
 	}
 
 	// recurse down both sides
@@ -151,6 +151,17 @@ static world_t w;
 areanode_t sv_areanodes[AREA_NODES];
 int sv_numareanodes;
 
+cvar_t sv_broadphase = { "sv_broadphase", "0" };
+
+static areagrid_t sv_areagrid_buckets[AREA_GRID_BUCKETS];
+static areagrid_t sv_areagrid_overflow;	// entities spanning more than MAX_ENT_GRIDCELLS cells
+qbool sv_areagrid;
+static unsigned int sv_areaquery;
+
+areastats_t sv_areastats;
+
+unsigned int sv_linkcount;
+
 /*
 ===============
 SV_CreateAreaNode
@@ -202,9 +213,32 @@ SV_ClearWorld
 */
 void SV_ClearWorld (void)
 {
+	int i;
+
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	for (i = 0; i < AREA_GRID_BUCKETS; i++)
+	{
+		ClearLink (&sv_areagrid_buckets[i].trigger_edicts);
+		ClearLink (&sv_areagrid_buckets[i].solid_edicts);
+	}
+	ClearLink (&sv_areagrid_overflow.trigger_edicts);
+	ClearLink (&sv_areagrid_overflow.solid_edicts);
+
+	sv_areagrid = (sv_broadphase.integer == 1);
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
+}
+
+static int SV_GridCell (float v)
+{
+	return (int) floor (v / AREA_GRID_CELL_SIZE);
+}
+
+static areagrid_t *SV_GridBucket (int x, int y)
+{
+	return &sv_areagrid_buckets[((unsigned int) x * 73856093u ^ (unsigned int) y * 19349663u) & (AREA_GRID_BUCKETS - 1)];
 }
 
 
@@ -215,12 +249,101 @@ SV_UnlinkEdict
 */
 void SV_UnlinkEdict (edict_t *ent)
 {
+	int i;
+
+	for (i = 0; i < ent->e->num_gridlinks; i++)
+		RemoveLink (&ent->e->gridlinks[i]);
+	ent->e->num_gridlinks = 0;
+
 	if (!ent->e->area.prev)
 		return;		// not linked in anywhere
 	RemoveLink (&ent->e->area);
 	ent->e->area.prev = ent->e->area.next = NULL;
 }
 
+/*
+====================
+SV_AreaEdictsInList
+
+Appends the edicts of one grid list touching mins/maxs, skipping the ones
+this query has already seen in another cell
+====================
+*/
+static int SV_AreaEdictsInList (link_t *start, vec3_t mins, vec3_t maxs, edict_t **edicts, int count, int max_edicts)
+{
+	link_t		*l;
+	edict_t		*touch;
+
+	for (l = start->next ; l != start ; l = l->next)
+	{
+		touch = EDICT_FROM_AREA(l);
+		sv_areastats.candidates++;
+		if (touch->e->areaquery == sv_areaquery)
+			continue;
+		touch->e->areaquery = sv_areaquery;
+
+		if (touch->v.solid == SOLID_NOT)
+			continue;
+
+		if (mins[0] > touch->v.absmax[0]
+					 || mins[1] > touch->v.absmax[1]
+					 || mins[2] > touch->v.absmax[2]
+					 || maxs[0] < touch->v.absmin[0]
+					 || maxs[1] < touch->v.absmin[1]
+					 || maxs[2] < touch->v.absmin[2])
+			continue;
+
+		if (count == max_edicts)
+			return count;
+		edicts[count++] = touch;
+	}
+
+	return count;
+}
+
+/*
+====================
+SV_AreaEdictsGrid
+====================
+*/
+static int SV_AreaEdictsGrid (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area)
+{
+	int			x, y, x0, y0, x1, y1, i, count;
+	areagrid_t	*bucket;
+
+	sv_areaquery++;
+
+	bucket = &sv_areagrid_overflow;
+	count = SV_AreaEdictsInList (area == AREA_SOLID ? &bucket->solid_edicts : &bucket->trigger_edicts, mins, maxs, edicts, 0, max_edicts);
+
+	x0 = SV_GridCell (mins[0]);
+	y0 = SV_GridCell (mins[1]);
+	x1 = SV_GridCell (maxs[0]);
+	y1 = SV_GridCell (maxs[1]);
+
+	if ((double) (x1 - x0 + 1) * (y1 - y0 + 1) >= AREA_GRID_BUCKETS)
+	{
+		// cheaper to look at every bucket once
+		for (i = 0; i < AREA_GRID_BUCKETS && count < max_edicts; i++)
+		{
+			bucket = &sv_areagrid_buckets[i];
+			count = SV_AreaEdictsInList (area == AREA_SOLID ? &bucket->solid_edicts : &bucket->trigger_edicts, mins, maxs, edicts, count, max_edicts);
+		}
+		return count;
+	}
+
+	for (x = x0; x <= x1; x++)
+	{
+		for (y = y0; y <= y1 && count < max_edicts; y++)
+		{
+			bucket = SV_GridBucket (x, y);
+			count = SV_AreaEdictsInList (area == AREA_SOLID ? &bucket->solid_edicts : &bucket->trigger_edicts, mins, maxs, edicts, count, max_edicts);
+		}
+	}
+
+	return count;
+}
+
 /*
 ====================
 SV_AreaEdicts
@@ -233,6 +356,15 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 	int			stackdepth = 0, count = 0;
 	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
 
+	sv_areastats.queries++;
+
+	if (sv_areagrid)
+	{
+		count = SV_AreaEdictsGrid (mins, maxs, edicts, max_edicts, area);
+		sv_areastats.found += count;
+		return count;
+	}
+
 // touch linked edicts
 	while (1)
 	{
@@ -244,6 +376,7 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 		for (l = start->next ; l != start ; l = l->next)
 		{
 			touch = EDICT_FROM_AREA(l);
+			sv_areastats.candidates++;
 			if (touch->v.solid == SOLID_NOT)
 				continue;
 
@@ -256,7 +389,10 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 				continue;
 
 			if (count == max_edicts)
+			{
+				sv_areastats.found += count;
 				return count;
+			}
 			edicts[count++] = touch;
 		}
 
@@ -283,7 +419,10 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 
 checkstack:
 		if (!stackdepth)
-		return count;
+		{
+			sv_areastats.found += count;
+			return count;
+		}
 		node = localstack[--stackdepth];
 	}
 
@@ -343,6 +482,41 @@ void SV_LinkToLeafs (edict_t *ent)
 }
 
 
+/*
+===============
+SV_LinkToGrid
+===============
+*/
+static void SV_LinkToGrid (edict_t *ent)
+{
+	int			x, y, x0, y0, x1, y1;
+	link_t		*link;
+	areagrid_t	*bucket;
+
+	x0 = SV_GridCell (ent->v.absmin[0]);
+	y0 = SV_GridCell (ent->v.absmin[1]);
+	x1 = SV_GridCell (ent->v.absmax[0]);
+	y1 = SV_GridCell (ent->v.absmax[1]);
+
+	if ((double) (x1 - x0 + 1) * (y1 - y0 + 1) > MAX_ENT_GRIDCELLS)
+	{
+		bucket = &sv_areagrid_overflow;
+		InsertLinkBefore (&ent->e->area, ent->v.solid == SOLID_TRIGGER ? &bucket->trigger_edicts : &bucket->solid_edicts);
+		return;
+	}
+
+	for (x = x0; x <= x1; x++)
+	{
+		for (y = y0; y <= y1; y++)
+		{
+			bucket = SV_GridBucket (x, y);
+			link = &ent->e->gridlinks[ent->e->num_gridlinks++];
+			link->ed = ent;
+			InsertLinkBefore (link, ent->v.solid == SOLID_TRIGGER ? &bucket->trigger_edicts : &bucket->solid_edicts);
+		}
+	}
+}
+
 /*
 ===============
 SV_LinkEdict
@@ -353,8 +527,10 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 {
 	areanode_t	*node;
 	
-	if (ent->e->area.prev)
+	if (ent->e->area.prev || ent->e->num_gridlinks)
 		SV_UnlinkEdict (ent);	// unlink from old position
+
+	sv_linkcount++;
 		
 	if (ent == sv.edicts)
 		return;		// don't add the world
@@ -397,6 +573,14 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
+	if (sv_areagrid)
+	{
+		SV_LinkToGrid (ent);
+		if (touch_triggers)
+			SV_TouchLinks ( ent, sv_areanodes );
+		return;
+	}
+
 // find the first node that the ent's box crosses
 	node = sv_areanodes;
 	while (1)
@@ -523,9 +707,13 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 	int			i, numtouch;
 	edict_t		*touchlist[MAX_EDICTS], *touch;
 	trace_t		trace;
+	unsigned int	candidates = sv_areastats.candidates;
 
 	numtouch = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist, sv.max_edicts, AREA_SOLID);
 
+	sv_areastats.traces++;
+	sv_areastats.trace_candidates += sv_areastats.candidates - candidates;
+
 	// touch linked edicts
 	for (i = 0; i < numtouch; i++)
 	{
@@ -723,18 +911,19 @@ void SV_AntilagClipCheck ( areanode_t *node, moveclip_t *clip )
 
 /*
 ==================
-SV_Trace
+SV_TraceEntities
+
+Clips a move already clipped to the world against the entities
 ==================
 */
-trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+static trace_t SV_TraceEntities (trace_t *world, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
 {
 	moveclip_t	clip;
 	int			i;
 
 	memset ( &clip, 0, sizeof ( moveclip_t ) );
 
-	// clip to world
-	clip.trace = SV_ClipMoveToEntity ( sv.edicts, NULL, start, mins, maxs, end );
+	clip.trace = *world;
 
 	clip.start = start;
 	clip.end = end;
@@ -774,4 +963,81 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 	return clip.trace;
 }
 
+/*
+==================
+SV_Trace
+==================
+*/
+trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	// clip to world
+	trace_t world = SV_ClipMoveToEntity ( sv.edicts, NULL, start, mins, maxs, end );
+
+	return SV_TraceEntities ( &world, start, mins, maxs, end, type, passedict );
+}
+
+/*
+==================
+SV_TraceBatch
+
+Same as calling SV_Trace for each of the moves, but the world part of the
+traces walks the BSP together, for moves close to each other
+==================
+*/
+#define MAX_TRACE_BATCH 16
+
+void SV_TraceBatch (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, int type, edict_t *passedict, trace_t *traces)
+{
+	vec3_t		starts_l[MAX_TRACE_BATCH], ends_l[MAX_TRACE_BATCH], offset;
+	hull_t		*hull;
+	int			i, n;
+
+	hull = SV_HullForEntity ( sv.edicts, mins, maxs, offset );
+
+	for ( ; count > 0; count -= n, starts += n, ends += n, traces += n)
+	{
+		n = min (count, MAX_TRACE_BATCH);
+
+		for (i = 0; i < n; i++)
+		{
+			VectorSubtract (starts[i], offset, starts_l[i]);
+			VectorSubtract (ends[i], offset, ends_l[i]);
+		}
+
+		// clip to world
+		CM_HullTraceBatch (hull, n, starts_l, ends_l, traces);
+
+		for (i = 0; i < n; i++)
+		{
+			VectorAdd (traces[i].endpos, offset, traces[i].endpos);
+			if (traces[i].fraction < 1 || traces[i].startsolid)
+				traces[i].e.ent = sv.edicts;
+
+			traces[i] = SV_TraceEntities ( &traces[i], starts[i], mins, maxs, ends[i], type, passedict );
+		}
+	}
+}
+
+/*
+==================
+SV_BroadphaseStats_f
+
+Prints how many edicts the broadphase handed out since the map started or
+the previous call, then resets the counters
+==================
+*/
+void SV_BroadphaseStats_f (void)
+{
+	areastats_t *s = &sv_areastats;
+
+	Con_Printf ("broadphase: %s%s\n", sv_areagrid ? "spatial hash" : "areanodes",
+		(sv_broadphase.integer == 1) != sv_areagrid ? " (sv_broadphase changes on map load)" : "");
+	Con_Printf ("%u traces, %.1f candidates per trace\n", s->traces,
+		s->traces ? (double) s->trace_candidates / s->traces : 0);
+	Con_Printf ("%u area queries, %.1f candidates & %.1f edicts per query\n", s->queries,
+		s->queries ? (double) s->candidates / s->queries : 0, s->queries ? (double) s->found / s->queries : 0);
+
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
+}
+
 #endif // !CLIENTONLY
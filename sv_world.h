@@ -45,6 +45,33 @@ typedef struct areanode_s
 
 extern	areanode_t	sv_areanodes[AREA_NODES];
 
+// uniform spatial hash on the xy plane, used instead of the areanodes if
+// sv_broadphase was 1 when the map was loaded
+#define	AREA_GRID_CELL_SIZE	256
+#define	AREA_GRID_BUCKETS	4096	// power of two
+
+typedef struct areagrid_s
+{
+	link_t	trigger_edicts;
+	link_t	solid_edicts;
+} areagrid_t;
+
+extern	qbool	sv_areagrid;
+
+// SV_AreaEdicts() counters, see sv_broadphase_stats
+typedef struct areastats_s
+{
+	unsigned int	queries;		// SV_AreaEdicts() calls
+	unsigned int	candidates;		// links visited by them
+	unsigned int	found;			// edicts returned by them
+	unsigned int	traces;			// SV_Trace() calls
+	unsigned int	trace_candidates;	// links visited on behalf of SV_Trace()
+} areastats_t;
+
+extern	areastats_t	sv_areastats;
+
+extern	unsigned int	sv_linkcount;	// bumped whenever SV_LinkEdict may change an edict's leafs
+
 void SV_ClearWorld (void);
 // called after the world model has been loaded, before linking any entities
 
@@ -78,8 +105,13 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_TraceBatch (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, int type, edict_t *passedict, trace_t *traces);
+// SV_Trace for each of count moves, sharing the BSP walk through the world
+
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area);
 
 void SV_AntilagReset (edict_t *ent);
 
+void SV_BroadphaseStats_f (void);
+
 #endif /* !__WORLD_H__ */
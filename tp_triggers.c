@@ -214,6 +214,171 @@ qbool TP_CheckSoundTrigger (wchar *wstr)
 	return false;
 }
 
+/****************************** TRIGGER PREFILTER *****************************/
+
+// Aho-Corasick automaton over the literal strings of the triggers, so that
+// a line is scanned once to find every literal it contains, instead of once
+// per trigger.  Literals get ids in the order they are added, after a scan
+// TrigMatcher_Seen tells if that literal is in the line.
+
+typedef struct trig_acstate_s {
+	int		child;			// first state one character further, 0 for none
+	int		sibling;		// next state with the same parent
+	int		fail;			// longest proper suffix that is also a state
+	int		output;			// this or the nearest state down the fail links that ends a literal
+	int		literal;		// first literal ending here, -1 for none
+	byte	c;
+} trig_acstate_t;
+
+typedef struct trig_matcher_s {
+	trig_acstate_t	*states;
+	int				numstates, maxstates;
+	int				root[256];		// transitions out of the root, 0 stays there
+	int				*nextliteral;	// other literals ending at the same state
+	unsigned		*seen;			// stamp of the last scan that found the literal
+	int				numliterals, maxliterals;
+	unsigned		stamp;
+	qbool			dirty;			// triggers changed since the last build
+} trig_matcher_t;
+
+static int TrigMatcher_Goto (const trig_matcher_t *m, int state, byte c)
+{
+	int s;
+
+	if (!state)
+		return m->root[c];
+
+	for (s = m->states[state].child; s; s = m->states[s].sibling) {
+		if (m->states[s].c == c)
+			return s;
+	}
+	return -1;
+}
+
+static int TrigMatcher_NewState (trig_matcher_t *m, byte c)
+{
+	trig_acstate_t *state;
+
+	if (m->numstates == m->maxstates) {
+		m->maxstates = max (64, m->maxstates * 2);
+		m->states = (trig_acstate_t *) Q_realloc (m->states, m->maxstates * sizeof (m->states[0]));
+	}
+
+	state = &m->states[m->numstates];
+	memset (state, 0, sizeof (*state));
+	state->literal = -1;
+	state->c = c;
+	return m->numstates++;
+}
+
+static void TrigMatcher_Clear (trig_matcher_t *m)
+{
+	m->numstates = 0;
+	m->numliterals = 0;
+	memset (m->root, 0, sizeof (m->root));
+	TrigMatcher_NewState (m, 0);
+	m->dirty = false;
+}
+
+static void TrigMatcher_Free (trig_matcher_t *m)
+{
+	Q_free (m->states);
+	Q_free (m->nextliteral);
+	Q_free (m->seen);
+	memset (m, 0, sizeof (*m));
+}
+
+// returns the id of the literal
+static int TrigMatcher_Add (trig_matcher_t *m, const char *literal)
+{
+	int state = 0, next;
+	const byte *p;
+
+	for (p = (const byte *) literal; *p; p++) {
+		next = TrigMatcher_Goto (m, state, *p);
+		if (next <= 0) {
+			next = TrigMatcher_NewState (m, *p);
+			if (state) {
+				m->states[next].sibling = m->states[state].child;
+				m->states[state].child = next;
+			}
+			else {
+				m->root[*p] = next;
+			}
+		}
+		state = next;
+	}
+
+	if (m->numliterals == m->maxliterals) {
+		m->maxliterals = max (32, m->maxliterals * 2);
+		m->nextliteral = (int *) Q_realloc (m->nextliteral, m->maxliterals * sizeof (m->nextliteral[0]));
+		m->seen = (unsigned *) Q_realloc (m->seen, m->maxliterals * sizeof (m->seen[0]));
+	}
+	m->nextliteral[m->numliterals] = m->states[state].literal;
+	m->seen[m->numliterals] = 0;
+	m->states[state].literal = m->numliterals;
+	m->stamp = 0;
+	return m->numliterals++;
+}
+
+// sets up the fail and output links once all literals are in
+static void TrigMatcher_Build (trig_matcher_t *m)
+{
+	int *queue, head = 0, tail = 0;
+	int state, s, f, c;
+
+	queue = (int *) Q_malloc (m->numstates * sizeof (queue[0]));
+
+	for (c = 0; c < 256; c++) {
+		if ((s = m->root[c])) {
+			m->states[s].fail = 0;
+			queue[tail++] = s;
+		}
+	}
+
+	while (head < tail) {
+		state = queue[head++];
+		m->states[state].output = (m->states[state].literal >= 0) ? state : m->states[m->states[state].fail].output;
+
+		for (s = m->states[state].child; s; s = m->states[s].sibling) {
+			for (f = m->states[state].fail; f && TrigMatcher_Goto (m, f, m->states[s].c) < 0; f = m->states[f].fail)
+				;
+			m->states[s].fail = TrigMatcher_Goto (m, f, m->states[s].c);
+			queue[tail++] = s;
+		}
+	}
+
+	Q_free (queue);
+}
+
+static void TrigMatcher_Scan (trig_matcher_t *m, const char *s)
+{
+	const byte *p;
+	int state = 0, next, out, id;
+
+	if (!++m->stamp) {
+		// wrapped around, old stamps could look current
+		memset (m->seen, 0, m->numliterals * sizeof (m->seen[0]));
+		m->stamp = 1;
+	}
+
+	for (p = (const byte *) s; *p; p++) {
+		while ((next = TrigMatcher_Goto (m, state, *p)) < 0)
+			state = m->states[state].fail;
+		state = next;
+
+		for (out = m->states[state].output; out; out = m->states[m->states[out].fail].output) {
+			for (id = m->states[out].literal; id >= 0; id = m->nextliteral[id])
+				m->seen[id] = m->stamp;
+		}
+	}
+}
+
+static qbool TrigMatcher_Seen (const trig_matcher_t *m, int id)
+{
+	return m->seen[id] == m->stamp;
+}
+
 /****************************** MESSAGE TRIGGERS ******************************/
  
 typedef struct msg_trigger_s
@@ -221,10 +386,12 @@ typedef struct msg_trigger_s
 	char	name[32];
 	char	string[64];
 	int		level;
+	int		literal;		// id of string in msg_matcher
 	struct msg_trigger_s *next;
 } msg_trigger_t;
  
 static msg_trigger_t *msg_triggers;
+static trig_matcher_t msg_matcher;
  
 void TP_ResetAllTriggers (void)
 {
@@ -235,6 +402,7 @@ void TP_ResetAllTriggers (void)
 		Q_free(msg_triggers);
 		msg_triggers = temp;
 	}
+	msg_matcher.dirty = true;
 }
  
 void TP_DumpTriggers (FILE *f)
@@ -313,6 +481,7 @@ void TP_MsgTrigger_f (void)
 		}
  
 		strlcpy (trig->string, Cmd_Argv(2), sizeof(trig->string));
+		msg_matcher.dirty = true;
 		if (c == 5 && !strcasecmp (Cmd_Argv(3), "-l")) {
 			if (!strcmp(Cmd_Argv(4), "t")) {
 				trig->level = 4;
@@ -357,9 +526,20 @@ void TP_SearchForMsgTriggers (const char *s, int level)
 	// we are in spec/demo mode, so play triggers if user want it
 	if ((cls.demoplayback || cl.spectator) && cl_restrictions.value)
 		return;
+
+	if (!msg_triggers)
+		return;
+
+	if (msg_matcher.dirty || !msg_matcher.states) {
+		TrigMatcher_Clear (&msg_matcher);
+		for (t = msg_triggers; t; t = t->next)
+			t->literal = t->string[0] ? TrigMatcher_Add (&msg_matcher, t->string) : -1;
+		TrigMatcher_Build (&msg_matcher);
+	}
+	TrigMatcher_Scan (&msg_matcher, s);
  
 	for (t = msg_triggers; t; t = t->next) {
-		if ((t->level == level || (t->level == 3 && level == 4)) && t->string[0] && strstr(s, t->string)) {
+		if ((t->level == level || (t->level == 3 && level == 4)) && t->literal >= 0 && TrigMatcher_Seen (&msg_matcher, t->literal)) {
 			if (level == PRINT_CHAT && (
 			            strstr (s, "f_version") || strstr (s, "f_skins") || strstr(s, "f_fakeshaft") ||
 			            strstr (s, "f_server") || strstr (s, "f_scripts") || strstr (s, "f_cmdline") ||
@@ -381,6 +561,216 @@ void TP_SearchForMsgTriggers (const char *s, int level)
 }
  
 /**************************** REGEXP TRIGGERS *********************************/
+
+// escapes that match something other than themselves without reading further
+// characters; \x, \p, back references and the like make us give up
+static qbool ReTrigger_SimpleEscape (char c)
+{
+	return c && strchr ("dDwWsSbBAzZGhHvVRnrtfea", c) != NULL;
+}
+
+// if p starts a quantifier, returns its length and sets *optional if it allows zero
+static int ReTrigger_Quantifier (const char *p, qbool *optional)
+{
+	const char *q;
+	int len;
+
+	if (*p == '?' || *p == '*' || *p == '+') {
+		*optional = (*p != '+');
+		len = 1;
+	}
+	else if (*p == '{' && isdigit ((byte) p[1])) {
+		*optional = (atoi (p + 1) == 0);
+		for (q = p + 1; isdigit ((byte) *q); q++)
+			;
+		if (*q == ',')
+			for (q++; isdigit ((byte) *q); q++)
+				;
+		if (*q != '}')
+			return 0;	// not a quantifier, pcre takes it literally
+		len = q + 1 - p;
+	}
+	else {
+		return 0;
+	}
+
+	// lazy or possessive
+	if (p[len] == '?' || p[len] == '+')
+		len++;
+	return len;
+}
+
+// Finds the longest run of plain characters that every match of the regexp
+// has to contain, so CL_SearchForReTriggers can skip pcre_exec for lines
+// without it.  Returns false for anything it doesn't follow, such as
+// alternation at the top level or option settings, and the trigger is then
+// tried on every line.
+static qbool ReTrigger_RequiredLiteral (const char *re, char *out)
+{
+	char run[RE_LITERAL_MAX];
+	int runlen = 0, bestlen = 0, depth, len;
+	const char *p = re, *q;
+	qbool literal, optional;
+	char c = 0;
+
+	if (strstr (re, "(?") || strstr (re, "\\Q") || strstr (re, "(*"))
+		return false;
+
+	while (*p) {
+		literal = false;
+
+		if (*p == '\\') {
+			if (isalnum ((byte) p[1])) {
+				if (!ReTrigger_SimpleEscape (p[1]))
+					return false;
+			}
+			else if (p[1]) {
+				literal = true;
+				c = p[1];
+			}
+			else {
+				return false;
+			}
+			p += 2;
+		}
+		else if (*p == '[') {
+			// class, a ] straight after [ or [^ is part of it
+			p++;
+			if (*p == '^')
+				p++;
+			if (*p == ']')
+				p++;
+			while (*p && *p != ']') {
+				if (*p == '\\' && p[1])
+					p++;
+				else if (*p == '[' && p[1] == ':' && (q = strstr (p + 2, ":]")))
+					p = q + 1;
+				p++;
+			}
+			if (!*p)
+				return false;
+			p++;
+		}
+		else if (*p == '(') {
+			// groups could be anything, skip them
+			for (depth = 0; *p; p++) {
+				if (*p == '\\' && p[1]) {
+					p++;
+				}
+				else if (*p == '[') {
+					for (p++, p += (*p == '^'), p += (*p == ']'); *p && *p != ']'; p++) {
+						if (*p == '\\' && p[1])
+							p++;
+					}
+					if (!*p)
+						return false;
+				}
+				else if (*p == '(') {
+					depth++;
+				}
+				else if (*p == ')' && !--depth) {
+					break;
+				}
+			}
+			if (!*p)
+				return false;
+			p++;
+		}
+		else if (*p == '|' || *p == ')' || ReTrigger_Quantifier (p, &optional)) {
+			return false;
+		}
+		else if (*p == '.' || *p == '^' || *p == '$') {
+			p++;
+		}
+		else {
+			literal = true;
+			c = *p++;
+		}
+
+		len = ReTrigger_Quantifier (p, &optional);
+		p += len;
+
+		if (literal && !(len && optional) && runlen < RE_LITERAL_MAX - 1)
+			run[runlen++] = c;
+
+		// a repeated or missing character breaks the run, so does anything but a character
+		if (!literal || len) {
+			if (runlen > bestlen) {
+				memcpy (out, run, runlen);
+				bestlen = runlen;
+			}
+			runlen = 0;
+		}
+	}
+
+	if (runlen > bestlen) {
+		memcpy (out, run, runlen);
+		bestlen = runlen;
+	}
+	out[bestlen] = 0;
+	return bestlen > 0;
+}
+
+static trig_matcher_t re_matcher;
+
+static void ReTrigger_BuildMatcher (void)
+{
+	pcre_trigger_t *rt;
+
+	TrigMatcher_Clear (&re_matcher);
+	for (rt = re_triggers; rt; rt = rt->next)
+		rt->literal = (rt->regexp && rt->literalstr[0]) ? TrigMatcher_Add (&re_matcher, rt->literalstr) : -1;
+	TrigMatcher_Build (&re_matcher);
+}
+
+static int ReTrigger_CompareCost (const void *a, const void *b)
+{
+	double ca = (*(const pcre_trigger_t **) a)->exec_time;
+	double cb = (*(const pcre_trigger_t **) b)->exec_time;
+
+	return (ca < cb) - (ca > cb);
+}
+
+// re_trigger_stats [regexp]
+static void CL_RE_Trigger_Stats_f (void)
+{
+	pcre_trigger_t *rt, **list;
+	double total = 0;
+	int i, count = 0;
+
+	if (Cmd_Argc () > 2) {
+		Com_Printf ("re_trigger_stats [regexp]\n");
+		return;
+	}
+	if (Cmd_Argc () == 2 && !ReSearchInit (Cmd_Argv (1)))
+		return;
+
+	for (rt = re_triggers; rt; rt = rt->next)
+		count++;
+	list = (pcre_trigger_t **) Q_malloc ((count + 1) * sizeof (list[0]));
+
+	for (rt = re_triggers, count = 0; rt; rt = rt->next) {
+		if (Cmd_Argc () == 1 || ReSearchMatch (rt->name))
+			list[count++] = rt;
+	}
+	if (Cmd_Argc () == 2)
+		ReSearchDone ();
+
+	qsort (list, count, sizeof (list[0]), ReTrigger_CompareCost);
+
+	Com_Printf ("%-16s %8s %8s %10s %8s  literal\n", "name", "runs", "skipped", "total ms", "us/run");
+	for (i = 0; i < count; i++) {
+		rt = list[i];
+		Com_Printf ("%-16s %8u %8u %10.3f %8.2f  %s\n", rt->name, rt->execs, rt->skips, rt->exec_time * 1000,
+			rt->execs ? rt->exec_time * 1000000 / rt->execs : 0, rt->literalstr[0] ? rt->literalstr : "-");
+		total += rt->exec_time;
+		rt->execs = rt->skips = 0;
+		rt->exec_time = 0;
+	}
+	Com_Printf ("------------\n%i re_triggers, %.3f ms matching\n", count, total * 1000);
+
+	Q_free (list);
+}
  
 typedef void ReTrigger_func (pcre_trigger_t *);
  
@@ -422,6 +812,7 @@ static void DeleteReTrigger (pcre_trigger_t *t)
 
 	Q_free(t->name);
 	Q_free(t);
+	re_matcher.dirty = true;
 }
  
 static void RemoveReTrigger (pcre_trigger_t *t)
@@ -530,6 +921,9 @@ static void CL_RE_Trigger_f (void)
 				trig->regexpstr = Q_strdup(regexpstr);
 				trig->regexp = re;
 				trig->regexp_extra = re_extra;
+				if (!ReTrigger_RequiredLiteral (regexpstr, trig->literalstr))
+					trig->literalstr[0] = 0;
+				re_matcher.dirty = true;
 				return;
 			}
 		} else {
@@ -755,6 +1149,7 @@ qbool CL_SearchForReTriggers (const char *s, unsigned trigger_type)
 	int result;
 	int offsets[99];
 	int len = strlen(s);
+	double start;
  
 	// internal triggers - always enabled
 	if (trigger_type < RE_PRINT_ECHO) {
@@ -785,6 +1180,14 @@ qbool CL_SearchForReTriggers (const char *s, unsigned trigger_type)
 	if ((cls.demoplayback || cl.spectator) && cl_restrictions.value)
 		return false;
  
+	if (!re_triggers)
+		return false;
+
+	// find the literals in the line once, triggers whose literal is missing can't match
+	if (re_matcher.dirty || !re_matcher.states)
+		ReTrigger_BuildMatcher ();
+	TrigMatcher_Scan (&re_matcher, s);
+
 	// regexp triggers
 	for (rt = re_triggers; rt; rt = rt->next)
 		if ( (rt->flags & RE_ENABLED) &&	// enabled
@@ -796,7 +1199,15 @@ qbool CL_SearchForReTriggers (const char *s, unsigned trigger_type)
 			// probably it dont solve re_trigger timers problem
 			// you always trigger on statusbar(TF) or wp_stats (KTPro/KTX) messages and get 0.5~1.5 accuracy for your timer
 		{
+			if (rt->literal >= 0 && !TrigMatcher_Seen (&re_matcher, rt->literal)) {
+				rt->skips++;
+				continue;
+			}
+
+			start = Sys_DoubleTime ();
 			result = pcre_exec (rt->regexp, rt->regexp_extra, s, len, 0, 0, offsets, 99);
+			rt->exec_time += Sys_DoubleTime () - start;
+			rt->execs++;
 			if (result >= 0) {
 				rt->lasttime = cls.realtime;
 				rt->counter++;
@@ -898,6 +1309,7 @@ void TP_InitTriggers (void)
 	Cmd_AddCommand ("re_trigger_enable", CL_RE_Trigger_Enable_f);
 	Cmd_AddCommand ("re_trigger_disable", CL_RE_Trigger_Disable_f);
 	Cmd_AddCommand ("re_trigger_match", CL_RE_Trigger_Match_f);
+	Cmd_AddCommand ("re_trigger_stats", CL_RE_Trigger_Stats_f);
 	InitInternalTriggers();
 
 	Cvar_SetCurrentGroup(CVAR_GROUP_COMMUNICATION);
@@ -925,4 +1337,7 @@ void TP_ShutdownTriggers(void)
 
 		Q_free(trigger);
 	}
+
+	TrigMatcher_Free(&re_matcher);
+	TrigMatcher_Free(&msg_matcher);
 }
@@ -31,6 +31,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define		RE_ENABLED			2048 // trigger is enabled
 #define		RE_NOACTION			4096 // do not call alias
 
+#define		RE_LITERAL_MAX		64 // longest literal the prefilter looks for
+
 typedef struct pcre_trigger_s {
 	char					*name;
 	char					*regexpstr;
@@ -41,6 +43,10 @@ typedef struct pcre_trigger_s {
 	float					min_interval;
 	double					lasttime;
 	int						counter;
+	char					literalstr[RE_LITERAL_MAX];	// every match contains this, empty if unknown
+	int						literal;					// id in the prefilter, -1 if always tried
+	unsigned				execs, skips;				// pcre_exec runs and lines skipped by the prefilter
+	double					exec_time;					// seconds spent in pcre_exec
 } pcre_trigger_t;
 
 typedef void internal_trigger_func (const char *s);
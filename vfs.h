@@ -56,6 +56,9 @@ typedef struct {
 	int		(*GeneratePureCRC) (void *handle, int seed, int usepure);
 
 	vfsfile_t *(*OpenVFS)(void *handle, flocation_t *loc, char *mode);
+
+	qbool	(*RawLocation)(void *handle, flocation_t *loc, char *ospath, size_t ospathsize, unsigned long *offset);
+		// OS file and offset holding the file's bytes as they are, false if it's compressed (optional)
 } searchpathfuncs_t;
 
 typedef struct searchpath_s
@@ -257,6 +257,13 @@ static int FSOS_EnumerateFiles (void *handle, char *match, int (*func)(char *, i
 	return Sys_EnumerateFiles(handle, match, func, parm);
 }
 
+static qbool FSOS_RawLocation(void *handle, flocation_t *loc, char *ospath, size_t ospathsize, unsigned long *offset)
+{
+	snprintf(ospath, ospathsize, "%s/%s", (char*)handle, loc->rawname);
+	*offset = 0;
+	return true;
+}
+
 searchpathfuncs_t osfilefuncs = {
 	FSOS_PrintPath,
 	FSOS_ClosePath,
@@ -266,5 +273,6 @@ searchpathfuncs_t osfilefuncs = {
 	FSOS_EnumerateFiles,
 	NULL,
 	NULL,
-	FSOS_OpenVFS
+	FSOS_OpenVFS,
+	FSOS_RawLocation
 };
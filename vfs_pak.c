@@ -271,6 +271,16 @@ static int FSPAK_EnumerateFiles (void *handle, char *match, int (*func)(char *,
 	return true;
 }
 
+static qbool FSPAK_RawLocation(void *handle, flocation_t *loc, char *ospath, size_t ospathsize, unsigned long *offset)
+{
+	pack_t *pak = handle;
+
+	// paks inside packages don't have an OS path, mapping them just fails
+	strlcpy(ospath, pak->filename, ospathsize);
+	*offset = loc->offset;
+	return true;
+}
+
 /*
 =================
 FSPAK_LoadPackFile
@@ -363,5 +373,6 @@ searchpathfuncs_t packfilefuncs = {
 	FSPAK_EnumerateFiles,
 	FSPAK_LoadPackFile,
 	NULL,
-	FSPAK_OpenVFS
+	FSPAK_OpenVFS,
+	FSPAK_RawLocation
 };
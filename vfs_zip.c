@@ -113,7 +113,7 @@ static void FSZIP_CreteFileFuncs(zlib_filefunc_def *funcs) {
 //==========================================
 typedef struct zipfile_s
 {
-	char filename[MAX_QPATH];
+	char filename[MAX_OSPATH];
 	unzFile handle;
 	int		numfiles;
 	packfile_t	*files;
@@ -131,77 +131,181 @@ typedef struct zipfile_s
 	int references;	//and a reference count
 } zipfile_t;
 
+// Deflated members are inflated straight from the raw zip with our own z_stream,
+// so every open file can seek without going through unzip.c's single current file.
+// Every VFSZIP_CHECKPOINT_INTERVAL bytes of output a copy of the inflate state
+// is kept, seeking restores the nearest one before the target and inflates forward.
+#define VFSZIP_INBUFFER_SIZE        16384
+#define VFSZIP_CHECKPOINT_INTERVAL  (512 * 1024)
+#define VFSZIP_MAX_CHECKPOINTS      64
+
+#define VFSZIP_METHOD_UNZIP         -1	// encrypted or unknown method, read through unzip.c
+
+typedef struct vfszip_checkpoint_s {
+	z_stream strm;		// inflateCopy() of the stream, total_in/total_out tell where it is
+} vfszip_checkpoint_t;
+
 typedef struct {
 	vfsfile_t funcs;
 
-	vfsfile_t *defer;
-
 	//in case we're forced away.
 	zipfile_t *parent;
-	qbool iscompressed;
-	int pos;
-	int length;	//try and optimise some things
+	int method;				// 0 (stored), Z_DEFLATED or VFSZIP_METHOD_UNZIP
+	unsigned long pos;
+	unsigned long length;	//try and optimise some things
 	int index;
-	int startpos;
+	int startpos;			// central directory offset, for unzSetOffset
+	unsigned long datapos;	// offset of the member's data in the zip
+	unsigned long csize;	// compressed size
+
+	// Z_DEFLATED only
+	z_stream strm;
+	byte *inbuf;
+	vfszip_checkpoint_t checkpoints[VFSZIP_MAX_CHECKPOINTS];
+	int numcheckpoints;
+	unsigned long checkpoint_interval;
 } vfszip_t;
 
-// VFS-FIXME Need to figure what this function is trying to do
 static void VFSZIP_MakeActive(vfszip_t *vfsz)
 {
-	int i;
-	char buffer[8192];	//must be power of two
+	unsigned long i;
+	char buffer[8192];
 
 	if ((vfszip_t*)vfsz->parent->currentfile == vfsz)
 		return;	//already us
 	if (vfsz->parent->currentfile)
 		unzCloseCurrentFile(vfsz->parent->handle);
 
-	//unzLocateFileMy(vfsz->parent->handle, vfsz->index, vfsz->startpos);
 	unzSetOffset(vfsz->parent->handle, vfsz->startpos);
 	unzOpenCurrentFile(vfsz->parent->handle);
 
-	if (vfsz->pos > 0)
-	{
-		Com_DPrintf("VFSZIP_MakeActive: Shockingly inefficient\n");
+	// now we need to read up to where we had previously gotten to.
+	for (i = 0; i < vfsz->pos; ) {
+		int chunk = (int) min(sizeof(buffer), vfsz->pos - i);
 
-		//now we need to seek up to where we had previously gotten to.
-		for (i = 0; i < vfsz->pos-sizeof(buffer); i++)
-			unzReadCurrentFile(vfsz->parent->handle, buffer, sizeof(buffer));
-		unzReadCurrentFile(vfsz->parent->handle, buffer, vfsz->pos - i);
+		if (unzReadCurrentFile(vfsz->parent->handle, buffer, chunk) != chunk)
+			break;
+		i += chunk;
 	}
 
 	vfsz->parent->currentfile = (vfsfile_t*)vfsz;
 }
 
+// Starts over from the beginning of the member (cp == NULL) or from a checkpoint.
+static qbool VFSZIP_InflateRestore(vfszip_t *vfsz, vfszip_checkpoint_t *cp)
+{
+	int ret;
+
+	inflateEnd(&vfsz->strm);
+	if (cp) {
+		ret = inflateCopy(&vfsz->strm, &cp->strm);
+	}
+	else {
+		memset(&vfsz->strm, 0, sizeof(vfsz->strm));
+		ret = inflateInit2(&vfsz->strm, -MAX_WBITS);
+	}
+
+	// The copy still points into the input buffer of the time, refill from total_in.
+	vfsz->strm.next_in = vfsz->inbuf;
+	vfsz->strm.avail_in = 0;
+	vfsz->pos = vfsz->strm.total_out;
+
+	return ret == Z_OK;
+}
+
+static void VFSZIP_InflateCheckpoint(vfszip_t *vfsz)
+{
+	int i, n;
+
+	if (vfsz->strm.total_out < (vfsz->numcheckpoints + 1) * vfsz->checkpoint_interval)
+		return;
+	if (vfsz->numcheckpoints && vfsz->strm.total_out <= vfsz->checkpoints[vfsz->numcheckpoints - 1].strm.total_out)
+		return;	// already passed here after seeking back
+
+	if (vfsz->numcheckpoints == VFSZIP_MAX_CHECKPOINTS) {
+		// keep every second one. zlib's state points back at its z_stream,
+		// so a checkpoint can't be moved as a plain struct, copy it across
+		for (i = 1, n = 1; i < VFSZIP_MAX_CHECKPOINTS; i++) {
+			if (!(i & 1) && inflateCopy(&vfsz->checkpoints[n].strm, &vfsz->checkpoints[i].strm) == Z_OK)
+				n++;
+			inflateEnd(&vfsz->checkpoints[i].strm);
+		}
+		vfsz->numcheckpoints = n;
+		vfsz->checkpoint_interval *= 2;
+		return;
+	}
+
+	if (inflateCopy(&vfsz->checkpoints[vfsz->numcheckpoints].strm, &vfsz->strm) == Z_OK)
+		vfsz->numcheckpoints++;
+}
+
+static int VFSZIP_Inflate(vfszip_t *vfsz, void *buffer, int bytestoread)
+{
+	z_stream *strm = &vfsz->strm;
+	int ret;
+
+	strm->next_out = buffer;
+	strm->avail_out = bytestoread;
+
+	while (strm->avail_out) {
+		if (!strm->avail_in) {
+			unsigned long chunk = min(VFSZIP_INBUFFER_SIZE, vfsz->csize - strm->total_in);
+			int read;
+
+			if (!chunk)
+				break;
+
+			VFS_SEEK(vfsz->parent->raw, vfsz->datapos + strm->total_in, SEEK_SET);
+			if ((read = VFS_READ(vfsz->parent->raw, vfsz->inbuf, chunk, NULL)) <= 0)
+				break;
+			strm->next_in = vfsz->inbuf;
+			strm->avail_in = read;
+		}
+
+		ret = inflate(strm, Z_NO_FLUSH);
+		VFSZIP_InflateCheckpoint(vfsz);
+
+		if (ret == Z_STREAM_END)
+			break;
+		if (ret != Z_OK) {
+			Com_DPrintf("VFSZIP_Inflate: %s in %s (%d)\n", strm->msg ? strm->msg : "error", vfsz->parent->files[vfsz->index].name, ret);
+			break;
+		}
+	}
+
+	vfsz->pos = strm->total_out;
+	return bytestoread - strm->avail_out;
+}
+
 static int VFSZIP_ReadBytes (struct vfsfile_s *file, void *buffer, int bytestoread, vfserrno_t *err)
 {
 	int read;
 	vfszip_t *vfsz = (vfszip_t*)file;
 
-	if (vfsz->defer)
-		return VFS_READ(vfsz->defer, buffer, bytestoread, err);
+	bytestoread = (int) min(bytestoread, vfsz->length - vfsz->pos);
 
-//	if (vfsz->iscompressed)
-//	{
+	if (vfsz->method == Z_DEFLATED)
+	{
+		read = VFSZIP_Inflate(vfsz, buffer, bytestoread);
+	}
+	else if (vfsz->method == 0)
+	{
+		VFS_SEEK(vfsz->parent->raw, vfsz->datapos + vfsz->pos, SEEK_SET);
+		read = VFS_READ(vfsz->parent->raw, buffer, bytestoread, NULL);
+		read = max(read, 0);
+		vfsz->pos += read;
+	}
+	else
+	{
 		VFSZIP_MakeActive(vfsz);
 		read = unzReadCurrentFile(vfsz->parent->handle, buffer, bytestoread);
-//	}
-//	else
-//	{
-		// VFS-FIXME This stuff seems to be only for optimisation, 
-		// hence we can probably just go with unzReadCurrentFile
-//		if (vfsz->parent->currentfile != file)
-//		{
-//			unzCloseCurrentFile(vfsz->parent->handle);
-//			VFS_SEEK(vfsz->parent->raw, vfsz->pos+vfsz->startpos, SEEK_SET);
-//			vfsz->parent->currentfile = file;
-//		}
-//		read = VFS_READ(vfsz->parent->raw, buffer, bytestoread, err);
-//	}
+		read = max(read, 0);
+		vfsz->pos += read;
+	}
+
 	if (err)
 		*err = ((read || bytestoread <= 0) ? VFSERR_NONE : VFSERR_EOF);
 
-	vfsz->pos += read;
 	return read;
 }
 
@@ -211,60 +315,67 @@ static int VFSZIP_WriteBytes (struct vfsfile_s *file, const void *buffer, int by
 	return 0;
 }
 
-// VFS-FIXME: What is going on here... why not just unzSetOffset
-static int VFSZIP_Seek (struct vfsfile_s *file, unsigned long pos, int whence)
+static int VFSZIP_SeekInflate(vfszip_t *vfsz, unsigned long pos)
 {
-	vfszip_t *vfsz = (vfszip_t*)file;
-
-	if (vfsz->defer)
-		return VFS_SEEK(vfsz->defer, pos, whence);
+	vfszip_checkpoint_t *cp = NULL;
+	char buffer[8192];
+	int i;
 
-	//This is *really* inefficient
-	if (vfsz->parent->currentfile == file)
-	{
-		if (vfsz->iscompressed)
-		{	//if they're going to seek on a file in a zip, let's just copy it out
-			char buffer[8192];
-			unsigned int chunk;
-			unsigned int i;
-			unsigned int length;
-
-			vfsz->defer = FS_OpenTemp();
-			if (vfsz->defer)
-			{
-				unzCloseCurrentFile(vfsz->parent->handle);
-				vfsz->parent->currentfile = NULL;	//make it not us
-
-				length = vfsz->length;
-				i = 0;
-				vfsz->pos = 0;
-				VFSZIP_MakeActive(vfsz);
-				while (1)
-				{
-					chunk = length - i;
-					if (chunk > sizeof(buffer))
-						chunk = sizeof(buffer);
-					if (chunk == 0)
-						break;
-					unzReadCurrentFile(vfsz->parent->handle, buffer, chunk);
-					VFS_WRITE(vfsz->defer, buffer, chunk);
-
-					i += chunk;
-				}
-			}
+	// nearest checkpoint at or before pos, if it gets us closer than where we are
+	for (i = vfsz->numcheckpoints - 1; i >= 0; i--) {
+		if (vfsz->checkpoints[i].strm.total_out <= pos) {
+			cp = &vfsz->checkpoints[i];
+			break;
 		}
+	}
 
-		unzCloseCurrentFile(vfsz->parent->handle);
-		vfsz->parent->currentfile = NULL;	//make it not us
+	if (pos < vfsz->pos || (cp && cp->strm.total_out > vfsz->pos)) {
+		if (!VFSZIP_InflateRestore(vfsz, cp))
+			return -1;
+	}
+
+	while (vfsz->pos < pos) {
+		int chunk = (int) min(sizeof(buffer), pos - vfsz->pos);
 
-		if (vfsz->defer)
-			return VFS_SEEK(vfsz->defer, pos, SEEK_SET);
+		if (VFSZIP_Inflate(vfsz, buffer, chunk) != chunk)
+			return -1;
 	}
 
+	return 0;
+}
 
+static int VFSZIP_Seek (struct vfsfile_s *file, unsigned long pos, int whence)
+{
+	vfszip_t *vfsz = (vfszip_t*)file;
+
+	switch (whence)
+	{
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			pos += vfsz->pos;
+			break;
+		case SEEK_END:
+			pos += vfsz->length;
+			break;
+		default:
+			Sys_Error("VFSZIP_Seek: Unknown whence value(%d)\n", whence);
+			return -1;
+	}
 
 	if (pos > vfsz->length)
 		return -1;
+
+	if (vfsz->method == Z_DEFLATED)
+		return VFSZIP_SeekInflate(vfsz, pos);
+
+	if (vfsz->method == VFSZIP_METHOD_UNZIP && vfsz->parent->currentfile == file)
+	{
+		// reopened and read up to pos on the next read
+		unzCloseCurrentFile(vfsz->parent->handle);
+		vfsz->parent->currentfile = NULL;	//make it not us
+	}
+
 	vfsz->pos = pos;
 
 	return 0;
@@ -274,9 +385,6 @@ static unsigned long VFSZIP_Tell (struct vfsfile_s *file)
 {
 	vfszip_t *vfsz = (vfszip_t*)file;
 
-	if (vfsz->defer)
-		return VFS_TELL(vfsz->defer);
-
 	return vfsz->pos;
 }
 
@@ -290,20 +398,57 @@ static void FSZIP_ClosePath(void *handle);
 static void VFSZIP_Close (struct vfsfile_s *file)
 {
 	vfszip_t *vfsz = (vfszip_t*)file;
+	int i;
 
 	if (vfsz->parent->currentfile == file)
+	{
+		unzCloseCurrentFile(vfsz->parent->handle);
 		vfsz->parent->currentfile = NULL;	//make it not us
+	}
 
-	if (vfsz->defer)
-		VFS_CLOSE(vfsz->defer);
+	if (vfsz->method == Z_DEFLATED)
+	{
+		inflateEnd(&vfsz->strm);
+		for (i = 0; i < vfsz->numcheckpoints; i++)
+			inflateEnd(&vfsz->checkpoints[i].strm);
+		Q_free(vfsz->inbuf);
+	}
 
 	FSZIP_ClosePath(vfsz->parent);
 	Q_free(vfsz);
 }
 
+// Finds where a member's data starts and how it's stored, from its local header.
+// method is VFSZIP_METHOD_UNZIP if we can't read it ourselves.
+static void FSZIP_LocateData(zipfile_t *zip, int startpos, int *method, unsigned long *datapos, unsigned long *csize)
+{
+	unz_file_info file_info;
+
+	*method = VFSZIP_METHOD_UNZIP;
+
+	if (zip->currentfile)
+	{
+		unzCloseCurrentFile(zip->handle);
+		zip->currentfile = NULL;
+	}
+
+	if (unzSetOffset(zip->handle, startpos) != UNZ_OK)
+		return;
+	if (unzGetCurrentFileInfo(zip->handle, &file_info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK)
+		return;
+	if ((file_info.flag & 1) || (file_info.compression_method != 0 && file_info.compression_method != Z_DEFLATED))
+		return;
+	if (unzOpenCurrentFile(zip->handle) != UNZ_OK)
+		return;
+
+	*datapos = (unsigned long) unzGetCurrentFileZStreamPos64(zip->handle);
+	*csize = file_info.compressed_size;
+	*method = file_info.compression_method;
+	unzCloseCurrentFile(zip->handle);
+}
+
 static vfsfile_t *FSZIP_OpenVFS(void *handle, flocation_t *loc, char *mode)
 {
-	//int rawofs;
 	zipfile_t *zip = handle;
 	vfszip_t *vfsz;
 
@@ -327,18 +472,17 @@ static vfsfile_t *FSZIP_OpenVFS(void *handle, flocation_t *loc, char *mode)
 	if (loc->search)
 		vfsz->funcs.copyprotected = loc->search->copyprotected;
 
-	// VFS-FIXME: 
-	// What is the point of is compressed etc
-	
-	//unzLocateFileMy(vfsz->parent->handle, vfsz->index, vfsz->startpos);
-	//rawofs = unzGetCurrentFileUncompressedPos(zip->handle);
-	/*vfsz->iscompressed = 1; // rawofs<0;
-	if (!vfsz->iscompressed)
+	FSZIP_LocateData(zip, vfsz->startpos, &vfsz->method, &vfsz->datapos, &vfsz->csize);
+	if (vfsz->method == Z_DEFLATED)
 	{
-		vfsz->startpos = rawofs;
-		VFS_SEEK(zip->raw, vfsz->startpos, SEEK_SET);
-		vfsz->parent->currentfile = (vfsfile_t*)vfsz;
-	}*/
+		vfsz->inbuf = Q_malloc(VFSZIP_INBUFFER_SIZE);
+		vfsz->checkpoint_interval = VFSZIP_CHECKPOINT_INTERVAL;
+		if (inflateInit2(&vfsz->strm, -MAX_WBITS) != Z_OK)
+		{
+			Q_free(vfsz->inbuf);
+			vfsz->method = VFSZIP_METHOD_UNZIP;
+		}
+	}
 
 	zip->references++;
 
@@ -458,6 +602,20 @@ static void FSZIP_ReadFile(void *handle, flocation_t *loc, char *buffer)
 }
 
 
+static qbool FSZIP_RawLocation(void *handle, flocation_t *loc, char *ospath, size_t ospathsize, unsigned long *offset)
+{
+	zipfile_t *zip = handle;
+	unsigned long csize;
+	int method;
+
+	FSZIP_LocateData(zip, zip->files[loc->index].filepos, &method, offset, &csize);
+	if (method != 0)
+		return false;
+
+	strlcpy(ospath, zip->filename, ospathsize);
+	return true;
+}
+
 static int FSZIP_EnumerateFiles (void *handle, char *match, int (*func)(char *, int, void *), void *parm)
 {
 	zipfile_t *zip = handle;
@@ -578,7 +736,8 @@ searchpathfuncs_t zipfilefuncs = {
 	FSZIP_EnumerateFiles,
 	FSZIP_LoadZipFile,
 	FSZIP_GeneratePureCRC,
-	FSZIP_OpenVFS
+	FSZIP_OpenVFS,
+	FSZIP_RawLocation
 };
 
 #endif // WITH_ZIP
@@ -1376,9 +1376,18 @@ static void VID_SDL_Init(void)
 		return;
 	}
 
+	// -demostats never presents a frame, so don't require a display: a hidden window on the
+	// offscreen driver (EGL, software rasterizer is fine) is enough to load maps and models.
+	if (COM_CheckParm(cmdline_param_client_demostats)) {
+		SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+	}
+
 	VID_SDL_InitSubSystem();
 
 	flags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_OPENGL | SDL_WINDOW_INPUT_FOCUS | SDL_WINDOW_SHOWN;
+	if (COM_CheckParm(cmdline_param_client_demostats)) {
+		flags = SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN;
+	}
 	// MEAG: deliberately not specifying SDL_WINDOW_ALLOW_HIGHDPI as in our current workflow, it
 	//          breaks retina devices (we ask for display resolution and get told lower value)
 	//       Understand this is meant to be helped by NSHighResolutionCapable in Info.plist, but